@@ -0,0 +1,167 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "bench_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NAME_MIN_LENGTH 4
+#define NAME_MAX_LENGTH 12
+
+double bench_seconds(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+    {
+        return now.tv_sec + now.tv_nsec / 1e9;
+    }
+#endif
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+unsigned bench_random(unsigned* state)
+{
+    /* xorshift32; the state must never become zero: */
+    unsigned x = *state ? *state : 0x9e3779b9u;
+    
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+void bench_random_name(char* name,
+                       int min_length,
+                       int max_length,
+                       unsigned* state)
+{
+    int length = min_length +
+                 (int)(bench_random(state) % (max_length - min_length + 1));
+    int i;
+    
+    for (i = 0; i < length; ++i)
+    {
+        name[i] = (char)((i == 0 ? 'A' : 'a') + bench_random(state) % 26);
+    }
+    
+    name[length] = '\0';
+}
+
+/*******************************************************************************
+* Allocates 'count' random names of 'NAME_MAX_LENGTH + 1' characters each, one *
+* after the other.                                                             *
+*******************************************************************************/
+static char* alloc_names(int count, unsigned* state)
+{
+    char* names = malloc((size_t) count * (NAME_MAX_LENGTH + 1));
+    int i;
+    
+    if (!names)
+    {
+        return NULL;
+    }
+    
+    for (i = 0; i < count; ++i)
+    {
+        bench_random_name(names + (size_t) i * (NAME_MAX_LENGTH + 1),
+                          NAME_MIN_LENGTH,
+                          NAME_MAX_LENGTH,
+                          state);
+    }
+    
+    return names;
+}
+
+telephone_book_record_list* bench_generate_book(int size,
+                                                int last_name_count,
+                                                int first_name_count,
+                                                unsigned seed)
+{
+    telephone_book_record_list* list;
+    char* last_names;
+    char* first_names;
+    char number[16];
+    int* ids;
+    size_t last_name_offset;
+    size_t first_name_offset;
+    int i;
+    int j;
+    int id;
+    unsigned state = seed;
+    
+    /* ALLOCATED: list, last_names, first_names, ids */
+    list = telephone_book_record_list_alloc_arena();
+    last_names = alloc_names(last_name_count, &state);
+    first_names = alloc_names(first_name_count, &state);
+    ids = malloc(sizeof(int) * (size_t)(size > 0 ? size : 1));
+    
+    if (!list || !last_names || !first_names || !ids)
+    {
+        telephone_book_record_list_free(list);
+        free(last_names);
+        free(first_names);
+        free(ids);
+        return NULL;
+    }
+    
+    for (i = 0; i < size; ++i)
+    {
+        ids[i] = i + 1;
+    }
+    
+    for (i = size - 1; i > 0; --i)
+    {
+        j = (int)(bench_random(&state) % (unsigned)(i + 1));
+        id = ids[i];
+        ids[i] = ids[j];
+        ids[j] = id;
+    }
+    
+    for (i = 0; i < size; ++i)
+    {
+        last_name_offset = (bench_random(&state) % last_name_count) *
+                           (size_t) (NAME_MAX_LENGTH + 1);
+        first_name_offset = (bench_random(&state) % first_name_count) *
+                            (size_t) (NAME_MAX_LENGTH + 1);
+        sprintf(number, "+%09u", bench_random(&state) % 1000000000u);
+        
+        if (telephone_book_record_list_append(list,
+                                              last_names + last_name_offset,
+                                              first_names + first_name_offset,
+                                              number,
+                                              ids[i]))
+        {
+            telephone_book_record_list_free(list);
+            list = NULL;
+            break;
+        }
+    }
+    
+    if (list)
+    {
+        list->next_id = size + 1;
+    }
+    
+    free(last_names);
+    free(first_names);
+    free(ids);
+    return list;
+}
+
+void bench_report(const char* name, double seconds, double baseline_seconds)
+{
+    if (baseline_seconds > 0.0 && seconds > 0.0)
+    {
+        printf("    %-28s %9.4f s  %6.2fx\n",
+               name,
+               seconds,
+               baseline_seconds / seconds);
+    }
+    else
+    {
+        printf("    %-28s %9.4f s\n", name, seconds);
+    }
+}
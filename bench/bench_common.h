@@ -0,0 +1,57 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include "../telephone_book.h"
+
+/*******************************************************************************
+* The number of times each benchmark repeats a measurement. The best of the    *
+* runs is reported.                                                            *
+*******************************************************************************/
+#define BENCH_RUN_COUNT 3
+
+
+
+
+/*******************************************************************************
+* Returns the current time in seconds, from a monotonic clock where there is   *
+* one.                                                                         *
+*******************************************************************************/
+double bench_seconds(void);
+
+/*******************************************************************************
+* Returns the next pseudo-random number of the generator whose state is in     *
+* 'state'. The sequence depends on the initial state only, so a benchmark sees *
+* the same data on every run.                                                  *
+*******************************************************************************/
+unsigned bench_random(unsigned* state);
+
+/*******************************************************************************
+* Fills 'name' with a random lowercase name of 'min_length' to 'max_length'    *
+* characters, the first of which is in uppercase. 'name' must have room for    *
+* 'max_length + 1' characters.                                                 *
+*******************************************************************************/
+void bench_random_name(char* name,
+                       int min_length,
+                       int max_length,
+                       unsigned* state);
+
+/*******************************************************************************
+* Generates an arena-backed book of 'size' records in random order. The last   *
+* names are drawn from 'last_name_count' random names and the first names from *
+* 'first_name_count' others, and the records have the IDs 1 to 'size'.         *
+* ---                                                                          *
+* Returns the new list or NULL if something goes wrong.                        *
+*******************************************************************************/
+telephone_book_record_list* bench_generate_book(int size,
+                                                int last_name_count,
+                                                int first_name_count,
+                                                unsigned seed);
+
+/*******************************************************************************
+* Prints a line of the benchmark report: the name of the measured variant, its *
+* best time in seconds and, if 'baseline_seconds' is positive, its speedup     *
+* over the baseline.                                                           *
+*******************************************************************************/
+void bench_report(const char* name, double seconds, double baseline_seconds);
+
+#endif /* BENCH_COMMON_H */
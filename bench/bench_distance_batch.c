@@ -0,0 +1,224 @@
+#include "bench_common.h"
+#include "../telephone_book_distance.h"
+#include "../telephone_book_distance_batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_NAME_COUNT 200000
+#define QUERY_COUNT 5
+#define NAME_SIZE 17
+
+static const char* const KERNEL_NAMES[] = { "batch, scalar kernel",
+                                            "batch, SSE2 kernel",
+                                            "batch, AVX2 kernel" };
+
+/*******************************************************************************
+* Computes the distances between each query and every name one name at a time, *
+* with a bit-parallel pattern per query, into 'distances + q * name_count' for *
+* the query 'q'. This is what the scan does, and is the baseline.              *
+*******************************************************************************/
+static void compute_with_patterns(char queries[][NAME_SIZE],
+                                  const char* const* names,
+                                  const size_t* name_lengths,
+                                  int name_count,
+                                  unsigned char* distances)
+{
+    static telephone_book_distance_pattern pattern;
+    int q;
+    int i;
+    
+    for (q = 0; q < QUERY_COUNT; ++q)
+    {
+        telephone_book_distance_pattern_init(&pattern, queries[q]);
+        
+        for (i = 0; i < name_count; ++i)
+        {
+            distances[(size_t) q * name_count + i] = (unsigned char)
+                telephone_book_distance_pattern_compute(&pattern,
+                                                        names[i],
+                                                        name_lengths[i]);
+        }
+    }
+}
+
+/*******************************************************************************
+* Computes the distances between each query and every name of the batch, one   *
+* query at a time, into 'distances + q * name_count' for the query 'q'.        *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int compute_with_batch(char queries[][NAME_SIZE],
+                              const telephone_book_distance_batch* batch,
+                              int name_count,
+                              unsigned char* distances)
+{
+    int q;
+    
+    for (q = 0; q < QUERY_COUNT; ++q)
+    {
+        if (telephone_book_distance_batch_compute(
+                                batch,
+                                queries[q],
+                                &distances[(size_t) q * name_count]))
+        {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Times computing the distances between a few random queries and 'NAME_COUNT'  *
+* random names (200k by default), one name at a time with a bit-parallel       *
+* pattern and with each kernel of the batch the processor supports. Every      *
+* kernel is checked to give the same distances as the patterns:                *
+*                                                                              *
+*     bench_distance_batch [NAME_COUNT]                                        *
+*******************************************************************************/
+int main(int argc, char* argv[])
+{
+    static char queries[QUERY_COUNT][NAME_SIZE];
+    telephone_book_distance_batch_kernel default_kernel;
+    telephone_book_distance_batch* batch;
+    char* name_buffer;
+    const char** names;
+    size_t* name_lengths;
+    unsigned char* expected_distances;
+    unsigned char* distances;
+    size_t distance_count;
+    unsigned state = 2021;
+    int name_count = argc > 1 ? atoi(argv[1]) : DEFAULT_NAME_COUNT;
+    double pattern_seconds = -1.0;
+    double best_seconds;
+    double start;
+    double seconds;
+    int kernel;
+    int status = 0;
+    int run;
+    int i;
+    
+    if (name_count < 1)
+    {
+        fputs("There must be at least one name.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    
+    distance_count = (size_t) QUERY_COUNT * name_count;
+    
+    /* ALLOCATED: name_buffer, names, name_lengths, expected_distances, */
+    /*            distances */
+    name_buffer = malloc((size_t) name_count * NAME_SIZE);
+    names = malloc(name_count * sizeof *names);
+    name_lengths = malloc(name_count * sizeof *name_lengths);
+    expected_distances = malloc(distance_count);
+    distances = malloc(distance_count);
+    batch = NULL;
+    
+    if (!name_buffer || !names || !name_lengths || !expected_distances ||
+        !distances)
+    {
+        status = 1;
+    }
+    
+    for (i = 0; i < name_count && status == 0; ++i)
+    {
+        names[i] = &name_buffer[(size_t) i * NAME_SIZE];
+        bench_random_name(&name_buffer[(size_t) i * NAME_SIZE],
+                          3,
+                          NAME_SIZE - 1,
+                          &state);
+        name_lengths[i] = strlen(names[i]);
+    }
+    
+    for (i = 0; i < QUERY_COUNT && status == 0; ++i)
+    {
+        bench_random_name(queries[i], 5, 10, &state);
+    }
+    
+    if (status == 0)
+    {
+        /* ALLOCATED: batch */
+        batch = telephone_book_distance_batch_alloc(names, name_count);
+        status = !batch;
+    }
+    
+    if (status)
+    {
+        fputs("Cannot generate the names.\n", stderr);
+    }
+    else
+    {
+        printf("Distances from %d queries to %d names:\n",
+               QUERY_COUNT, name_count);
+    }
+    
+    for (run = 0; run < BENCH_RUN_COUNT && status == 0; ++run)
+    {
+        start = bench_seconds();
+        compute_with_patterns(queries, names, name_lengths, name_count,
+                              expected_distances);
+        seconds = bench_seconds() - start;
+        
+        if (pattern_seconds < 0.0 || seconds < pattern_seconds)
+        {
+            pattern_seconds = seconds;
+        }
+    }
+    
+    if (status == 0)
+    {
+        bench_report("pattern per name (baseline)", pattern_seconds, 0.0);
+    }
+    
+    default_kernel = telephone_book_distance_batch_get_kernel();
+    
+    for (kernel = TELEPHONE_BOOK_DISTANCE_BATCH_SCALAR;
+         kernel <= TELEPHONE_BOOK_DISTANCE_BATCH_AVX2 && status == 0;
+         ++kernel)
+    {
+        if (telephone_book_distance_batch_set_kernel(
+                            (telephone_book_distance_batch_kernel) kernel))
+        {
+            printf("    %-28s not supported here\n", KERNEL_NAMES[kernel]);
+            continue;
+        }
+        
+        best_seconds = -1.0;
+        
+        for (run = 0; run < BENCH_RUN_COUNT && status == 0; ++run)
+        {
+            memset(distances, 0xff, distance_count);
+            start = bench_seconds();
+            status = compute_with_batch(queries, batch, name_count, distances);
+            seconds = bench_seconds() - start;
+            status = status ||
+                     memcmp(distances, expected_distances, distance_count);
+            
+            if (best_seconds < 0.0 || seconds < best_seconds)
+            {
+                best_seconds = seconds;
+            }
+        }
+        
+        if (status == 0)
+        {
+            bench_report(KERNEL_NAMES[kernel], best_seconds, pattern_seconds);
+        }
+        else
+        {
+            fprintf(stderr, "The %s disagrees with the patterns.\n",
+                    KERNEL_NAMES[kernel]);
+        }
+    }
+    
+    telephone_book_distance_batch_set_kernel(default_kernel);
+    telephone_book_distance_batch_free(batch);
+    free(name_buffer);
+    free(names);
+    free(name_lengths);
+    free(expected_distances);
+    free(distances);
+    return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
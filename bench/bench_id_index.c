@@ -0,0 +1,178 @@
+#include "bench_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_ROW_COUNT 1000000
+#define WALK_REMOVAL_COUNT 200
+#define INDEX_REMOVAL_COUNT 100000
+
+/*******************************************************************************
+* Removes the record with ID 'id' the way 'remove_entry' did before the ID     *
+* index: by walking the list from the head. Kept here as the baseline.         *
+*******************************************************************************/
+static telephone_book_record*
+remove_by_walk(telephone_book_record_list* list, int id)
+{
+    telephone_book_record_list_node* previous_node = NULL;
+    telephone_book_record_list_node* current_node;
+    
+    for (current_node = list->head;
+         current_node;
+         previous_node = current_node, current_node = current_node->next)
+    {
+        if (current_node->record->id == id)
+        {
+            if (previous_node)
+            {
+                previous_node->next = current_node->next;
+            }
+            else
+            {
+                list->head = current_node->next;
+            }
+            
+            if (!current_node->next)
+            {
+                list->tail = previous_node;
+            }
+            
+            --list->size;
+            return current_node->record;
+        }
+    }
+    
+    return NULL;
+}
+
+/*******************************************************************************
+* Removes the records with the first 'removal_count' IDs of 'ids' from a fresh *
+* book of 'row_count' records, by a list walk if 'use_walk' is set and with    *
+* 'telephone_book_record_list_remove_entry' otherwise. The index is built by   *
+* the first removal, so its cost is part of the time.                          *
+* ---                                                                          *
+* Returns the best time in seconds, or a negative value if something fails or  *
+* a record is not found.                                                       *
+*******************************************************************************/
+static double time_removals(int row_count,
+                            const int* ids,
+                            int removal_count,
+                            int use_walk)
+{
+    telephone_book_record_list* list;
+    telephone_book_record* record;
+    double best_seconds = -1.0;
+    double start;
+    double seconds;
+    int run;
+    int i;
+    
+    for (run = 0; run < BENCH_RUN_COUNT; ++run)
+    {
+        list = bench_generate_book(row_count, row_count / 4, row_count / 20,
+                                   16);
+        
+        if (!list)
+        {
+            return -1.0;
+        }
+        
+        start = bench_seconds();
+        
+        for (i = 0; i < removal_count; ++i)
+        {
+            if (use_walk)
+            {
+                record = remove_by_walk(list, ids[i]);
+            }
+            else
+            {
+                record = telephone_book_record_list_remove_entry(list, ids[i]);
+            }
+            
+            /* The records are borrowed from the arena of the list: */
+            if (!record || record->id != ids[i])
+            {
+                telephone_book_record_list_free(list);
+                return -1.0;
+            }
+        }
+        
+        seconds = bench_seconds() - start;
+        telephone_book_record_list_free(list);
+        
+        if (best_seconds < 0.0 || seconds < best_seconds)
+        {
+            best_seconds = seconds;
+        }
+    }
+    
+    return best_seconds;
+}
+
+/*******************************************************************************
+* Times removing records by random IDs from a book of 'ROW_COUNT' records (1M  *
+* by default), one at a time, with a list walk and through the ID index:       *
+*                                                                              *
+*     bench_id_index [ROW_COUNT]                                               *
+*******************************************************************************/
+int main(int argc, char* argv[])
+{
+    int row_count = argc > 1 ? atoi(argv[1]) : DEFAULT_ROW_COUNT;
+    int* ids;
+    int i;
+    int j;
+    int id;
+    unsigned state = 2016;
+    double walk_seconds;
+    double index_seconds;
+    double many_index_seconds;
+    char name[64];
+    
+    if (row_count < INDEX_REMOVAL_COUNT)
+    {
+        fprintf(stderr, "The book needs at least %d records.\n",
+                INDEX_REMOVAL_COUNT);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: ids */
+    ids = malloc(sizeof(int) * (size_t) row_count);
+    
+    if (!ids)
+    {
+        return EXIT_FAILURE;
+    }
+    
+    for (i = 0; i < row_count; ++i)
+    {
+        ids[i] = i + 1;
+    }
+    
+    for (i = row_count - 1; i > 0; --i)
+    {
+        j = (int)(bench_random(&state) % (unsigned)(i + 1));
+        id = ids[i];
+        ids[i] = ids[j];
+        ids[j] = id;
+    }
+    
+    walk_seconds = time_removals(row_count, ids, WALK_REMOVAL_COUNT, 1);
+    index_seconds = time_removals(row_count, ids, WALK_REMOVAL_COUNT, 0);
+    many_index_seconds = time_removals(row_count, ids, INDEX_REMOVAL_COUNT, 0);
+    free(ids);
+    
+    if (walk_seconds < 0.0 || index_seconds < 0.0 || many_index_seconds < 0.0)
+    {
+        fputs("A removal failed.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    
+    printf("Removal by ID, %d records:\n", row_count);
+    sprintf(name, "%d by list walk (baseline)", WALK_REMOVAL_COUNT);
+    bench_report(name, walk_seconds, 0.0);
+    sprintf(name, "%d by ID index", WALK_REMOVAL_COUNT);
+    bench_report(name, index_seconds, walk_seconds);
+    sprintf(name, "%d by ID index", INDEX_REMOVAL_COUNT);
+    bench_report(name, many_index_seconds, 0.0);
+    return EXIT_SUCCESS;
+}
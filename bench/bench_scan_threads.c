@@ -0,0 +1,220 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "bench_common.h"
+#include "../telephone_book_search.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define DEFAULT_ROW_COUNT 1000000
+#define QUERY_COUNT 20
+#define MAX_THREAD_COUNT 8
+#define QUERY_NAME_SIZE (TELEPHONE_BOOK_MAX_FIELD_LENGTH + 1)
+
+/*******************************************************************************
+* Picks 'QUERY_COUNT' queries from the records of the list: the names of       *
+* evenly spaced records, each with one character changed, as a misspelled      *
+* query would be. The names go to 'last_names' and 'first_names', which must   *
+* have room for 'QUERY_COUNT' names.                                           *
+*******************************************************************************/
+static void pick_queries(telephone_book_record_list* list,
+                         char last_names[][QUERY_NAME_SIZE],
+                         char first_names[][QUERY_NAME_SIZE])
+{
+    telephone_book_record_list_node* node = list->head;
+    int step = list->size / QUERY_COUNT;
+    int q;
+    int i;
+    
+    for (q = 0; q < QUERY_COUNT; ++q)
+    {
+        for (i = 0; i < step && node->next; ++i)
+        {
+            node = node->next;
+        }
+        
+        strcpy(last_names[q], node->record->last_name);
+        strcpy(first_names[q], node->record->first_name);
+        last_names[q][q % strlen(last_names[q])] = 'x';
+    }
+}
+
+/*******************************************************************************
+* Checks that two results hold the same records at the same distance, in the   *
+* same order.                                                                  *
+*******************************************************************************/
+static int is_same_result(const telephone_book_search_result* a,
+                          const telephone_book_search_result* b)
+{
+    return a->size == b->size &&
+           a->distance == b->distance &&
+           memcmp(a->record_indices,
+                  b->record_indices,
+                  a->size * sizeof *a->record_indices) == 0;
+}
+
+/*******************************************************************************
+* Generates a book of 'row_count' records over 'last_name_count' last names    *
+* and 'first_name_count' first names, scans it for the queries on 1, 2, 4 and  *
+* 8 threads, and prints the best times.                                        *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails or a thread *
+* count finds other records than one thread.                                   *
+*******************************************************************************/
+static int run_case(const char* title,
+                    int row_count,
+                    int last_name_count,
+                    int first_name_count)
+{
+    static char last_names[QUERY_COUNT][QUERY_NAME_SIZE];
+    static char first_names[QUERY_COUNT][QUERY_NAME_SIZE];
+    telephone_book_search_result expected_results[QUERY_COUNT];
+    telephone_book_search_result result;
+    telephone_book_record_list* list;
+    telephone_book_search_index* index = NULL;
+    double one_thread_seconds = 0.0;
+    double best_seconds;
+    double start;
+    double seconds;
+    int thread_count;
+    int status = 0;
+    int run;
+    int q;
+    char name[64];
+    
+    /* ALLOCATED: list, index */
+    list = bench_generate_book(row_count, last_name_count, first_name_count,
+                               20);
+    
+    if (list)
+    {
+        index = telephone_book_search_index_alloc(list,
+                                                  TELEPHONE_BOOK_SEARCH_SCAN);
+    }
+    
+    if (!index)
+    {
+        fputs("Cannot build the scan index.\n", stderr);
+        telephone_book_record_list_free(list);
+        return 1;
+    }
+    
+    pick_queries(list, last_names, first_names);
+    telephone_book_search_result_init(&result);
+    
+    for (q = 0; q < QUERY_COUNT; ++q)
+    {
+        telephone_book_search_result_init(&expected_results[q]);
+        status = status ||
+                 telephone_book_search_find_closest(index,
+                                                    last_names[q],
+                                                    first_names[q],
+                                                    &expected_results[q]);
+    }
+    
+    printf("Scan, %d records, %s (%d last and %d first names), %d queries:\n",
+           row_count, title, last_name_count, first_name_count, QUERY_COUNT);
+    
+    for (thread_count = 1;
+         thread_count <= MAX_THREAD_COUNT && status == 0;
+         thread_count *= 2)
+    {
+        status = telephone_book_search_index_set_thread_count(index,
+                                                              thread_count);
+        best_seconds = -1.0;
+        
+        for (run = 0; run < BENCH_RUN_COUNT && status == 0; ++run)
+        {
+            start = bench_seconds();
+            
+            for (q = 0; q < QUERY_COUNT && status == 0; ++q)
+            {
+                telephone_book_search_result_destroy(&result);
+                telephone_book_search_result_init(&result);
+                status = telephone_book_search_find_closest(index,
+                                                            last_names[q],
+                                                            first_names[q],
+                                                            &result) ||
+                         !is_same_result(&result, &expected_results[q]);
+            }
+            
+            seconds = bench_seconds() - start;
+            
+            if (best_seconds < 0.0 || seconds < best_seconds)
+            {
+                best_seconds = seconds;
+            }
+        }
+        
+        if (status == 0)
+        {
+            if (thread_count == 1)
+            {
+                one_thread_seconds = best_seconds;
+            }
+            
+            sprintf(name, "%d thread%s%s", thread_count,
+                    thread_count == 1 ? "" : "s",
+                    thread_count == 1 ? " (baseline)" : "");
+            bench_report(name,
+                         best_seconds,
+                         thread_count == 1 ? 0.0 : one_thread_seconds);
+        }
+    }
+    
+    for (q = 0; q < QUERY_COUNT; ++q)
+    {
+        telephone_book_search_result_destroy(&expected_results[q]);
+    }
+    
+    telephone_book_search_result_destroy(&result);
+    telephone_book_search_index_free(index);
+    telephone_book_record_list_free(list);
+    
+    if (status)
+    {
+        fputs("A search failed, or the thread counts disagree.\n", stderr);
+    }
+    
+    return status;
+}
+
+/*******************************************************************************
+* Times scanning a book of 'ROW_COUNT' records (1M by default) for a few       *
+* misspelled names on 1, 2, 4 and 8 threads, and checks that every thread      *
+* count finds the same records as one thread. The threads split the distinct   *
+* names and then the rows; the book is generated with few and with many        *
+* distinct names. The speedup is bounded by the number of processors, which    *
+* is printed too:                                                              *
+*                                                                              *
+*     bench_scan_threads [ROW_COUNT]                                           *
+*******************************************************************************/
+int main(int argc, char* argv[])
+{
+    int row_count = argc > 1 ? atoi(argv[1]) : DEFAULT_ROW_COUNT;
+    
+    if (row_count < 1000)
+    {
+        fputs("The book needs at least 1000 records.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    
+#ifndef _WIN32
+    printf("%ld processors online.\n", sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+    
+    if (run_case("common names", row_count, row_count / 200, row_count / 1000))
+    {
+        return EXIT_FAILURE;
+    }
+    
+    if (run_case("distinct names", row_count, row_count / 4, row_count / 20))
+    {
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
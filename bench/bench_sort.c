@@ -0,0 +1,203 @@
+#include "bench_common.h"
+#include "../telephone_book_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ROW_COUNT 1000000
+
+/*******************************************************************************
+* This structure holds the sorting key of one row for the qsort baseline.      *
+*******************************************************************************/
+typedef struct {
+    const char* last_name;
+    const char* first_name;
+    int row;
+} row_key;
+
+static int row_key_cmp(const void* pa, const void* pb)
+{
+    const row_key* a = pa;
+    const row_key* b = pb;
+    /* The names are interned, so equal names share their address: */
+    int c = a->last_name == b->last_name ? 0 :
+            strcmp(a->last_name, b->last_name);
+    
+    if (c)
+    {
+        return c;
+    }
+    
+    c = a->first_name == b->first_name ? 0 :
+        strcmp(a->first_name, b->first_name);
+    
+    if (c)
+    {
+        return c;
+    }
+    
+    return (a->row > b->row) - (a->row < b->row);
+}
+
+/*******************************************************************************
+* Sorts the list the way the store did before the radix sort: by a qsort of    *
+* the rows over their (last name, first name) pointers. Kept here as the       *
+* baseline.                                                                    *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int sort_with_qsort(telephone_book_record_list* list)
+{
+    telephone_book_store* store;
+    row_key* keys;
+    int i;
+    
+    /* ALLOCATED: store, keys */
+    store = telephone_book_store_alloc(list);
+    keys = store ? malloc((store->size + 1) * sizeof *keys) : NULL;
+    
+    if (!keys)
+    {
+        telephone_book_store_free(store);
+        return 1;
+    }
+    
+    for (i = 0; i < store->size; ++i)
+    {
+        keys[i].last_name =
+            &store->names[store->name_offsets[store->last_name_ids[i]]];
+        keys[i].first_name =
+            &store->names[store->name_offsets[store->first_name_ids[i]]];
+        keys[i].row = i;
+    }
+    
+    qsort(keys, store->size, sizeof *keys, row_key_cmp);
+    
+    for (i = 0; i + 1 < store->size; ++i)
+    {
+        store->nodes[keys[i].row]->next = store->nodes[keys[i + 1].row];
+    }
+    
+    if (store->size > 0)
+    {
+        list->head = store->nodes[keys[0].row];
+        list->tail = store->nodes[keys[store->size - 1].row];
+        list->tail->next = NULL;
+    }
+    
+    telephone_book_record_list_drop_id_index(list);
+    free(keys);
+    telephone_book_store_free(store);
+    return 0;
+}
+
+static void keep_best(double* best_seconds, double seconds)
+{
+    if (*best_seconds < 0.0 || seconds < *best_seconds)
+    {
+        *best_seconds = seconds;
+    }
+}
+
+/*******************************************************************************
+* Sorts fresh copies of the same generated book with the qsort baseline and    *
+* with 'telephone_book_record_list_sort', checks that both give the same       *
+* order, and prints the best times.                                            *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int run_case(const char* title,
+                    int row_count,
+                    int last_name_count,
+                    int first_name_count)
+{
+    telephone_book_record_list* lists[2];
+    telephone_book_record_list_node* nodes[2];
+    double best_seconds[2] = { -1.0, -1.0 };
+    double start;
+    int status = 0;
+    int run;
+    
+    printf("Sort, %d records, %s (%d last and %d first names):\n",
+           row_count, title, last_name_count, first_name_count);
+    
+    for (run = 0; run < BENCH_RUN_COUNT && status == 0; ++run)
+    {
+        /* ALLOCATED: lists[0], lists[1] */
+        lists[0] = bench_generate_book(row_count, last_name_count,
+                                       first_name_count, 19);
+        lists[1] = bench_generate_book(row_count, last_name_count,
+                                       first_name_count, 19);
+        status = !lists[0] || !lists[1];
+        
+        if (status == 0)
+        {
+            start = bench_seconds();
+            status = sort_with_qsort(lists[0]);
+            keep_best(&best_seconds[0], bench_seconds() - start);
+            start = bench_seconds();
+            status = status || telephone_book_record_list_sort(lists[1]);
+            keep_best(&best_seconds[1], bench_seconds() - start);
+        }
+        
+        /* Both sorts are stable, so the orders must agree record by record: */
+        nodes[0] = status ? NULL : lists[0]->head;
+        nodes[1] = status ? NULL : lists[1]->head;
+        
+        while (nodes[0] && nodes[1] &&
+               nodes[0]->record->id == nodes[1]->record->id)
+        {
+            nodes[0] = nodes[0]->next;
+            nodes[1] = nodes[1]->next;
+        }
+        
+        status = status || nodes[0] || nodes[1];
+        telephone_book_record_list_free(lists[0]);
+        telephone_book_record_list_free(lists[1]);
+    }
+    
+    if (status)
+    {
+        fputs("A sort failed, or the sorts disagree.\n", stderr);
+        return 1;
+    }
+    
+    bench_report("qsort (baseline)", best_seconds[0], 0.0);
+    bench_report("name ranks + radix sort", best_seconds[1], best_seconds[0]);
+    return 0;
+}
+
+/*******************************************************************************
+* Times sorting a shuffled book of 'ROW_COUNT' records (1M by default) with    *
+* the qsort baseline and with 'telephone_book_record_list_sort', for a few     *
+* name distributions down to nearly every name being distinct:                 *
+*                                                                              *
+*     bench_sort [ROW_COUNT]                                                   *
+*******************************************************************************/
+int main(int argc, char* argv[])
+{
+    int row_count = argc > 1 ? atoi(argv[1]) : DEFAULT_ROW_COUNT;
+    
+    if (row_count < 1000)
+    {
+        fputs("The book needs at least 1000 records.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    
+    if (run_case("common names", row_count, row_count / 200, row_count / 1000))
+    {
+        return EXIT_FAILURE;
+    }
+    
+    if (run_case("many names", row_count, row_count / 4, row_count / 20))
+    {
+        return EXIT_FAILURE;
+    }
+    
+    if (run_case("distinct names", row_count, row_count, row_count))
+    {
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
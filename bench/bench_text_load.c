@@ -0,0 +1,209 @@
+#include "bench_common.h"
+#include "../telephone_book_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_ROW_COUNT 1000000
+#define TOKEN_SCAN_FORMAT "%64s"
+#define MAX_RECORD_TOKEN_LENGTH 65
+
+/*******************************************************************************
+* The text reader as it was before the block reader: one fscanf and three heap *
+* strings per record. Kept here as the baseline.                               *
+*******************************************************************************/
+static telephone_book_record_list* read_with_fscanf(FILE* f)
+{
+    telephone_book_record_list* record_list;
+    telephone_book_record* current_record;
+    
+    char last_name_token   [MAX_RECORD_TOKEN_LENGTH];
+    char first_name_token  [MAX_RECORD_TOKEN_LENGTH];
+    char phone_number_token[MAX_RECORD_TOKEN_LENGTH];
+    int  id_holder;
+    
+    record_list = telephone_book_record_list_alloc();
+    
+    if (!record_list)
+    {
+        return NULL;
+    }
+    
+    while (!feof(f) && !ferror(f))
+    {
+        if (fscanf(f,
+                   TOKEN_SCAN_FORMAT
+                   TOKEN_SCAN_FORMAT
+                   TOKEN_SCAN_FORMAT
+                   "%d\n",
+                   last_name_token,
+                   first_name_token,
+                   phone_number_token,
+                   &id_holder) != 4)
+        {
+            telephone_book_record_list_free(record_list);
+            return NULL;
+        }
+        
+        current_record = telephone_book_record_alloc(last_name_token,
+                                                     first_name_token,
+                                                     phone_number_token,
+                                                     id_holder);
+        
+        if (!current_record ||
+            telephone_book_record_list_add_record(record_list,
+                                                  current_record))
+        {
+            telephone_book_record_free(current_record);
+            telephone_book_record_list_free(record_list);
+            return NULL;
+        }
+    }
+    
+    return record_list;
+}
+
+/*******************************************************************************
+* Writes the records of the list to 'f', one per line and without a header, so *
+* that both readers accept the file.                                           *
+*******************************************************************************/
+static int write_book(telephone_book_record_list* list, FILE* f)
+{
+    telephone_book_record_list_node* node;
+    
+    for (node = list->head; node; node = node->next)
+    {
+        if (fprintf(f, "%s %s %s %d\n",
+                    node->record->last_name,
+                    node->record->first_name,
+                    node->record->telephone_number,
+                    node->record->id) < 0)
+        {
+            return 1;
+        }
+    }
+    
+    return fflush(f) != 0;
+}
+
+/*******************************************************************************
+* Reads the book in 'f' 'BENCH_RUN_COUNT' times with the fscanf reader if      *
+* 'use_fscanf' is set, and with the block reader otherwise.                    *
+* ---                                                                          *
+* Returns the best time in seconds, or a negative value if a read fails or     *
+* loses records.                                                               *
+*******************************************************************************/
+static double time_reader(FILE* f, int use_fscanf, int row_count)
+{
+    telephone_book_record_list* list;
+    double best_seconds = -1.0;
+    double start;
+    double seconds;
+    int run;
+    
+    for (run = 0; run < BENCH_RUN_COUNT; ++run)
+    {
+        rewind(f);
+        start = bench_seconds();
+        list = use_fscanf ? read_with_fscanf(f)
+                          : telephone_book_record_list_read_from_file(f, NULL);
+        seconds = bench_seconds() - start;
+        
+        if (!list || telephone_book_record_list_size(list) != row_count)
+        {
+            telephone_book_record_list_free(list);
+            return -1.0;
+        }
+        
+        telephone_book_record_list_free(list);
+        
+        if (best_seconds < 0.0 || seconds < best_seconds)
+        {
+            best_seconds = seconds;
+        }
+    }
+    
+    return best_seconds;
+}
+
+/*******************************************************************************
+* Generates a book of 'row_count' records over 'last_name_count' last names    *
+* and 'first_name_count' first names, and prints the times both readers take   *
+* to load it.                                                                  *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int run_case(const char* title,
+                    int row_count,
+                    int last_name_count,
+                    int first_name_count)
+{
+    telephone_book_record_list* list;
+    FILE* f;
+    double fscanf_seconds;
+    double block_seconds;
+    
+    /* ALLOCATED: list, f */
+    list = bench_generate_book(row_count, last_name_count, first_name_count,
+                               13);
+    f = tmpfile();
+    
+    if (!list || !f || write_book(list, f))
+    {
+        fputs("Cannot generate the book.\n", stderr);
+        telephone_book_record_list_free(list);
+        
+        if (f)
+        {
+            fclose(f);
+        }
+        
+        return 1;
+    }
+    
+    telephone_book_record_list_free(list);
+    printf("Text load, %d records, %s (%d last and %d first names):\n",
+           row_count, title, last_name_count, first_name_count);
+    fscanf_seconds = time_reader(f, 1, row_count);
+    block_seconds = time_reader(f, 0, row_count);
+    fclose(f);
+    
+    if (fscanf_seconds < 0.0 || block_seconds < 0.0)
+    {
+        fputs("A reader failed.\n", stderr);
+        return 1;
+    }
+    
+    bench_report("fscanf (baseline)", fscanf_seconds, 0.0);
+    bench_report("block reader", block_seconds, fscanf_seconds);
+    return 0;
+}
+
+/*******************************************************************************
+* Times loading a text book of 'ROW_COUNT' records (1M by default) with the    *
+* fscanf reader and with 'telephone_book_record_list_read_from_file', once     *
+* with a few common names and once with mostly distinct names:                 *
+*                                                                              *
+*     bench_text_load [ROW_COUNT]                                              *
+*******************************************************************************/
+int main(int argc, char* argv[])
+{
+    int row_count = argc > 1 ? atoi(argv[1]) : DEFAULT_ROW_COUNT;
+    
+    if (row_count < 1000)
+    {
+        fputs("The book needs at least 1000 records.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    
+    if (run_case("common names", row_count, row_count / 200, row_count / 1000))
+    {
+        return EXIT_FAILURE;
+    }
+    
+    if (run_case("distinct names", row_count, row_count / 4, row_count / 20))
+    {
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
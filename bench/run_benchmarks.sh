@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+# Builds and runs the benchmarks of the telephone book. Each bench_*.c file
+# is a program of its own, built against the same sources as the telephone
+# book itself (all of them but main.c), and compares one of its routines
+# with the simpler code it replaced, on generated data:
+#
+#     sh bench/run_benchmarks.sh                  # runs every benchmark
+#     sh bench/run_benchmarks.sh text_load sort   # runs the named ones
+#
+# Set CC to choose the compiler and CFLAGS to change the flags, which are
+# "-std=c99 -O2" by default. A built benchmark takes the size of its data as
+# its first argument, if a different size is wanted:
+#
+#     BENCH_KEEP_DIR=/tmp/bench sh bench/run_benchmarks.sh text_load
+#     /tmp/bench/bench_text_load 10000000
+#
+# The times are the best of a few runs, in seconds, and depend on the
+# machine: compare the lines of one report, not reports from different
+# machines.
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+SOURCE_DIR=$(dirname "$BENCH_DIR")
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--std=c99 -O2}
+STATUS=0
+
+if [ -n "$BENCH_KEEP_DIR" ]; then
+    WORK_DIR=$BENCH_KEEP_DIR
+    mkdir -p "$WORK_DIR" || exit 1
+else
+    WORK_DIR=$(mktemp -d)
+    trap 'rm -rf "$WORK_DIR"' EXIT
+fi
+
+if [ $# -eq 0 ]; then
+    for source in "$BENCH_DIR"/bench_*.c; do
+        name=$(basename "$source" .c)
+        [ "$name" = bench_common ] || set -- "$@" "${name#bench_}"
+    done
+fi
+
+for name in "$@"; do
+    program="$WORK_DIR/bench_$name"
+
+    # The word splitting of CFLAGS is intended:
+    if ! $CC $CFLAGS -o "$program" "$BENCH_DIR/bench_$name.c" \
+         "$BENCH_DIR/bench_common.c" \
+         "$SOURCE_DIR"/telephone_book*.c -lpthread; then
+        echo "Cannot build bench_$name." >&2
+        STATUS=1
+        continue
+    fi
+
+    "$program" || STATUS=1
+    echo
+done
+
+exit $STATUS
@@ -1,11 +1,23 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "telephone_book.h"
+#include "telephone_book_binary.h"
 #include "telephone_book_io.h"
+#include "telephone_book_journal.h"
+#include "telephone_book_search.h"
+#include "telephone_book_server.h"
 #include "telephone_book_utils.h"
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #define ERROR "[ERROR] "
 #define WARNING "[WARNING] "
 #define INFO "[INFO] "
@@ -19,31 +31,67 @@ static const char* OPTION_REMOVE_LONG  = "--remove";
 static const char* OPTION_HELP_SHORT = "-h";
 static const char* OPTION_HELP_LONG  = "--help";
 
+static const char* OPTION_SEARCH_SHORT = "-s";
+static const char* OPTION_SEARCH_LONG  = "--search";
+
+static const char* OPTION_THREADS_LONG = "--threads";
+
+static const char* OPTION_TOP_LONG = "--top";
+
+static const char* OPTION_ALLOCATIONS_LONG = "--allocations";
+
+static const char* OPTION_IMPORT_LONG = "--import";
+static const char* OPTION_EXPORT_LONG = "--export";
+
+static const char* OPTION_SERVE_LONG = "--serve";
+
+static const char* OPTION_QUERIES_LONG = "--queries";
+
+static const char* TEMPORARY_FILE_SUFFIX = ".tmp";
+
 static const size_t RECORDS_PER_BLOCK = 3;
 
+/* The query lines read and answered at a time, see '--queries': */
+#define QUERY_BATCH_SIZE 1024
+#define INITIAL_QUERY_LINE_CAPACITY 128
+
+/* The threads a server answers the requests with, see '--serve'. */
+#define SERVER_WORKER_COUNT 4
+
 /*******************************************************************************
-* Returns the smallest of 'a', 'b', and 'c'.                                   *
+* This structure holds the options that modify the search or the diagnostics:  *
+* the engine answering the nearest-match queries ('--search') and whether one  *
+* was chosen at all, the threads a scan may split the records among            *
+* ('--threads'), how many closest records to list instead of the tied ones     *
+* ('--top'), and whether to report the record allocations on exit              *
+* ('--allocations').                                                           *
 *******************************************************************************/
-static size_t min3(size_t a, size_t b, size_t c)
-{
-    if (a < b)
-    {
-        if (c < a)
-        {
-            return c;
-        }
-        
-        return a;
-    }
-    
-    /* b <= a */
-    if (c < b)
-    {
-        return c;
-    }
-    
-    return b;
-}
+typedef struct {
+    telephone_book_search_strategy search_strategy;
+    int is_search_strategy_chosen;
+    int thread_count;
+    int top_count;
+    int report_allocations;
+} command_options;
+
+/* A single query is answered fastest by a scan, as an index costs more to */
+/* build than it saves: */
+static const command_options DEFAULT_OPTIONS = {
+    TELEPHONE_BOOK_SEARCH_SCAN, 0, 1, 0, 0
+};
+
+/* The engines the commands answering many queries from one index default */
+/* to, as the index then pays for itself: */
+#define SERVED_SEARCH_STRATEGY TELEPHONE_BOOK_SEARCH_BK_TREE
+#define BATCH_SEARCH_STRATEGY TELEPHONE_BOOK_SEARCH_BATCH
+
+/* The options of this invocation. */
+static command_options options;
+
+/* The lock of the record book file while this process holds it, and how */
+/* many times it was taken, see 'lock_record_book': */
+static FILE* record_book_lock = NULL;
+static int record_book_lock_depth = 0;
 
 /*******************************************************************************
 * Prints the help message to the standard output.                              *
@@ -70,530 +118,2462 @@ static void print_help(char* executable_name)
     printf("       %s -r       ID1 ID2 ... IDn\n", executable_name);
     printf("       %s --remove ID1 ID2 ... IDn\n", executable_name);
     puts("");
+    printf("       %s --import TEXT_FILE\n", executable_name);
+    printf("       %s --export TEXT_FILE\n", executable_name);
+    puts("");
+    printf("       %s --serve\n", executable_name);
+    puts("");
+    printf("       %s --queries QUERY_FILE\n", executable_name);
+    puts("");
     printf("(1)    %s\n",                      executable_name);
     printf("(2)    %s LAST_EXPR\n",            executable_name);
     printf("(3)    %s - FIRST_EXPR\n",         executable_name);
     printf("(4)    %s LAST_EXPR FIRST_EXPR\n", executable_name);
     puts("");
+    printf("Any of (1) - (4) and --queries may be preceded by -s or --search "
+           "STRATEGY,\n");
+    printf("by --top K ");
+    printf("and by --threads N.\n");
+    printf("Any command may be preceded by --allocations.\n");
+    puts("");
     puts("Where: -a or --add for adding one new book entry.");
     puts("       -r or --remove for removing book entries by their IDs.");
+    puts("       --import for replacing the book with a binary book built "
+         "from a text");
+    puts("                file.");
+    puts("       --export for writing the book to a text file.");
+    puts("       --serve for keeping the book in memory and answering the "
+         "other commands");
+    puts("               over a socket until interrupted. While a server "
+         "runs, adding,");
+    puts("               removing and listing go through it, and importing "
+         "is refused.");
+    puts("       --queries for answering the query on each line of a file "
+         "(or of the");
+    puts("                 standard input for '-'), written as the LAST_EXPR "
+         "and optional");
+    puts("                 FIRST_EXPR of (2) - (4), from one load of the book. "
+         "Each entry");
+    puts("                 found is printed on a line of tab-separated "
+         "fields: the query");
+    puts("                 line number, the distance, the last name, the "
+         "first name, the");
+    puts("                 number and the ID. With 'simd', the default "
+         "strategy here, the");
+    puts("                 queries are answered together in cache-sized "
+         "blocks where");
+    puts("                 the processor has vector instructions, and one "
+         "by one by a");
+    puts("                 scan where it has none.");
     puts("");
     puts("(1) List all book entries in order.");
     puts("(2) Match by last name and list the closest book entries.");
     puts("(3) Match by first name and list the closest book entries.");
     puts("(4) Match by both last and first names and list the closest book "
          "entries");
+    puts("");
+    puts("STRATEGY is 'scan' for scanning all the entries, 'bk-tree' for "
+         "BK-tree lookup,");
+    puts("'qgram' for q-gram candidate filtering, 'symspell' for deletion "
+         "dictionary");
+    puts("lookup of close typos, 'trie' for shared-prefix traversal of a name "
+         "trie, or");
+    puts("'simd' for computing the distances to all the distinct names at "
+         "once with the");
+    puts("vector instructions of the processor, which scans where it has "
+         "none. The");
+    puts("default is 'scan', as building an index takes longer than a scan. "
+         "Only a");
+    puts("server defaults to 'bk-tree' and --queries to 'simd', since they "
+         "answer many");
+    puts("queries from one index.");
+    puts("");
+    puts("--top K lists the K closest book entries ranked by distance instead "
+         "of only");
+    puts("the ones at the smallest distance.");
+    puts("");
+    puts("--threads N splits a scan of a large book among N threads "
+         "(default 1).");
+    puts("");
+    puts("--allocations prints the number of heap blocks allocated for the "
+         "records.");
+}
+
+/*******************************************************************************
+* Consumes the leading options that modify the search or the diagnostics into  *
+* 'options', and removes them from the argument vector. Complaints go to 'err'.*
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if an option is malformed.     *
+*******************************************************************************/
+static int parse_search_options(int* argc,
+                                char* argv[],
+                                command_options* options,
+                                FILE* err)
+{
+    int arg_index;
+    int option_length;
+    
+    while (*argc > 1)
+    {
+        option_length = 2;
+        
+        if (strcmp(argv[1], OPTION_ALLOCATIONS_LONG) == 0)
+        {
+            options->report_allocations = 1;
+            option_length = 1;
+        }
+        else if (strcmp(argv[1], OPTION_SEARCH_SHORT) == 0 ||
+            strcmp(argv[1], OPTION_SEARCH_LONG) == 0)
+        {
+            if (*argc < 3 ||
+                telephone_book_search_strategy_parse(
+                                                argv[2],
+                                                &options->search_strategy))
+            {
+                fprintf(err,
+                        ERROR "Bad search strategy '%s'.\n",
+                        *argc < 3 ? "" : argv[2]);
+                return 1;
+            }
+            
+            options->is_search_strategy_chosen = 1;
+        }
+        else if (strcmp(argv[1], OPTION_TOP_LONG) == 0)
+        {
+            if (*argc < 3 ||
+                sscanf(argv[2], "%d", &options->top_count) != 1 ||
+                options->top_count < 1)
+            {
+                fprintf(err,
+                        ERROR "Bad number of records '%s'.\n",
+                        *argc < 3 ? "" : argv[2]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[1], OPTION_THREADS_LONG) == 0)
+        {
+            if (*argc < 3 ||
+                sscanf(argv[2], "%d", &options->thread_count) != 1 ||
+                options->thread_count < 1)
+            {
+                fprintf(err,
+                        ERROR "Bad thread count '%s'.\n",
+                        *argc < 3 ? "" : argv[2]);
+                return 1;
+            }
+        }
+        else
+        {
+            return 0;
+        }
+        
+        /* Shift the remaining arguments (and the terminating NULL) left: */
+        for (arg_index = 1; arg_index + option_length <= *argc; ++arg_index)
+        {
+            argv[arg_index] = argv[arg_index + option_length];
+        }
+        
+        *argc -= option_length;
+    }
+    
+    return 0;
 }
 
 /*******************************************************************************
-* Implements the Levenshtein distance algorithm.                               *
+* Takes the lock of the record book, which a process holds from reading the    *
+* book or its journal until it has written the change it derived, waiting for  *
+* other processes to release it. A holder may take the lock again; it is       *
+* released by the matching last 'unlock_record_book'. Only one thread of the   *
+* process may use the lock at a time.                                          *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
 *******************************************************************************/
-static size_t edit_distance(char* word1,
-                            char* word2,
-                            size_t length1,
-                            size_t length2)
+static int lock_record_book(void)
 {
-    int cost;
+    char* lock_file_name;
     
-    if (length1 == 0)
+    if (record_book_lock_depth > 0)
     {
-        return length2;
+        ++record_book_lock_depth;
+        return 0;
     }
     
-    if (length2 == 0)
+    /* ALLOCATED: lock_file_name */
+    lock_file_name = get_telephone_record_book_lock_file_path();
+    
+    if (!lock_file_name)
     {
-        return length1;
+        fputs(ERROR
+              "Cannot allocate memory for the telephone book file name.\n",
+              stderr);
+        return 1;
     }
     
-    cost = tolower(word1[length1 - 1]) ==
-           tolower(word2[length2 - 1]) ? 0 : 1;
+    record_book_lock = telephone_book_file_lock(lock_file_name);
     
-    return min3(edit_distance(word1, word2, length1, length2 - 1) + 1,
-                edit_distance(word1, word2, length1 - 1, length2) + 1,
-                edit_distance(word1, word2, length1 - 1, length2 - 1) + cost);
+    if (!record_book_lock)
+    {
+        fprintf(stderr,
+                ERROR "Cannot lock the record book through '%s'.\n",
+                lock_file_name);
+        free(lock_file_name);
+        return 1;
+    }
+    
+    free(lock_file_name);
+    record_book_lock_depth = 1;
+    return 0;
 }
 
 /*******************************************************************************
-* Computes the Levenshtein disance between words 'word1' and 'word2'.          *
+* Releases the lock of the record book taken by 'lock_record_book'.            *
 *******************************************************************************/
-static size_t compute_edit_distance(char* word1, char* word2)
+static void unlock_record_book(void)
 {
-    return edit_distance(word1, word2, strlen(word1), strlen(word2));
+    if (record_book_lock_depth > 0 && --record_book_lock_depth == 0)
+    {
+        telephone_book_file_unlock(record_book_lock);
+        record_book_lock = NULL;
+    }
 }
 
 /*******************************************************************************
-* Implements listing the telephone book records.                               *
+* Writes the record list to the record book 'file_name' in the text or in the  *
+* binary format. The book is written to a temporary file that is forced to the *
+* disk and then renamed over the book, so that a crash leaves either the old   *
+* or the new book in place. (The list may also still be mapped from the old    *
+* book.)                                                                       *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
 *******************************************************************************/
-int command_list_telephone_book_records_impl(
-                        telephone_book_record_list* record_list,
-                        char* last_name,
-                        char* first_name)
+static int store_record_book(telephone_book_record_list* record_list,
+                             const char* file_name,
+                             int is_binary)
 {
-    size_t best_tentative_distance = 1000 * 1000 * 1000;
-    size_t temp_distance;
-    size_t i;
-    output_table_strings* output_strings;
-    telephone_book_record* record;
-    telephone_book_record_list_node* current_node;
-    telephone_book_record_list* best_record_list =
-        telephone_book_record_list_alloc();
+    char* temporary_file_name;
+    FILE* f;
+    int result;
     
-    /* ALLOCATED: best_record_list */
-    if (!best_record_list)
+    /* ALLOCATED: temporary_file_name */
+    temporary_file_name = malloc(strlen(file_name) +
+                                 strlen(TEMPORARY_FILE_SUFFIX) + 1);
+    
+    if (!temporary_file_name)
     {
-        fputs(ERROR "Cannot allocate the best record list.\n", stderr);
-        return EXIT_FAILURE;
+        return 1;
     }
     
-    current_node = record_list->head;
+    strcpy(temporary_file_name, file_name);
+    strcat(temporary_file_name, TEMPORARY_FILE_SUFFIX);
+    f = fopen(temporary_file_name, is_binary ? "wb" : "w");
     
-    while (current_node)
+    if (!f)
     {
-        temp_distance =
-        (last_name ?
-            compute_edit_distance(last_name,
-                                  current_node->record->last_name) : 0) +
-        (first_name ?
-            compute_edit_distance(first_name,
-                                  current_node->record->first_name) : 0);
-        
-        if (best_tentative_distance > temp_distance)
-        {
-            /* 'temp_distance' improves the best known edit distance,     */
-            /* clear the current best list and append the current record: */
-            telephone_book_record_list_free(best_record_list);
-            best_record_list = telephone_book_record_list_alloc();
-            
-            if (!best_record_list)
-            {
-                fputs(ERROR "Cannot allocate new best record list.\n", stderr);
-                return EXIT_FAILURE;
-            }
-            
-            record = telephone_book_record_alloc(
-                            current_node->record->last_name,
-                            current_node->record->first_name,
-                            current_node->record->telephone_number,
-                            current_node->record->id);
-            
-            if (!record)
-            {
-                fputs(ERROR "Cannot allocate a copy record.\n", stderr);
-                telephone_book_record_list_free(best_record_list);
-                return EXIT_FAILURE;
-            }
-            
-            if (telephone_book_record_list_add_record(best_record_list, record))
-            {
-                fputs(ERROR "Cannot add a new record to the best list.\n",
-                      stderr);
-                telephone_book_record_list_free(best_record_list);
-                telephone_book_record_free(record);
-                return EXIT_FAILURE;
-            }
-            
-            best_tentative_distance = temp_distance;
-        }
-        else if (best_tentative_distance == temp_distance)
-        {
-            /* Append the current record to the best list: */
-            record = telephone_book_record_alloc(
-                            current_node->record->last_name,
-                            current_node->record->first_name,
-                            current_node->record->telephone_number,
-                            current_node->record->id);
-            
-            if (!record)
-            {
-                fputs(ERROR "Cannot allocate a copy record.\n", stderr);
-                telephone_book_record_list_free(best_record_list);
-                return EXIT_FAILURE;
-            }
-            
-            
-            if (telephone_book_record_list_add_record(best_record_list, record))
-            {
-                fputs(ERROR "Cannot add a new record to the best list.\n",
-                      stderr);
-                telephone_book_record_list_free(best_record_list);
-                telephone_book_record_free(record);
-                return EXIT_FAILURE;
-            }
-        }
-        
-        current_node = current_node->next;
+        free(temporary_file_name);
+        return 1;
     }
     
-    output_strings = output_table_strings_create(best_record_list);
+    result = is_binary ?
+             telephone_book_binary_write_to_file(record_list, f) :
+             telephone_book_record_list_write_to_file(record_list, f);
     
-    if (!output_strings)
+    if (!result)
     {
-        telephone_book_record_list_free(best_record_list);
-        return EXIT_FAILURE;
+        result = telephone_book_file_sync(f);
     }
     
-    puts(output_strings->separator_string);
-    puts(output_strings->title_string);
-    puts(output_strings->separator_string);
-    
-    current_node = best_record_list->head;
-    i = 0;
-    
-    while (current_node)
+    if (fclose(f) || result)
     {
-        printf(output_strings->record_format_string,
-               current_node->record->last_name,
-               current_node->record->first_name,
-               current_node->record->telephone_number,
-               current_node->record->id);
-        
-        current_node = current_node->next;
-        ++i;
-        
-        if (current_node && i % RECORDS_PER_BLOCK == 0)
-        {
-            puts(output_strings->separator_string);
-        }
+        remove(temporary_file_name);
+        free(temporary_file_name);
+        return 1;
     }
-    
-    output_table_strings_free(output_strings);
-    telephone_book_record_list_free(best_record_list);
-    return EXIT_SUCCESS;
+
+#ifdef _WIN32
+    /* 'rename' does not replace existing files on Windows: */
+    remove(file_name);
+#endif
+    
+    result = rename(temporary_file_name, file_name);
+    free(temporary_file_name);
+    return result != 0;
 }
 
 /*******************************************************************************
-* Handles the command for listing the records.                                 *
+* Finishes a compaction that a crash cut short, if there was one: replays the  *
+* journal it set aside onto the record list read from the book 'file_name',    *
+* which may already contain some or all of the journal, writes the list back   *
+* to the book, and removes the set aside journal.                              *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
 *******************************************************************************/
-static int command_list_telephone_book_records(int argc, char* argv[])
+static int recover_folded_journal(telephone_book_record_list* record_list,
+                                  const char* file_name,
+                                  int is_binary)
 {
-    char* file_name;
+    char* folded_file_name;
     FILE* f;
-    telephone_book_record_list* record_list;
-    char* last_name;
-    char* first_name;
+    size_t bad_line_number;
+    int result;
     
-    /* ALLOCATED: file_name */
-    file_name = get_telephone_record_book_file_path();
+    /* ALLOCATED: folded_file_name */
+    folded_file_name = get_telephone_record_book_folded_journal_file_path();
     
-    if (!file_name)
+    if (!folded_file_name)
     {
-        fputs(ERROR
-              "Cannot allocate memory for the telephone book file name.\n",
-              stderr);
-        return EXIT_FAILURE;
+        return 1;
     }
     
-    f = fopen(get_telephone_record_book_file_path(), "r");
+    f = fopen(folded_file_name, "r");
     
     if (!f)
     {
-        fprintf(stderr,
-                ERROR "Cannot open the record book file '%s'.\n",
-                file_name);
-        
-        free(file_name);
-        return EXIT_FAILURE;
+        /* No compaction was cut short. */
+        free(folded_file_name);
+        return 0;
     }
     
-    /* ALLOCATED: file_name, record_list */
-    record_list = telephone_book_record_list_read_from_file(f);
     fclose(f);
     
-    if (!record_list)
+    if (telephone_book_journal_replay(folded_file_name,
+                                      record_list,
+                                      1,
+                                      NULL,
+                                      &bad_line_number))
     {
-        fputs(ERROR "Cannot read the record book file.\n", stderr);
-        free(file_name);
-        return EXIT_FAILURE;
+        if (bad_line_number > 0)
+        {
+            fprintf(stderr,
+                    ERROR "Malformed entry on line %zu of '%s'.\n",
+                    bad_line_number,
+                    folded_file_name);
+        }
+        
+        free(folded_file_name);
+        return 1;
     }
     
-    /* If fails, silently ignore: */
-    telephone_book_record_list_sort(record_list);
-    /* Does not ask for resources, should be OK: */
-    telephone_book_record_list_fix_ids(record_list);
-    
-    /* "w" means overwrite the file. */
-    f = fopen(file_name, "w");
+    /* The book is stored the way a compaction would have left it: */
+    result = telephone_book_record_list_fix_ids(record_list, NULL);
     
-    if (f)
+    if (!result)
     {
-        /* Write the file back. It will update the order of the records and */
-        /* fix the record IDs, if needed. */
-        telephone_book_record_list_write_to_file(record_list, f);
-        fclose(f);
+        telephone_book_record_list_sort(record_list);
+        result = store_record_book(record_list, file_name, is_binary) ||
+                 telephone_book_journal_clear(folded_file_name);
     }
     
-    last_name  = argc >= 2 ? argv[1] : NULL;
-    first_name = argc >= 3 ? argv[2] : NULL;
-    
-    if (argc > 1 && strcmp(argv[1], "-") == 0)
+    if (result)
     {
-        /* Match all last names: */
-        last_name = NULL;
+        fprintf(stderr,
+                ERROR "Cannot write the journal '%s' of an interrupted "
+                "compaction to the record book.\n",
+                folded_file_name);
     }
     
-    /* ALLOCATED: record_list */
-    free(file_name);
-    
-    return command_list_telephone_book_records_impl(record_list,
-                                                    last_name,
-                                                    first_name);
+    free(folded_file_name);
+    return result;
 }
 
 /*******************************************************************************
-* Handles the command for adding a new record.                                 *
+* Reads the record book 'file_name' for 'load_record_book', which holds the    *
+* lock of the book.                                                            *
 *******************************************************************************/
-static int command_add_record(int argc, char* argv[])
+static telephone_book_record_list* read_record_book(const char* file_name,
+                                                    int* is_binary)
 {
-    char* file_name;
-    FILE* f;
     telephone_book_record_list* record_list;
-    telephone_book_record* record;
-    
-    if (argc != 5)
-    {
-        print_help(argv[0]);
-        return EXIT_FAILURE;
-    }
+    char* journal_file_name;
+    FILE* f;
+    uint32_t flags = 0;
+    size_t operation_count;
+    size_t bad_line_number;
+    int fixed_id_count;
     
-    /* ALLOCATED: file_name */
-    file_name = get_telephone_record_book_file_path();
+    *is_binary = telephone_book_binary_is_book_file(file_name);
     
-    if (!file_name)
+    if (*is_binary)
     {
-        fputs(ERROR
-              "Cannot allocate memory for the telephone book file name.\n",
-              stderr);
-        return EXIT_FAILURE;
+        record_list = telephone_book_binary_read(file_name, &flags);
     }
-    
-    f = fopen(file_name, "r");
-    
-    if (!f)
+    else
     {
-        fprintf(stderr, ERROR "Cannot open the record book file '%s'.\n",
-                file_name);
+        f = fopen(file_name, "r");
         
-        free(file_name);
-        return EXIT_FAILURE;
+        if (!f)
+        {
+            return NULL;
+        }
+        
+        record_list = telephone_book_record_list_read_from_file(
+                                                        f,
+                                                        &bad_line_number);
+        fclose(f);
+        
+        if (!record_list && bad_line_number > 0)
+        {
+            fprintf(stderr,
+                    ERROR "Malformed record on line %zu of '%s'.\n",
+                    bad_line_number,
+                    file_name);
+        }
     }
     
-    /* ALLOCATED: file_name, record_list */
-    record_list = telephone_book_record_list_read_from_file(f);
-    fclose(f);
-    
     if (!record_list)
     {
-        fputs(ERROR "Cannot read the record book file.\n", stderr);
-        free(file_name);
-        return EXIT_FAILURE;
+        return NULL;
     }
     
-    /* ALLOCATED: file_name, record_list, record */
-    record = telephone_book_record_alloc(argv[2], argv[3], argv[4], -1);
-    
-    if (!record)
+    /* A book written before the IDs were kept may lack some; they are     */
+    /* handed out before the journal is replayed and written back at once, */
+    /* so that a record keeps the ID it was listed with: */
+    if (telephone_book_record_list_fix_ids(record_list, &fixed_id_count))
     {
-        fputs(ERROR "Cannot allocate memory for the new record.\n", stderr);
-        free(file_name);
+        fputs(ERROR "Cannot assign the record IDs.\n", stderr);
         telephone_book_record_list_free(record_list);
-        return EXIT_FAILURE;
+        return NULL;
     }
     
-    if (telephone_book_record_list_add_record(record_list, record))
+    if (fixed_id_count > 0 &&
+        store_record_book(record_list, file_name, *is_binary))
     {
-        fputs(ERROR "Cannot add the new entry to the record book.\n", stderr);
-        free(file_name);
-        telephone_book_record_list_free(record_list);
-        telephone_book_record_free(record);
-        return EXIT_FAILURE;
+        fprintf(stderr,
+                WARNING "Cannot write the new record IDs to '%s'.\n",
+                file_name);
     }
     
-    /* Even if the following two functions fail, proceed further. */
-    telephone_book_record_list_sort(record_list);
-    telephone_book_record_list_fix_ids(record_list);
+    if (recover_folded_journal(record_list, file_name, *is_binary))
+    {
+        telephone_book_record_list_free(record_list);
+        return NULL;
+    }
     
-    f = fopen(file_name, "w");
-    free(file_name);
+    /* ALLOCATED: record_list, journal_file_name */
+    journal_file_name = get_telephone_record_book_journal_file_path();
     
-    if (!f)
+    if (!journal_file_name ||
+        telephone_book_journal_replay(journal_file_name,
+                                      record_list,
+                                      0,
+                                      &operation_count,
+                                      &bad_line_number))
     {
-        fputs(ERROR "Cannot open the record book file.\n", stderr);
-        /* 'record' is contained in 'record_list' so is freed by it: */
+        if (journal_file_name && bad_line_number > 0)
+        {
+            fprintf(stderr,
+                    ERROR "Malformed entry or duplicate record ID on line "
+                    "%zu of '%s'.\n",
+                    bad_line_number,
+                    journal_file_name);
+        }
+        
+        fputs(ERROR "Cannot replay the record book journal.\n", stderr);
+        free(journal_file_name);
         telephone_book_record_list_free(record_list);
-        telephone_book_record_free(record);
-        return EXIT_FAILURE;
+        return NULL;
     }
     
-    if (telephone_book_record_list_write_to_file(record_list, f))
+    free(journal_file_name);
+    
+    if (operation_count == 0 && (flags & TELEPHONE_BOOK_BINARY_FLAG_SORTED))
     {
-        fputs(ERROR "Cannot update the record book file.\n", stderr);
+        return record_list;
     }
     
-    fclose(f);
-    /* 'record' is contained in 'record_list' so is freed by it: */
-    telephone_book_record_list_free(record_list);
-    return EXIT_SUCCESS;
+    /* Only the records added by the journal without an ID are touched: */
+    if (telephone_book_record_list_fix_ids(record_list, NULL))
+    {
+        fputs(ERROR "Cannot assign the record IDs.\n", stderr);
+        telephone_book_record_list_free(record_list);
+        return NULL;
+    }
+    
+    /* Only the records added since the book was sorted get sorted, and are */
+    /* then merged in. If fails, silently ignore: */
+    telephone_book_record_list_sort(record_list);
+    return record_list;
 }
 
 /*******************************************************************************
-* Handles the commmand for removing records by their IDs.                      *
+* Loads the record book 'file_name', which may be either in the text or in the *
+* binary format, and replays the journal of the changes made since it was last *
+* written. Records of the book without an ID of their own first get a fresh    *
+* one, which is written back to the book right away, so that the IDs do not    *
+* depend on the journal. So is a journal set aside by a compaction that a      *
+* crash cut short. The records are sorted unless they already are (which a     *
+* binary book may state in its header). Sets 'is_binary' to tell which format  *
+* the book was in. The book is read under its lock, so that no other process   *
+* changes it half-way.                                                         *
+* ---                                                                          *
+* Returns the record list on success, and NULL on failure.                     *
 *******************************************************************************/
-static int command_remove_records(int argc, char* argv[])
+static telephone_book_record_list* load_record_book(const char* file_name,
+                                                    int* is_binary)
 {
-    char* file_name;
-    FILE* f;
     telephone_book_record_list* record_list;
-    telephone_book_record_list* removed_record_list;
-    telephone_book_record* removed_record;
-    telephone_book_record_list_node* current_node;
-    char* removed_record_format;
-    int arg_index;
-    int id;
     
-    if (argc < 3)
+    if (lock_record_book())
     {
-        puts(WARNING "No record IDs given. Nothing to remove.");
-        return EXIT_SUCCESS;
+        return NULL;
     }
     
-    /* ALLOCATED: file_name */
-    file_name = get_telephone_record_book_file_path();
+    record_list = read_record_book(file_name, is_binary);
+    unlock_record_book();
+    return record_list;
+}
+
+/*******************************************************************************
+* Writes the whole record list to the record book 'file_name' and drops the    *
+* journal, whose changes the list already contains. The journal is first set   *
+* aside, and removed once the book is written, so that a load after a crash in *
+* between finishes the compaction. The caller should hold the lock of the      *
+* book since it loaded the list, or else the changes other processes           *
+* journaled meanwhile are lost.                                                *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int compact_record_book(telephone_book_record_list* record_list,
+                               const char* file_name,
+                               int is_binary)
+{
+    char* journal_file_name;
+    char* folded_file_name;
+    int result;
+    
+    if (lock_record_book())
+    {
+        return 1;
+    }
+    
+    /* ALLOCATED: journal_file_name, folded_file_name */
+    journal_file_name = get_telephone_record_book_journal_file_path();
+    folded_file_name = get_telephone_record_book_folded_journal_file_path();
+    
+    /* Once set aside, the journal is told apart from a new one by a load */
+    /* after a crash, whether or not the book was written: */
+    result = !journal_file_name ||
+             !folded_file_name ||
+             telephone_book_journal_set_aside(journal_file_name,
+                                              folded_file_name) ||
+             store_record_book(record_list, file_name, is_binary) ||
+             telephone_book_journal_clear(folded_file_name);
+    
+    free(journal_file_name);
+    free(folded_file_name);
+    unlock_record_book();
+    return result;
+}
+
+/*******************************************************************************
+* Appends the records in 'records' to the journal as operation 'operation'.    *
+* Once the journal passes the compaction size, 'record_list' (or the book      *
+* reloaded from the disk if NULL) is written back and the journal is dropped.  *
+* All of it happens under the lock of the book, which the caller should have   *
+* held since it loaded 'record_list' or read the next ID.                      *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int journal_record_book_change(telephone_book_record_list* record_list,
+                                      telephone_book_record_list* records,
+                                      char operation,
+                                      const char* file_name)
+{
+    telephone_book_record_list* loaded_record_list = NULL;
+    char* journal_file_name;
+    int is_binary;
+    int result;
+    
+    if (lock_record_book())
+    {
+        return 1;
+    }
+    
+    /* ALLOCATED: journal_file_name */
+    journal_file_name = get_telephone_record_book_journal_file_path();
+    
+    if (!journal_file_name)
+    {
+        unlock_record_book();
+        return 1;
+    }
+    
+    if (telephone_book_journal_append(journal_file_name, operation, records))
+    {
+        free(journal_file_name);
+        unlock_record_book();
+        return 1;
+    }
+    
+    if (!telephone_book_journal_needs_compaction(journal_file_name))
+    {
+        free(journal_file_name);
+        unlock_record_book();
+        return 0;
+    }
+    
+    free(journal_file_name);
+    
+    if (!record_list)
+    {
+        /* ALLOCATED: loaded_record_list */
+        loaded_record_list = load_record_book(file_name, &is_binary);
+        
+        if (!loaded_record_list)
+        {
+            unlock_record_book();
+            return 1;
+        }
+        
+        record_list = loaded_record_list;
+    }
+    else
+    {
+        is_binary = telephone_book_binary_is_book_file(file_name);
+    }
+    
+    result = compact_record_book(record_list, file_name, is_binary);
+    telephone_book_record_list_free(loaded_record_list);
+    unlock_record_book();
+    return result;
+}
+
+/*******************************************************************************
+* Lists the records of the search index closest to the query to 'out', and     *
+* complains to 'err'.                                                          *
+* ---                                                                          *
+* Returns the exit status of the command.                                      *
+*******************************************************************************/
+static int list_closest_records(telephone_book_search_index* search_index,
+                                const command_options* list_options,
+                                char* last_name,
+                                char* first_name,
+                                FILE* out,
+                                FILE* err)
+{
+    size_t i;
+    size_t record_count;
+    output_table_strings* output_strings;
+    telephone_book_record** records;
+    telephone_book_search_result search_result;
+    
+    if (search_index->thread_count != list_options->thread_count &&
+        telephone_book_search_index_set_thread_count(
+                                            search_index,
+                                            list_options->thread_count))
+    {
+        fputs(ERROR "Cannot prepare the search threads.\n", err);
+        return EXIT_FAILURE;
+    }
+    
+    telephone_book_search_result_init(&search_result);
+    telephone_book_search_result_set_limit(&search_result,
+                                           list_options->top_count);
+    
+    /* ALLOCATED: search_result */
+    if (telephone_book_search_find_closest(search_index,
+                                           last_name,
+                                           first_name,
+                                           &search_result))
+    {
+        fputs(ERROR "Cannot search the record book.\n", err);
+        telephone_book_search_result_destroy(&search_result);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: search_result, records */
+    records = malloc((search_result.size + 1) * sizeof *records);
+    
+    if (!records)
+    {
+        fputs(ERROR "Cannot allocate the best record table.\n", err);
+        telephone_book_search_result_destroy(&search_result);
+        return EXIT_FAILURE;
+    }
+    
+    record_count = (size_t) search_result.size;
+    
+    /* The records stay in the list, so the table only points to them: */
+    for (i = 0; i < record_count; ++i)
+    {
+        records[i] = telephone_book_store_record(
+                                search_index->store,
+                                search_result.record_indices[i]);
+    }
+    
+    /* ALLOCATED: records */
+    telephone_book_search_result_destroy(&search_result);
+    output_strings = output_table_strings_create(records, record_count);
+    
+    if (!output_strings)
+    {
+        free(records);
+        return EXIT_FAILURE;
+    }
+    
+    fprintf(out, "%s\n", output_strings->separator_string);
+    fprintf(out, "%s\n", output_strings->title_string);
+    fprintf(out, "%s\n", output_strings->separator_string);
+    
+    for (i = 0; i < record_count; ++i)
+    {
+        fprintf(out,
+                output_strings->record_format_string,
+                records[i]->last_name,
+                records[i]->first_name,
+                records[i]->telephone_number,
+                records[i]->id);
+        
+        if (i + 1 < record_count && (i + 1) % RECORDS_PER_BLOCK == 0)
+        {
+            fprintf(out, "%s\n", output_strings->separator_string);
+        }
+    }
+    
+    output_table_strings_free(output_strings);
+    free(records);
+    return EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+* Implements listing the telephone book records.                               *
+*******************************************************************************/
+int command_list_telephone_book_records_impl(
+                        telephone_book_record_list* record_list,
+                        char* last_name,
+                        char* first_name)
+{
+    telephone_book_search_index* search_index;
+    int result;
+    
+    /* ALLOCATED: search_index */
+    search_index = telephone_book_search_index_alloc(
+                                            record_list,
+                                            options.search_strategy);
+    
+    if (!search_index)
+    {
+        fputs(ERROR "Cannot build the search index.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    
+    result = list_closest_records(search_index,
+                                  &options,
+                                  last_name,
+                                  first_name,
+                                  stdout,
+                                  stderr);
+    
+    telephone_book_search_index_free(search_index);
+    return result;
+}
+
+/*******************************************************************************
+* Picks the names to match from the arguments of the listing command. A NULL   *
+* name matches every record.                                                   *
+*******************************************************************************/
+static void get_query_names(int argc,
+                            char* argv[],
+                            char** last_name,
+                            char** first_name)
+{
+    *last_name  = argc >= 2 ? argv[1] : NULL;
+    *first_name = argc >= 3 ? argv[2] : NULL;
+    
+    if (argc > 1 && strcmp(argv[1], "-") == 0)
+    {
+        /* Match all last names: */
+        *last_name = NULL;
+    }
+}
+
+/*******************************************************************************
+* Handles the command for listing the records.                                 *
+*******************************************************************************/
+static int command_list_telephone_book_records(int argc, char* argv[])
+{
+    char* file_name;
+    telephone_book_record_list* record_list;
+    char* last_name;
+    char* first_name;
+    int is_binary;
+    int result;
+    
+    /* ALLOCATED: file_name */
+    file_name = get_telephone_record_book_file_path();
+    
+    if (!file_name)
+    {
+        fputs(ERROR
+              "Cannot allocate memory for the telephone book file name.\n",
+              stderr);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name, record_list */
+    record_list = load_record_book(file_name, &is_binary);
+    
+    if (!record_list)
+    {
+        fprintf(stderr,
+                ERROR "Cannot read the record book file '%s'.\n",
+                file_name);
+        
+        free(file_name);
+        return EXIT_FAILURE;
+    }
+    
+    /* Listing only reads the book; the records are in order in memory, */
+    /* and changes reach the file through the journal. */
+    get_query_names(argc, argv, &last_name, &first_name);
+    
+    /* ALLOCATED: record_list */
+    free(file_name);
+    
+    result = command_list_telephone_book_records_impl(record_list,
+                                                      last_name,
+                                                      first_name);
+    
+    /* Unmaps the book if it was read in the binary format: */
+    telephone_book_record_list_free(record_list);
+    return result;
+}
+
+/*******************************************************************************
+* Finds the ID for a new record in the record book 'file_name': the high-water *
+* mark stated by the book, raised past the records added in the journal. Only  *
+* a book too old to state it is loaded in full.                                *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int get_next_record_id(const char* file_name, int* next_id)
+{
+    telephone_book_record_list* record_list;
+    char* journal_file_name;
+    char* folded_file_name;
+    FILE* f;
+    int is_binary;
+    int result;
+    
+    if (telephone_book_binary_is_book_file(file_name))
+    {
+        result = telephone_book_binary_read_next_id(file_name, next_id);
+    }
+    else
+    {
+        f = fopen(file_name, "r");
+        
+        if (!f)
+        {
+            return 1;
+        }
+        
+        result = telephone_book_record_list_read_next_id_from_file(f, next_id);
+        fclose(f);
+    }
+    
+    if (result)
+    {
+        return 1;
+    }
+    
+    if (*next_id == 0)
+    {
+        /* ALLOCATED: record_list */
+        record_list = load_record_book(file_name, &is_binary);
+        
+        if (!record_list)
+        {
+            return 1;
+        }
+        
+        *next_id = record_list->next_id;
+        telephone_book_record_list_free(record_list);
+    }
+    
+    /* ALLOCATED: journal_file_name, folded_file_name */
+    journal_file_name = get_telephone_record_book_journal_file_path();
+    folded_file_name = get_telephone_record_book_folded_journal_file_path();
+    
+    /* A compaction cut short may have set aside records the book lacks: */
+    result = !journal_file_name ||
+             !folded_file_name ||
+             telephone_book_journal_read_next_id(folded_file_name, next_id) ||
+             telephone_book_journal_read_next_id(journal_file_name, next_id);
+    
+    free(journal_file_name);
+    free(folded_file_name);
+    return result;
+}
+
+/*******************************************************************************
+* Checks the last name, the first name and the telephone number given to the   *
+* add command in 'argv', complaining to 'err' about the first invalid one.     *
+* ---                                                                          *
+* Returns zero if all of them may be stored, and a non-zero value otherwise.   *
+*******************************************************************************/
+static int check_added_record_fields(char* argv[], FILE* err)
+{
+    static const char* field_names[] = {
+        "last name",
+        "first name",
+        "telephone number"
+    };
+    
+    int i;
+    
+    for (i = 0; i < 3; ++i)
+    {
+        if (!telephone_book_record_is_valid_field(argv[i + 2]))
+        {
+            fprintf(err,
+                    ERROR "The %s '%s' must be 1 to %d characters long "
+                    "without whitespace.\n",
+                    field_names[i],
+                    argv[i + 2],
+                    TELEPHONE_BOOK_MAX_FIELD_LENGTH);
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Handles the command for adding a new record. The record gets a fresh ID and  *
+* is only appended to the journal; it takes its place in the book at the next  *
+* compaction.                                                                  *
+*******************************************************************************/
+static int command_add_record(int argc, char* argv[])
+{
+    char* file_name;
+    FILE* f;
+    telephone_book_record_list* added_record_list;
+    telephone_book_record* record;
+    int id;
+    
+    if (argc != 5)
+    {
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    if (check_added_record_fields(argv, stderr))
+    {
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name */
+    file_name = get_telephone_record_book_file_path();
+    
+    if (!file_name)
+    {
+        fputs(ERROR
+              "Cannot allocate memory for the telephone book file name.\n",
+              stderr);
+        return EXIT_FAILURE;
+    }
+    
+    /* The journal extends an existing book: */
+    f = fopen(file_name, "r");
+    
+    if (!f)
+    {
+        fprintf(stderr, ERROR "Cannot open the record book file '%s'.\n",
+                file_name);
+        
+        free(file_name);
+        return EXIT_FAILURE;
+    }
+    
+    fclose(f);
+    
+    if (get_next_record_id(file_name, &id) || id < 1)
+    {
+        fprintf(stderr, ERROR "Cannot find a new ID in the record book file "
+                "'%s'.\n", file_name);
+        
+        free(file_name);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name, added_record_list */
+    added_record_list = telephone_book_record_list_alloc();
+    
+    if (!added_record_list)
+    {
+        fputs(ERROR "Cannot allocate memory for the new record.\n", stderr);
+        free(file_name);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name, added_record_list, record */
+    record = telephone_book_record_alloc(argv[2], argv[3], argv[4], id);
+    
+    if (!record)
+    {
+        fputs(ERROR "Cannot allocate memory for the new record.\n", stderr);
+        free(file_name);
+        telephone_book_record_list_free(added_record_list);
+        return EXIT_FAILURE;
+    }
+    
+    if (telephone_book_record_list_add_record(added_record_list, record))
+    {
+        fputs(ERROR "Cannot add the new entry to the record book.\n", stderr);
+        free(file_name);
+        telephone_book_record_list_free(added_record_list);
+        telephone_book_record_free(record);
+        return EXIT_FAILURE;
+    }
+    
+    if (journal_record_book_change(NULL,
+                                   added_record_list,
+                                   TELEPHONE_BOOK_JOURNAL_ADD,
+                                   file_name))
+    {
+        fputs(ERROR "Cannot update the record book file.\n", stderr);
+        free(file_name);
+        telephone_book_record_list_free(added_record_list);
+        return EXIT_FAILURE;
+    }
+    
+    printf(INFO "Added the record with ID %d.\n", id);
+    free(file_name);
+    /* 'record' is contained in 'added_record_list' so is freed by it: */
+    telephone_book_record_list_free(added_record_list);
+    return EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+* Parses the record IDs given to the removal command, warning on 'out' about   *
+* the malformed ones, which are skipped.                                       *
+* ---                                                                          *
+* Returns the number of IDs stored in the new array '*ids', or -1 if the array *
+* cannot be allocated.                                                         *
+*******************************************************************************/
+static int parse_record_ids(int argc, char* argv[], int** ids, FILE* out)
+{
+    int id_count = 0;
+    int arg_index;
+    
+    /* ALLOCATED: ids */
+    *ids = malloc((argc - 2) * sizeof **ids);
+    
+    if (!*ids)
+    {
+        return -1;
+    }
+    
+    for (arg_index = 2; arg_index < argc; ++arg_index)
+    {
+        if (sscanf(argv[arg_index], "%d", &(*ids)[id_count]) != 1)
+        {
+            fprintf(out,
+                    WARNING "Bad ID = \'%s\'. Ignored.\n",
+                    argv[arg_index]);
+            continue;
+        }
+        
+        ++id_count;
+    }
+    
+    return id_count;
+}
+
+/*******************************************************************************
+* Reports to 'out' the records in 'removed_record_list', removed for the       *
+* 'requested_count' IDs given to the removal command.                          *
+*******************************************************************************/
+static void print_removed_records(
+                        telephone_book_record_list* removed_record_list,
+                        int requested_count,
+                        FILE* out)
+{
+    telephone_book_record_list_node* current_node;
+    char* removed_record_format;
+    
+    fprintf(out,
+            INFO "Number of records to remove: %d, removed: %d.\n",
+            requested_count,
+            telephone_book_record_list_size(removed_record_list));
+    
+    if (telephone_book_record_list_size(removed_record_list) == 0)
+    {
+        fputs(INFO "Nothing to remove.\n", out);
+        return;
+    }
+    
+    fputs(INFO "List of removed entries:\n", out);
+    current_node = removed_record_list->head;
+    removed_record_format =
+        get_removed_record_output_format_string(removed_record_list);
+    
+    while (current_node)
+    {
+        if (removed_record_format)
+        {
+            fprintf(out,
+                    removed_record_format,
+                    current_node->record->last_name,
+                    current_node->record->first_name,
+                    current_node->record->telephone_number,
+                    current_node->record->id);
+        }
+        else
+        {
+            /* Fallback format output: */
+            fprintf(out,
+                    "%s, %s - %s, ID %d\n",
+                    current_node->record->last_name,
+                    current_node->record->first_name,
+                    current_node->record->telephone_number,
+                    current_node->record->id);
+        }
+        
+        current_node = current_node->next;
+    }
+    
+    free(removed_record_format);
+}
+
+/*******************************************************************************
+* Handles the commmand for removing records by their IDs.                      *
+*******************************************************************************/
+static int command_remove_records(int argc, char* argv[])
+{
+    char* file_name;
+    telephone_book_record_list* record_list;
+    telephone_book_record_list* removed_record_list;
+    int* ids;
+    int id_count;
+    int is_binary;
+    
+    if (argc < 3)
+    {
+        puts(WARNING "No record IDs given. Nothing to remove.");
+        return EXIT_SUCCESS;
+    }
+    
+    /* ALLOCATED: file_name */
+    file_name = get_telephone_record_book_file_path();
+    
+    if (!file_name)
+    {
+        fputs(ERROR
+              "Cannot allocate memory for the telephone book file name.\n",
+              stderr);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name, record_list */
+    record_list = load_record_book(file_name, &is_binary);
+    
+    if (!record_list)
+    {
+        fprintf(stderr,
+                ERROR "Cannot read the record book file '%s'.\n",
+                file_name);
+        
+        free(file_name);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name, record_list, removed_record_list */
+    removed_record_list = telephone_book_record_list_alloc();
+    
+    if (!removed_record_list)
+    {
+        fputs(ERROR
+              "Cannot allocate memory for the list of removed records.\n",
+              stderr);
+        free(file_name);
+        telephone_book_record_list_free(record_list);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name, record_list, removed_record_list, ids */
+    id_count = parse_record_ids(argc, argv, &ids, stdout);
+    
+    if (id_count < 0)
+    {
+        fputs(ERROR "Cannot allocate memory for the record IDs.\n", stderr);
+        free(file_name);
+        telephone_book_record_list_free(removed_record_list);
+        telephone_book_record_list_free(record_list);
+        return EXIT_FAILURE;
+    }
+    
+    /* Remove all the records in one pass over the book: */
+    if (telephone_book_record_list_remove_entries(record_list,
+                                                  ids,
+                                                  id_count,
+                                                  removed_record_list))
+    {
+        fputs(ERROR "Cannot remove the records.\n", stderr);
+        free(ids);
+        free(file_name);
+        telephone_book_record_list_free(removed_record_list);
+        telephone_book_record_list_free(record_list);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name, record_list, removed_record_list */
+    free(ids);
+    
+    if (journal_record_book_change(record_list,
+                                   removed_record_list,
+                                   TELEPHONE_BOOK_JOURNAL_REMOVE,
+                                   file_name))
+    {
+        fputs(ERROR "Cannot update the record book file.\n", stderr);
+        free(file_name);
+        telephone_book_record_list_free(removed_record_list);
+        telephone_book_record_list_free(record_list);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: record_list, removed_record_list */
+    free(file_name); /* We do not need 'file_name' anymore. */
+    
+    print_removed_records(removed_record_list, argc - 2, stdout);
+    
+    /* The removed records may be borrowed from 'record_list', so free them */
+    /* first: */
+    telephone_book_record_list_free(removed_record_list);
+    telephone_book_record_list_free(record_list);
+    return EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+* Handles the command for replacing the record book with a binary book built   *
+* from a text file.                                                            *
+*******************************************************************************/
+static int command_import_records(int argc, char* argv[])
+{
+    char* file_name;
+    FILE* f;
+    telephone_book_record_list* record_list;
+    size_t bad_line_number;
+    
+    if (argc != 3)
+    {
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    f = fopen(argv[2], "r");
+    
+    if (!f)
+    {
+        fprintf(stderr, ERROR "Cannot open the text file '%s'.\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: record_list */
+    record_list = telephone_book_record_list_read_from_file(f,
+                                                            &bad_line_number);
+    fclose(f);
+    
+    if (!record_list && bad_line_number > 0)
+    {
+        fprintf(stderr,
+                ERROR "Malformed record on line %zu of '%s'.\n",
+                bad_line_number,
+                argv[2]);
+        return EXIT_FAILURE;
+    }
+    
+    if (!record_list)
+    {
+        fprintf(stderr, ERROR "Cannot read the text file '%s'.\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    
+    /* Store the book in the order every other command leaves it, keeping */
+    /* the IDs of the file: */
+    if (telephone_book_record_list_fix_ids(record_list, NULL))
+    {
+        fputs(ERROR "Cannot assign the record IDs.\n", stderr);
+        telephone_book_record_list_free(record_list);
+        return EXIT_FAILURE;
+    }
+    
+    telephone_book_record_list_sort(record_list);
+    
+    /* ALLOCATED: record_list, file_name */
+    file_name = get_telephone_record_book_file_path();
+    
+    if (!file_name)
+    {
+        fputs(ERROR
+              "Cannot allocate memory for the telephone book file name.\n",
+              stderr);
+        telephone_book_record_list_free(record_list);
+        return EXIT_FAILURE;
+    }
+    
+    /* The imported book replaces the old one along with its journal: */
+    if (compact_record_book(record_list, file_name, 1))
+    {
+        fprintf(stderr,
+                ERROR "Cannot write the record book file '%s'.\n",
+                file_name);
+        
+        free(file_name);
+        telephone_book_record_list_free(record_list);
+        return EXIT_FAILURE;
+    }
+    
+    printf(INFO "Imported %d records.\n",
+           telephone_book_record_list_size(record_list));
+    
+    free(file_name);
+    telephone_book_record_list_free(record_list);
+    return EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+* Handles the command for writing the record book to a text file.              *
+*******************************************************************************/
+static int command_export_records(int argc, char* argv[])
+{
+    char* file_name;
+    FILE* f;
+    telephone_book_record_list* record_list;
+    int is_binary;
+    int result;
+    
+    if (argc != 3)
+    {
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name */
+    file_name = get_telephone_record_book_file_path();
+    
+    if (!file_name)
+    {
+        fputs(ERROR
+              "Cannot allocate memory for the telephone book file name.\n",
+              stderr);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: file_name, record_list */
+    record_list = load_record_book(file_name, &is_binary);
+    
+    if (!record_list)
+    {
+        fprintf(stderr,
+                ERROR "Cannot read the record book file '%s'.\n",
+                file_name);
+        
+        free(file_name);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: record_list */
+    free(file_name);
+    f = fopen(argv[2], "w");
+    
+    if (!f)
+    {
+        fprintf(stderr, ERROR "Cannot open the text file '%s'.\n", argv[2]);
+        telephone_book_record_list_free(record_list);
+        return EXIT_FAILURE;
+    }
+    
+    result = telephone_book_record_list_write_to_file(record_list, f);
+    
+    if (fclose(f) || result)
+    {
+        fprintf(stderr, ERROR "Cannot write the text file '%s'.\n", argv[2]);
+        telephone_book_record_list_free(record_list);
+        return EXIT_FAILURE;
+    }
+    
+    telephone_book_record_list_free(record_list);
+    return EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+* This structure holds a batch of query lines read by '--queries': the lines,  *
+* their line numbers, the names each one asks for, and their results.          *
+*******************************************************************************/
+typedef struct {
+    char* lines[QUERY_BATCH_SIZE];
+    size_t line_numbers[QUERY_BATCH_SIZE];
+    const char* last_names[QUERY_BATCH_SIZE];
+    const char* first_names[QUERY_BATCH_SIZE];
+    telephone_book_search_result results[QUERY_BATCH_SIZE];
+    int size;
+} query_batch;
+
+/*******************************************************************************
+* Reads the next line of 'f' into '*line', without its line break, growing the *
+* buffer (of '*capacity' bytes) as needed.                                     *
+* ---                                                                          *
+* Returns zero on success, a negative value at the end of the file, and a      *
+* positive value if something fails.                                           *
+*******************************************************************************/
+static int read_query_line(FILE* f, char** line, size_t* capacity)
+{
+    char* new_line;
+    size_t length = 0;
+    
+    for (;;)
+    {
+        if (*capacity - length < 2)
+        {
+            new_line = realloc(*line, 2 * *capacity);
+            
+            if (!new_line)
+            {
+                return 1;
+            }
+            
+            *line = new_line;
+            *capacity *= 2;
+        }
+        
+        if (!fgets(&(*line)[length], (int) (*capacity - length), f))
+        {
+            return ferror(f) ? 1 : length == 0 ? -1 : 0;
+        }
+        
+        length += strlen(&(*line)[length]);
+        
+        if (length > 0 && (*line)[length - 1] == '\n')
+        {
+            (*line)[--length] = '\0';
+            
+            if (length > 0 && (*line)[length - 1] == '\r')
+            {
+                (*line)[--length] = '\0';
+            }
+            
+            return 0;
+        }
+    }
+}
+
+/*******************************************************************************
+* Cuts the next whitespace-separated token out of '*text', and moves '*text'   *
+* past it.                                                                     *
+* ---                                                                          *
+* Returns the token, or NULL if there is none left.                            *
+*******************************************************************************/
+static char* next_query_token(char** text)
+{
+    char* token = *text;
+    
+    while (*token == ' ' || *token == '\t')
+    {
+        ++token;
+    }
+    
+    if (*token == '\0')
+    {
+        *text = token;
+        return NULL;
+    }
+    
+    for (*text = token; **text != '\0' && **text != ' ' && **text != '\t';)
+    {
+        ++*text;
+    }
+    
+    if (**text != '\0')
+    {
+        *(*text)++ = '\0';
+    }
+    
+    return token;
+}
+
+/*******************************************************************************
+* Answers the queries in the batch and prints what they found to 'out', one    *
+* tab-separated line per record.                                               *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int answer_query_batch(telephone_book_search_index* search_index,
+                              query_batch* batch,
+                              FILE* out)
+{
+    telephone_book_search_result* result;
+    telephone_book_record* record;
+    int q;
+    int i;
+    
+    if (telephone_book_search_find_closest_many(search_index,
+                                                batch->last_names,
+                                                batch->first_names,
+                                                batch->size,
+                                                batch->results))
+    {
+        return 1;
+    }
+    
+    for (q = 0; q < batch->size; ++q)
+    {
+        result = &batch->results[q];
+        
+        for (i = 0; i < result->size; ++i)
+        {
+            record = telephone_book_store_record(search_index->store,
+                                                 result->record_indices[i]);
+            fprintf(out,
+                    "%zu\t%zu\t%s\t%s\t%s\t%d\n",
+                    batch->line_numbers[q],
+                    result->limit ? result->distances[i] : result->distance,
+                    record->last_name,
+                    record->first_name,
+                    record->telephone_number,
+                    record->id);
+        }
+    }
+    
+    return ferror(out);
+}
+
+/*******************************************************************************
+* Answers the queries read from 'f' in batches of 'QUERY_BATCH_SIZE' lines.    *
+* Blank lines are skipped; lines with more than two names are reported and     *
+* skipped.                                                                     *
+* ---                                                                          *
+* Returns the exit status of the command.                                      *
+*******************************************************************************/
+static int answer_queries(telephone_book_search_index* search_index, FILE* f)
+{
+    query_batch* batch;
+    char* line;
+    char* text;
+    char* last_name;
+    char* first_name;
+    size_t capacity = INITIAL_QUERY_LINE_CAPACITY;
+    size_t line_number = 0;
+    int status = 0;
+    int is_done = 0;
+    int q;
+    
+    /* ALLOCATED: batch, line */
+    batch = malloc(sizeof *batch);
+    line = malloc(capacity);
+    
+    if (!batch || !line)
+    {
+        fputs(ERROR "Cannot allocate memory for the queries.\n", stderr);
+        free(batch);
+        free(line);
+        return EXIT_FAILURE;
+    }
+    
+    batch->size = 0;
+    
+    for (q = 0; q < QUERY_BATCH_SIZE; ++q)
+    {
+        batch->lines[q] = NULL;
+        telephone_book_search_result_init(&batch->results[q]);
+        telephone_book_search_result_set_limit(&batch->results[q],
+                                               options.top_count);
+    }
+    
+    while (!is_done && !status)
+    {
+        status = read_query_line(f, &line, &capacity);
+        is_done = status < 0;
+        status = status > 0;
+        ++line_number;
+        
+        if (!is_done && !status)
+        {
+            text = line;
+            last_name = next_query_token(&text);
+            first_name = next_query_token(&text);
+            
+            if (!last_name)
+            {
+                continue;
+            }
+            
+            if (next_query_token(&text))
+            {
+                fprintf(stderr,
+                        WARNING "Malformed query on line %zu. Ignored.\n",
+                        line_number);
+                continue;
+            }
+            
+            /* The batch keeps the line the names point into: */
+            batch->lines[batch->size] = line;
+            batch->line_numbers[batch->size] = line_number;
+            batch->last_names[batch->size] =
+                strcmp(last_name, "-") == 0 ? NULL : last_name;
+            batch->first_names[batch->size++] = first_name;
+            capacity = INITIAL_QUERY_LINE_CAPACITY;
+            line = malloc(capacity);
+            status = !line;
+        }
+        
+        if (!status && batch->size > 0 &&
+            (batch->size == QUERY_BATCH_SIZE || is_done))
+        {
+            status = answer_query_batch(search_index, batch, stdout);
+            
+            for (q = 0; q < batch->size; ++q)
+            {
+                free(batch->lines[q]);
+                batch->lines[q] = NULL;
+            }
+            
+            batch->size = 0;
+        }
+    }
+    
+    for (q = 0; q < QUERY_BATCH_SIZE; ++q)
+    {
+        free(batch->lines[q]);
+        telephone_book_search_result_destroy(&batch->results[q]);
+    }
+    
+    free(batch);
+    free(line);
+    
+    if (status)
+    {
+        fputs(ERROR "Cannot answer the queries.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+* Handles the command for answering many queries from one load of the book.    *
+*******************************************************************************/
+static int command_answer_queries(int argc, char* argv[])
+{
+    char* file_name;
+    FILE* f;
+    telephone_book_record_list* record_list;
+    telephone_book_search_index* search_index;
+    int is_binary;
+    int result;
+    
+    if (argc != 3)
+    {
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    f = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "r");
+    
+    if (!f)
+    {
+        fprintf(stderr, ERROR "Cannot open the query file '%s'.\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: f, file_name */
+    file_name = get_telephone_record_book_file_path();
     
     if (!file_name)
     {
-        fputs(ERROR "Cannot allocate memory for the telephone book file name.",
-              stderr);
+        fputs(ERROR
+              "Cannot allocate memory for the telephone book file name.\n",
+              stderr);
+        
+        if (f != stdin)
+        {
+            fclose(f);
+        }
+        
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: f, file_name, record_list */
+    record_list = load_record_book(file_name, &is_binary);
+    
+    if (!record_list)
+    {
+        fprintf(stderr,
+                ERROR "Cannot read the record book file '%s'.\n",
+                file_name);
+        
+        free(file_name);
+        
+        if (f != stdin)
+        {
+            fclose(f);
+        }
+        
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: f, record_list, search_index */
+    free(file_name);
+    search_index = telephone_book_search_index_alloc(
+                                            record_list,
+                                            options.is_search_strategy_chosen ?
+                                            options.search_strategy :
+                                            BATCH_SEARCH_STRATEGY);
+    
+    if (!search_index ||
+        telephone_book_search_index_set_thread_count(search_index,
+                                                     options.thread_count))
+    {
+        fputs(ERROR "Cannot build the search index.\n", stderr);
+        result = EXIT_FAILURE;
+    }
+    else
+    {
+        result = answer_queries(search_index, f);
+    }
+    
+    if (f != stdin)
+    {
+        fclose(f);
+    }
+    
+    telephone_book_search_index_free(search_index);
+    telephone_book_record_list_free(record_list);
+    return result;
+}
+
+#ifndef _WIN32
+/*******************************************************************************
+* This structure holds a change to the resident book that is still to be       *
+* appended to the journal: the added or removed records and the operation.     *
+*******************************************************************************/
+typedef struct pending_change {
+    struct pending_change* next;
+    telephone_book_record_list* records;
+    char operation;
+} pending_change;
+
+/*******************************************************************************
+* This structure holds a search index kept over the resident book between the  *
+* requests. A busy index is in use by a request.                               *
+*******************************************************************************/
+typedef struct {
+    telephone_book_search_index* index;
+    telephone_book_search_strategy strategy;
+    int is_busy;
+} cached_search_index;
+
+/*******************************************************************************
+* This structure holds the record book a server keeps in memory. Requests read *
+* the book under the read side of 'lock' and change it under the write side.   *
+* The search indices are built on demand, at most one per served request, and  *
+* dropped whenever the book changes. The changes are applied to the book at    *
+* once and queued, in the order they were applied, for the 'persister' thread  *
+* that appends them to the journal and compacts it. 'journal_size' is the size *
+* of the journal as of the last append of the server, so that a journal other  *
+* processes have appended to is not dropped.                                   *
+*******************************************************************************/
+typedef struct {
+    telephone_book_record_list* record_list;
+    char* file_name;
+    char* journal_file_name;
+    int is_binary;
+    int is_changed;
+    long journal_size;
+    pthread_rwlock_t lock;
+    cached_search_index indices[SERVER_WORKER_COUNT];
+    pthread_mutex_t index_mutex;
+    pending_change* pending_head;
+    pending_change* pending_tail;
+    pthread_mutex_t pending_mutex;
+    pthread_cond_t pending_changed;
+    int is_stopping;
+    pthread_t persister;
+} resident_book;
+
+/*******************************************************************************
+* Picks an idle search index over the resident book, built for 'strategy'      *
+* unless one already is, and marks it busy. The caller holds the read lock of  *
+* the book.                                                                    *
+* ---                                                                          *
+* Returns the index, or NULL if none is idle or the index cannot be built.     *
+*******************************************************************************/
+static cached_search_index* acquire_search_index(
+                                    resident_book* book,
+                                    telephone_book_search_strategy strategy)
+{
+    cached_search_index* cached = NULL;
+    int i;
+    
+    pthread_mutex_lock(&book->index_mutex);
+    
+    for (i = 0; i < SERVER_WORKER_COUNT; ++i)
+    {
+        if (!book->indices[i].is_busy &&
+            (!cached ||
+             (book->indices[i].index &&
+              book->indices[i].strategy == strategy)))
+        {
+            cached = &book->indices[i];
+        }
+    }
+    
+    if (cached)
+    {
+        cached->is_busy = 1;
+    }
+    
+    pthread_mutex_unlock(&book->index_mutex);
+    
+    if (!cached)
+    {
+        return NULL;
+    }
+    
+    /* The index is built outside the mutex; being busy, it stays ours: */
+    if (cached->index && cached->strategy != strategy)
+    {
+        telephone_book_search_index_free(cached->index);
+        cached->index = NULL;
+    }
+    
+    if (!cached->index)
+    {
+        cached->index = telephone_book_search_index_alloc(book->record_list,
+                                                          strategy);
+        cached->strategy = strategy;
+    }
+    
+    if (!cached->index)
+    {
+        pthread_mutex_lock(&book->index_mutex);
+        cached->is_busy = 0;
+        pthread_mutex_unlock(&book->index_mutex);
+        return NULL;
+    }
+    
+    return cached;
+}
+
+/*******************************************************************************
+* Makes the search index acquired by 'acquire_search_index' idle again.        *
+*******************************************************************************/
+static void release_search_index(resident_book* book,
+                                 cached_search_index* cached)
+{
+    pthread_mutex_lock(&book->index_mutex);
+    cached->is_busy = 0;
+    pthread_mutex_unlock(&book->index_mutex);
+}
+
+/*******************************************************************************
+* Drops the search indices over the resident book once it has changed. The     *
+* caller holds the write lock of the book, so that no index is busy.           *
+*******************************************************************************/
+static void drop_search_indices(resident_book* book)
+{
+    int i;
+    
+    for (i = 0; i < SERVER_WORKER_COUNT; ++i)
+    {
+        telephone_book_search_index_free(book->indices[i].index);
+        book->indices[i].index = NULL;
+    }
+}
+
+/*******************************************************************************
+* Queues the records in 'records' for the journal as operation 'operation'.    *
+* The queue takes over the list. The caller holds the write lock of the book.  *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int queue_record_book_change(resident_book* book,
+                                    telephone_book_record_list* records,
+                                    char operation)
+{
+    pending_change* change;
+    
+    /* ALLOCATED: change */
+    change = malloc(sizeof *change);
+    
+    if (!change)
+    {
+        return 1;
+    }
+    
+    change->next = NULL;
+    change->records = records;
+    change->operation = operation;
+    
+    pthread_mutex_lock(&book->pending_mutex);
+    
+    if (book->pending_tail)
+    {
+        book->pending_tail->next = change;
+    }
+    else
+    {
+        book->pending_head = change;
+    }
+    
+    book->pending_tail = change;
+    pthread_cond_signal(&book->pending_changed);
+    pthread_mutex_unlock(&book->pending_mutex);
+    return 0;
+}
+
+/*******************************************************************************
+* Writes the resident book back to the record book file and drops the journal, *
+* unless the journal has grown since the server last appended to it: another   *
+* process then journaled changes the resident book lacks, and the journal is   *
+* kept. The caller holds the lock of the book and the read lock of 'book'.     *
+* ---                                                                          *
+* Returns zero unless the book cannot be written.                              *
+*******************************************************************************/
+static int compact_resident_book(resident_book* book)
+{
+    if (telephone_book_journal_size(book->journal_file_name) !=
+        book->journal_size)
+    {
+        fputs(WARNING "The record book journal was changed by another "
+              "process, so it is kept.\n", stderr);
+        return 0;
+    }
+    
+    if (compact_record_book(book->record_list,
+                            book->file_name,
+                            book->is_binary))
+    {
+        fputs(ERROR "Cannot update the record book file.\n", stderr);
+        return 1;
+    }
+    
+    book->journal_size = 0;
+    return 0;
+}
+
+/*******************************************************************************
+* Appends the queued changes to the journal until the server stops and the     *
+* queue is drained. Once the journal passes the compaction size, the resident  *
+* book is written back as soon as every change it contains is in the journal.  *
+* Each change is appended, and the book written back, under the lock of the    *
+* book, which the persister is the only thread of the server to take.          *
+*******************************************************************************/
+static void* run_persister(void* argument)
+{
+    resident_book* book = argument;
+    pending_change* change;
+    int is_drained;
+    
+    pthread_mutex_lock(&book->pending_mutex);
+    
+    for (;;)
+    {
+        while (!book->pending_head && !book->is_stopping)
+        {
+            pthread_cond_wait(&book->pending_changed, &book->pending_mutex);
+        }
+        
+        if (!book->pending_head)
+        {
+            break;
+        }
+        
+        change = book->pending_head;
+        book->pending_head = change->next;
+        
+        if (!book->pending_head)
+        {
+            book->pending_tail = NULL;
+        }
+        
+        pthread_mutex_unlock(&book->pending_mutex);
+        
+        if (lock_record_book() ||
+            telephone_book_journal_append(book->journal_file_name,
+                                          change->operation,
+                                          change->records))
+        {
+            fputs(ERROR "Cannot update the record book journal.\n", stderr);
+        }
+        else
+        {
+            book->journal_size =
+                telephone_book_journal_size(book->journal_file_name);
+        }
+        
+        /* The removed records may be borrowed from the book, which outlives */
+        /* this thread: */
+        telephone_book_record_list_free(change->records);
+        free(change);
+        
+        if (telephone_book_journal_needs_compaction(book->journal_file_name))
+        {
+            pthread_rwlock_rdlock(&book->lock);
+            pthread_mutex_lock(&book->pending_mutex);
+            is_drained = book->pending_head == NULL;
+            pthread_mutex_unlock(&book->pending_mutex);
+            
+            /* Changes still queued are in the book but not in the journal, */
+            /* so the journal must not be dropped yet: */
+            if (is_drained)
+            {
+                compact_resident_book(book);
+            }
+            
+            pthread_rwlock_unlock(&book->lock);
+        }
+        
+        unlock_record_book();
+        pthread_mutex_lock(&book->pending_mutex);
+    }
+    
+    pthread_mutex_unlock(&book->pending_mutex);
+    return NULL;
+}
+
+/*******************************************************************************
+* Serves a listing request from the resident book. The listing is rendered in  *
+* memory and only sent once the book is unlocked, so that a client slow to     *
+* take in the response keeps no writer waiting.                                *
+*******************************************************************************/
+static int serve_list_request(resident_book* book,
+                              const command_options* request_options,
+                              int argc,
+                              char* argv[],
+                              FILE* out)
+{
+    cached_search_index* cached;
+    char* last_name;
+    char* first_name;
+    char* response = NULL;
+    size_t response_size = 0;
+    FILE* response_stream;
+    int result;
+    
+    get_query_names(argc, argv, &last_name, &first_name);
+    
+    /* ALLOCATED: response_stream, response */
+    response_stream = open_memstream(&response, &response_size);
+    
+    if (!response_stream)
+    {
+        fputs(ERROR "Cannot allocate memory for the response.\n", out);
+        return EXIT_FAILURE;
+    }
+    
+    pthread_rwlock_rdlock(&book->lock);
+    cached = acquire_search_index(book, request_options->search_strategy);
+    
+    if (!cached)
+    {
+        pthread_rwlock_unlock(&book->lock);
+        fclose(response_stream);
+        free(response);
+        fputs(ERROR "Cannot build the search index.\n", out);
+        return EXIT_FAILURE;
+    }
+    
+    result = list_closest_records(cached->index,
+                                  request_options,
+                                  last_name,
+                                  first_name,
+                                  response_stream,
+                                  response_stream);
+    
+    release_search_index(book, cached);
+    pthread_rwlock_unlock(&book->lock);
+    
+    if (fclose(response_stream))
+    {
+        free(response);
+        fputs(ERROR "Cannot allocate memory for the response.\n", out);
+        return EXIT_FAILURE;
+    }
+    
+    fwrite(response, 1, response_size, out);
+    free(response);
+    return result;
+}
+
+/*******************************************************************************
+* Serves a request for adding a new record to the resident book.               *
+*******************************************************************************/
+static int serve_add_request(resident_book* book, char* argv[], FILE* out)
+{
+    telephone_book_record_list* added_record_list;
+    telephone_book_record* record;
+    int id;
+    
+    if (check_added_record_fields(argv, out))
+    {
         return EXIT_FAILURE;
     }
     
-    f = fopen(file_name, "r");
+    /* ALLOCATED: added_record_list */
+    added_record_list = telephone_book_record_list_alloc();
     
-    if (!f)
+    if (!added_record_list)
     {
-        fprintf(stderr,
-                ERROR "Cannot open the record book file '%s'.\n",
-                file_name);
-        
-        free(file_name);
+        fputs(ERROR "Cannot allocate memory for the new record.\n", out);
         return EXIT_FAILURE;
     }
     
-    /* ALLOCATED: file_name, record_list */
-    record_list = telephone_book_record_list_read_from_file(f);
-    fclose(f);
+    pthread_rwlock_wrlock(&book->lock);
+    id = telephone_book_record_list_allocate_id(book->record_list);
     
-    if (!record_list)
+    /* ALLOCATED: added_record_list, record */
+    record = id < 1 ? NULL :
+             telephone_book_record_alloc(argv[2], argv[3], argv[4], id);
+    
+    if (!record ||
+        telephone_book_record_list_add_record(added_record_list, record))
     {
-        fputs(ERROR "Cannot read the record book file.", stderr);
-        free(file_name);
+        pthread_rwlock_unlock(&book->lock);
+        fputs(ERROR "Cannot allocate memory for the new record.\n", out);
+        telephone_book_record_list_free(added_record_list);
+        telephone_book_record_free(record);
         return EXIT_FAILURE;
     }
     
-    /* ALLOCATED: file_name, record_list, removed_record_list */
+    if (telephone_book_record_list_append(book->record_list,
+                                          argv[2],
+                                          argv[3],
+                                          argv[4],
+                                          id))
+    {
+        pthread_rwlock_unlock(&book->lock);
+        fputs(ERROR "Cannot add the new entry to the record book.\n", out);
+        telephone_book_record_list_free(added_record_list);
+        return EXIT_FAILURE;
+    }
+    
+    /* The new record is merged into place; if fails, silently ignore: */
+    telephone_book_record_list_sort(book->record_list);
+    drop_search_indices(book);
+    book->is_changed = 1;
+    
+    /* ALLOCATED: (queued) added_record_list */
+    if (queue_record_book_change(book,
+                                 added_record_list,
+                                 TELEPHONE_BOOK_JOURNAL_ADD))
+    {
+        pthread_rwlock_unlock(&book->lock);
+        fputs(ERROR "Cannot update the record book file.\n", out);
+        telephone_book_record_list_free(added_record_list);
+        return EXIT_FAILURE;
+    }
+    
+    pthread_rwlock_unlock(&book->lock);
+    fprintf(out, INFO "Added the record with ID %d.\n", id);
+    return EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+* Serves a request for removing records from the resident book.                *
+*******************************************************************************/
+static int serve_remove_request(resident_book* book,
+                                int argc,
+                                char* argv[],
+                                FILE* out)
+{
+    telephone_book_record_list* removed_record_list;
+    int* ids;
+    int id_count;
+    
+    if (argc < 3)
+    {
+        fputs(WARNING "No record IDs given. Nothing to remove.\n", out);
+        return EXIT_SUCCESS;
+    }
+    
+    /* ALLOCATED: removed_record_list */
     removed_record_list = telephone_book_record_list_alloc();
     
     if (!removed_record_list)
     {
-        fputs(ERROR "Cannot allocate memory for the list of removed records.",
-              stderr);
-        free(file_name);
-        telephone_book_record_list_free(record_list);
+        fputs(ERROR
+              "Cannot allocate memory for the list of removed records.\n",
+              out);
         return EXIT_FAILURE;
     }
     
-    /* Even if the following two functions fail, proceed further. */
-    telephone_book_record_list_sort(record_list);
-    telephone_book_record_list_fix_ids(record_list);
+    /* ALLOCATED: removed_record_list, ids */
+    id_count = parse_record_ids(argc, argv, &ids, out);
     
-    f = fopen(file_name, "w");
+    if (id_count < 0)
+    {
+        fputs(ERROR "Cannot allocate memory for the record IDs.\n", out);
+        telephone_book_record_list_free(removed_record_list);
+        return EXIT_FAILURE;
+    }
     
-    /* ALLOCATED: record_list, removed_record_list */
-    free(file_name); /* We do not need 'file_name' anymore. */
+    pthread_rwlock_wrlock(&book->lock);
     
-    if (!f)
+    if (telephone_book_record_list_remove_entries(book->record_list,
+                                                  ids,
+                                                  id_count,
+                                                  removed_record_list))
     {
-        fputs(ERROR "Cannot open the record book file for writing.", stderr);
-        telephone_book_record_list_free(record_list);
+        pthread_rwlock_unlock(&book->lock);
+        fputs(ERROR "Cannot remove the records.\n", out);
+        free(ids);
         telephone_book_record_list_free(removed_record_list);
         return EXIT_FAILURE;
     }
     
-    for (arg_index = 2; arg_index < argc; ++arg_index)
+    /* ALLOCATED: removed_record_list */
+    free(ids);
+    
+    /* The list goes to the journal, so it is reported while it is ours: */
+    print_removed_records(removed_record_list, argc - 2, out);
+    
+    if (telephone_book_record_list_size(removed_record_list) == 0)
+    {
+        pthread_rwlock_unlock(&book->lock);
+        telephone_book_record_list_free(removed_record_list);
+        return EXIT_SUCCESS;
+    }
+    
+    drop_search_indices(book);
+    book->is_changed = 1;
+    
+    if (queue_record_book_change(book,
+                                 removed_record_list,
+                                 TELEPHONE_BOOK_JOURNAL_REMOVE))
+    {
+        pthread_rwlock_unlock(&book->lock);
+        fputs(ERROR "Cannot update the record book file.\n", out);
+        telephone_book_record_list_free(removed_record_list);
+        return EXIT_FAILURE;
+    }
+    
+    pthread_rwlock_unlock(&book->lock);
+    return EXIT_SUCCESS;
+}
+
+/*******************************************************************************
+* Serves a command line sent by a client, see 'telephone_book_server_handler'. *
+* The client only sends the commands listed here, with well-formed options.    *
+*******************************************************************************/
+static int serve_request(void* context, int argc, char* argv[], FILE* out)
+{
+    resident_book* book = context;
+    command_options request_options = DEFAULT_OPTIONS;
+    
+    if (parse_search_options(&argc, argv, &request_options, out))
+    {
+        return EXIT_FAILURE;
+    }
+    
+    if (!request_options.is_search_strategy_chosen)
+    {
+        request_options.search_strategy = SERVED_SEARCH_STRATEGY;
+    }
+    
+    if (argc == 1)
     {
-        if (sscanf(argv[arg_index], "%d", &id) != 1)
+        return serve_list_request(book, &request_options, argc, argv, out);
+    }
+    
+    if (strcmp(argv[1], OPTION_ADD_SHORT) == 0 ||
+        strcmp(argv[1], OPTION_ADD_LONG) == 0)
+    {
+        if (argc != 5)
         {
-            printf(WARNING "Bad ID = \'%s\'. Ignored.\n", argv[arg_index]);
-            continue;
+            fputs(ERROR "Bad record to add.\n", out);
+            return EXIT_FAILURE;
         }
         
-        removed_record = telephone_book_record_list_remove_entry(record_list,
-                                                                 id);
-        
-        if (removed_record)
-        {
-            telephone_book_record_list_add_record(removed_record_list,
-                                                  removed_record);
-        }
+        return serve_add_request(book, argv, out);
     }
     
-    if (telephone_book_record_list_write_to_file(record_list, f))
+    if (strcmp(argv[1], OPTION_REMOVE_SHORT) == 0 ||
+        strcmp(argv[1], OPTION_REMOVE_LONG) == 0)
     {
-        fputs(ERROR "Cannot update the record book file.", stderr);
-        telephone_book_record_list_free(record_list);
-        telephone_book_record_list_free(removed_record_list);
-        fclose(f);
+        return serve_remove_request(book, argc, argv, out);
+    }
+    
+    if (strcmp(argv[1], OPTION_HELP_SHORT) == 0 ||
+        strcmp(argv[1], OPTION_HELP_LONG) == 0 ||
+        strcmp(argv[1], OPTION_IMPORT_LONG) == 0 ||
+        strcmp(argv[1], OPTION_EXPORT_LONG) == 0 ||
+        strcmp(argv[1], OPTION_SERVE_LONG) == 0 ||
+        strcmp(argv[1], OPTION_QUERIES_LONG) == 0)
+    {
+        fprintf(out, ERROR "The command '%s' is not served.\n", argv[1]);
         return EXIT_FAILURE;
     }
     
-    fclose(f);
+    return serve_list_request(book, &request_options, argc, argv, out);
+}
+
+/*******************************************************************************
+* Handles the command for serving the record book from memory until the        *
+* process is interrupted.                                                      *
+*******************************************************************************/
+static int command_serve(int argc, char* argv[])
+{
+    resident_book book;
+    char* socket_file_name;
+    int listener_fd = -1;
+    int result = EXIT_SUCCESS;
+    int i;
+    
+    if (argc != 2)
+    {
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
     
-    printf(INFO "Number of records to remove: %d, removed: %d.\n",
-           argc - 2,
-           telephone_book_record_list_size(removed_record_list));
+    memset(&book, 0, sizeof book);
     
-    if (telephone_book_record_list_size(removed_record_list) == 0)
+    /* ALLOCATED: book.file_name, book.journal_file_name, socket_file_name */
+    book.file_name = get_telephone_record_book_file_path();
+    book.journal_file_name = get_telephone_record_book_journal_file_path();
+    socket_file_name = get_telephone_record_book_socket_file_path();
+    
+    if (!book.file_name || !book.journal_file_name || !socket_file_name)
     {
-        puts(INFO "Nothing to remove.");
-        telephone_book_record_list_free(removed_record_list);
-        telephone_book_record_list_free(record_list);
-        return EXIT_SUCCESS;
+        fputs(ERROR
+              "Cannot allocate memory for the telephone book file name.\n",
+              stderr);
+        free(book.file_name);
+        free(book.journal_file_name);
+        free(socket_file_name);
+        return EXIT_FAILURE;
     }
     
-    puts(INFO "List of removed entries:");
-    current_node = removed_record_list->head;
-    removed_record_format =
-        get_removed_record_output_format_string(removed_record_list);
+    /* Until the server listens, a command of another process would change */
+    /* the book behind its back, so the lock is held from the load on: */
+    if (lock_record_book())
+    {
+        free(book.file_name);
+        free(book.journal_file_name);
+        free(socket_file_name);
+        return EXIT_FAILURE;
+    }
     
-    while (current_node)
+    /* ALLOCATED: book.file_name, book.journal_file_name, socket_file_name, */
+    /*            book.record_list, listener_fd */
+    book.record_list = load_record_book(book.file_name, &book.is_binary);
+    
+    if (book.record_list)
     {
-        if (removed_record_format)
+        book.journal_size = telephone_book_journal_size(book.journal_file_name);
+        listener_fd = telephone_book_server_listen(socket_file_name);
+    }
+    
+    unlock_record_book();
+    
+    if (!book.record_list || listener_fd < 0)
+    {
+        if (!book.record_list)
         {
-            printf(removed_record_format,
-                   current_node->record->last_name,
-                   current_node->record->first_name,
-                   current_node->record->telephone_number,
-                   current_node->record->id);
+            fprintf(stderr,
+                    ERROR "Cannot read the record book file '%s'.\n",
+                    book.file_name);
         }
         else
         {
-            /* Fallback format output: */
-            printf("%s, %s - %s, ID %d\n",
-                   current_node->record->last_name,
-                   current_node->record->first_name,
-                   current_node->record->telephone_number,
-                   current_node->record->id);
+            fprintf(stderr,
+                    ERROR "Cannot listen on '%s'. Is the book already "
+                    "served?\n",
+                    socket_file_name);
         }
         
-        current_node = current_node->next;
+        telephone_book_record_list_free(book.record_list);
+        free(book.file_name);
+        free(book.journal_file_name);
+        free(socket_file_name);
+        return EXIT_FAILURE;
     }
     
-    free(removed_record_format);
-    telephone_book_record_list_free(record_list);
-    telephone_book_record_list_free(removed_record_list);
-    return EXIT_SUCCESS;
+    pthread_rwlock_init(&book.lock, NULL);
+    pthread_mutex_init(&book.index_mutex, NULL);
+    pthread_mutex_init(&book.pending_mutex, NULL);
+    pthread_cond_init(&book.pending_changed, NULL);
+    
+    if (pthread_create(&book.persister, NULL, run_persister, &book))
+    {
+        fputs(ERROR "Cannot start the journal thread.\n", stderr);
+        close(listener_fd);
+        unlink(socket_file_name);
+        result = EXIT_FAILURE;
+    }
+    else
+    {
+        printf(INFO "Serving %d records on '%s'.\n",
+               telephone_book_record_list_size(book.record_list),
+               socket_file_name);
+        fflush(stdout);
+        
+        if (telephone_book_server_run(listener_fd,
+                                      socket_file_name,
+                                      SERVER_WORKER_COUNT,
+                                      serve_request,
+                                      &book))
+        {
+            fprintf(stderr,
+                    ERROR "Cannot serve on '%s'.\n",
+                    socket_file_name);
+            result = EXIT_FAILURE;
+        }
+        
+        pthread_mutex_lock(&book.pending_mutex);
+        book.is_stopping = 1;
+        pthread_cond_signal(&book.pending_changed);
+        pthread_mutex_unlock(&book.pending_mutex);
+        pthread_join(book.persister, NULL);
+        
+        /* Every change is in the journal by now; folding it into the book */
+        /* spares the next load the replay: */
+        if (book.is_changed &&
+            (lock_record_book() || compact_resident_book(&book)))
+        {
+            result = EXIT_FAILURE;
+        }
+        
+        unlock_record_book();
+        
+        puts(INFO "Stopped serving the record book.");
+    }
+    
+    for (i = 0; i < SERVER_WORKER_COUNT; ++i)
+    {
+        telephone_book_search_index_free(book.indices[i].index);
+    }
+    
+    pthread_cond_destroy(&book.pending_changed);
+    pthread_mutex_destroy(&book.pending_mutex);
+    pthread_mutex_destroy(&book.index_mutex);
+    pthread_rwlock_destroy(&book.lock);
+    telephone_book_record_list_free(book.record_list);
+    free(book.file_name);
+    free(book.journal_file_name);
+    free(socket_file_name);
+    return result;
+}
+#else
+/*******************************************************************************
+* Handles the command for serving the record book, which needs Unix domain     *
+* sockets.                                                                     *
+*******************************************************************************/
+static int command_serve(int argc, char* argv[])
+{
+    (void) argc;
+    (void) argv;
+    fputs(ERROR "Serving the record book is not supported here.\n", stderr);
+    return EXIT_FAILURE;
 }
+#endif
 
-int main(int argc, char* argv[]) {
+/*******************************************************************************
+* Dispatches the command given by the arguments left after the leading         *
+* options.                                                                     *
+*******************************************************************************/
+static int run_command(int argc, char* argv[])
+{
     if (argc == 1)
     {
         return command_list_telephone_book_records(argc, argv);
@@ -618,5 +2598,203 @@ int main(int argc, char* argv[]) {
         return command_remove_records(argc, argv);
     }
     
+    if (strcmp(argv[1], OPTION_IMPORT_LONG) == 0)
+    {
+        return command_import_records(argc, argv);
+    }
+    
+    if (strcmp(argv[1], OPTION_EXPORT_LONG) == 0)
+    {
+        return command_export_records(argc, argv);
+    }
+    
+    if (strcmp(argv[1], OPTION_SERVE_LONG) == 0)
+    {
+        return command_serve(argc, argv);
+    }
+    
+    if (strcmp(argv[1], OPTION_QUERIES_LONG) == 0)
+    {
+        return command_answer_queries(argc, argv);
+    }
+    
     return command_list_telephone_book_records(argc, argv);
 }
+
+/*******************************************************************************
+* Runs the changing command given by the arguments left after the leading      *
+* options under the lock of the record book, so that the commands of other     *
+* processes can neither interleave with it nor hand out the same IDs. A server *
+* holds the lock from loading the book until it listens, so one started since  *
+* the command was left to this process is seen here, and the command refused.  *
+*******************************************************************************/
+static int run_locked_command(int argc, char* argv[])
+{
+    char* socket_file_name;
+    int result;
+    
+    if (lock_record_book())
+    {
+        return EXIT_FAILURE;
+    }
+    
+    /* ALLOCATED: socket_file_name */
+    socket_file_name = get_telephone_record_book_socket_file_path();
+    
+    if (socket_file_name && telephone_book_server_is_running(socket_file_name))
+    {
+        fputs(ERROR "The record book server has just started. Try again.\n",
+              stderr);
+        result = EXIT_FAILURE;
+    }
+    else
+    {
+        result = run_command(argc, argv);
+    }
+    
+    free(socket_file_name);
+    unlock_record_book();
+    return result;
+}
+
+/*******************************************************************************
+* Tells whether a server answers the command line 'argv' (after the leading    *
+* options) in place of this process.                                           *
+*******************************************************************************/
+static int is_served_command(int argc, char* argv[])
+{
+    if (argc == 1)
+    {
+        return 1;
+    }
+    
+    if (strcmp(argv[1], OPTION_ADD_SHORT) == 0 ||
+        strcmp(argv[1], OPTION_ADD_LONG) == 0)
+    {
+        return argc == 5;
+    }
+    
+    return strcmp(argv[1], OPTION_HELP_SHORT) != 0 &&
+           strcmp(argv[1], OPTION_HELP_LONG) != 0 &&
+           strcmp(argv[1], OPTION_IMPORT_LONG) != 0 &&
+           strcmp(argv[1], OPTION_EXPORT_LONG) != 0 &&
+           strcmp(argv[1], OPTION_SERVE_LONG) != 0 &&
+           strcmp(argv[1], OPTION_QUERIES_LONG) != 0;
+}
+
+/*******************************************************************************
+* Tells whether the command line 'argv' (after the leading options) changes    *
+* the record book.                                                             *
+*******************************************************************************/
+static int is_changing_command(int argc, char* argv[])
+{
+    return argc > 1 &&
+           (strcmp(argv[1], OPTION_ADD_SHORT) == 0 ||
+            strcmp(argv[1], OPTION_ADD_LONG) == 0 ||
+            strcmp(argv[1], OPTION_REMOVE_SHORT) == 0 ||
+            strcmp(argv[1], OPTION_REMOVE_LONG) == 0 ||
+            strcmp(argv[1], OPTION_IMPORT_LONG) == 0);
+}
+
+/*******************************************************************************
+* Hands the command line 'command_argv' over to the server of the record book, *
+* if one is running. A changing command that cannot be handed over is refused, *
+* since the server would not see the change.                                   *
+* ---                                                                          *
+* Returns zero if the command is left to this process, and a non-zero value if *
+* it is done, storing its exit status in 'status'.                             *
+*******************************************************************************/
+static int forward_command(int command_argc,
+                           char* command_argv[],
+                           int argc,
+                           char* argv[],
+                           int* status)
+{
+    char* socket_file_name;
+    int result;
+    int is_done = 0;
+    
+    /* ALLOCATED: socket_file_name */
+    socket_file_name = get_telephone_record_book_socket_file_path();
+    
+    if (!socket_file_name)
+    {
+        return 0;
+    }
+    
+    /* The allocation report is about this process, so it stays local: */
+    if (is_served_command(argc, argv) && !options.report_allocations)
+    {
+        result = telephone_book_server_forward(socket_file_name,
+                                               command_argc,
+                                               command_argv,
+                                               status);
+        
+        if (result > 0)
+        {
+            fputs(ERROR "The record book server did not answer.\n", stderr);
+            *status = EXIT_FAILURE;
+        }
+        
+        /* No server listening leaves the command to this process: */
+        is_done = result >= 0;
+    }
+    else if (is_changing_command(argc, argv) &&
+             telephone_book_server_is_running(socket_file_name))
+    {
+        fputs(ERROR "The record book is being served. Stop the server "
+              "first.\n", stderr);
+        *status = EXIT_FAILURE;
+        is_done = 1;
+    }
+    
+    free(socket_file_name);
+    return is_done;
+}
+
+int main(int argc, char* argv[]) {
+    char** command_argv;
+    int command_argc = argc;
+    int result;
+    
+    options = DEFAULT_OPTIONS;
+    
+    /* ALLOCATED: command_argv */
+    command_argv = malloc((argc + 1) * sizeof *command_argv);
+    
+    if (!command_argv)
+    {
+        fputs(ERROR "Cannot allocate memory for the arguments.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    
+    /* The options are parsed here and again by a server: */
+    memcpy(command_argv, argv, (argc + 1) * sizeof *command_argv);
+    
+    if (parse_search_options(&argc, argv, &options, stderr))
+    {
+        free(command_argv);
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    if (forward_command(command_argc, command_argv, argc, argv, &result))
+    {
+        free(command_argv);
+        return result;
+    }
+    
+    free(command_argv);
+    result = is_changing_command(argc, argv) ?
+             run_locked_command(argc, argv) :
+             run_command(argc, argv);
+    
+    if (options.report_allocations)
+    {
+        fprintf(stderr,
+                INFO "Record heap allocations: %zu.\n",
+                telephone_book_allocation_count());
+    }
+    
+    return result;
+}
@@ -1,10 +1,27 @@
 #include "telephone_book.h"
+#include "telephone_book_counter.h"
+#include "telephone_book_store.h"
 #include "telephone_book_utils.h"
+#include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
+/* The heap blocks allocated by this module: */
+static size_t allocation_count = 0;
+
+/*******************************************************************************
+* This structure holds an ID to remove, the position where it first appears in *
+* the request, and the record removed for it, if any.                          *
+*******************************************************************************/
+typedef struct {
+    int id;
+    int position;
+    telephone_book_record* removed_record;
+} removal;
+
 /*******************************************************************************
 * Documentation comments may be found in telephone_book.h                      *
 *******************************************************************************/
@@ -33,8 +50,10 @@ telephone_book_record_list_node_alloc(telephone_book_record* record)
         return NULL;
     }
     
+    TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 1);
     node->record = record;
     node->next = NULL;
+    node->is_borrowed = 0;
     
     return node;
 }
@@ -55,6 +74,10 @@ telephone_book_record* telephone_book_record_alloc(const char* last_name,
     record->first_name       = malloc(strlen(first_name) + 1);
     record->telephone_number = malloc(strlen(phone_number) + 1);
     record->id = id;
+    TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 4);
+    record->is_borrowed = 0;
+    record->last_name_id = -1;
+    record->first_name_id = -1;
     
     strcpy(record->last_name, last_name);
     strcpy(record->first_name, first_name);
@@ -63,9 +86,30 @@ telephone_book_record* telephone_book_record_alloc(const char* last_name,
     return record;
 }
 
+int telephone_book_record_is_valid_field(const char* field)
+{
+    size_t length;
+    
+    if (!field)
+    {
+        return 0;
+    }
+    
+    for (length = 0; field[length]; ++length)
+    {
+        if (isspace((unsigned char) field[length]) ||
+            length == TELEPHONE_BOOK_MAX_FIELD_LENGTH)
+        {
+            return 0;
+        }
+    }
+    
+    return length > 0;
+}
+
 void telephone_book_record_free(telephone_book_record* record)
 {
-    if (!record)
+    if (!record || record->is_borrowed)
     {
         return;
     }
@@ -85,12 +129,194 @@ telephone_book_record_list* telephone_book_record_list_alloc()
         return NULL;
     }
     
+    TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 1);
     record_list->head = NULL;
     record_list->tail = NULL;
     record_list->size = 0;
+    record_list->next_id = 1;
+    record_list->arena = NULL;
+    record_list->names = NULL;
+    record_list->id_index = NULL;
+    record_list->storage = NULL;
+    record_list->storage_free = NULL;
     return record_list;
 }
 
+telephone_book_record_list* telephone_book_record_list_alloc_arena()
+{
+    telephone_book_record_list* record_list =
+        telephone_book_record_list_alloc();
+    
+    if (!record_list)
+    {
+        return NULL;
+    }
+    
+    record_list->arena =
+        telephone_book_arena_alloc(TELEPHONE_BOOK_ARENA_DEFAULT_BLOCK_SIZE);
+    
+    record_list->names = telephone_book_intern_table_alloc();
+    
+    if (!record_list->arena || !record_list->names)
+    {
+        telephone_book_record_list_free(record_list);
+        return NULL;
+    }
+    
+    return record_list;
+}
+
+static void link_tail_node(telephone_book_record_list* list,
+                           telephone_book_record_list_node* new_node)
+{
+    /* A repeated ID makes the index useless, so drop it in that case: */
+    if (list->id_index && telephone_book_id_index_add(list->id_index,
+                                                      new_node->record->id,
+                                                      new_node,
+                                                      list->tail))
+    {
+        telephone_book_record_list_drop_id_index(list);
+    }
+    
+    if (list->head)
+    {
+        list->tail->next = new_node;
+    }
+    else
+    {
+        list->head = new_node;
+    }
+    
+    list->tail = new_node;
+    list->size++;
+}
+
+/*******************************************************************************
+* Returns the canonical copy of the name 'name' in the arena of the list,      *
+* making it if the name is new, and stores its ID in 'name_id'.                *
+* ---                                                                          *
+* Returns NULL if the name could not be interned.                              *
+*******************************************************************************/
+static char* intern_name(telephone_book_record_list* list,
+                         const char* name,
+                         int* name_id)
+{
+    size_t length = strlen(name);
+    char* copy;
+    
+    *name_id = telephone_book_intern_table_find(list->names, name, length);
+    
+    if (*name_id >= 0)
+    {
+        /* The canonical copies are carved from the arena, so are writable: */
+        return (char*) list->names->names[*name_id];
+    }
+    
+    copy = telephone_book_arena_allocate(list->arena, length + 1);
+    
+    if (!copy)
+    {
+        return NULL;
+    }
+    
+    memcpy(copy, name, length + 1);
+    *name_id = telephone_book_intern_table_add(list->names, copy, length);
+    return *name_id >= 0 ? copy : NULL;
+}
+
+int telephone_book_record_list_append(telephone_book_record_list* list,
+                                      const char* last_name,
+                                      const char* first_name,
+                                      const char* phone_number,
+                                      int id)
+{
+    telephone_book_record* record;
+    telephone_book_record_list_node* node;
+    size_t phone_number_size;
+    
+    if (!list)
+    {
+        return 1;
+    }
+    
+    if (!list->arena)
+    {
+        record = telephone_book_record_alloc(last_name,
+                                             first_name,
+                                             phone_number,
+                                             id);
+        
+        if (telephone_book_record_list_add_record(list, record))
+        {
+            telephone_book_record_free(record);
+            return 1;
+        }
+        
+        return 0;
+    }
+    
+    phone_number_size = strlen(phone_number) + 1;
+    
+    /* The record and node share one carving, the telephone number takes */
+    /* another, and the names are shared with the earlier records: */
+    record = telephone_book_arena_allocate(list->arena,
+                                           sizeof *record + sizeof *node);
+    
+    if (!record)
+    {
+        return 1;
+    }
+    
+    record->telephone_number = telephone_book_arena_allocate(list->arena,
+                                                             phone_number_size);
+    
+    record->last_name = intern_name(list, last_name, &record->last_name_id);
+    record->first_name = intern_name(list, first_name, &record->first_name_id);
+    
+    if (!record->telephone_number || !record->last_name || !record->first_name)
+    {
+        return 1;
+    }
+    
+    node = (telephone_book_record_list_node*) (record + 1);
+    
+    memcpy(record->telephone_number, phone_number, phone_number_size);
+    record->id = id;
+    record->is_borrowed = 1;
+    
+    node->record = record;
+    node->next = NULL;
+    node->is_borrowed = 1;
+    
+    link_tail_node(list, node);
+    return 0;
+}
+
+int telephone_book_record_list_intern_borrowed_name(
+                                        telephone_book_record_list* list,
+                                        char** name,
+                                        int* name_id)
+{
+    size_t length;
+    
+    if (!list || !list->names)
+    {
+        return 1;
+    }
+    
+    length = strlen(*name);
+    *name_id = telephone_book_intern_table_find(list->names, *name, length);
+    
+    if (*name_id >= 0)
+    {
+        *name = (char*) list->names->names[*name_id];
+        return 0;
+    }
+    
+    *name_id = telephone_book_intern_table_add(list->names, *name, length);
+    return *name_id < 0;
+}
+
 int telephone_book_record_list_add_record(telephone_book_record_list* list,
                                           telephone_book_record* record)
 {
@@ -108,18 +334,137 @@ int telephone_book_record_list_add_record(telephone_book_record_list* list,
         return 1;
     }
     
-    if (list->head)
+    link_tail_node(list, new_node);
+    return 0;
+}
+
+/*******************************************************************************
+* Returns the ID index of the list, building it first if needed.               *
+* ---                                                                          *
+* Returns NULL if the IDs of the list repeat or something fails.               *
+*******************************************************************************/
+static telephone_book_id_index* use_id_index(telephone_book_record_list* list)
+{
+    telephone_book_record_list_node* previous_node = NULL;
+    telephone_book_record_list_node* current_node;
+    
+    if (list->id_index)
     {
-        list->tail->next = new_node;
+        return list->id_index;
+    }
+    
+    list->id_index = telephone_book_id_index_alloc(list->size > 0 ?
+                                                   (size_t) list->size : 0);
+    
+    if (!list->id_index)
+    {
+        return NULL;
+    }
+    
+    for (current_node = list->head;
+         current_node;
+         current_node = current_node->next)
+    {
+        if (telephone_book_id_index_add(list->id_index,
+                                        current_node->record->id,
+                                        current_node,
+                                        previous_node))
+        {
+            telephone_book_record_list_drop_id_index(list);
+            return NULL;
+        }
+        
+        previous_node = current_node;
+    }
+    
+    return list->id_index;
+}
+
+/*******************************************************************************
+* Unlinks the node in the slot 'slot' of the ID index of the list, and keeps   *
+* the index up to date.                                                        *
+* ---                                                                          *
+* Returns the record of the unlinked node.                                     *
+*******************************************************************************/
+static telephone_book_record*
+unlink_indexed_node(telephone_book_record_list* list,
+                    telephone_book_id_index_slot* slot)
+{
+    telephone_book_record_list_node* node = slot->node;
+    telephone_book_record_list_node* previous_node = slot->previous_node;
+    telephone_book_record_list_node* next_node = node->next;
+    telephone_book_record* record = node->record;
+    
+    if (previous_node)
+    {
+        previous_node->next = next_node;
     }
     else
     {
-        list->head = new_node;
+        list->head = next_node;
     }
     
-    list->tail = new_node;
-    list->size++;
-    return 0;
+    if (next_node)
+    {
+        telephone_book_id_index_find(list->id_index,
+                                     next_node->record->id)->previous_node =
+            previous_node;
+    }
+    else
+    {
+        list->tail = previous_node;
+    }
+    
+    telephone_book_id_index_remove(list->id_index, record->id);
+    list->size--;
+    
+    if (!node->is_borrowed)
+    {
+        free(node);
+    }
+    
+    return record;
+}
+
+telephone_book_record*
+telephone_book_record_list_find_entry(telephone_book_record_list* list, int id)
+{
+    telephone_book_record_list_node* current_node;
+    telephone_book_id_index_slot* slot;
+    
+    if (!list)
+    {
+        return NULL;
+    }
+    
+    if (use_id_index(list))
+    {
+        slot = telephone_book_id_index_find(list->id_index, id);
+        return slot ? slot->node->record : NULL;
+    }
+    
+    for (current_node = list->head;
+         current_node;
+         current_node = current_node->next)
+    {
+        if (current_node->record->id == id)
+        {
+            return current_node->record;
+        }
+    }
+    
+    return NULL;
+}
+
+void telephone_book_record_list_drop_id_index(telephone_book_record_list* list)
+{
+    if (!list)
+    {
+        return;
+    }
+    
+    telephone_book_id_index_free(list->id_index);
+    list->id_index = NULL;
 }
 
 telephone_book_record*
@@ -130,12 +475,19 @@ telephone_book_record_list_remove_entry(telephone_book_record_list* list,
     telephone_book_record_list_node* current_node;
     telephone_book_record_list_node* next_node;
     telephone_book_record* removed_record;
+    telephone_book_id_index_slot* slot;
     
     if (!list)
     {
         return NULL;
     }
     
+    if (use_id_index(list))
+    {
+        slot = telephone_book_id_index_find(list->id_index, id);
+        return slot ? unlink_indexed_node(list, slot) : NULL;
+    }
+    
     previous_node = NULL;
     current_node = list->head;
     
@@ -161,8 +513,14 @@ telephone_book_record_list_remove_entry(telephone_book_record_list* list,
                 list->tail = previous_node;
             }
             
+            list->size--;
             removed_record = current_node->record;
-            free(current_node);
+            
+            if (!current_node->is_borrowed)
+            {
+                free(current_node);
+            }
+            
             return removed_record;
         }
         
@@ -173,6 +531,215 @@ telephone_book_record_list_remove_entry(telephone_book_record_list* list,
     return NULL;
 }
 
+static int removal_id_cmp(const void* pa, const void* pb)
+{
+    const removal* a = pa;
+    const removal* b = pb;
+    
+    if (a->id != b->id)
+    {
+        return (a->id > b->id) - (a->id < b->id);
+    }
+    
+    return (a->position > b->position) - (a->position < b->position);
+}
+
+static int removal_position_cmp(const void* pa, const void* pb)
+{
+    const removal* a = pa;
+    const removal* b = pb;
+    
+    return (a->position > b->position) - (a->position < b->position);
+}
+
+/*******************************************************************************
+* Returns the removal for 'id' in the 'size' removals sorted by ID, or NULL.   *
+*******************************************************************************/
+static removal* find_removal(removal* removals, int size, int id)
+{
+    int low = 0;
+    int high = size - 1;
+    int middle;
+    
+    while (low <= high)
+    {
+        middle = low + (high - low) / 2;
+        
+        if (removals[middle].id < id)
+        {
+            low = middle + 1;
+        }
+        else if (removals[middle].id > id)
+        {
+            high = middle - 1;
+        }
+        else
+        {
+            return &removals[middle];
+        }
+    }
+    
+    return NULL;
+}
+
+int telephone_book_record_list_remove_entries(
+                                    telephone_book_record_list* list,
+                                    const int* ids,
+                                    int id_count,
+                                    telephone_book_record_list* removed_list)
+{
+    telephone_book_record_list_node* previous_node;
+    telephone_book_record_list_node* current_node;
+    telephone_book_record_list_node* next_node;
+    telephone_book_id_index_slot* slot;
+    removal* removals;
+    removal* match;
+    int removal_count;
+    int status = 0;
+    int i;
+    
+    if (!list || !removed_list || (id_count > 0 && !ids) || id_count < 0)
+    {
+        return 1;
+    }
+    
+    /* ALLOCATED: removals */
+    removals = malloc((id_count + 1) * sizeof *removals);
+    
+    if (!removals)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i < id_count; ++i)
+    {
+        removals[i].id = ids[i];
+        removals[i].position = i;
+        removals[i].removed_record = NULL;
+    }
+    
+    /* Sort by ID and keep the first occurrence of each: */
+    qsort(removals, id_count, sizeof *removals, removal_id_cmp);
+    removal_count = 0;
+    
+    for (i = 0; i < id_count; ++i)
+    {
+        if (removal_count == 0 ||
+            removals[removal_count - 1].id != removals[i].id)
+        {
+            removals[removal_count++] = removals[i];
+        }
+    }
+    
+    /* Find the records first, so that a failure below changes nothing: */
+    if (use_id_index(list))
+    {
+        for (i = 0; i < removal_count; ++i)
+        {
+            slot = telephone_book_id_index_find(list->id_index,
+                                                removals[i].id);
+            
+            removals[i].removed_record = slot ? slot->node->record : NULL;
+        }
+    }
+    else
+    {
+        for (current_node = list->head;
+             current_node;
+             current_node = current_node->next)
+        {
+            match = find_removal(removals,
+                                 removal_count,
+                                 current_node->record->id);
+            
+            if (match && !match->removed_record)
+            {
+                match->removed_record = current_node->record;
+            }
+        }
+    }
+    
+    /* Hand the records over in request order: */
+    qsort(removals, removal_count, sizeof *removals, removal_position_cmp);
+    
+    for (i = 0; i < removal_count && !status; ++i)
+    {
+        if (removals[i].removed_record)
+        {
+            status = telephone_book_record_list_add_record(
+                                                removed_list,
+                                                removals[i].removed_record);
+        }
+    }
+    
+    if (status)
+    {
+        free(removals);
+        return 1;
+    }
+    
+    if (list->id_index)
+    {
+        for (i = 0; i < removal_count; ++i)
+        {
+            if (removals[i].removed_record)
+            {
+                unlink_indexed_node(
+                    list,
+                    telephone_book_id_index_find(list->id_index,
+                                                 removals[i].id));
+            }
+        }
+        
+        free(removals);
+        return 0;
+    }
+    
+    /* Since the IDs are unique, every matching node can now be unlinked: */
+    qsort(removals, removal_count, sizeof *removals, removal_id_cmp);
+    previous_node = NULL;
+    current_node = list->head;
+    
+    while (current_node)
+    {
+        next_node = current_node->next;
+        match = find_removal(removals, removal_count, current_node->record->id);
+        
+        if (match && match->removed_record == current_node->record)
+        {
+            if (previous_node)
+            {
+                previous_node->next = next_node;
+            }
+            else
+            {
+                list->head = next_node;
+            }
+            
+            if (!next_node)
+            {
+                list->tail = previous_node;
+            }
+            
+            list->size--;
+            
+            if (!current_node->is_borrowed)
+            {
+                free(current_node);
+            }
+        }
+        else
+        {
+            previous_node = current_node;
+        }
+        
+        current_node = next_node;
+    }
+    
+    free(removals);
+    return 0;
+}
+
 static int record_cmp(const void* pa, const void* pb)
 {
     int c;
@@ -183,91 +750,233 @@ static int record_cmp(const void* pa, const void* pb)
     telephone_book_record_list_node* b =
     *(telephone_book_record_list_node *const *) pb;
     
-    c = strcmp(a->record->last_name, b->record->last_name);
+    /* Interned names that are equal share their address: */
+    c = a->record->last_name == b->record->last_name ? 0 :
+        strcmp(a->record->last_name, b->record->last_name);
     
     if (c)
     {
         return c;
     }
     
-    return strcmp(a->record->first_name, b->record->first_name);
+    return a->record->first_name == b->record->first_name ? 0 :
+           strcmp(a->record->first_name, b->record->first_name);
 }
 
-int telephone_book_record_list_sort(telephone_book_record_list* list)
+/*******************************************************************************
+* Merges the sorted runs starting at 'run' and 'new_run' into the list. Ties   *
+* go to 'run', which came first, so that the merge is stable.                  *
+*******************************************************************************/
+static void merge_runs(telephone_book_record_list* list,
+                       telephone_book_record_list_node* run,
+                       telephone_book_record_list_node* new_run)
 {
-    telephone_book_record_list_node** array;
-    telephone_book_record_list_node* current_node;
+    telephone_book_record_list_node sentinel;
+    telephone_book_record_list_node* tail = &sentinel;
     
-    int list_length;
-    int index;
+    while (run && new_run)
+    {
+        if (record_cmp(&run, &new_run) <= 0)
+        {
+            tail->next = run;
+            run = run->next;
+        }
+        else
+        {
+            tail->next = new_run;
+            new_run = new_run->next;
+        }
+        
+        tail = tail->next;
+    }
+    
+    tail->next = run ? run : new_run;
+    
+    while (tail->next)
+    {
+        tail = tail->next;
+    }
+    
+    list->head = sentinel.next;
+    list->tail = tail;
+}
+
+int telephone_book_record_list_sort(telephone_book_record_list* list)
+{
+    telephone_book_record_list_node* run_end;
+    telephone_book_record_list* new_rows;
+    telephone_book_store* store;
+    int status;
     
     if (!list)
     {
         return 1;
     }
     
-    list_length = telephone_book_record_list_size(list);
+    /* Find the sorted run the list starts with: */
+    for (run_end = list->head;
+         run_end && run_end->next && record_cmp(&run_end, &run_end->next) <= 0;
+         run_end = run_end->next)
+    {
+    }
     
-    if (list_length == 0)
+    if (!run_end || !run_end->next)
     {
-        /* Nothing to sort. */
         return 0;
     }
     
-    array = malloc(list_length * sizeof *array);
+    telephone_book_record_list_drop_id_index(list);
+    
+    /* ALLOCATED: new_rows */
+    new_rows = telephone_book_record_list_alloc();
     
-    if (!array)
+    if (!new_rows)
     {
         return 1;
     }
     
-    current_node = list->head;
+    /* Lend the rows after the run to a list of their own, sharing the name */
+    /* IDs, and sort the packed columns rather than chase the pointers: */
+    new_rows->head = run_end->next;
+    new_rows->tail = list->tail;
+    new_rows->names = list->names;
+    run_end->next = NULL;
+    
+    store = telephone_book_store_alloc(new_rows);
+    
+    status = !store ||
+             telephone_book_store_sort(store) ||
+             telephone_book_store_relink(store, new_rows);
     
-    for (index = 0;
-         index < list_length;
-         index++, current_node = current_node->next)
+    /* On failure, the rows are merged back all the same, out of order: */
+    merge_runs(list, list->head, new_rows->head);
+    
+    telephone_book_store_free(store);
+    new_rows->head = NULL;
+    new_rows->names = NULL;
+    telephone_book_record_list_free(new_rows);
+    return status;
+}
+
+int telephone_book_record_list_allocate_id(telephone_book_record_list* list)
+{
+    if (!list || list->next_id < 1 || list->next_id == INT_MAX)
     {
-        array[index] = current_node;
+        return -1;
     }
     
-    qsort(array, list_length, sizeof *array, record_cmp);
+    return list->next_id++;
+}
+
+int telephone_book_record_list_fix_ids(telephone_book_record_list* list,
+                                       int* fixed_count)
+{
+    telephone_book_record_list_node* current_node;
+    telephone_book_record* record;
+    unsigned char* seen_ids;
+    int max_id = 0;
     
-    /* Relink the nodes: */
-    list->head = array[0];
-    list->tail = array[list_length - 1];
+    if (fixed_count)
+    {
+        *fixed_count = 0;
+    }
     
-    list->tail->next = NULL;
+    if (!list)
+    {
+        return 1;
+    }
+    
+    for (current_node = list->head;
+         current_node;
+         current_node = current_node->next)
+    {
+        if (current_node->record->id > max_id)
+        {
+            max_id = current_node->record->id;
+        }
+    }
     
-    for (index = 0; index < list_length - 1; ++index)
+    if (max_id == INT_MAX)
     {
-        array[index]->next = array[index + 1];
+        return 1;
+    }
+    
+    if (list->next_id <= max_id)
+    {
+        list->next_id = max_id + 1;
+    }
+    
+    /* One bit per possible ID; pages no ID falls on are never touched: */
+    /* ALLOCATED: seen_ids */
+    seen_ids = calloc((size_t) max_id / CHAR_BIT + 1, 1);
+    
+    if (!seen_ids)
+    {
+        return 1;
+    }
+    
+    for (current_node = list->head;
+         current_node;
+         current_node = current_node->next)
+    {
+        record = current_node->record;
+        
+        if (record->id > 0 &&
+            !(seen_ids[record->id / CHAR_BIT] & (1u << record->id % CHAR_BIT)))
+        {
+            seen_ids[record->id / CHAR_BIT] |= 1u << record->id % CHAR_BIT;
+            continue;
+        }
+        
+        /* Only the records without an ID of their own change: */
+        record->id = telephone_book_record_list_allocate_id(list);
+        telephone_book_record_list_drop_id_index(list);
+        
+        if (record->id < 0)
+        {
+            free(seen_ids);
+            return 1;
+        }
+        
+        if (fixed_count)
+        {
+            ++*fixed_count;
+        }
     }
     
-    /* Freeing memory! */
-    free(array);
+    free(seen_ids);
     return 0;
 }
 
-int telephone_book_record_list_fix_ids(telephone_book_record_list* list)
+int telephone_book_record_list_is_sorted(telephone_book_record_list* list)
 {
-    int id;
     telephone_book_record_list_node* current_node;
     
     if (!list)
     {
-        return 1;
+        return 0;
     }
     
-    id = 0;
     current_node = list->head;
     
     while (current_node)
     {
-        current_node->record->id = ++id;
+        if (current_node->record->id < 1 ||
+            current_node->record->id >= list->next_id)
+        {
+            return 0;
+        }
+        
+        if (current_node->next && record_cmp(&current_node,
+                                             &current_node->next) > 0)
+        {
+            return 0;
+        }
+        
         current_node = current_node->next;
     }
     
-    return 0;
+    return 1;
 }
 
 void telephone_book_record_list_free(telephone_book_record_list* list)
@@ -286,9 +995,30 @@ void telephone_book_record_list_free(telephone_book_record_list* list)
     {
         next_node = current_node->next;
         telephone_book_record_free(current_node->record);
-        free(current_node);
+        
+        if (!current_node->is_borrowed)
+        {
+            free(current_node);
+        }
+        
         current_node = next_node;
     }
     
+    if (list->storage_free)
+    {
+        list->storage_free(list->storage);
+    }
+    
+    telephone_book_id_index_free(list->id_index);
+    telephone_book_intern_table_free(list->names);
+    telephone_book_arena_free(list->arena);
     free(list);
 }
+
+size_t telephone_book_allocation_count(void)
+{
+    return TELEPHONE_BOOK_COUNTER_READ(allocation_count) +
+           telephone_book_arena_allocation_count() +
+           telephone_book_id_index_allocation_count() +
+           telephone_book_intern_allocation_count();
+}
@@ -1,32 +1,67 @@
 #ifndef TELEPHONE_BOOK_H
 #define TELEPHONE_BOOK_H
 
+#include "telephone_book_arena.h"
+#include "telephone_book_id_index.h"
+#include "telephone_book_intern.h"
+#include <stddef.h>
+
+/*******************************************************************************
+* The longest last name, first name or telephone number a record may have. The *
+* book and journal files separate the fields by whitespace, so a field is also *
+* never empty and never contains whitespace.                                   *
+*******************************************************************************/
+#define TELEPHONE_BOOK_MAX_FIELD_LENGTH 64
+
 /*******************************************************************************
-* This structure holds a single telephone book record.                         *
+* This structure holds a single telephone book record. A borrowed record lives *
+* in storage owned by a record list (for example, a mapped book file), and is  *
+* not freed on its own. The name IDs index the intern table of the list the    *
+* record was loaded into, and are -1 for names that were not interned.         *
 *******************************************************************************/
 typedef struct {
     char* first_name;
     char* last_name;
     char* telephone_number;
     int id;
+    int is_borrowed;
+    int last_name_id;
+    int first_name_id;
 } telephone_book_record;
 
 /*******************************************************************************
 * This structure defines a linked list node for the telephone book record      *
-* list.                                                                        *
+* list. A borrowed node lives in storage owned by the list.                    *
 *******************************************************************************/
 typedef struct telephone_book_record_list_node {
     telephone_book_record* record;
     struct telephone_book_record_list_node* next;
+    int is_borrowed;
 } telephone_book_record_list_node;
 
 /*******************************************************************************
-* This structure holds a doubly-linked list of telephone book records.         *
+* This structure holds a doubly-linked list of telephone book records. The     *
+* optional 'arena' holds borrowed nodes, records and strings, and the optional *
+* 'storage' anything else they point into (such as a mapped file), released by *
+* 'storage_free'. Both go away when the list is freed. An arena-backed list    *
+* has an intern table in 'names' for the names it copies or maps, so that each *
+* distinct name is stored once; the names of a text book point into its        *
+* contents and are not interned. The optional 'id_index' maps record IDs to    *
+* nodes; it is built on the first lookup by ID and kept up to date by adding   *
+* and removing records. 'next_id' is the high-water mark of the record IDs:    *
+* the ID the next new record gets. IDs below it are never handed out again, so *
+* the ID of a record stays the same for as long as the record exists.          *
 *******************************************************************************/
 typedef struct {
     struct telephone_book_record_list_node* head;
     struct telephone_book_record_list_node* tail;
     int size;
+    int next_id;
+    telephone_book_arena* arena;
+    telephone_book_intern_table* names;
+    telephone_book_id_index* id_index;
+    void* storage;
+    void (*storage_free)(void* storage);
 } telephone_book_record_list;
 
 
@@ -47,9 +82,18 @@ telephone_book_record* telephone_book_record_alloc(const char* last_name,
                                                    const char* phone_number,
                                                    int id);
 
+/*******************************************************************************
+* Checks that 'field' can be stored as a field of a record: it is not empty,   *
+* holds no whitespace and is at most 'TELEPHONE_BOOK_MAX_FIELD_LENGTH'         *
+* characters long.                                                             *
+* ---                                                                          *
+* Returns a non-zero value if the field is valid, and zero otherwise.          *
+*******************************************************************************/
+int telephone_book_record_is_valid_field(const char* field);
+
 /*******************************************************************************
 * Frees the memory occupied by the telephone book record: all existing fields  *
-* and the actual record.                                                       *
+* and the actual record. Borrowed records are left to their list.              *
 *******************************************************************************/
 void telephone_book_record_free(telephone_book_record* record);
 
@@ -64,6 +108,42 @@ void telephone_book_record_free(telephone_book_record* record);
 *******************************************************************************/
 telephone_book_record_list* telephone_book_record_list_alloc();
 
+/*******************************************************************************
+* Allocates an empty telephone book record list backed by an arena. The        *
+* records appended by 'telephone_book_record_list_append' are then carved from *
+* a few large blocks and released all at once with the list.                   *
+* ---                                                                          *
+* Returns a new empty telephone book record list or NULL if something goes     *
+* wrong.                                                                       *
+*******************************************************************************/
+telephone_book_record_list* telephone_book_record_list_alloc_arena();
+
+/*******************************************************************************
+* Appends a new record with copies of the given fields to the tail of the      *
+* list. The record and its node come from the arena of the list if it has one, *
+* and from the heap otherwise. In an arena-backed list, the names are interned *
+* and a name seen before shares its earlier copy.                              *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_record_list_append(telephone_book_record_list* list,
+                                      const char* last_name,
+                                      const char* first_name,
+                                      const char* phone_number,
+                                      int id);
+
+/*******************************************************************************
+* Interns the name '*name', which lives in storage owned by the arena-backed   *
+* list, without copying it: a name seen before is replaced by its earlier      *
+* occurrence. The ID of the name is stored in 'name_id'.                       *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_record_list_intern_borrowed_name(
+                                        telephone_book_record_list* list,
+                                        char** name,
+                                        int* name_id);
+
 /*******************************************************************************
 * Appends the argument telephone book record to the tail of the argument       *
 * telephone book record list.                                                  *
@@ -74,8 +154,23 @@ telephone_book_record_list* telephone_book_record_list_alloc();
 int telephone_book_record_list_add_record(telephone_book_record_list* list,
                                           telephone_book_record* record);
 
+/*******************************************************************************
+* Returns the telephone book record that has 'id' as its record ID, or NULL if *
+* there is none. Runs in constant time once the ID index of the list is built, *
+* which the first lookup does unless the IDs of the list repeat.               *
+*******************************************************************************/
+telephone_book_record*
+telephone_book_record_list_find_entry(telephone_book_record_list* list, int id);
+
+/*******************************************************************************
+* Drops the ID index of the list. Must be called after relinking the nodes or  *
+* changing the IDs of the list other than by adding and removing records.      *
+*******************************************************************************/
+void telephone_book_record_list_drop_id_index(telephone_book_record_list* list);
+
 /*******************************************************************************
 * Removes and returns the telephone book record that has 'id' as its record ID.*
+* A borrowed record stays valid until the list it came from is freed.          *
 * ---                                                                          *
 * Returns NULL if something fails or the list does not contain record with ID  *
 * 'id'. Otherwise, a removed record is returned.                               *
@@ -84,9 +179,29 @@ telephone_book_record*
 telephone_book_record_list_remove_entry(telephone_book_record_list* list,
                                         int id);
 
+/*******************************************************************************
+* Removes all the records whose IDs are among the 'id_count' IDs in 'ids',     *
+* through the ID index or else in a single pass over the list, and appends     *
+* them to 'removed_list' in the order in which their IDs first appear in       *
+* 'ids'. IDs matching no record, or repeating an earlier one, are skipped.     *
+* Borrowed records stay valid until the list they came from is freed.          *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails. On         *
+* failure, the list is left unchanged.                                         *
+*******************************************************************************/
+int telephone_book_record_list_remove_entries(
+                                    telephone_book_record_list* list,
+                                    const int* ids,
+                                    int id_count,
+                                    telephone_book_record_list* removed_list);
+
 /*******************************************************************************
 * Sorts the telephone records. The last name of each record is the primary     *
 * sorting key, and the first name of each record is the secondary sorting key. *
+* Records with equal names keep their order. Only the records after the sorted *
+* run the list starts with are sorted, and are then merged into the run in one *
+* pass, so appending records to a sorted list and sorting it again costs time  *
+* linear in the list plus the sorting of the new records.                      *
 * ---                                                                          *
 * Returns zero on success, and a non-zero value if the sorting could not be    *
 * completed.                                                                   *
@@ -94,11 +209,38 @@ telephone_book_record_list_remove_entry(telephone_book_record_list* list,
 int telephone_book_record_list_sort(telephone_book_record_list* list);
 
 /*******************************************************************************
-* Makes sure that each telephone book record has a unique ID.                  *
+* Hands out a fresh record ID from the high-water mark of the list.            *
+* ---                                                                          *
+* Returns the new ID, or -1 if the list or the IDs are exhausted.              *
+*******************************************************************************/
+int telephone_book_record_list_allocate_id(telephone_book_record_list* list);
+
+/*******************************************************************************
+* Makes sure that each telephone book record has a unique ID. Records whose ID *
+* is not positive or repeats that of an earlier record get a fresh ID, and the *
+* high-water mark is raised past every ID in the list. All the other records   *
+* keep their IDs. The number of records given a fresh ID is stored in          *
+* 'fixed_count' unless it is NULL.                                             *
 * ---                                                                          *
 * Returns zero on success, and a non-zero value if something fails.            *
 *******************************************************************************/
-int telephone_book_record_list_fix_ids(telephone_book_record_list* list);
+int telephone_book_record_list_fix_ids(telephone_book_record_list* list,
+                                       int* fixed_count);
+
+/*******************************************************************************
+* Checks in one pass whether the list is already in the order left by          *
+* 'telephone_book_record_list_sort', and all its IDs are positive and below    *
+* the high-water mark.                                                         *
+* ---                                                                          *
+* Returns a non-zero value if both hold, and zero otherwise.                   *
+*******************************************************************************/
+int telephone_book_record_list_is_sorted(telephone_book_record_list* list);
+
+/*******************************************************************************
+* Returns the number of heap blocks allocated so far for records, their        *
+* strings, list nodes, lists, arena blocks and intern tables.                  *
+*******************************************************************************/
+size_t telephone_book_allocation_count(void);
 
 /*******************************************************************************
 * Frees all the memory occupied by the argument telephone book record list.    *
@@ -0,0 +1,109 @@
+#include "telephone_book_arena.h"
+#include "telephone_book_counter.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+* The strictest alignment among the types the arena hands out memory for.      *
+*******************************************************************************/
+typedef union {
+    long l;
+    double d;
+    void* p;
+} arena_alignment;
+
+#define ALIGNMENT (sizeof(arena_alignment))
+#define ALIGN_UP(n) (((n) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+#define BLOCK_HEADER_SIZE ALIGN_UP(sizeof(telephone_book_arena_block))
+
+static size_t allocation_count = 0;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_arena.h                *
+*******************************************************************************/
+
+
+telephone_book_arena* telephone_book_arena_alloc(size_t block_size)
+{
+    telephone_book_arena* arena = malloc(sizeof *arena);
+    
+    if (!arena)
+    {
+        return NULL;
+    }
+    
+    TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 1);
+    arena->head = NULL;
+    arena->block_size = block_size > 0 ? block_size :
+                        TELEPHONE_BOOK_ARENA_DEFAULT_BLOCK_SIZE;
+    return arena;
+}
+
+void* telephone_book_arena_allocate(telephone_book_arena* arena, size_t size)
+{
+    telephone_book_arena_block* block;
+    size_t block_size;
+    
+    if (!arena)
+    {
+        return NULL;
+    }
+    
+    size = ALIGN_UP(size > 0 ? size : 1);
+    block = arena->head;
+    
+    if (!block || block->size - block->used < size)
+    {
+        block_size = size > arena->block_size ? size : arena->block_size;
+        block = malloc(BLOCK_HEADER_SIZE + block_size);
+        
+        if (!block)
+        {
+            return NULL;
+        }
+        
+        TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 1);
+        block->size = block_size;
+        block->used = 0;
+        
+        /* An oversized block is filled at once, so keep carving from the */
+        /* current one: */
+        if (arena->head && block_size > arena->block_size)
+        {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        }
+        else
+        {
+            block->next = arena->head;
+            arena->head = block;
+        }
+    }
+    
+    block->used += size;
+    return (char*) block + BLOCK_HEADER_SIZE + block->used - size;
+}
+
+void telephone_book_arena_free(telephone_book_arena* arena)
+{
+    telephone_book_arena_block* block;
+    telephone_book_arena_block* next_block;
+    
+    if (!arena)
+    {
+        return;
+    }
+    
+    for (block = arena->head; block; block = next_block)
+    {
+        next_block = block->next;
+        free(block);
+    }
+    
+    free(arena);
+}
+
+size_t telephone_book_arena_allocation_count(void)
+{
+    return TELEPHONE_BOOK_COUNTER_READ(allocation_count);
+}
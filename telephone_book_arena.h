@@ -0,0 +1,57 @@
+#ifndef TELEPHONE_BOOK_ARENA_H
+#define TELEPHONE_BOOK_ARENA_H
+
+#include <stddef.h>
+
+/*******************************************************************************
+* The default size of an arena block. Requests larger than a block get a block *
+* of their own.                                                                *
+*******************************************************************************/
+#define TELEPHONE_BOOK_ARENA_DEFAULT_BLOCK_SIZE (1024 * 1024)
+
+/*******************************************************************************
+* This structure holds an arena block. The block bytes follow the header.      *
+*******************************************************************************/
+typedef struct telephone_book_arena_block {
+    struct telephone_book_arena_block* next;
+    size_t size;
+    size_t used;
+} telephone_book_arena_block;
+
+/*******************************************************************************
+* This structure holds a bump allocator. Memory is carved from the newest      *
+* block and only ever released all at once, when the arena is freed.           *
+*******************************************************************************/
+typedef struct {
+    telephone_book_arena_block* head;
+    size_t block_size;
+} telephone_book_arena;
+
+
+
+
+/*******************************************************************************
+* Allocates an empty arena whose blocks hold 'block_size' bytes.               *
+* ---                                                                          *
+* Returns the new arena or NULL if something goes wrong.                       *
+*******************************************************************************/
+telephone_book_arena* telephone_book_arena_alloc(size_t block_size);
+
+/*******************************************************************************
+* Carves 'size' bytes, suitably aligned for any object, out of the arena.      *
+* ---                                                                          *
+* Returns the memory or NULL if a new block could not be allocated.            *
+*******************************************************************************/
+void* telephone_book_arena_allocate(telephone_book_arena* arena, size_t size);
+
+/*******************************************************************************
+* Frees the arena along with everything carved out of it.                      *
+*******************************************************************************/
+void telephone_book_arena_free(telephone_book_arena* arena);
+
+/*******************************************************************************
+* Returns the number of heap blocks allocated by all the arenas so far.        *
+*******************************************************************************/
+size_t telephone_book_arena_allocation_count(void);
+
+#endif /* TELEPHONE_BOOK_ARENA_H */
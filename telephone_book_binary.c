@@ -0,0 +1,470 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "telephone_book_binary.h"
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*******************************************************************************
+* This structure holds the file contents the strings of a list read from a     *
+* binary book point into.                                                      *
+*******************************************************************************/
+typedef struct {
+    void* data;
+    size_t size;
+} binary_storage;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_binary.h               *
+*******************************************************************************/
+
+
+/*******************************************************************************
+* Loads the entire file 'file_name' into memory: mapped where 'mmap' exists,   *
+* read into a heap block otherwise.                                            *
+* ---                                                                          *
+* Returns the file contents and stores their size in 'size', or returns NULL   *
+* if something fails.                                                          *
+*******************************************************************************/
+static void* load_file(const char* file_name, size_t* size)
+{
+#ifdef _WIN32
+    FILE* f;
+    long file_size;
+    void* data;
+    
+    f = fopen(file_name, "rb");
+    
+    if (!f)
+    {
+        return NULL;
+    }
+    
+    if (fseek(f, 0, SEEK_END) || (file_size = ftell(f)) < 0 ||
+        fseek(f, 0, SEEK_SET))
+    {
+        fclose(f);
+        return NULL;
+    }
+    
+    /* ALLOCATED: data */
+    data = malloc(file_size > 0 ? (size_t) file_size : 1);
+    
+    if (!data || fread(data, 1, (size_t) file_size, f) != (size_t) file_size)
+    {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    
+    fclose(f);
+    *size = (size_t) file_size;
+    return data;
+#else
+    struct stat file_status;
+    void* data;
+    int fd;
+    
+    fd = open(file_name, O_RDONLY);
+    
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    
+    if (fstat(fd, &file_status) || file_status.st_size <= 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    
+    /* ALLOCATED: data. The mapping outlives the descriptor. */
+    data = mmap(NULL,
+                (size_t) file_status.st_size,
+                PROT_READ,
+                MAP_PRIVATE,
+                fd,
+                0);
+    
+    close(fd);
+    
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+    
+    *size = (size_t) file_status.st_size;
+    return data;
+#endif
+}
+
+static void unload_file(void* data, size_t size)
+{
+#ifdef _WIN32
+    (void) size;
+    free(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+static void binary_storage_free(void* storage)
+{
+    binary_storage* binary = storage;
+    
+    unload_file(binary->data, binary->size);
+    free(binary);
+}
+
+/*******************************************************************************
+* Checks that the first 'size' bytes of a file hold a whole header of the      *
+* version this program reads.                                                  *
+* ---                                                                          *
+* Returns zero if they do, and a non-zero value otherwise.                     *
+*******************************************************************************/
+static int validate_header_version(const telephone_book_binary_header* header,
+                                   size_t size)
+{
+    return size < sizeof *header ||
+           memcmp(header->magic,
+                  TELEPHONE_BOOK_BINARY_MAGIC,
+                  TELEPHONE_BOOK_BINARY_MAGIC_LENGTH) ||
+           header->version != TELEPHONE_BOOK_BINARY_VERSION ||
+           header->next_id < 1;
+}
+
+/*******************************************************************************
+* Checks that the header describes a book of a readable version whose record   *
+* array and string table fit within 'size' bytes.                              *
+* ---                                                                          *
+* Returns zero if the header is valid, and a non-zero value otherwise.         *
+*******************************************************************************/
+static int validate_header(const telephone_book_binary_header* header,
+                           size_t size)
+{
+    const char* strings;
+    
+    if (validate_header_version(header, size))
+    {
+        return 1;
+    }
+    
+    if (header->record_count >= (uint64_t) INT_MAX ||
+        header->records_offset % sizeof(telephone_book_binary_record) ||
+        header->records_offset > size ||
+        header->record_count > (size - header->records_offset) /
+                               sizeof(telephone_book_binary_record))
+    {
+        return 1;
+    }
+    
+    if (header->strings_offset > size ||
+        header->strings_size > size - header->strings_offset ||
+        header->strings_size == 0)
+    {
+        return 1;
+    }
+    
+    /* The last string must be terminated within the table: */
+    strings = (const char*) header + header->strings_offset;
+    return strings[header->strings_size - 1] != '\0';
+}
+
+int telephone_book_binary_is_book_file(const char* file_name)
+{
+    char magic[TELEPHONE_BOOK_BINARY_MAGIC_LENGTH];
+    FILE* f;
+    size_t read_size;
+    
+    f = fopen(file_name, "rb");
+    
+    if (!f)
+    {
+        return 0;
+    }
+    
+    read_size = fread(magic, 1, sizeof magic, f);
+    fclose(f);
+    
+    return read_size == sizeof magic &&
+           memcmp(magic,
+                  TELEPHONE_BOOK_BINARY_MAGIC,
+                  TELEPHONE_BOOK_BINARY_MAGIC_LENGTH) == 0;
+}
+
+int telephone_book_binary_read_next_id(const char* file_name, int* next_id)
+{
+    telephone_book_binary_header header;
+    FILE* f;
+    size_t read_size;
+    
+    if (!file_name || !next_id)
+    {
+        return 1;
+    }
+    
+    f = fopen(file_name, "rb");
+    
+    if (!f)
+    {
+        return 1;
+    }
+    
+    read_size = fread(&header, 1, sizeof header, f);
+    fclose(f);
+    
+    if (validate_header_version(&header, read_size) ||
+        header.record_count >= (uint64_t) INT_MAX)
+    {
+        return 1;
+    }
+    
+    *next_id = header.next_id;
+    return 0;
+}
+
+telephone_book_record_list* telephone_book_binary_read(const char* file_name,
+                                                       uint32_t* flags)
+{
+    telephone_book_record_list* record_list;
+    const telephone_book_binary_header* header;
+    const telephone_book_binary_record* binary_records;
+    const telephone_book_binary_record* binary_record;
+    telephone_book_record* records;
+    telephone_book_record* record;
+    telephone_book_record_list_node* nodes;
+    telephone_book_record_list_node* node;
+    binary_storage* storage;
+    char* strings;
+    size_t record_count;
+    size_t i;
+    
+    if (!file_name)
+    {
+        return NULL;
+    }
+    
+    storage = malloc(sizeof *storage);
+    
+    if (!storage)
+    {
+        return NULL;
+    }
+    
+    /* ALLOCATED: storage, data */
+    storage->data = load_file(file_name, &storage->size);
+    
+    if (!storage->data)
+    {
+        free(storage);
+        return NULL;
+    }
+    
+    header = storage->data;
+    
+    if (validate_header(header, storage->size))
+    {
+        unload_file(storage->data, storage->size);
+        free(storage);
+        return NULL;
+    }
+    
+    record_count = (size_t) header->record_count;
+    binary_records = (const telephone_book_binary_record*)
+                     ((const char*) storage->data + header->records_offset);
+    
+    strings = (char*) storage->data + header->strings_offset;
+    
+    /* ALLOCATED: storage, data, record_list */
+    record_list = telephone_book_record_list_alloc_arena();
+    
+    if (!record_list)
+    {
+        binary_storage_free(storage);
+        return NULL;
+    }
+    
+    /* From now on the list owns the mapping: */
+    record_list->storage = storage;
+    record_list->storage_free = binary_storage_free;
+    
+    records = telephone_book_arena_allocate(record_list->arena,
+                                            record_count * sizeof *records);
+    
+    nodes = telephone_book_arena_allocate(record_list->arena,
+                                          record_count * sizeof *nodes);
+    
+    if (!records || !nodes)
+    {
+        telephone_book_record_list_free(record_list);
+        return NULL;
+    }
+    
+    for (i = 0; i < record_count; ++i)
+    {
+        binary_record = &binary_records[i];
+        
+        if (binary_record->last_name_offset >= header->strings_size ||
+            binary_record->first_name_offset >= header->strings_size ||
+            binary_record->telephone_number_offset >= header->strings_size)
+        {
+            telephone_book_record_list_free(record_list);
+            return NULL;
+        }
+        
+        /* The mapping is read-only; the strings are never written through */
+        /* these pointers. */
+        record = &records[i];
+        record->last_name = &strings[binary_record->last_name_offset];
+        record->first_name = &strings[binary_record->first_name_offset];
+        record->telephone_number =
+            &strings[binary_record->telephone_number_offset];
+        
+        record->id = binary_record->id;
+        record->is_borrowed = 1;
+        
+        /* Records with the same name share its first copy in the mapping: */
+        if (telephone_book_record_list_intern_borrowed_name(
+                                                record_list,
+                                                &record->last_name,
+                                                &record->last_name_id) ||
+            telephone_book_record_list_intern_borrowed_name(
+                                                record_list,
+                                                &record->first_name,
+                                                &record->first_name_id))
+        {
+            telephone_book_record_list_free(record_list);
+            return NULL;
+        }
+        
+        node = &nodes[i];
+        node->record = record;
+        node->next = i + 1 < record_count ? &nodes[i + 1] : NULL;
+        node->is_borrowed = 1;
+    }
+    
+    record_list->head = record_count > 0 ? &nodes[0] : NULL;
+    record_list->tail = record_count > 0 ? &nodes[record_count - 1] : NULL;
+    record_list->size = (int) record_count;
+    record_list->next_id = header->next_id;
+    
+    if (flags)
+    {
+        *flags = header->flags;
+    }
+    
+    return record_list;
+}
+
+int telephone_book_binary_write_to_file(telephone_book_record_list* list,
+                                        FILE* f)
+{
+    telephone_book_binary_header header;
+    telephone_book_binary_record binary_record;
+    telephone_book_record_list_node* current_node;
+    telephone_book_record* record;
+    uint64_t strings_size;
+    uint32_t string_offset;
+    
+    if (!list || !f)
+    {
+        return 1;
+    }
+    
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic,
+           TELEPHONE_BOOK_BINARY_MAGIC,
+           TELEPHONE_BOOK_BINARY_MAGIC_LENGTH);
+    
+    header.version = TELEPHONE_BOOK_BINARY_VERSION;
+    header.next_id = list->next_id;
+    header.flags = telephone_book_record_list_is_sorted(list) ?
+                   TELEPHONE_BOOK_BINARY_FLAG_SORTED : 0;
+    
+    strings_size = 0;
+    
+    /* The first pass measures the string table: */
+    for (current_node = list->head;
+         current_node;
+         current_node = current_node->next)
+    {
+        record = current_node->record;
+        strings_size += strlen(record->last_name) +
+                        strlen(record->first_name) +
+                        strlen(record->telephone_number) + 3;
+        
+        ++header.record_count;
+    }
+    
+    /* The string offsets are 32 bits wide: */
+    if (strings_size > UINT32_MAX)
+    {
+        return 1;
+    }
+    
+    /* An empty book still has a terminated (empty) string table: */
+    header.strings_size = strings_size > 0 ? strings_size : 1;
+    header.records_offset = sizeof header;
+    header.strings_offset = header.records_offset +
+                            header.record_count * sizeof binary_record;
+    
+    if (fwrite(&header, sizeof header, 1, f) != 1)
+    {
+        return 1;
+    }
+    
+    string_offset = 0;
+    
+    for (current_node = list->head;
+         current_node;
+         current_node = current_node->next)
+    {
+        record = current_node->record;
+        binary_record.last_name_offset = string_offset;
+        string_offset += (uint32_t) strlen(record->last_name) + 1;
+        binary_record.first_name_offset = string_offset;
+        string_offset += (uint32_t) strlen(record->first_name) + 1;
+        binary_record.telephone_number_offset = string_offset;
+        string_offset += (uint32_t) strlen(record->telephone_number) + 1;
+        binary_record.id = record->id;
+        
+        if (fwrite(&binary_record, sizeof binary_record, 1, f) != 1)
+        {
+            return 1;
+        }
+    }
+    
+    if (header.record_count == 0)
+    {
+        return fputc('\0', f) == EOF;
+    }
+    
+    for (current_node = list->head;
+         current_node;
+         current_node = current_node->next)
+    {
+        record = current_node->record;
+        
+        if (fwrite(record->last_name,
+                   strlen(record->last_name) + 1, 1, f) != 1 ||
+            fwrite(record->first_name,
+                   strlen(record->first_name) + 1, 1, f) != 1 ||
+            fwrite(record->telephone_number,
+                   strlen(record->telephone_number) + 1, 1, f) != 1)
+        {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,100 @@
+#ifndef TELEPHONE_BOOK_BINARY_H
+#define TELEPHONE_BOOK_BINARY_H
+
+#include "telephone_book.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/*******************************************************************************
+* The first bytes of every binary record book file.                            *
+*******************************************************************************/
+#define TELEPHONE_BOOK_BINARY_MAGIC "TBOOKBIN"
+#define TELEPHONE_BOOK_BINARY_MAGIC_LENGTH 8
+
+/*******************************************************************************
+* The version of the binary format written and read by this program. Files of  *
+* any other version are rejected.                                              *
+*******************************************************************************/
+#define TELEPHONE_BOOK_BINARY_VERSION 2
+
+/*******************************************************************************
+* Set in the header flags if the records are sorted by last name and then by   *
+* first name, and carry distinct positive IDs below 'next_id'.                 *
+*******************************************************************************/
+#define TELEPHONE_BOOK_BINARY_FLAG_SORTED 1u
+
+/*******************************************************************************
+* This structure holds the header of a binary record book file. All the fields *
+* are in the native byte order. The unused words once held column widths that  *
+* nothing read; they are now written as zeros and ignored, which keeps the     *
+* layout of the files written before. 'next_id' is the high-water mark of the  *
+* record IDs, and the reserved words keep the record array aligned.            *
+*******************************************************************************/
+typedef struct {
+    char magic[TELEPHONE_BOOK_BINARY_MAGIC_LENGTH];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t record_count;
+    uint32_t unused[4];
+    uint64_t records_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    int32_t next_id;
+    uint32_t reserved[3];
+} telephone_book_binary_header;
+
+/*******************************************************************************
+* This structure holds a fixed-width record of a binary record book file. The  *
+* string fields are offsets of NUL-terminated strings in the string table.     *
+*******************************************************************************/
+typedef struct {
+    uint32_t last_name_offset;
+    uint32_t first_name_offset;
+    uint32_t telephone_number_offset;
+    int32_t id;
+} telephone_book_binary_record;
+
+
+
+
+/*******************************************************************************
+* Checks whether the file 'file_name' starts with the binary format magic.     *
+* ---                                                                          *
+* Returns a non-zero value if the file is a binary record book, and zero if it *
+* is not or cannot be read.                                                    *
+*******************************************************************************/
+int telephone_book_binary_is_book_file(const char* file_name);
+
+/*******************************************************************************
+* Reads the high-water mark of the record IDs from the header of the binary    *
+* record book file 'file_name' without loading the records, and stores it in   *
+* 'next_id'.                                                                   *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the header cannot be read.  *
+*******************************************************************************/
+int telephone_book_binary_read_next_id(const char* file_name, int* next_id);
+
+/*******************************************************************************
+* Maps the binary record book file 'file_name' into memory and builds a record *
+* list over it. The records and nodes of the list are borrowed: their strings  *
+* point into the mapping, which is released when the list is freed. Nothing is *
+* parsed or copied, but the list is not free either: every row still gets a    *
+* record and a node carved from one arena, and its two names are looked up in  *
+* the intern table of the list, so loading takes time and memory linear in the *
+* number of records. The header flags are stored in 'flags' unless it is NULL. *
+* ---                                                                          *
+* Returns the record list on success, and NULL on failure.                     *
+*******************************************************************************/
+telephone_book_record_list* telephone_book_binary_read(const char* file_name,
+                                                       uint32_t* flags);
+
+/*******************************************************************************
+* Writes the entire contents of the telephone record list to a specified file  *
+* handle in the binary format. The file must be opened in binary mode.         *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_binary_write_to_file(telephone_book_record_list* list,
+                                        FILE* f);
+
+#endif /* TELEPHONE_BOOK_BINARY_H */
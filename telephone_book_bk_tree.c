@@ -0,0 +1,329 @@
+#include "telephone_book_bk_tree.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_NODE_CAPACITY 16
+#define INITIAL_STACK_CAPACITY 64
+
+/*******************************************************************************
+* This structure holds a pending subtree of a search along with the smallest   *
+* distance any of its names may have from the query.                           *
+*******************************************************************************/
+typedef struct {
+    int node_index;
+    size_t lower_bound;
+} search_stack_entry;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_bk_tree.h              *
+*******************************************************************************/
+
+
+telephone_book_bk_tree* telephone_book_bk_tree_alloc(int record_capacity)
+{
+    telephone_book_bk_tree* tree = malloc(sizeof *tree);
+    
+    if (!tree)
+    {
+        return NULL;
+    }
+    
+    /* ALLOCATED: tree, nodes */
+    tree->nodes = malloc(INITIAL_NODE_CAPACITY * sizeof *tree->nodes);
+    
+    if (!tree->nodes)
+    {
+        free(tree);
+        return NULL;
+    }
+    
+    /* ALLOCATED: tree, nodes, next_record */
+    tree->next_record = malloc((record_capacity + 1) *
+                               sizeof *tree->next_record);
+    
+    if (!tree->next_record)
+    {
+        free(tree->nodes);
+        free(tree);
+        return NULL;
+    }
+    
+    tree->size = 0;
+    tree->capacity = INITIAL_NODE_CAPACITY;
+    tree->record_capacity = record_capacity;
+    tree->last_inserted_node = -1;
+    return tree;
+}
+
+/*******************************************************************************
+* Appends a new node for the name 'name' to the node array.                    *
+* ---                                                                          *
+* Returns the index of the new node, or -1 if the array could not grow.        *
+*******************************************************************************/
+static int append_node(telephone_book_bk_tree* tree,
+                       const char* name,
+                       size_t name_length,
+                       size_t edge_distance)
+{
+    telephone_book_bk_tree_node* new_nodes;
+    telephone_book_bk_tree_node* node;
+    
+    if (tree->size == tree->capacity)
+    {
+        new_nodes = realloc(tree->nodes,
+                            2 * tree->capacity * sizeof *tree->nodes);
+        
+        if (!new_nodes)
+        {
+            return -1;
+        }
+        
+        tree->nodes = new_nodes;
+        tree->capacity *= 2;
+    }
+    
+    node = &tree->nodes[tree->size];
+    node->name = name;
+    node->name_length = name_length;
+    node->edge_distance = edge_distance;
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->first_record = -1;
+    node->last_record = -1;
+    return tree->size++;
+}
+
+/*******************************************************************************
+* Appends the record with index 'record_index' to the chain of the node.       *
+*******************************************************************************/
+static void append_record(telephone_book_bk_tree* tree,
+                          int node_index,
+                          int record_index)
+{
+    telephone_book_bk_tree_node* node = &tree->nodes[node_index];
+    
+    tree->next_record[record_index] = -1;
+    
+    if (node->last_record >= 0)
+    {
+        tree->next_record[node->last_record] = record_index;
+    }
+    else
+    {
+        node->first_record = record_index;
+    }
+    
+    node->last_record = record_index;
+    tree->last_inserted_node = node_index;
+}
+
+int telephone_book_bk_tree_insert(telephone_book_bk_tree* tree,
+                                  const char* name,
+                                  int record_index)
+{
+    telephone_book_distance_pattern pattern;
+    telephone_book_bk_tree_node* node;
+    size_t distance;
+    int node_index;
+    int child_index;
+    int new_node_index;
+    
+    if (!tree || !name || record_index < 0 ||
+        record_index >= tree->record_capacity)
+    {
+        return 1;
+    }
+    
+    if (tree->size == 0)
+    {
+        if (append_node(tree, name, strlen(name), 0) < 0)
+        {
+            return 1;
+        }
+        
+        append_record(tree, 0, record_index);
+        return 0;
+    }
+    
+    telephone_book_distance_pattern_init(&pattern, name);
+    
+    /* Sorted input puts equal names next to each other, so try the most */
+    /* recently used node before descending from the root: */
+    node_index = tree->last_inserted_node;
+    node = &tree->nodes[node_index];
+    
+    if (node->name_length == pattern.length &&
+        telephone_book_distance_pattern_compute_bounded(&pattern,
+                                                        node->name,
+                                                        node->name_length,
+                                                        0) == 0)
+    {
+        append_record(tree, node_index, record_index);
+        return 0;
+    }
+    
+    node_index = 0;
+    
+    for (;;)
+    {
+        node = &tree->nodes[node_index];
+        distance = telephone_book_distance_pattern_compute(&pattern,
+                                                           node->name,
+                                                           node->name_length);
+        
+        if (distance == 0)
+        {
+            append_record(tree, node_index, record_index);
+            return 0;
+        }
+        
+        for (child_index = node->first_child;
+             child_index >= 0;
+             child_index = tree->nodes[child_index].next_sibling)
+        {
+            if (tree->nodes[child_index].edge_distance == distance)
+            {
+                break;
+            }
+        }
+        
+        if (child_index < 0)
+        {
+            break;
+        }
+        
+        node_index = child_index;
+    }
+    
+    new_node_index = append_node(tree, name, pattern.length, distance);
+    
+    if (new_node_index < 0)
+    {
+        return 1;
+    }
+    
+    /* 'append_node' may have moved the node array: */
+    tree->nodes[new_node_index].next_sibling =
+        tree->nodes[node_index].first_child;
+    
+    tree->nodes[node_index].first_child = new_node_index;
+    append_record(tree, new_node_index, record_index);
+    return 0;
+}
+
+int telephone_book_bk_tree_search(
+                            const telephone_book_bk_tree* tree,
+                            const telephone_book_distance_pattern* pattern,
+                            size_t radius,
+                            telephone_book_bk_tree_visitor visitor,
+                            void* state)
+{
+    search_stack_entry* stack;
+    search_stack_entry* new_stack;
+    size_t stack_size;
+    size_t stack_capacity;
+    const telephone_book_bk_tree_node* node;
+    size_t distance;
+    size_t edge_distance;
+    int node_index;
+    int child_index;
+    
+    if (!tree || !pattern || !visitor)
+    {
+        return 1;
+    }
+    
+    if (tree->size == 0)
+    {
+        return 0;
+    }
+    
+    /* ALLOCATED: stack */
+    stack_capacity = INITIAL_STACK_CAPACITY;
+    stack = malloc(stack_capacity * sizeof *stack);
+    
+    if (!stack)
+    {
+        return 1;
+    }
+    
+    stack[0].node_index = 0;
+    stack[0].lower_bound = 0;
+    stack_size = 1;
+    
+    while (stack_size > 0)
+    {
+        --stack_size;
+        
+        /* The radius may have shrunk since the subtree was pushed: */
+        if (stack[stack_size].lower_bound > radius)
+        {
+            continue;
+        }
+        
+        node_index = stack[stack_size].node_index;
+        node = &tree->nodes[node_index];
+        distance = telephone_book_distance_pattern_compute(pattern,
+                                                           node->name,
+                                                           node->name_length);
+        
+        if (distance <= radius)
+        {
+            radius = visitor(state,
+                             node->first_record,
+                             tree->next_record,
+                             distance);
+        }
+        
+        for (child_index = node->first_child;
+             child_index >= 0;
+             child_index = tree->nodes[child_index].next_sibling)
+        {
+            /* By the triangle inequality, every name in the child subtree */
+            /* is at least |edge - distance| away from the query:          */
+            edge_distance = tree->nodes[child_index].edge_distance;
+            edge_distance = edge_distance > distance ?
+                            edge_distance - distance :
+                            distance - edge_distance;
+            
+            if (edge_distance > radius)
+            {
+                continue;
+            }
+            
+            if (stack_size == stack_capacity)
+            {
+                new_stack = realloc(stack,
+                                    2 * stack_capacity * sizeof *stack);
+                
+                if (!new_stack)
+                {
+                    free(stack);
+                    return 1;
+                }
+                
+                stack = new_stack;
+                stack_capacity *= 2;
+            }
+            
+            stack[stack_size].node_index = child_index;
+            stack[stack_size].lower_bound = edge_distance;
+            ++stack_size;
+        }
+    }
+    
+    free(stack);
+    return 0;
+}
+
+void telephone_book_bk_tree_free(telephone_book_bk_tree* tree)
+{
+    if (!tree)
+    {
+        return;
+    }
+    
+    free(tree->nodes);
+    free(tree->next_record);
+    free(tree);
+}
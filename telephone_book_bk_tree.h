@@ -0,0 +1,90 @@
+#ifndef TELEPHONE_BOOK_BK_TREE_H
+#define TELEPHONE_BOOK_BK_TREE_H
+
+#include "telephone_book_distance.h"
+#include <stddef.h>
+
+/*******************************************************************************
+* This structure holds a single node of a BK-tree. Each node stands for one    *
+* distinct (case-insensitive) name and chains the indices of all the records   *
+* that carry that name.                                                        *
+*******************************************************************************/
+typedef struct {
+    const char* name;
+    size_t name_length;
+    size_t edge_distance;
+    int first_child;
+    int next_sibling;
+    int first_record;
+    int last_record;
+} telephone_book_bk_tree_node;
+
+/*******************************************************************************
+* This structure holds a BK-tree over names keyed by the case-insensitive      *
+* Levenshtein distance. The nodes are kept in a single array, and the record   *
+* chains are threaded through 'next_record' which maps a record index to the   *
+* next record index with the same name, or -1.                                 *
+*******************************************************************************/
+typedef struct {
+    telephone_book_bk_tree_node* nodes;
+    int size;
+    int capacity;
+    int* next_record;
+    int record_capacity;
+    int last_inserted_node;
+} telephone_book_bk_tree;
+
+/*******************************************************************************
+* The type of the function called for each node within the search radius. It   *
+* receives the search state, the first record of the node, the record chain    *
+* links and the distance from the query to the node name.                      *
+* ---                                                                          *
+* Returns the new (possibly smaller) search radius.                            *
+*******************************************************************************/
+typedef size_t (*telephone_book_bk_tree_visitor)(void* state,
+                                                 int first_record,
+                                                 const int* next_record,
+                                                 size_t distance);
+
+
+
+
+/*******************************************************************************
+* Allocates an empty BK-tree that can hold records with indices from zero to   *
+* 'record_capacity - 1'.                                                       *
+* ---                                                                          *
+* Returns the new tree or NULL if something goes wrong.                        *
+*******************************************************************************/
+telephone_book_bk_tree* telephone_book_bk_tree_alloc(int record_capacity);
+
+/*******************************************************************************
+* Inserts the record with index 'record_index' under the name 'name'. The name *
+* is not copied, so it must outlive the tree. Records must be inserted in      *
+* ascending index order so that each chain stays sorted.                       *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_bk_tree_insert(telephone_book_bk_tree* tree,
+                                  const char* name,
+                                  int record_index);
+
+/*******************************************************************************
+* Calls 'visitor' for each node whose name is within 'radius' from the         *
+* pattern. The radius returned by the visitor replaces the current one, which  *
+* lets nearest-neighbour searches shrink the set of subtrees visited.          *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_bk_tree_search(
+                            const telephone_book_bk_tree* tree,
+                            const telephone_book_distance_pattern* pattern,
+                            size_t radius,
+                            telephone_book_bk_tree_visitor visitor,
+                            void* state);
+
+/*******************************************************************************
+* Frees all the memory occupied by the BK-tree.                                *
+*******************************************************************************/
+void telephone_book_bk_tree_free(telephone_book_bk_tree* tree);
+
+#endif /* TELEPHONE_BOOK_BK_TREE_H */
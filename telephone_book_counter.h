@@ -0,0 +1,23 @@
+#ifndef TELEPHONE_BOOK_COUNTER_H
+#define TELEPHONE_BOOK_COUNTER_H
+
+#include <stddef.h>
+
+/*******************************************************************************
+* Adds 'n' to the 'size_t' counter 'counter', and reads the counter. The       *
+* allocation counters of the modules are bumped by every thread of a server,   *
+* so where the compiler offers atomic built-ins (GCC and Clang) they are used; *
+* elsewhere plain arithmetic is exact as long as one thread allocates at a     *
+* time. The counters only feed diagnostics, so no ordering is needed.          *
+*******************************************************************************/
+#if defined(__GNUC__)
+#define TELEPHONE_BOOK_COUNTER_ADD(counter, n) \
+    ((void) __atomic_fetch_add(&(counter), (size_t) (n), __ATOMIC_RELAXED))
+#define TELEPHONE_BOOK_COUNTER_READ(counter) \
+    __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#else
+#define TELEPHONE_BOOK_COUNTER_ADD(counter, n) ((void) ((counter) += (n)))
+#define TELEPHONE_BOOK_COUNTER_READ(counter) (counter)
+#endif
+
+#endif /* TELEPHONE_BOOK_COUNTER_H */
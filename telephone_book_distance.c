@@ -0,0 +1,477 @@
+#include "telephone_book_distance.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DP_ROW_STACK_CAPACITY 128
+#define MAX_HISTOGRAM_WORD_LENGTH 255
+#define UNBOUNDED ((size_t) -1)
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_distance.h             *
+*******************************************************************************/
+
+
+unsigned char telephone_book_distance_fold(char c)
+{
+    return (unsigned char) tolower((unsigned char) c);
+}
+
+void telephone_book_distance_pattern_init(
+                            telephone_book_distance_pattern* pattern,
+                            const char* word)
+{
+    size_t i;
+    int c;
+    
+    pattern->word = word;
+    pattern->length = strlen(word);
+    pattern->is_bit_parallel =
+        pattern->length <= TELEPHONE_BOOK_DISTANCE_MAX_BIT_PARALLEL_LENGTH;
+    
+    memset(pattern->match_masks, 0, sizeof pattern->match_masks);
+    
+    if (!pattern->is_bit_parallel)
+    {
+        return;
+    }
+    
+    for (i = 0; i < pattern->length; ++i)
+    {
+        pattern->match_masks[telephone_book_distance_fold(word[i])] |=
+            (uint64_t) 1 << i;
+    }
+    
+    /* Let the uppercase characters share the masks of their lowercase */
+    /* counterparts so that the kernel never needs to fold the text:   */
+    for (c = 0; c < 256; ++c)
+    {
+        pattern->match_masks[c] =
+            pattern->match_masks[telephone_book_distance_fold((char) c)];
+    }
+}
+
+/*******************************************************************************
+* Implements the bit-parallel Levenshtein distance algorithm of Myers in the   *
+* formulation of Hyyro. Each column of the dynamic programming matrix is kept  *
+* as two bit vectors of vertical deltas. Since the last row may drop by at     *
+* most one per remaining column, the scan stops once the distance cannot get   *
+* back to 'max_distance'.                                                      *
+*******************************************************************************/
+static size_t bit_parallel_distance(
+                            const telephone_book_distance_pattern* pattern,
+                            const char* text,
+                            size_t text_length,
+                            size_t max_distance)
+{
+    uint64_t positive_vertical = ~(uint64_t) 0;
+    uint64_t negative_vertical = 0;
+    uint64_t positive_horizontal;
+    uint64_t negative_horizontal;
+    uint64_t equal_mask;
+    uint64_t x_vertical;
+    uint64_t x_horizontal;
+    uint64_t last_bit = (uint64_t) 1 << (pattern->length - 1);
+    size_t score = pattern->length;
+    size_t j;
+    
+    for (j = 0; j < text_length; ++j)
+    {
+        equal_mask = pattern->match_masks[(unsigned char) text[j]];
+        x_vertical = equal_mask | negative_vertical;
+        x_horizontal = (((equal_mask & positive_vertical) + positive_vertical)
+                        ^ positive_vertical) | equal_mask;
+        
+        positive_horizontal = negative_vertical |
+                              ~(x_horizontal | positive_vertical);
+        negative_horizontal = positive_vertical & x_horizontal;
+        
+        if (positive_horizontal & last_bit)
+        {
+            ++score;
+        }
+        else if (negative_horizontal & last_bit)
+        {
+            --score;
+        }
+        
+        /* The top row of the matrix grows by one in each column: */
+        positive_horizontal = (positive_horizontal << 1) | 1;
+        negative_horizontal <<= 1;
+        
+        positive_vertical = negative_horizontal |
+                            ~(x_vertical | positive_horizontal);
+        negative_vertical = positive_horizontal & x_vertical;
+        
+        if (max_distance != UNBOUNDED &&
+            score > max_distance + (text_length - j - 1))
+        {
+            return max_distance + 1;
+        }
+    }
+    
+    return score;
+}
+
+size_t telephone_book_distance_pattern_compute(
+                            const telephone_book_distance_pattern* pattern,
+                            const char* text,
+                            size_t text_length)
+{
+    if (pattern->length == 0)
+    {
+        return text_length;
+    }
+    
+    if (text_length == 0)
+    {
+        return pattern->length;
+    }
+    
+    if (pattern->is_bit_parallel)
+    {
+        return bit_parallel_distance(pattern, text, text_length, UNBOUNDED);
+    }
+    
+    return telephone_book_distance_compute_dp(pattern->word,
+                                              pattern->length,
+                                              text,
+                                              text_length);
+}
+
+size_t telephone_book_distance_pattern_compute_bounded(
+                            const telephone_book_distance_pattern* pattern,
+                            const char* text,
+                            size_t text_length,
+                            size_t max_distance)
+{
+    size_t length_difference = pattern->length > text_length ?
+                               pattern->length - text_length :
+                               text_length - pattern->length;
+    
+    if (length_difference > max_distance)
+    {
+        return max_distance + 1;
+    }
+    
+    if (pattern->length == 0 || text_length == 0)
+    {
+        /* The distance is the length difference, which fits the bound. */
+        return length_difference;
+    }
+    
+    if (pattern->is_bit_parallel)
+    {
+        return bit_parallel_distance(pattern,
+                                     text,
+                                     text_length,
+                                     max_distance);
+    }
+    
+    return telephone_book_distance_compute_banded(pattern->word,
+                                                  pattern->length,
+                                                  text,
+                                                  text_length,
+                                                  max_distance);
+}
+
+size_t telephone_book_distance_compute_dp(const char* word1,
+                                          size_t length1,
+                                          const char* word2,
+                                          size_t length2)
+{
+    size_t stack_row[DP_ROW_STACK_CAPACITY];
+    size_t* row;
+    size_t diagonal;
+    size_t above;
+    size_t best;
+    size_t i;
+    size_t j;
+    const char* swap_word;
+    size_t swap_length;
+    unsigned char c;
+    
+    /* Keep the row over the shorter word: */
+    if (length2 > length1)
+    {
+        swap_word = word1;
+        word1 = word2;
+        word2 = swap_word;
+        
+        swap_length = length1;
+        length1 = length2;
+        length2 = swap_length;
+    }
+    
+    if (length2 == 0)
+    {
+        return length1;
+    }
+    
+    if (length2 < DP_ROW_STACK_CAPACITY)
+    {
+        row = stack_row;
+    }
+    else
+    {
+        /* ALLOCATED: row */
+        row = malloc((length2 + 1) * sizeof *row);
+        
+        if (!row)
+        {
+            return (size_t) -1;
+        }
+    }
+    
+    for (j = 0; j <= length2; ++j)
+    {
+        row[j] = j;
+    }
+    
+    for (i = 1; i <= length1; ++i)
+    {
+        c = telephone_book_distance_fold(word1[i - 1]);
+        diagonal = row[0];
+        row[0] = i;
+        
+        for (j = 1; j <= length2; ++j)
+        {
+            above = row[j];
+            best = diagonal +
+                   (c == telephone_book_distance_fold(word2[j - 1]) ? 0 : 1);
+            
+            if (above + 1 < best)
+            {
+                best = above + 1;
+            }
+            
+            if (row[j - 1] + 1 < best)
+            {
+                best = row[j - 1] + 1;
+            }
+            
+            diagonal = above;
+            row[j] = best;
+        }
+    }
+    
+    best = row[length2];
+    
+    if (row != stack_row)
+    {
+        free(row);
+    }
+    
+    return best;
+}
+
+size_t telephone_book_distance_compute_banded(const char* word1,
+                                              size_t length1,
+                                              const char* word2,
+                                              size_t length2,
+                                              size_t max_distance)
+{
+    size_t stack_row[DP_ROW_STACK_CAPACITY];
+    size_t* row;
+    size_t diagonal;
+    size_t above;
+    size_t best;
+    size_t row_minimum;
+    size_t infinity;
+    size_t low;
+    size_t high;
+    size_t i;
+    size_t j;
+    const char* swap_word;
+    size_t swap_length;
+    unsigned char c;
+    
+    /* Keep the row over the shorter word: */
+    if (length2 > length1)
+    {
+        swap_word = word1;
+        word1 = word2;
+        word2 = swap_word;
+        
+        swap_length = length1;
+        length1 = length2;
+        length2 = swap_length;
+    }
+    
+    if (length1 - length2 > max_distance)
+    {
+        return max_distance + 1;
+    }
+    
+    if (max_distance >= length1)
+    {
+        /* The band covers the entire matrix: */
+        return telephone_book_distance_compute_dp(word1,
+                                                  length1,
+                                                  word2,
+                                                  length2);
+    }
+    
+    if (length2 < DP_ROW_STACK_CAPACITY)
+    {
+        row = stack_row;
+    }
+    else
+    {
+        /* ALLOCATED: row */
+        row = malloc((length2 + 1) * sizeof *row);
+        
+        if (!row)
+        {
+            return (size_t) -1;
+        }
+    }
+    
+    /* Every cell outside of the band counts as 'infinity': */
+    infinity = max_distance + 1;
+    
+    for (j = 0; j <= length2; ++j)
+    {
+        row[j] = j <= max_distance ? j : infinity;
+    }
+    
+    for (i = 1; i <= length1; ++i)
+    {
+        c = telephone_book_distance_fold(word1[i - 1]);
+        low = i > max_distance ? i - max_distance : 1;
+        high = i + max_distance < length2 ? i + max_distance : length2;
+        
+        diagonal = row[low - 1];
+        row[low - 1] = low == 1 && i <= max_distance ? i : infinity;
+        row_minimum = row[low - 1];
+        
+        for (j = low; j <= high; ++j)
+        {
+            above = row[j];
+            best = diagonal +
+                   (c == telephone_book_distance_fold(word2[j - 1]) ? 0 : 1);
+            
+            if (above + 1 < best)
+            {
+                best = above + 1;
+            }
+            
+            if (row[j - 1] + 1 < best)
+            {
+                best = row[j - 1] + 1;
+            }
+            
+            if (best > infinity)
+            {
+                best = infinity;
+            }
+            
+            if (best < row_minimum)
+            {
+                row_minimum = best;
+            }
+            
+            diagonal = above;
+            row[j] = best;
+        }
+        
+        if (row_minimum > max_distance)
+        {
+            /* Every path to the last cell crosses this row: */
+            break;
+        }
+    }
+    
+    best = i > length1 ? row[length2] : infinity;
+    
+    if (row != stack_row)
+    {
+        free(row);
+    }
+    
+    return best;
+}
+
+size_t telephone_book_distance_compute(const char* word1, const char* word2)
+{
+    telephone_book_distance_pattern pattern;
+    size_t length1 = strlen(word1);
+    size_t length2 = strlen(word2);
+    
+    if (length1 > length2)
+    {
+        /* Preprocess the shorter word so that it fits the bit vector: */
+        pattern.word = word1;
+        word1 = word2;
+        word2 = pattern.word;
+        
+        pattern.length = length1;
+        length1 = length2;
+        length2 = pattern.length;
+    }
+    
+    if (length1 > TELEPHONE_BOOK_DISTANCE_MAX_BIT_PARALLEL_LENGTH)
+    {
+        return telephone_book_distance_compute_dp(word1,
+                                                  length1,
+                                                  word2,
+                                                  length2);
+    }
+    
+    telephone_book_distance_pattern_init(&pattern, word1);
+    return telephone_book_distance_pattern_compute(&pattern, word2, length2);
+}
+
+void telephone_book_distance_signature_init(
+                            telephone_book_distance_signature* signature,
+                            const char* word)
+{
+    size_t i;
+    
+    signature->length = strlen(word);
+    memset(signature->histogram, 0, sizeof signature->histogram);
+    
+    if (signature->length > MAX_HISTOGRAM_WORD_LENGTH)
+    {
+        /* The counts could overflow, leave the histogram empty. */
+        return;
+    }
+    
+    for (i = 0; i < signature->length; ++i)
+    {
+        signature->histogram[telephone_book_distance_fold(word[i]) %
+                             TELEPHONE_BOOK_DISTANCE_HISTOGRAM_SIZE]++;
+    }
+}
+
+size_t telephone_book_distance_lower_bound(
+                        const telephone_book_distance_signature* signature1,
+                        const telephone_book_distance_signature* signature2)
+{
+    size_t surplus = 0;
+    size_t deficit = 0;
+    size_t i;
+    
+    if (signature1->length > MAX_HISTOGRAM_WORD_LENGTH ||
+        signature2->length > MAX_HISTOGRAM_WORD_LENGTH)
+    {
+        return signature1->length > signature2->length ?
+               signature1->length - signature2->length :
+               signature2->length - signature1->length;
+    }
+    
+    for (i = 0; i < TELEPHONE_BOOK_DISTANCE_HISTOGRAM_SIZE; ++i)
+    {
+        if (signature1->histogram[i] > signature2->histogram[i])
+        {
+            surplus += signature1->histogram[i] - signature2->histogram[i];
+        }
+        else
+        {
+            deficit += signature2->histogram[i] - signature1->histogram[i];
+        }
+    }
+    
+    /* The larger of the two also bounds the length difference: */
+    return surplus > deficit ? surplus : deficit;
+}
@@ -0,0 +1,127 @@
+#ifndef TELEPHONE_BOOK_DISTANCE_H
+#define TELEPHONE_BOOK_DISTANCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************************************************************************
+* The longest pattern that fits into the bit-parallel distance kernel. Since   *
+* the record tokens are at most 64 characters long, every stored name fits.    *
+*******************************************************************************/
+#define TELEPHONE_BOOK_DISTANCE_MAX_BIT_PARALLEL_LENGTH 64
+
+/*******************************************************************************
+* The number of character classes in a name signature histogram. Lowercase     *
+* letters fall into distinct classes.                                          *
+*******************************************************************************/
+#define TELEPHONE_BOOK_DISTANCE_HISTOGRAM_SIZE 32
+
+/*******************************************************************************
+* This structure holds a preprocessed word that is matched against many other  *
+* words. Preprocessing is done once per query, after which each distance       *
+* computation costs O(n) word operations for patterns of at most 64 chars.     *
+*******************************************************************************/
+typedef struct {
+    const char* word;
+    size_t length;
+    int is_bit_parallel;
+    uint64_t match_masks[256];
+} telephone_book_distance_pattern;
+
+/*******************************************************************************
+* This structure holds a cheap summary of a word: its length and the counts of *
+* its case-folded character classes. Two signatures give a lower bound of the  *
+* edit distance between the words they summarize.                              *
+*******************************************************************************/
+typedef struct {
+    size_t length;
+    unsigned char histogram[TELEPHONE_BOOK_DISTANCE_HISTOGRAM_SIZE];
+} telephone_book_distance_signature;
+
+
+
+
+/*******************************************************************************
+* Returns the lowercase version of the character 'c'. All distances in this    *
+* module are case-insensitive.                                                 *
+*******************************************************************************/
+unsigned char telephone_book_distance_fold(char c);
+
+/*******************************************************************************
+* Preprocesses the word 'word' for subsequent distance computations. The word  *
+* is not copied, so it must outlive the pattern.                               *
+*******************************************************************************/
+void telephone_book_distance_pattern_init(
+                            telephone_book_distance_pattern* pattern,
+                            const char* word);
+
+/*******************************************************************************
+* Computes the case-insensitive Levenshtein distance between the pattern and   *
+* the word 'text' of length 'text_length'.                                     *
+*******************************************************************************/
+size_t telephone_book_distance_pattern_compute(
+                            const telephone_book_distance_pattern* pattern,
+                            const char* text,
+                            size_t text_length);
+
+/*******************************************************************************
+* Computes the case-insensitive Levenshtein distance between the pattern and   *
+* the word 'text' of length 'text_length', giving up as soon as the distance   *
+* is known to exceed 'max_distance'.                                           *
+* ---                                                                          *
+* Returns the exact distance if it is at most 'max_distance', and              *
+* 'max_distance + 1' otherwise.                                                *
+*******************************************************************************/
+size_t telephone_book_distance_pattern_compute_bounded(
+                            const telephone_book_distance_pattern* pattern,
+                            const char* text,
+                            size_t text_length,
+                            size_t max_distance);
+
+/*******************************************************************************
+* Computes the case-insensitive Levenshtein distance between words 'word1' and *
+* 'word2' using the two-row dynamic programming algorithm.                     *
+* ---                                                                          *
+* Returns (size_t) -1 if the working row could not be allocated.               *
+*******************************************************************************/
+size_t telephone_book_distance_compute_dp(const char* word1,
+                                          size_t length1,
+                                          const char* word2,
+                                          size_t length2);
+
+/*******************************************************************************
+* Computes the case-insensitive Levenshtein distance between words 'word1' and *
+* 'word2' within the diagonal band of width 'max_distance' (Ukkonen's cutoff). *
+* ---                                                                          *
+* Returns the exact distance if it is at most 'max_distance', and              *
+* 'max_distance + 1' otherwise.                                                *
+*******************************************************************************/
+size_t telephone_book_distance_compute_banded(const char* word1,
+                                              size_t length1,
+                                              const char* word2,
+                                              size_t length2,
+                                              size_t max_distance);
+
+/*******************************************************************************
+* Computes the case-insensitive Levenshtein distance between words 'word1' and *
+* 'word2', choosing the fastest available algorithm.                           *
+*******************************************************************************/
+size_t telephone_book_distance_compute(const char* word1, const char* word2);
+
+/*******************************************************************************
+* Computes the signature of the word 'word'.                                   *
+*******************************************************************************/
+void telephone_book_distance_signature_init(
+                            telephone_book_distance_signature* signature,
+                            const char* word);
+
+/*******************************************************************************
+* Returns a lower bound of the edit distance between two words given their     *
+* signatures. Each edit operation changes the length by at most one and moves  *
+* at most one character in and one character out of the histogram.             *
+*******************************************************************************/
+size_t telephone_book_distance_lower_bound(
+                        const telephone_book_distance_signature* signature1,
+                        const telephone_book_distance_signature* signature2);
+
+#endif /* TELEPHONE_BOOK_DISTANCE_H */
@@ -0,0 +1,606 @@
+#include "telephone_book_distance_batch.h"
+#include "telephone_book_distance.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#define LANES TELEPHONE_BOOK_DISTANCE_BATCH_LANES
+#define MAX_LENGTH TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH
+
+/* The bytes of transposed words a call for several queries keeps in the */
+/* cache while every query runs over them: */
+#define CACHE_BLOCK_SIZE (128 * 1024)
+
+/*******************************************************************************
+* This type points to a kernel. A kernel fills 'rows' with the last row of the *
+* dynamic programming matrix between 'query' and each word of a block whose    *
+* longest word has length 'block_length': the distance between the query and   *
+* the first 'j' characters of the word in lane 'l' ends up in                  *
+* 'rows[j * LANES + l]'.                                                       *
+*******************************************************************************/
+typedef void (*block_kernel)(const unsigned char* characters,
+                             size_t block_length,
+                             const unsigned char* query,
+                             size_t query_length,
+                             unsigned char* rows);
+
+/* The fastest kernel the processor supports, chosen once by the first use: */
+static telephone_book_distance_batch_kernel default_kernel;
+
+#ifndef _WIN32
+static pthread_once_t default_kernel_once = PTHREAD_ONCE_INIT;
+#endif
+
+/* The kernel selected by 'telephone_book_distance_batch_set_kernel', or -1: */
+static int selected_kernel = -1;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_distance_batch.h       *
+*******************************************************************************/
+
+
+static void init_rows(size_t block_length, unsigned char* rows)
+{
+    size_t j;
+    
+    for (j = 0; j <= block_length; ++j)
+    {
+        memset(&rows[j * LANES], (int) j, LANES);
+    }
+}
+
+/*******************************************************************************
+* Runs the dynamic programming over the lanes of a block one at a time. This   *
+* is the fallback for the processors without the vector kernels.               *
+*******************************************************************************/
+static void scalar_kernel(const unsigned char* characters,
+                          size_t block_length,
+                          const unsigned char* query,
+                          size_t query_length,
+                          unsigned char* rows)
+{
+    unsigned char diagonal[LANES];
+    const unsigned char* column;
+    unsigned char* row;
+    unsigned int best;
+    unsigned int up;
+    size_t i;
+    size_t j;
+    int l;
+    
+    init_rows(block_length, rows);
+    
+    for (i = 0; i < query_length; ++i)
+    {
+        memcpy(diagonal, rows, LANES);
+        memset(rows, (int) (i + 1), LANES);
+        
+        for (j = 1; j <= block_length; ++j)
+        {
+            row = &rows[j * LANES];
+            column = &characters[(j - 1) * LANES];
+            
+            for (l = 0; l < LANES; ++l)
+            {
+                up = row[l];
+                best = diagonal[l] + (column[l] != query[i]);
+                
+                if (up + 1 < best)
+                {
+                    best = up + 1;
+                }
+                
+                if (row[l - LANES] + 1u < best)
+                {
+                    best = row[l - LANES] + 1u;
+                }
+                
+                diagonal[l] = (unsigned char) up;
+                row[l] = (unsigned char) best;
+            }
+        }
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+/*******************************************************************************
+* Runs the dynamic programming over a block as two halves of 16 byte lanes.    *
+* The distances never exceed 255, so the saturating byte arithmetic is exact.  *
+*******************************************************************************/
+__attribute__((target("sse2")))
+static void sse2_kernel(const unsigned char* characters,
+                        size_t block_length,
+                        const unsigned char* query,
+                        size_t query_length,
+                        unsigned char* rows)
+{
+    __m128i one = _mm_set1_epi8(1);
+    __m128i query_character;
+    __m128i diagonal[2];
+    __m128i left[2];
+    __m128i up[2];
+    __m128i cost[2];
+    __m128i* row;
+    const __m128i* column;
+    size_t i;
+    size_t j;
+    int h;
+    
+    init_rows(block_length, rows);
+    
+    for (i = 0; i < query_length; ++i)
+    {
+        query_character = _mm_set1_epi8((char) query[i]);
+        row = (__m128i*) rows;
+        
+        for (h = 0; h < 2; ++h)
+        {
+            diagonal[h] = _mm_loadu_si128(&row[h]);
+            left[h] = _mm_set1_epi8((char) (i + 1));
+            _mm_storeu_si128(&row[h], left[h]);
+        }
+        
+        for (j = 1; j <= block_length; ++j)
+        {
+            row = (__m128i*) &rows[j * LANES];
+            column = (const __m128i*) &characters[(j - 1) * LANES];
+            
+            for (h = 0; h < 2; ++h)
+            {
+                up[h] = _mm_loadu_si128(&row[h]);
+                cost[h] = _mm_andnot_si128(
+                        _mm_cmpeq_epi8(_mm_loadu_si128(&column[h]),
+                                       query_character),
+                        one);
+                left[h] = _mm_min_epu8(
+                        _mm_adds_epu8(diagonal[h], cost[h]),
+                        _mm_adds_epu8(_mm_min_epu8(up[h], left[h]), one));
+                _mm_storeu_si128(&row[h], left[h]);
+                diagonal[h] = up[h];
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* Runs the dynamic programming over a block as 32 byte lanes of one register.  *
+*******************************************************************************/
+__attribute__((target("avx2")))
+static void avx2_kernel(const unsigned char* characters,
+                        size_t block_length,
+                        const unsigned char* query,
+                        size_t query_length,
+                        unsigned char* rows)
+{
+    __m256i one = _mm256_set1_epi8(1);
+    __m256i query_character;
+    __m256i diagonal;
+    __m256i left;
+    __m256i up;
+    __m256i cost;
+    __m256i* row;
+    size_t i;
+    size_t j;
+    
+    init_rows(block_length, rows);
+    
+    for (i = 0; i < query_length; ++i)
+    {
+        query_character = _mm256_set1_epi8((char) query[i]);
+        diagonal = _mm256_loadu_si256((const __m256i*) rows);
+        left = _mm256_set1_epi8((char) (i + 1));
+        _mm256_storeu_si256((__m256i*) rows, left);
+        
+        for (j = 1; j <= block_length; ++j)
+        {
+            row = (__m256i*) &rows[j * LANES];
+            up = _mm256_loadu_si256(row);
+            cost = _mm256_andnot_si256(
+                    _mm256_cmpeq_epi8(
+                        _mm256_loadu_si256(
+                            (const __m256i*) &characters[(j - 1) * LANES]),
+                        query_character),
+                    one);
+            left = _mm256_min_epu8(
+                    _mm256_adds_epu8(diagonal, cost),
+                    _mm256_adds_epu8(_mm256_min_epu8(up, left), one));
+            _mm256_storeu_si256(row, left);
+            diagonal = up;
+        }
+    }
+}
+#endif
+
+/*******************************************************************************
+* Returns non-zero if the processor and the compiler support the kernel.       *
+*******************************************************************************/
+static int is_kernel_supported(telephone_book_distance_batch_kernel kernel)
+{
+    switch (kernel)
+    {
+        case TELEPHONE_BOOK_DISTANCE_BATCH_SCALAR:
+            return 1;
+
+#ifdef HAVE_X86_KERNELS
+        case TELEPHONE_BOOK_DISTANCE_BATCH_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        
+        case TELEPHONE_BOOK_DISTANCE_BATCH_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        
+        default:
+            return 0;
+    }
+}
+
+static block_kernel get_block_kernel(void)
+{
+    switch (telephone_book_distance_batch_get_kernel())
+    {
+#ifdef HAVE_X86_KERNELS
+        case TELEPHONE_BOOK_DISTANCE_BATCH_SSE2:
+            return sse2_kernel;
+        
+        case TELEPHONE_BOOK_DISTANCE_BATCH_AVX2:
+            return avx2_kernel;
+#endif
+        
+        default:
+            return scalar_kernel;
+    }
+}
+
+telephone_book_distance_batch*
+telephone_book_distance_batch_alloc(const char* const* words, int size)
+{
+    telephone_book_distance_batch* batch;
+    size_t length_counts[MAX_LENGTH + 2] = { 0 };
+    size_t length;
+    size_t character_count = 0;
+    int* sorted_indices;
+    int word_count = 0;
+    int slot;
+    int i;
+    int j;
+    
+    if (!words || size < 0)
+    {
+        return NULL;
+    }
+    
+    for (i = 0; i < size; ++i)
+    {
+        if (!words[i])
+        {
+            continue;
+        }
+        
+        length = strlen(words[i]);
+        
+        if (length > MAX_LENGTH)
+        {
+            return NULL;
+        }
+        
+        ++length_counts[length + 1];
+        ++word_count;
+    }
+    
+    /* Order the words by length so that each block wastes little work: */
+    for (length = 1; length <= MAX_LENGTH + 1; ++length)
+    {
+        length_counts[length] += length_counts[length - 1];
+    }
+    
+    batch = malloc(sizeof *batch);
+    
+    if (!batch)
+    {
+        return NULL;
+    }
+    
+    batch->block_count = (word_count + LANES - 1) / LANES;
+    batch->word_indices = malloc((batch->block_count * LANES + 1) *
+                                 sizeof *batch->word_indices);
+    batch->word_lengths = calloc(batch->block_count * LANES + 1,
+                                 sizeof *batch->word_lengths);
+    batch->block_lengths = malloc(batch->block_count + 1);
+    batch->block_offsets = malloc((batch->block_count + 1) *
+                                  sizeof *batch->block_offsets);
+    batch->characters = NULL;
+    
+    /* ALLOCATED: batch, sorted_indices */
+    sorted_indices = malloc((word_count + 1) * sizeof *sorted_indices);
+    
+    if (!batch->word_indices ||
+        !batch->word_lengths ||
+        !batch->block_lengths ||
+        !batch->block_offsets ||
+        !sorted_indices)
+    {
+        free(sorted_indices);
+        telephone_book_distance_batch_free(batch);
+        return NULL;
+    }
+    
+    for (i = 0; i < size; ++i)
+    {
+        if (words[i])
+        {
+            sorted_indices[length_counts[strlen(words[i])]++] = i;
+        }
+    }
+    
+    for (i = 0; i < batch->block_count * LANES; ++i)
+    {
+        batch->word_indices[i] = i < word_count ? sorted_indices[i] : -1;
+        
+        if (i < word_count)
+        {
+            batch->word_lengths[i] =
+                (unsigned char) strlen(words[sorted_indices[i]]);
+        }
+    }
+    
+    free(sorted_indices);
+    
+    for (i = 0; i < batch->block_count; ++i)
+    {
+        /* The words are sorted, so the last full lane is the longest: */
+        slot = i * LANES + LANES - 1;
+        
+        while (batch->word_indices[slot] < 0)
+        {
+            --slot;
+        }
+        
+        batch->block_lengths[i] = batch->word_lengths[slot];
+        batch->block_offsets[i] = character_count;
+        character_count += (size_t) batch->block_lengths[i] * LANES;
+    }
+    
+    batch->characters = calloc(character_count + 1,
+                               sizeof *batch->characters);
+    
+    if (!batch->characters)
+    {
+        telephone_book_distance_batch_free(batch);
+        return NULL;
+    }
+    
+    for (i = 0; i < batch->block_count * LANES; ++i)
+    {
+        if (batch->word_indices[i] < 0)
+        {
+            continue;
+        }
+        
+        for (j = 0; j < batch->word_lengths[i]; ++j)
+        {
+            batch->characters[batch->block_offsets[i / LANES] +
+                              (size_t) j * LANES + i % LANES] =
+                telephone_book_distance_fold(
+                                        words[batch->word_indices[i]][j]);
+        }
+    }
+    
+    return batch;
+}
+
+int telephone_book_distance_batch_compute(
+                            const telephone_book_distance_batch* batch,
+                            const char* query,
+                            unsigned char* distances)
+{
+    return telephone_book_distance_batch_compute_many(batch,
+                                                      &query,
+                                                      1,
+                                                      distances,
+                                                      0);
+}
+
+int telephone_book_distance_batch_compute_many(
+                            const telephone_book_distance_batch* batch,
+                            const char* const* queries,
+                            int query_count,
+                            unsigned char* distances,
+                            size_t distance_stride)
+{
+    unsigned char folded_query[MAX_LENGTH];
+    unsigned char rows[(MAX_LENGTH + 1) * LANES];
+    block_kernel kernel = get_block_kernel();
+    unsigned char* query_distances;
+    size_t query_length;
+    size_t i;
+    int chunk_begin;
+    int chunk_end;
+    int block;
+    int slot;
+    int q;
+    int l;
+    
+    if (!batch || !queries || query_count < 0 || !distances)
+    {
+        return 1;
+    }
+    
+    for (q = 0; q < query_count; ++q)
+    {
+        if (!queries[q] || strlen(queries[q]) > MAX_LENGTH)
+        {
+            return 1;
+        }
+    }
+    
+    /* Each chunk of blocks is loaded into the cache once, and then run */
+    /* against every query: */
+    for (chunk_begin = 0; chunk_begin < batch->block_count;
+         chunk_begin = chunk_end)
+    {
+        chunk_end = chunk_begin + 1;
+        
+        while (chunk_end < batch->block_count &&
+               batch->block_offsets[chunk_end] -
+               batch->block_offsets[chunk_begin] < CACHE_BLOCK_SIZE)
+        {
+            ++chunk_end;
+        }
+        
+        for (q = 0; q < query_count; ++q)
+        {
+            query_length = strlen(queries[q]);
+            query_distances = &distances[q * distance_stride];
+            
+            for (i = 0; i < query_length; ++i)
+            {
+                folded_query[i] = telephone_book_distance_fold(queries[q][i]);
+            }
+            
+            for (block = chunk_begin; block < chunk_end; ++block)
+            {
+                kernel(&batch->characters[batch->block_offsets[block]],
+                       batch->block_lengths[block],
+                       folded_query,
+                       query_length,
+                       rows);
+                
+                /* Each lane ends at the column of its own length: */
+                for (l = 0; l < LANES; ++l)
+                {
+                    slot = block * LANES + l;
+                    
+                    if (batch->word_indices[slot] >= 0)
+                    {
+                        query_distances[batch->word_indices[slot]] =
+                            rows[batch->word_lengths[slot] * LANES + l];
+                    }
+                }
+            }
+        }
+    }
+    
+    return 0;
+}
+
+int telephone_book_distance_batch_compute_blocks(
+                            const telephone_book_distance_batch* batch,
+                            const char* query,
+                            int first_block,
+                            int block_count,
+                            unsigned char* lane_distances)
+{
+    unsigned char folded_query[MAX_LENGTH];
+    unsigned char rows[(MAX_LENGTH + 1) * LANES];
+    block_kernel kernel = get_block_kernel();
+    size_t query_length;
+    size_t i;
+    int block;
+    int slot;
+    int l;
+    
+    if (!batch || !query || !lane_distances || first_block < 0 ||
+        block_count < 0 || first_block + block_count > batch->block_count)
+    {
+        return 1;
+    }
+    
+    query_length = strlen(query);
+    
+    if (query_length > MAX_LENGTH)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i < query_length; ++i)
+    {
+        folded_query[i] = telephone_book_distance_fold(query[i]);
+    }
+    
+    for (block = first_block; block < first_block + block_count; ++block)
+    {
+        kernel(&batch->characters[batch->block_offsets[block]],
+               batch->block_lengths[block],
+               folded_query,
+               query_length,
+               rows);
+        
+        for (l = 0; l < LANES; ++l)
+        {
+            slot = block * LANES + l;
+            lane_distances[(block - first_block) * LANES + l] =
+                rows[batch->word_lengths[slot] * LANES + l];
+        }
+    }
+    
+    return 0;
+}
+
+void telephone_book_distance_batch_free(telephone_book_distance_batch* batch)
+{
+    if (!batch)
+    {
+        return;
+    }
+    
+    free(batch->word_indices);
+    free(batch->word_lengths);
+    free(batch->block_lengths);
+    free(batch->block_offsets);
+    free(batch->characters);
+    free(batch);
+}
+
+/*******************************************************************************
+* Chooses the fastest kernel the processor supports as the default kernel.     *
+*******************************************************************************/
+static void choose_default_kernel(void)
+{
+    default_kernel =
+        is_kernel_supported(TELEPHONE_BOOK_DISTANCE_BATCH_AVX2) ?
+            TELEPHONE_BOOK_DISTANCE_BATCH_AVX2 :
+        is_kernel_supported(TELEPHONE_BOOK_DISTANCE_BATCH_SSE2) ?
+            TELEPHONE_BOOK_DISTANCE_BATCH_SSE2 :
+            TELEPHONE_BOOK_DISTANCE_BATCH_SCALAR;
+}
+
+telephone_book_distance_batch_kernel
+telephone_book_distance_batch_get_kernel(void)
+{
+    if (selected_kernel >= 0)
+    {
+        return (telephone_book_distance_batch_kernel) selected_kernel;
+    }
+    
+#ifdef _WIN32
+    /* There are no other threads to race with: */
+    choose_default_kernel();
+#else
+    pthread_once(&default_kernel_once, choose_default_kernel);
+#endif
+    
+    return default_kernel;
+}
+
+int telephone_book_distance_batch_set_kernel(
+                            telephone_book_distance_batch_kernel kernel)
+{
+    if (!is_kernel_supported(kernel))
+    {
+        return 1;
+    }
+    
+    selected_kernel = kernel;
+    return 0;
+}
@@ -0,0 +1,133 @@
+#ifndef TELEPHONE_BOOK_DISTANCE_BATCH_H
+#define TELEPHONE_BOOK_DISTANCE_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************************************************************************
+* The number of words whose distances to a query are computed at once. A block *
+* of words fills one AVX2 register, or two SSE2 registers, per name position.  *
+*******************************************************************************/
+#define TELEPHONE_BOOK_DISTANCE_BATCH_LANES 32
+
+/*******************************************************************************
+* The longest word or query the batch kernels accept. Distances are kept in    *
+* bytes, and the distance between two words never exceeds the longer one.      *
+*******************************************************************************/
+#define TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH 255
+
+/*******************************************************************************
+* This enumeration lists the implementations of the batch kernel.              *
+*******************************************************************************/
+typedef enum {
+    TELEPHONE_BOOK_DISTANCE_BATCH_SCALAR,
+    TELEPHONE_BOOK_DISTANCE_BATCH_SSE2,
+    TELEPHONE_BOOK_DISTANCE_BATCH_AVX2
+} telephone_book_distance_batch_kernel;
+
+/*******************************************************************************
+* This structure holds a set of words laid out for the batch kernel. The words *
+* are grouped by length into blocks of 'TELEPHONE_BOOK_DISTANCE_BATCH_LANES'   *
+* lanes, and each block is stored transposed: character 'j' of the word in     *
+* lane 'l' of block 'b' is at 'characters[block_offsets[b] + j * LANES + l]',  *
+* case-folded. Lane 'l' of block 'b' holds the word with index                 *
+* 'word_indices[b * LANES + l]' (-1 for an empty lane) and length              *
+* 'word_lengths[b * LANES + l]'.                                               *
+*******************************************************************************/
+typedef struct {
+    int block_count;
+    int* word_indices;
+    unsigned char* word_lengths;
+    unsigned char* block_lengths;
+    size_t* block_offsets;
+    unsigned char* characters;
+} telephone_book_distance_batch;
+
+
+
+
+/*******************************************************************************
+* Builds a batch over the 'size' words in 'words'. The word at position 'i' is *
+* reported under the index 'i'. NULL words are left out of the batch.          *
+* ---                                                                          *
+* Returns the new batch or NULL if something goes wrong, which includes a word *
+* longer than 'TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH'.                      *
+*******************************************************************************/
+telephone_book_distance_batch*
+telephone_book_distance_batch_alloc(const char* const* words, int size);
+
+/*******************************************************************************
+* Computes the case-insensitive Levenshtein distance between 'query' and every *
+* word of the batch. The distance to the word with index 'i' is stored in      *
+* 'distances[i]'; the entries of the words left out of the batch are not       *
+* touched.                                                                     *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the query is longer than    *
+* 'TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH'.                                  *
+*******************************************************************************/
+int telephone_book_distance_batch_compute(
+                            const telephone_book_distance_batch* batch,
+                            const char* query,
+                            unsigned char* distances);
+
+/*******************************************************************************
+* Computes the distances between every word of the batch and each of the       *
+* 'query_count' queries in 'queries', which go to 'distances + q *             *
+* distance_stride' for the query 'q'. The words are streamed through the cache *
+* in chunks, and all the queries run over a chunk before the next one is       *
+* loaded, so that a large batch is read from memory once per call rather than  *
+* once per query.                                                              *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if a query is longer than      *
+* 'TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH', in which case nothing is         *
+* computed.                                                                    *
+*******************************************************************************/
+int telephone_book_distance_batch_compute_many(
+                            const telephone_book_distance_batch* batch,
+                            const char* const* queries,
+                            int query_count,
+                            unsigned char* distances,
+                            size_t distance_stride);
+
+/*******************************************************************************
+* Computes the distances between 'query' and the words of the 'block_count'    *
+* blocks starting at block 'first_block', in lane order: the distance to the   *
+* word in lane 'l' of block 'first_block + b' goes to                          *
+* 'lane_distances[b * LANES + l]'. The entries of empty lanes are meaningless. *
+* This lets a caller walk a large batch a few blocks at a time, and consume    *
+* the distances while the blocks are in the cache.                             *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the blocks are out of range *
+* or the query is longer than 'TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH'.      *
+*******************************************************************************/
+int telephone_book_distance_batch_compute_blocks(
+                            const telephone_book_distance_batch* batch,
+                            const char* query,
+                            int first_block,
+                            int block_count,
+                            unsigned char* lane_distances);
+
+/*******************************************************************************
+* Frees all the memory occupied by the batch.                                  *
+*******************************************************************************/
+void telephone_book_distance_batch_free(telephone_book_distance_batch* batch);
+
+/*******************************************************************************
+* Returns the kernel the batches use. Unless one is selected, this is the      *
+* fastest kernel the processor supports.                                       *
+*******************************************************************************/
+telephone_book_distance_batch_kernel
+telephone_book_distance_batch_get_kernel(void);
+
+/*******************************************************************************
+* Makes the batches use the kernel 'kernel', which is mostly useful to compare *
+* the kernels against each other. Unlike choosing the default kernel, this is  *
+* not safe while other threads use batches.                                    *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the processor or the        *
+* compiler does not support the kernel.                                        *
+*******************************************************************************/
+int telephone_book_distance_batch_set_kernel(
+                            telephone_book_distance_batch_kernel kernel);
+
+#endif /* TELEPHONE_BOOK_DISTANCE_BATCH_H */
@@ -0,0 +1,237 @@
+#include "telephone_book_id_index.h"
+#include "telephone_book_counter.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Fibonacci hashing: spreads runs of consecutive IDs over distinct slots. */
+#define HASH_MULTIPLIER 2654435769u
+#define MINIMUM_SLOT_COUNT 64
+
+static size_t allocation_count = 0;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_id_index.h             *
+*******************************************************************************/
+
+
+static size_t home_slot(int id, size_t slot_mask)
+{
+    return (size_t) ((uint32_t) id * HASH_MULTIPLIER) & slot_mask;
+}
+
+static telephone_book_id_index_slot* alloc_slots(size_t slot_count)
+{
+    telephone_book_id_index_slot* slots = malloc(slot_count * sizeof *slots);
+    size_t i;
+    
+    if (!slots)
+    {
+        return NULL;
+    }
+    
+    TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 1);
+    
+    for (i = 0; i < slot_count; ++i)
+    {
+        slots[i].node = NULL;
+    }
+    
+    return slots;
+}
+
+/*******************************************************************************
+* Returns the slot holding the ID 'id', or the empty slot where it belongs.    *
+*******************************************************************************/
+static telephone_book_id_index_slot*
+find_slot(const telephone_book_id_index* index, int id)
+{
+    size_t i = home_slot(id, index->slot_mask);
+    
+    while (index->slots[i].node && index->slots[i].id != id)
+    {
+        i = (i + 1) & index->slot_mask;
+    }
+    
+    return &index->slots[i];
+}
+
+/*******************************************************************************
+* Doubles the slot table.                                                      *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int grow_slots(telephone_book_id_index* index)
+{
+    size_t new_mask = 2 * index->slot_mask + 1;
+    telephone_book_id_index_slot* new_slots = alloc_slots(new_mask + 1);
+    size_t i;
+    size_t j;
+    
+    if (!new_slots)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i <= index->slot_mask; ++i)
+    {
+        if (!index->slots[i].node)
+        {
+            continue;
+        }
+        
+        /* The IDs are distinct, so just find the first empty slot: */
+        for (j = home_slot(index->slots[i].id, new_mask);
+             new_slots[j].node;
+             j = (j + 1) & new_mask)
+        {
+        }
+        
+        new_slots[j] = index->slots[i];
+    }
+    
+    free(index->slots);
+    index->slots = new_slots;
+    index->slot_mask = new_mask;
+    return 0;
+}
+
+telephone_book_id_index* telephone_book_id_index_alloc(size_t capacity)
+{
+    telephone_book_id_index* index = malloc(sizeof *index);
+    size_t slot_count = MINIMUM_SLOT_COUNT;
+    
+    if (!index)
+    {
+        return NULL;
+    }
+    
+    TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 1);
+    
+    /* Keep the load factor at most one half: */
+    while (slot_count < 2 * capacity)
+    {
+        slot_count *= 2;
+    }
+    
+    index->size = 0;
+    index->slot_mask = slot_count - 1;
+    index->slots = alloc_slots(slot_count);
+    
+    if (!index->slots)
+    {
+        free(index);
+        return NULL;
+    }
+    
+    return index;
+}
+
+telephone_book_id_index_slot*
+telephone_book_id_index_find(const telephone_book_id_index* index, int id)
+{
+    telephone_book_id_index_slot* slot;
+    
+    if (!index)
+    {
+        return NULL;
+    }
+    
+    slot = find_slot(index, id);
+    return slot->node ? slot : NULL;
+}
+
+int telephone_book_id_index_add(
+                        telephone_book_id_index* index,
+                        int id,
+                        struct telephone_book_record_list_node* node,
+                        struct telephone_book_record_list_node* previous_node)
+{
+    telephone_book_id_index_slot* slot;
+    
+    if (!index || !node)
+    {
+        return 1;
+    }
+    
+    if (2 * (index->size + 1) > index->slot_mask && grow_slots(index))
+    {
+        return 1;
+    }
+    
+    slot = find_slot(index, id);
+    
+    if (slot->node)
+    {
+        return 1;
+    }
+    
+    slot->id = id;
+    slot->node = node;
+    slot->previous_node = previous_node;
+    index->size++;
+    return 0;
+}
+
+void telephone_book_id_index_remove(telephone_book_id_index* index, int id)
+{
+    telephone_book_id_index_slot* slot;
+    size_t hole;
+    size_t i;
+    size_t home;
+    
+    if (!index)
+    {
+        return;
+    }
+    
+    slot = find_slot(index, id);
+    
+    if (!slot->node)
+    {
+        return;
+    }
+    
+    /* Shift the later entries of the probe run back over the hole, so that */
+    /* no tombstones are needed: */
+    hole = (size_t) (slot - index->slots);
+    i = hole;
+    
+    for (;;)
+    {
+        i = (i + 1) & index->slot_mask;
+        
+        if (!index->slots[i].node)
+        {
+            break;
+        }
+        
+        home = home_slot(index->slots[i].id, index->slot_mask);
+        
+        /* Move the entry unless its home lies cyclically in (hole, i]: */
+        if (((i - home) & index->slot_mask) >=
+            ((i - hole) & index->slot_mask))
+        {
+            index->slots[hole] = index->slots[i];
+            hole = i;
+        }
+    }
+    
+    index->slots[hole].node = NULL;
+    index->size--;
+}
+
+void telephone_book_id_index_free(telephone_book_id_index* index)
+{
+    if (!index)
+    {
+        return;
+    }
+    
+    free(index->slots);
+    free(index);
+}
+
+size_t telephone_book_id_index_allocation_count(void)
+{
+    return TELEPHONE_BOOK_COUNTER_READ(allocation_count);
+}
@@ -0,0 +1,76 @@
+#ifndef TELEPHONE_BOOK_ID_INDEX_H
+#define TELEPHONE_BOOK_ID_INDEX_H
+
+#include <stddef.h>
+
+struct telephone_book_record_list_node;
+
+/*******************************************************************************
+* This structure holds a slot of an ID index: the node of the record with the  *
+* ID 'id', and the node before it in its list, or NULL if it is the head. An   *
+* empty slot has a NULL node.                                                  *
+*******************************************************************************/
+typedef struct {
+    int id;
+    struct telephone_book_record_list_node* node;
+    struct telephone_book_record_list_node* previous_node;
+} telephone_book_id_index_slot;
+
+/*******************************************************************************
+* This structure holds an ID index: an open addressing table with linear       *
+* probing that maps each record ID of a list to its node. The IDs must be      *
+* distinct.                                                                    *
+*******************************************************************************/
+typedef struct {
+    telephone_book_id_index_slot* slots;
+    size_t slot_mask;
+    size_t size;
+} telephone_book_id_index;
+
+
+
+
+/*******************************************************************************
+* Allocates an empty ID index with room for 'capacity' IDs before it grows.    *
+* ---                                                                          *
+* Returns the new index or NULL if something goes wrong.                       *
+*******************************************************************************/
+telephone_book_id_index* telephone_book_id_index_alloc(size_t capacity);
+
+/*******************************************************************************
+* Looks up the ID 'id'.                                                        *
+* ---                                                                          *
+* Returns the slot of the ID, or NULL if the index does not contain it.        *
+*******************************************************************************/
+telephone_book_id_index_slot*
+telephone_book_id_index_find(const telephone_book_id_index* index, int id);
+
+/*******************************************************************************
+* Maps the ID 'id' to the node 'node', which follows 'previous_node'.          *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the ID is already in the    *
+* index or something fails.                                                    *
+*******************************************************************************/
+int telephone_book_id_index_add(
+                        telephone_book_id_index* index,
+                        int id,
+                        struct telephone_book_record_list_node* node,
+                        struct telephone_book_record_list_node* previous_node);
+
+/*******************************************************************************
+* Removes the ID 'id' from the index, if present.                              *
+*******************************************************************************/
+void telephone_book_id_index_remove(telephone_book_id_index* index, int id);
+
+/*******************************************************************************
+* Frees all the memory occupied by the ID index. The nodes are left to their   *
+* list.                                                                        *
+*******************************************************************************/
+void telephone_book_id_index_free(telephone_book_id_index* index);
+
+/*******************************************************************************
+* Returns the number of heap blocks allocated by all the ID indices so far.    *
+*******************************************************************************/
+size_t telephone_book_id_index_allocation_count(void);
+
+#endif /* TELEPHONE_BOOK_ID_INDEX_H */
@@ -0,0 +1,230 @@
+#include "telephone_book_intern.h"
+#include "telephone_book_counter.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+#define INITIAL_NAME_CAPACITY 64
+
+static size_t allocation_count = 0;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_intern.h               *
+*******************************************************************************/
+
+
+static uint32_t hash_name(const char* name, size_t length)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+    size_t i;
+    
+    for (i = 0; i < length; ++i)
+    {
+        hash ^= (unsigned char) name[i];
+        hash *= FNV_PRIME;
+    }
+    
+    return hash;
+}
+
+static telephone_book_intern_slot* alloc_slots(size_t slot_count)
+{
+    telephone_book_intern_slot* slots = malloc(slot_count * sizeof *slots);
+    size_t i;
+    
+    if (!slots)
+    {
+        return NULL;
+    }
+    
+    TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 1);
+    
+    for (i = 0; i < slot_count; ++i)
+    {
+        slots[i].name_id = -1;
+    }
+    
+    return slots;
+}
+
+/*******************************************************************************
+* Returns the slot holding the name 'name' with hash 'hash', or the empty slot *
+* where such a name belongs.                                                   *
+*******************************************************************************/
+static telephone_book_intern_slot*
+find_slot(const telephone_book_intern_table* table,
+          const char* name,
+          size_t length,
+          uint32_t hash)
+{
+    size_t i = (size_t) hash & table->slot_mask;
+    telephone_book_intern_slot* slot;
+    
+    for (;; i = (i + 1) & table->slot_mask)
+    {
+        slot = &table->slots[i];
+        
+        if (slot->name_id < 0)
+        {
+            return slot;
+        }
+        
+        if (slot->hash == hash &&
+            table->name_lengths[slot->name_id] == length &&
+            memcmp(table->names[slot->name_id], name, length) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+/*******************************************************************************
+* Doubles the slot table.                                                      *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int grow_slots(telephone_book_intern_table* table)
+{
+    size_t new_mask = 2 * table->slot_mask + 1;
+    telephone_book_intern_slot* new_slots = alloc_slots(new_mask + 1);
+    size_t i;
+    size_t j;
+    
+    if (!new_slots)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i <= table->slot_mask; ++i)
+    {
+        if (table->slots[i].name_id < 0)
+        {
+            continue;
+        }
+        
+        /* The names are distinct, so just find the first empty slot: */
+        for (j = (size_t) table->slots[i].hash & new_mask;
+             new_slots[j].name_id >= 0;
+             j = (j + 1) & new_mask)
+        {
+        }
+        
+        new_slots[j] = table->slots[i];
+    }
+    
+    free(table->slots);
+    table->slots = new_slots;
+    table->slot_mask = new_mask;
+    return 0;
+}
+
+telephone_book_intern_table* telephone_book_intern_table_alloc(void)
+{
+    telephone_book_intern_table* table = malloc(sizeof *table);
+    
+    if (!table)
+    {
+        return NULL;
+    }
+    
+    TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 1);
+    table->size = 0;
+    table->capacity = INITIAL_NAME_CAPACITY;
+    table->slot_mask = 2 * INITIAL_NAME_CAPACITY - 1;
+    table->names = malloc(table->capacity * sizeof *table->names);
+    table->name_lengths = malloc(table->capacity * sizeof *table->name_lengths);
+    table->slots = alloc_slots(table->slot_mask + 1);
+    TELEPHONE_BOOK_COUNTER_ADD(allocation_count, 2);
+    
+    if (!table->names || !table->name_lengths || !table->slots)
+    {
+        telephone_book_intern_table_free(table);
+        return NULL;
+    }
+    
+    return table;
+}
+
+int telephone_book_intern_table_find(const telephone_book_intern_table* table,
+                                     const char* name,
+                                     size_t length)
+{
+    if (!table)
+    {
+        return -1;
+    }
+    
+    return find_slot(table, name, length, hash_name(name, length))->name_id;
+}
+
+int telephone_book_intern_table_add(telephone_book_intern_table* table,
+                                    const char* name,
+                                    size_t length)
+{
+    telephone_book_intern_slot* slot;
+    const char** new_names;
+    uint32_t* new_name_lengths;
+    uint32_t hash;
+    
+    if (!table || length > UINT32_MAX)
+    {
+        return -1;
+    }
+    
+    if (table->size == table->capacity)
+    {
+        new_names = realloc(table->names,
+                            2 * table->capacity * sizeof *table->names);
+        
+        if (!new_names)
+        {
+            return -1;
+        }
+        
+        table->names = new_names;
+        new_name_lengths = realloc(table->name_lengths,
+                                   2 * table->capacity *
+                                   sizeof *table->name_lengths);
+        
+        if (!new_name_lengths)
+        {
+            return -1;
+        }
+        
+        table->name_lengths = new_name_lengths;
+        table->capacity *= 2;
+    }
+    
+    /* Keep the load factor at most one half: */
+    if (2 * (size_t) (table->size + 1) > table->slot_mask && grow_slots(table))
+    {
+        return -1;
+    }
+    
+    hash = hash_name(name, length);
+    slot = find_slot(table, name, length, hash);
+    slot->hash = hash;
+    slot->name_id = table->size;
+    table->names[table->size] = name;
+    table->name_lengths[table->size] = (uint32_t) length;
+    return table->size++;
+}
+
+void telephone_book_intern_table_free(telephone_book_intern_table* table)
+{
+    if (!table)
+    {
+        return;
+    }
+    
+    free(table->names);
+    free(table->name_lengths);
+    free(table->slots);
+    free(table);
+}
+
+size_t telephone_book_intern_allocation_count(void)
+{
+    return TELEPHONE_BOOK_COUNTER_READ(allocation_count);
+}
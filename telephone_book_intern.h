@@ -0,0 +1,71 @@
+#ifndef TELEPHONE_BOOK_INTERN_H
+#define TELEPHONE_BOOK_INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************************************************************************
+* This structure holds a slot of the open addressing table of an intern table. *
+* An empty slot has a negative name ID.                                        *
+*******************************************************************************/
+typedef struct {
+    uint32_t hash;
+    int name_id;
+} telephone_book_intern_slot;
+
+/*******************************************************************************
+* This structure holds an intern table: a set of distinct names, each with a   *
+* dense ID from zero to 'size - 1' in the order the names were added. The      *
+* table keeps pointers to canonical copies of the names, which are owned by    *
+* the caller and must outlive the table.                                       *
+*******************************************************************************/
+typedef struct {
+    const char** names;
+    uint32_t* name_lengths;
+    int size;
+    int capacity;
+    telephone_book_intern_slot* slots;
+    size_t slot_mask;
+} telephone_book_intern_table;
+
+
+
+
+/*******************************************************************************
+* Allocates an empty intern table.                                             *
+* ---                                                                          *
+* Returns the new table or NULL if something goes wrong.                       *
+*******************************************************************************/
+telephone_book_intern_table* telephone_book_intern_table_alloc(void);
+
+/*******************************************************************************
+* Looks up the name 'name' of length 'length'.                                 *
+* ---                                                                          *
+* Returns the ID of the name, or -1 if the table does not contain it.          *
+*******************************************************************************/
+int telephone_book_intern_table_find(const telephone_book_intern_table* table,
+                                     const char* name,
+                                     size_t length);
+
+/*******************************************************************************
+* Adds the name 'name' of length 'length', which must not be in the table yet. *
+* The name is not copied, so it becomes the canonical copy.                    *
+* ---                                                                          *
+* Returns the ID of the new name, or -1 if something fails.                    *
+*******************************************************************************/
+int telephone_book_intern_table_add(telephone_book_intern_table* table,
+                                    const char* name,
+                                    size_t length);
+
+/*******************************************************************************
+* Frees all the memory occupied by the intern table. The names are left to     *
+* their owners.                                                                *
+*******************************************************************************/
+void telephone_book_intern_table_free(telephone_book_intern_table* table);
+
+/*******************************************************************************
+* Returns the number of heap blocks allocated by all the intern tables so far. *
+*******************************************************************************/
+size_t telephone_book_intern_allocation_count(void);
+
+#endif /* TELEPHONE_BOOK_INTERN_H */
@@ -1,108 +1,808 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+/* For 'madvise': */
+#define _DEFAULT_SOURCE
+#endif
+
 #include "telephone_book_io.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/locking.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2_SCAN
+#endif
+
+#define MAX_RECORD_TOKEN_LENGTH TELEPHONE_BOOK_MAX_FIELD_LENGTH
+#define RECORD_TOKEN_COUNT 4
+#define NEXT_ID_TOKEN_COUNT 2
+#define NEXT_ID_LINE_LENGTH 256
+#define READ_BLOCK_SIZE (1024 * 1024)
+#define WRITE_BUFFER_SIZE (1024 * 1024)
+
+/* The bytes the tokenizer classifies at once, one bit of a mask each: */
+#define SCAN_BLOCK_SIZE 64
 
-#define TOKEN_SCAN_FORMAT "%64s"
-#define MAX_RECORD_TOKEN_LENGTH 65
+/* The records carved from the arena at once, which double from chunk to */
+/* chunk: */
+#define MIN_RECORD_CHUNK_SIZE 4096
+#define MAX_RECORD_CHUNK_SIZE (128 * 1024)
+
+/* The longest formatted 'int' and the three spaces and newline of a line: */
+#define MAX_RECORD_LINE_OVERHEAD (11 + 4)
+
+/* The byte classes of the tokenizer: */
+#define BYTE_TOKEN 0
+#define BYTE_SEPARATOR 1
+#define BYTE_NEWLINE 2
 
 /*******************************************************************************
 * Documentation comments may be found in telephone_book_io.h                   *
 *******************************************************************************/
 
 
-telephone_book_record_list* telephone_book_record_list_read_from_file(FILE* f)
+/*******************************************************************************
+* Returns the table mapping each byte to its class: the whitespace characters  *
+* of the C locale separate the tokens, except the newline, which ends a line.  *
+* One lookup per byte then tells the tokenizer everything it needs.            *
+*******************************************************************************/
+static const unsigned char* get_byte_class_table(void)
 {
-    telephone_book_record_list* record_list;
-    telephone_book_record* current_record;
+    static unsigned char byte_class_table[256];
+    static int is_initialized = 0;
     
-    char last_name_token   [MAX_RECORD_TOKEN_LENGTH];
-    char first_name_token  [MAX_RECORD_TOKEN_LENGTH];
-    char phone_number_token[MAX_RECORD_TOKEN_LENGTH];
-    int  id_holder;
-    int read_result;
+    if (!is_initialized)
+    {
+        byte_class_table[' '] = BYTE_SEPARATOR;
+        byte_class_table['\t'] = BYTE_SEPARATOR;
+        byte_class_table['\r'] = BYTE_SEPARATOR;
+        byte_class_table['\v'] = BYTE_SEPARATOR;
+        byte_class_table['\f'] = BYTE_SEPARATOR;
+        byte_class_table['\n'] = BYTE_NEWLINE;
+        is_initialized = 1;
+    }
     
-    if (!f)
+    return byte_class_table;
+}
+
+/*******************************************************************************
+* Asks the system to back the block 'memory' of 'size' bytes with huge pages   *
+* where it can. The text reader touches every page of its large blocks once,   *
+* and faulting them in a small page at a time costs more than reading the      *
+* file. Only the whole pages of the block are advised, a failure just keeps    *
+* the small pages, and where the advice does not exist this does nothing.      *
+*******************************************************************************/
+static void advise_huge_pages(void* memory, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+    uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t) memory + page_size - 1) /
+                      page_size * page_size;
+    uintptr_t end = ((uintptr_t) memory + size) / page_size * page_size;
+    
+    if (end > begin)
+    {
+        madvise((void*) begin, end - begin, MADV_HUGEPAGE);
+    }
+#else
+    (void) memory;
+    (void) size;
+#endif
+}
+
+/*******************************************************************************
+* Reads the rest of the file into one heap block, terminated by a newline and  *
+* followed by 'SCAN_BLOCK_SIZE' zero bytes, so that the tokenizer may look at  *
+* whole blocks and needs no end checks. The file is read in large blocks, and  *
+* the block is trimmed to its final size.                                      *
+* ---                                                                          *
+* Returns the contents and stores their size without the terminators in        *
+* 'size', or returns NULL if something fails.                                  *
+*******************************************************************************/
+static char* read_contents(FILE* f, size_t* size)
+{
+    char* contents;
+    char* new_contents;
+    size_t capacity = READ_BLOCK_SIZE;
+    size_t length = 0;
+    size_t read_count;
+    long position;
+    long end_position;
+    
+    /* Read a regular file in one go: */
+    position = ftell(f);
+    
+    if (position >= 0 && fseek(f, 0, SEEK_END) == 0)
+    {
+        end_position = ftell(f);
+        
+        if (fseek(f, position, SEEK_SET))
+        {
+            return NULL;
+        }
+        
+        if (end_position > position)
+        {
+            capacity = (size_t) (end_position - position) + 1;
+        }
+    }
+    
+    /* ALLOCATED: contents */
+    contents = malloc(capacity + 1 + SCAN_BLOCK_SIZE);
+    
+    if (!contents)
     {
         return NULL;
     }
     
-    record_list = telephone_book_record_list_alloc();
+    for (;;)
+    {
+        advise_huge_pages(&contents[length], capacity - length);
+        read_count = fread(&contents[length], 1, capacity - length, f);
+        length += read_count;
+        
+        if (length < capacity)
+        {
+            break;
+        }
+        
+        new_contents = realloc(contents, 2 * capacity + 1 + SCAN_BLOCK_SIZE);
+        
+        if (!new_contents)
+        {
+            free(contents);
+            return NULL;
+        }
+        
+        contents = new_contents;
+        capacity *= 2;
+    }
     
-    if (!record_list)
+    if (ferror(f))
     {
+        free(contents);
         return NULL;
     }
     
-    while (!feof(f) && !ferror(f))
+    contents[length] = '\n';
+    memset(&contents[length + 1], 0, SCAN_BLOCK_SIZE);
+    
+    /* Give back the slack; a failure just keeps it. */
+    new_contents = realloc(contents, length + 1 + SCAN_BLOCK_SIZE);
+    contents = new_contents ? new_contents : contents;
+    
+    *size = length;
+    return contents;
+}
+
+/*******************************************************************************
+* Parses the record ID 'token' the way '%d' does: an optional sign followed by *
+* decimal digits.                                                              *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the token is not an 'int'.  *
+*******************************************************************************/
+static int parse_id(const char* token, int* id)
+{
+    long long value = 0;
+    int is_negative = 0;
+    
+    if (*token == '-' || *token == '+')
+    {
+        is_negative = *token++ == '-';
+    }
+    
+    if (*token == '\0')
+    {
+        return 1;
+    }
+    
+    for (; *token; ++token)
+    {
+        if (*token < '0' || *token > '9')
+        {
+            return 1;
+        }
+        
+        value = 10 * value + (*token - '0');
+        
+        if (value > (long long) INT_MAX + 1)
+        {
+            return 1;
+        }
+    }
+    
+    if (is_negative)
     {
-        read_result = fscanf(f,
-                             TOKEN_SCAN_FORMAT
-                             TOKEN_SCAN_FORMAT
-                             TOKEN_SCAN_FORMAT
-                             "%d\n",
-                             last_name_token,
-                             first_name_token,
-                             phone_number_token,
-                             &id_holder);
+        value = -value;
+    }
+    
+    if (value > INT_MAX)
+    {
+        return 1;
+    }
+    
+    *id = (int) value;
+    return 0;
+}
+
+/*******************************************************************************
+* This structure holds the state of the text reader between lines: the list    *
+* being read, the chunk of 'chunk_size' records and nodes the next records are *
+* carved from, and whether the high-water mark of the IDs was read.            *
+*******************************************************************************/
+typedef struct {
+    telephone_book_record_list* list;
+    telephone_book_record* records;
+    telephone_book_record_list_node* nodes;
+    int chunk_size;
+    int chunk_used;
+    int has_next_id;
+} text_reader;
+
+/*******************************************************************************
+* Returns the mask of the bytes of the 'SCAN_BLOCK_SIZE' bytes at 'block' that *
+* may end a token: bit 'i' is set if byte 'i' is whitespace. With SSE2, every  *
+* byte up to the space is flagged, so the caller looks the flagged bytes up in *
+* 'byte_class_table' again; elsewhere the table is used byte by byte.          *
+*******************************************************************************/
+static uint64_t scan_block(const char* block,
+                           const unsigned char* byte_class_table)
+{
+    uint64_t mask = 0;
+    int i;
+
+#ifdef HAVE_SSE2_SCAN
+    const __m128i space = _mm_set1_epi8(' ');
+    __m128i bytes;
+    
+    (void) byte_class_table;
+    
+    for (i = 0; i < SCAN_BLOCK_SIZE; i += 16)
+    {
+        /* The bytes up to the space are those their unsigned minimum keeps: */
+        bytes = _mm_loadu_si128((const __m128i*) &block[i]);
+        mask |= (uint64_t) (unsigned int)
+            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(bytes, space),
+                                             bytes)) << i;
+    }
+#else
+    for (i = 0; i < SCAN_BLOCK_SIZE; ++i)
+    {
+        mask |= (uint64_t)
+            (byte_class_table[(unsigned char) block[i]] != BYTE_TOKEN) << i;
+    }
+#endif
+    
+    return mask;
+}
+
+/*******************************************************************************
+* Returns the position of the lowest set bit of the non-zero 'mask'.           *
+*******************************************************************************/
+static int lowest_set_bit(uint64_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(mask);
+#else
+    int position = 0;
+    
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        ++position;
+    }
+    
+    return position;
+#endif
+}
+
+/*******************************************************************************
+* Adds the line number 'line_number', split into its 'token_count' tokens, to  *
+* the list of the reader. A negative 'token_count' marks a token longer than   *
+* 'MAX_RECORD_TOKEN_LENGTH' characters; only the first 'RECORD_TOKEN_COUNT'    *
+* tokens are in 'tokens'. Blank lines are skipped.                             *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails. If the     *
+* line is malformed, its number is stored in 'bad_line_number'.                *
+*******************************************************************************/
+static int add_line(text_reader* reader,
+                    char* tokens[RECORD_TOKEN_COUNT],
+                    int token_count,
+                    size_t line_number,
+                    size_t* bad_line_number)
+{
+    telephone_book_record_list* list = reader->list;
+    telephone_book_record* record;
+    telephone_book_record_list_node* node;
+    
+    if (token_count == 0)
+    {
+        return 0;
+    }
+    
+    /* Only the first line may state the high-water mark of the IDs: */
+    if (list->size == 0 &&
+        !reader->has_next_id &&
+        token_count == NEXT_ID_TOKEN_COUNT &&
+        strcmp(tokens[0], TELEPHONE_BOOK_TEXT_NEXT_ID_TAG) == 0)
+    {
+        reader->has_next_id = 1;
         
-        if (read_result == 4)
+        if (parse_id(tokens[1], &list->next_id) || list->next_id < 1)
         {
-            current_record = telephone_book_record_alloc(last_name_token,
-                                                         first_name_token,
-                                                         phone_number_token,
-                                                         id_holder);
-            if (!current_record)
+            if (bad_line_number)
             {
-                telephone_book_record_list_free(record_list);
-                return NULL;
+                *bad_line_number = line_number;
             }
             
-            if (telephone_book_record_list_add_record(record_list,
-                                                      current_record))
+            return 1;
+        }
+        
+        return 0;
+    }
+    
+    if (reader->chunk_used == reader->chunk_size)
+    {
+        if (reader->records && reader->chunk_size < MAX_RECORD_CHUNK_SIZE)
+        {
+            reader->chunk_size *= 2;
+        }
+        
+        reader->records = telephone_book_arena_allocate(
+                                list->arena,
+                                reader->chunk_size * sizeof *reader->records);
+        reader->nodes = telephone_book_arena_allocate(
+                                list->arena,
+                                reader->chunk_size * sizeof *reader->nodes);
+        reader->chunk_used = 0;
+        
+        if (!reader->records || !reader->nodes)
+        {
+            return 1;
+        }
+        
+        advise_huge_pages(reader->records,
+                          reader->chunk_size * sizeof *reader->records);
+        advise_huge_pages(reader->nodes,
+                          reader->chunk_size * sizeof *reader->nodes);
+    }
+    
+    record = &reader->records[reader->chunk_used];
+    node = &reader->nodes[reader->chunk_used];
+    
+    if (token_count != RECORD_TOKEN_COUNT || parse_id(tokens[3], &record->id))
+    {
+        if (bad_line_number)
+        {
+            *bad_line_number = line_number;
+        }
+        
+        return 1;
+    }
+    
+    ++reader->chunk_used;
+    record->last_name = tokens[0];
+    record->first_name = tokens[1];
+    record->telephone_number = tokens[2];
+    record->is_borrowed = 1;
+    
+    /* The names are interned when a store is built over the list: */
+    record->last_name_id = -1;
+    record->first_name_id = -1;
+    
+    node->record = record;
+    node->next = NULL;
+    node->is_borrowed = 1;
+    
+    if (list->tail)
+    {
+        list->tail->next = node;
+    }
+    else
+    {
+        list->head = node;
+    }
+    
+    list->tail = node;
+    ++list->size;
+    return 0;
+}
+
+telephone_book_record_list*
+telephone_book_record_list_read_from_file(FILE* f, size_t* bad_line_number)
+{
+    const unsigned char* byte_class_table = get_byte_class_table();
+    text_reader reader;
+    char* tokens[RECORD_TOKEN_COUNT];
+    char* contents;
+    char* contents_end;
+    char* block;
+    char* token;
+    char* end;
+    size_t contents_size;
+    size_t line_number = 1;
+    uint64_t mask;
+    int token_count = 0;
+    int byte_class;
+    
+    if (bad_line_number)
+    {
+        *bad_line_number = 0;
+    }
+    
+    if (!f)
+    {
+        return NULL;
+    }
+    
+    /* ALLOCATED: contents */
+    contents = read_contents(f, &contents_size);
+    
+    if (!contents)
+    {
+        return NULL;
+    }
+    
+    /* ALLOCATED: contents, reader.list */
+    reader.list = telephone_book_record_list_alloc_arena();
+    
+    if (!reader.list)
+    {
+        free(contents);
+        return NULL;
+    }
+    
+    /* From now on the list owns the contents, which the records point into: */
+    reader.list->storage = contents;
+    reader.list->storage_free = free;
+    reader.records = NULL;
+    reader.nodes = NULL;
+    reader.chunk_size = MIN_RECORD_CHUNK_SIZE;
+    reader.chunk_used = MIN_RECORD_CHUNK_SIZE;
+    reader.has_next_id = 0;
+    
+    /* The contents end with the newline at 'contents_end': */
+    contents_end = contents + contents_size;
+    token = contents;
+    
+    /* Each whitespace byte ends the token before it, if any, and becomes */
+    /* its NUL terminator; each newline then ends a line: */
+    for (block = contents; block <= contents_end; block += SCAN_BLOCK_SIZE)
+    {
+        for (mask = scan_block(block, byte_class_table);
+             mask;
+             mask &= mask - 1)
+        {
+            end = block + lowest_set_bit(mask);
+            
+            if (end > contents_end)
+            {
+                break;
+            }
+            
+            byte_class = byte_class_table[(unsigned char) *end];
+            
+            if (byte_class == BYTE_TOKEN)
             {
-                telephone_book_record_list_free(record_list);
-                telephone_book_record_free(current_record);
-                return NULL;
+                /* A control character within a token. */
+                continue;
+            }
+            
+            if (end > token && token_count >= 0)
+            {
+                if (end - token > MAX_RECORD_TOKEN_LENGTH)
+                {
+                    token_count = -1;
+                }
+                else if (token_count++ < RECORD_TOKEN_COUNT)
+                {
+                    tokens[token_count - 1] = token;
+                }
+            }
+            
+            *end = '\0';
+            token = end + 1;
+            
+            if (byte_class == BYTE_NEWLINE)
+            {
+                if (add_line(&reader,
+                             tokens,
+                             token_count,
+                             line_number,
+                             bad_line_number))
+                {
+                    telephone_book_record_list_free(reader.list);
+                    return NULL;
+                }
+                
+                token_count = 0;
+                ++line_number;
             }
         }
-        else
+    }
+    
+    return reader.list;
+}
+
+int telephone_book_record_list_read_next_id_from_file(FILE* f, int* next_id)
+{
+    char line[NEXT_ID_LINE_LENGTH];
+    char tag[NEXT_ID_LINE_LENGTH];
+    char rest;
+    int id;
+    
+    if (!f || !next_id)
+    {
+        return 1;
+    }
+    
+    *next_id = 0;
+    
+    while (fgets(line, sizeof line, f))
+    {
+        if (sscanf(line, " %c", &rest) != 1)
         {
-            fclose(f);
-            telephone_book_record_list_free(record_list);
-            return NULL;
+            /* Blank lines are skipped. */
+            continue;
+        }
+        
+        if (sscanf(line, "%255s %d %c", tag, &id, &rest) == 2 &&
+            strcmp(tag, TELEPHONE_BOOK_TEXT_NEXT_ID_TAG) == 0 &&
+            id >= 1)
+        {
+            *next_id = id;
         }
+        
+        break;
     }
     
-    return record_list;
+    return ferror(f) != 0;
+}
+
+/*******************************************************************************
+* Writes the 'length' bytes of 'buffer' to the file, bypassing the stream      *
+* buffer where the platform allows it. The stream must have been flushed.      *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int write_buffer(FILE* f, const char* buffer, size_t length)
+{
+#ifdef _WIN32
+    return fwrite(buffer, 1, length, f) != length;
+#else
+    ssize_t written;
+    int fd = fileno(f);
+    
+    while (length > 0)
+    {
+        written = write(fd, buffer, length);
+        
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            
+            return 1;
+        }
+        
+        buffer += written;
+        length -= (size_t) written;
+    }
+    
+    return 0;
+#endif
+}
+
+/*******************************************************************************
+* Writes the decimal form of 'value' to 'out', as '%d' would.                  *
+* ---                                                                          *
+* Returns the position past the number.                                        *
+*******************************************************************************/
+static char* format_int(char* out, int value)
+{
+    char digits[12];
+    char* digit = digits + sizeof digits;
+    /* Negate in unsigned arithmetic so that INT_MIN does not overflow: */
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int) value :
+                                         (unsigned int) value;
+    
+    do
+    {
+        *--digit = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    }
+    while (magnitude > 0);
+    
+    if (value < 0)
+    {
+        *out++ = '-';
+    }
+    
+    memcpy(out, digit, digits + sizeof digits - digit);
+    return out + (digits + sizeof digits - digit);
 }
 
 int telephone_book_record_list_write_to_file(telephone_book_record_list* list,
                                              FILE* f)
 {
     telephone_book_record_list_node* current_node;
+    telephone_book_record* record;
+    size_t last_name_length;
+    size_t first_name_length;
+    size_t telephone_number_length;
+    size_t line_length;
+    char* buffer;
+    char* out;
+    int result = 0;
     
     if (!list || !f)
     {
         return 1;
     }
     
-    if (list->size == 0)
+    /* ALLOCATED: buffer */
+    buffer = malloc(WRITE_BUFFER_SIZE);
+    
+    if (!buffer)
     {
-        return 0;
+        return 1;
+    }
+    
+    /* Whatever the caller wrote so far goes first: */
+    if (fflush(f))
+    {
+        free(buffer);
+        return 1;
     }
     
-    current_node = list->head;
+    memcpy(buffer,
+           TELEPHONE_BOOK_TEXT_NEXT_ID_TAG " ",
+           sizeof TELEPHONE_BOOK_TEXT_NEXT_ID_TAG);
+    
+    out = format_int(buffer + sizeof TELEPHONE_BOOK_TEXT_NEXT_ID_TAG,
+                     list->next_id);
+    *out++ = '\n';
     
-    while (current_node)
+    for (current_node = list->head;
+         current_node && !result;
+         current_node = current_node->next)
     {
-        fprintf(f,
-                "%s %s %s %d\n",
-                current_node->record->last_name,
-                current_node->record->first_name,
-                current_node->record->telephone_number,
-                current_node->record->id);
+        record = current_node->record;
+        last_name_length = strlen(record->last_name);
+        first_name_length = strlen(record->first_name);
+        telephone_number_length = strlen(record->telephone_number);
+        line_length = last_name_length + first_name_length +
+                      telephone_number_length + MAX_RECORD_LINE_OVERHEAD;
+        
+        if (line_length > (size_t) (buffer + WRITE_BUFFER_SIZE - out))
+        {
+            result = write_buffer(f, buffer, out - buffer);
+            out = buffer;
+            
+            if (line_length > WRITE_BUFFER_SIZE)
+            {
+                result = 1;
+                break;
+            }
+        }
         
-        current_node = current_node->next;
+        memcpy(out, record->last_name, last_name_length);
+        out += last_name_length;
+        *out++ = ' ';
+        memcpy(out, record->first_name, first_name_length);
+        out += first_name_length;
+        *out++ = ' ';
+        memcpy(out, record->telephone_number, telephone_number_length);
+        out += telephone_number_length;
+        *out++ = ' ';
+        out = format_int(out, record->id);
+        *out++ = '\n';
     }
     
-    return 0;
+    if (!result)
+    {
+        result = write_buffer(f, buffer, out - buffer);
+    }
+    
+    free(buffer);
+    return result;
+}
+
+int telephone_book_file_sync(FILE* f)
+{
+    if (fflush(f))
+    {
+        return 1;
+    }
+
+#ifdef _WIN32
+    return _commit(_fileno(f)) != 0;
+#else
+    return fsync(fileno(f)) != 0;
+#endif
+}
+
+int telephone_book_file_truncate(FILE* f, long size)
+{
+    if (fflush(f) || size < 0)
+    {
+        return 1;
+    }
+
+#ifdef _WIN32
+    return _chsize(_fileno(f), size) != 0;
+#else
+    return ftruncate(fileno(f), (off_t) size) != 0;
+#endif
+}
+
+FILE* telephone_book_file_lock(const char* file_name)
+{
+    FILE* f;
+    int result;
+#ifndef _WIN32
+    struct flock lock;
+#endif
+    
+    if (!file_name)
+    {
+        return NULL;
+    }
+    
+    /* ALLOCATED: f */
+    f = fopen(file_name, "a");
+    
+    if (!f)
+    {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    /* Locks the first byte, retrying for a while if another process has it: */
+    result = fseek(f, 0, SEEK_SET) ||
+             _locking(_fileno(f), _LK_LOCK, 1);
+#else
+    memset(&lock, 0, sizeof lock);
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    
+    /* A zero length covers the whole file; a signal must not end the wait: */
+    do
+    {
+        result = fcntl(fileno(f), F_SETLKW, &lock);
+    }
+    while (result != 0 && errno == EINTR);
+#endif
+    
+    if (result != 0)
+    {
+        fclose(f);
+        return NULL;
+    }
+    
+    return f;
+}
+
+void telephone_book_file_unlock(FILE* f)
+{
+    if (f)
+    {
+        /* Closing the file releases the lock: */
+        fclose(f);
+    }
 }
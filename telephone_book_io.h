@@ -4,22 +4,80 @@
 #include "telephone_book.h"
 #include <stdio.h>
 
+/*******************************************************************************
+* The tag of the optional first line of a text book, which holds the tag and   *
+* the high-water mark of the record IDs.                                       *
+*******************************************************************************/
+#define TELEPHONE_BOOK_TEXT_NEXT_ID_TAG "#next_id"
+
 /*******************************************************************************
 * Reconstructs the telephone book record list from a file pointed to by the    *
-* argument file handle.                                                        *
+* argument file handle. Each line holds the last name, the first name, the     *
+* telephone number and the ID of one record, separated by whitespace; blank    *
+* lines are skipped. The first line may instead carry the high-water mark of   *
+* the IDs after 'TELEPHONE_BOOK_TEXT_NEXT_ID_TAG'. The file is read into a     *
+* single block that the records point into, and which the list releases when   *
+* it is freed. The names are not interned, and their name IDs are -1; a store  *
+* built over the list interns them.                                            *
 * ---                                                                          *
-* Returns the record list on success, and NULL on failure.                     *
+* Returns the record list on success, and NULL on failure. If the failure is   *
+* a malformed line, its (one-based) number is stored in 'bad_line_number',     *
+* which is set to zero otherwise. 'bad_line_number' may be NULL.               *
 *******************************************************************************/
-telephone_book_record_list* telephone_book_record_list_read_from_file(FILE* f);
+telephone_book_record_list*
+telephone_book_record_list_read_from_file(FILE* f, size_t* bad_line_number);
+
+/*******************************************************************************
+* Reads the high-water mark of the record IDs from the first line of the text  *
+* book behind the file handle without reading the records, and stores it in    *
+* 'next_id'. Stores zero if the book does not state it.                        *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_record_list_read_next_id_from_file(FILE* f, int* next_id);
 
 /*******************************************************************************
 * Writes the entire contents of the telephone record list to a specified file  *
-* handle.                                                                      *
+* handle, after a line with the high-water mark of the IDs. The lines are      *
+* formatted into one large buffer that is handed to the operating system       *
+* whenever it fills up, bypassing the stream buffer where the platform allows  *
+* it.                                                                          *
 * ---                                                                          *
 * Returns zero on success, and a non-zero value if something fails.            *
 *******************************************************************************/
 int telephone_book_record_list_write_to_file(telephone_book_record_list* list,
                                              FILE* f);
 
+/*******************************************************************************
+* Flushes the stream and asks the operating system to put the file on the      *
+* disk.                                                                        *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_file_sync(FILE* f);
+
+/*******************************************************************************
+* Flushes the stream and cuts the file behind it down to its first 'size'      *
+* bytes.                                                                       *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_file_truncate(FILE* f, long size);
+
+/*******************************************************************************
+* Opens the file 'file_name', creating it if it is missing, and waits until    *
+* this process holds the exclusive lock of the file. Other processes calling   *
+* this function for the same file wait until the lock is released. The lock    *
+* belongs to the process, not to the thread, and must not be taken twice.      *
+* ---                                                                          *
+* Returns the locked file on success, and NULL if something fails.             *
+*******************************************************************************/
+FILE* telephone_book_file_lock(const char* file_name);
+
+/*******************************************************************************
+* Releases the lock taken by 'telephone_book_file_lock' and closes the file.   *
+*******************************************************************************/
+void telephone_book_file_unlock(FILE* f);
+
 
 #endif /* telephone_book_io_h */
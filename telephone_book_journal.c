@@ -0,0 +1,583 @@
+#include "telephone_book_journal.h"
+#include "telephone_book_io.h"
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RECORD_TOKEN_LENGTH TELEPHONE_BOOK_MAX_FIELD_LENGTH
+#define JOURNAL_FIELD_COUNT 5
+#define TAIL_BLOCK_SIZE 4096
+
+/* The operation tag, three tokens, the ID, their separators and the newline: */
+#define MAX_LINE_LENGTH (4 * (MAX_RECORD_TOKEN_LENGTH + 1) + 20)
+
+/*******************************************************************************
+* This structure holds one operation read from the journal.                    *
+*******************************************************************************/
+typedef struct {
+    char operation;
+    char last_name[MAX_RECORD_TOKEN_LENGTH + 1];
+    char first_name[MAX_RECORD_TOKEN_LENGTH + 1];
+    char telephone_number[MAX_RECORD_TOKEN_LENGTH + 1];
+    int id;
+} journal_entry;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_journal.h              *
+*******************************************************************************/
+
+
+/*******************************************************************************
+* Unlinks and frees the first record in the list whose fields equal the given  *
+* ones.                                                                        *
+* ---                                                                          *
+* Returns zero if a record was removed, and a non-zero value if none matched.  *
+*******************************************************************************/
+static int remove_matching_record(telephone_book_record_list* list,
+                                  const char* last_name,
+                                  const char* first_name,
+                                  const char* telephone_number)
+{
+    telephone_book_record_list_node* previous_node = NULL;
+    telephone_book_record_list_node* current_node = list->head;
+    telephone_book_record* record;
+    
+    while (current_node)
+    {
+        record = current_node->record;
+        
+        if (strcmp(record->last_name, last_name) == 0 &&
+            strcmp(record->first_name, first_name) == 0 &&
+            strcmp(record->telephone_number, telephone_number) == 0)
+        {
+            if (previous_node)
+            {
+                previous_node->next = current_node->next;
+            }
+            else
+            {
+                list->head = current_node->next;
+            }
+            
+            if (!current_node->next)
+            {
+                list->tail = previous_node;
+            }
+            
+            list->size--;
+            telephone_book_record_list_drop_id_index(list);
+            telephone_book_record_free(record);
+            
+            if (!current_node->is_borrowed)
+            {
+                free(current_node);
+            }
+            
+            return 0;
+        }
+        
+        previous_node = current_node;
+        current_node = current_node->next;
+    }
+    
+    return 1;
+}
+
+/*******************************************************************************
+* Cuts off the torn last line a crash while appending may have left at the end *
+* of the journal behind 'f', so that the journal ends with a newline again.    *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int drop_torn_tail(FILE* f)
+{
+    char block[TAIL_BLOCK_SIZE];
+    long end_position;
+    long position;
+    long kept_size = 0;
+    size_t block_size;
+    size_t i;
+    
+    if (fseek(f, 0, SEEK_END) || (end_position = ftell(f)) < 0)
+    {
+        return 1;
+    }
+    
+    /* Look for the last newline, a block at a time from the end: */
+    for (position = end_position; position > 0 && kept_size == 0; )
+    {
+        block_size = position < TAIL_BLOCK_SIZE ? (size_t) position :
+                                                  TAIL_BLOCK_SIZE;
+        position -= (long) block_size;
+        
+        if (fseek(f, position, SEEK_SET) ||
+            fread(block, 1, block_size, f) != block_size)
+        {
+            return 1;
+        }
+        
+        for (i = block_size; i > 0; --i)
+        {
+            if (block[i - 1] == '\n')
+            {
+                kept_size = position + (long) i;
+                break;
+            }
+        }
+    }
+    
+    if (kept_size < end_position &&
+        telephone_book_file_truncate(f, kept_size))
+    {
+        return 1;
+    }
+    
+    /* A write must follow a seek on an update stream: */
+    return fseek(f, 0, SEEK_END) != 0;
+}
+
+int telephone_book_journal_append(const char* file_name,
+                                  char operation,
+                                  telephone_book_record_list* records)
+{
+    telephone_book_record_list_node* current_node;
+    FILE* f;
+    
+    if (!file_name || !records)
+    {
+        return 1;
+    }
+    
+    if (!records->head)
+    {
+        return 0;
+    }
+    
+    /* "a" keeps whatever a concurrent writer has appended meanwhile. */
+    f = fopen(file_name, "ab+");
+    
+    if (!f)
+    {
+        return 1;
+    }
+    
+    /* A line appended to a torn one would merge with it: */
+    if (drop_torn_tail(f))
+    {
+        fclose(f);
+        return 1;
+    }
+    
+    for (current_node = records->head;
+         current_node;
+         current_node = current_node->next)
+    {
+        fprintf(f,
+                "%c %s %s %s %d\n",
+                operation,
+                current_node->record->last_name,
+                current_node->record->first_name,
+                current_node->record->telephone_number,
+                current_node->record->id);
+    }
+    
+    if (ferror(f) || telephone_book_file_sync(f))
+    {
+        fclose(f);
+        return 1;
+    }
+    
+    return fclose(f) != 0;
+}
+
+/*******************************************************************************
+* Splits the line 'line' into NUL-terminated tokens in place and stores them   *
+* in 'tokens'.                                                                 *
+* ---                                                                          *
+* Returns the number of tokens on the line, or -1 if the line has more than    *
+* 'JOURNAL_FIELD_COUNT' tokens or a token longer than                          *
+* 'MAX_RECORD_TOKEN_LENGTH' characters.                                        *
+*******************************************************************************/
+static int split_entry_line(char* line, char* tokens[JOURNAL_FIELD_COUNT])
+{
+    int token_count = 0;
+    
+    for (;;)
+    {
+        while (*line && isspace((unsigned char) *line))
+        {
+            ++line;
+        }
+        
+        if (!*line)
+        {
+            return token_count;
+        }
+        
+        if (token_count == JOURNAL_FIELD_COUNT)
+        {
+            return -1;
+        }
+        
+        tokens[token_count++] = line;
+        
+        while (*line && !isspace((unsigned char) *line))
+        {
+            ++line;
+        }
+        
+        if (line - tokens[token_count - 1] > MAX_RECORD_TOKEN_LENGTH)
+        {
+            return -1;
+        }
+        
+        if (*line)
+        {
+            *line++ = '\0';
+        }
+    }
+}
+
+/*******************************************************************************
+* Parses the record ID 'token', which must be a whole decimal 'int'.           *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the token is not an 'int'.  *
+*******************************************************************************/
+static int parse_entry_id(const char* token, int* id)
+{
+    char* end;
+    long value;
+    
+    errno = 0;
+    value = strtol(token, &end, 10);
+    
+    if (errno || end == token || *end || value < INT_MIN || value > INT_MAX)
+    {
+        return 1;
+    }
+    
+    *id = (int) value;
+    return 0;
+}
+
+/*******************************************************************************
+* Reads the next operation of the journal into 'entry'. A line must hold the   *
+* operation tag, the three fields of the record and its ID, or else no ID if   *
+* it was written before the IDs were journaled; anything else is malformed.    *
+* ---                                                                          *
+* Returns 1 if an operation was read, 0 at the end of the journal (including a *
+* torn last line from a crash while appending), and -1 if the journal is       *
+* malformed or cannot be read.                                                 *
+*******************************************************************************/
+static int read_entry(FILE* f, journal_entry* entry)
+{
+    char line[MAX_LINE_LENGTH];
+    char* tokens[JOURNAL_FIELD_COUNT];
+    size_t line_length;
+    int token_count;
+    
+    if (!fgets(line, sizeof line, f))
+    {
+        return ferror(f) ? -1 : 0;
+    }
+    
+    line_length = strlen(line);
+    
+    if (line_length == 0 || line[line_length - 1] != '\n')
+    {
+        /* A torn append is the end; anything else is too long to be valid: */
+        return feof(f) ? 0 : -1;
+    }
+    
+    token_count = split_entry_line(line, tokens);
+    
+    if (token_count < JOURNAL_FIELD_COUNT - 1 || strlen(tokens[0]) != 1)
+    {
+        return -1;
+    }
+    
+    entry->operation = tokens[0][0];
+    
+    if (entry->operation != TELEPHONE_BOOK_JOURNAL_ADD &&
+        entry->operation != TELEPHONE_BOOK_JOURNAL_REMOVE)
+    {
+        return -1;
+    }
+    
+    strcpy(entry->last_name, tokens[1]);
+    strcpy(entry->first_name, tokens[2]);
+    strcpy(entry->telephone_number, tokens[3]);
+    
+    /* Lines written before the IDs were journaled carry none: */
+    if (token_count == JOURNAL_FIELD_COUNT - 1)
+    {
+        entry->id = -1;
+    }
+    else if (parse_entry_id(tokens[4], &entry->id))
+    {
+        return -1;
+    }
+    
+    return 1;
+}
+
+/*******************************************************************************
+* Unlinks and frees the record the removal 'entry' names: the record with its  *
+* ID if the fields agree, or else, for a removal journaled without an ID, the  *
+* first record with the same fields. A record that is gone already was removed *
+* before the journal was last folded into the book, so nothing is undone.      *
+*******************************************************************************/
+static void remove_entry_record(telephone_book_record_list* list,
+                                const journal_entry* entry)
+{
+    telephone_book_record* record;
+    
+    if (entry->id < 1)
+    {
+        remove_matching_record(list,
+                               entry->last_name,
+                               entry->first_name,
+                               entry->telephone_number);
+        return;
+    }
+    
+    record = telephone_book_record_list_find_entry(list, entry->id);
+    
+    if (record &&
+        strcmp(record->last_name, entry->last_name) == 0 &&
+        strcmp(record->first_name, entry->first_name) == 0 &&
+        strcmp(record->telephone_number, entry->telephone_number) == 0)
+    {
+        telephone_book_record_free(
+            telephone_book_record_list_remove_entry(list, entry->id));
+    }
+}
+
+int telephone_book_journal_replay(const char* file_name,
+                                  telephone_book_record_list* list,
+                                  int may_be_folded,
+                                  size_t* operation_count,
+                                  size_t* bad_line_number)
+{
+    FILE* f;
+    journal_entry entry;
+    size_t applied_count = 0;
+    size_t line_number;
+    int status;
+    
+    if (bad_line_number)
+    {
+        *bad_line_number = 0;
+    }
+    
+    if (!file_name || !list)
+    {
+        return 1;
+    }
+    
+    if (operation_count)
+    {
+        *operation_count = 0;
+    }
+    
+    f = fopen(file_name, "r");
+    
+    if (!f)
+    {
+        /* No journal, nothing to replay. */
+        return 0;
+    }
+    
+    for (line_number = 0;
+         (status = read_entry(f, &entry)) > 0;
+         ++line_number)
+    {
+        if (entry.operation == TELEPHONE_BOOK_JOURNAL_ADD)
+        {
+            if (entry.id > 0 &&
+                telephone_book_record_list_find_entry(list, entry.id))
+            {
+                /* Two records given the same ID would lose one of them: */
+                if (!may_be_folded)
+                {
+                    status = -1;
+                    break;
+                }
+                
+                /* The book already holds the records of a journal whose */
+                /* compaction crashed right after writing the book: */
+                continue;
+            }
+            
+            if (telephone_book_record_list_append(list,
+                                                  entry.last_name,
+                                                  entry.first_name,
+                                                  entry.telephone_number,
+                                                  entry.id))
+            {
+                fclose(f);
+                return 1;
+            }
+        }
+        else
+        {
+            remove_entry_record(list, &entry);
+        }
+        
+        ++applied_count;
+    }
+    
+    fclose(f);
+    
+    if (status < 0)
+    {
+        if (bad_line_number)
+        {
+            *bad_line_number = line_number + 1;
+        }
+        
+        return 1;
+    }
+    
+    if (operation_count)
+    {
+        *operation_count = applied_count;
+    }
+    
+    return 0;
+}
+
+int telephone_book_journal_read_next_id(const char* file_name, int* next_id)
+{
+    FILE* f;
+    journal_entry entry;
+    int unnumbered_count = 0;
+    int status;
+    
+    if (!file_name || !next_id)
+    {
+        return 1;
+    }
+    
+    f = fopen(file_name, "r");
+    
+    if (!f)
+    {
+        /* No journal, nothing to raise. */
+        return 0;
+    }
+    
+    while ((status = read_entry(f, &entry)) > 0)
+    {
+        if (entry.operation != TELEPHONE_BOOK_JOURNAL_ADD)
+        {
+            continue;
+        }
+        
+        if (entry.id < 1)
+        {
+            /* Loading gives such a record the next fresh ID: */
+            ++unnumbered_count;
+        }
+        else if (entry.id >= *next_id)
+        {
+            *next_id = entry.id == INT_MAX ? INT_MAX : entry.id + 1;
+        }
+    }
+    
+    fclose(f);
+    
+    if (status < 0 || unnumbered_count > INT_MAX - *next_id)
+    {
+        return 1;
+    }
+    
+    *next_id += unnumbered_count;
+    return 0;
+}
+
+long telephone_book_journal_size(const char* file_name)
+{
+    FILE* f;
+    long size;
+    
+    if (!file_name)
+    {
+        return -1;
+    }
+    
+    f = fopen(file_name, "rb");
+    
+    if (!f)
+    {
+        /* No journal is an empty one: */
+        return 0;
+    }
+    
+    size = fseek(f, 0, SEEK_END) ? -1 : ftell(f);
+    fclose(f);
+    return size;
+}
+
+int telephone_book_journal_needs_compaction(const char* file_name)
+{
+    return telephone_book_journal_size(file_name) >=
+           TELEPHONE_BOOK_JOURNAL_COMPACTION_SIZE;
+}
+
+int telephone_book_journal_set_aside(const char* file_name,
+                                     const char* folded_file_name)
+{
+    FILE* f;
+    
+    if (!file_name || !folded_file_name)
+    {
+        return 1;
+    }
+    
+    f = fopen(file_name, "r");
+    
+    if (!f)
+    {
+        /* No journal, nothing to set aside. */
+        return 0;
+    }
+    
+    fclose(f);
+
+#ifdef _WIN32
+    /* 'rename' does not replace existing files on Windows: */
+    remove(folded_file_name);
+#endif
+    
+    return rename(file_name, folded_file_name) != 0;
+}
+
+int telephone_book_journal_clear(const char* file_name)
+{
+    FILE* f;
+    
+    if (!file_name)
+    {
+        return 1;
+    }
+    
+    if (remove(file_name) == 0)
+    {
+        return 0;
+    }
+    
+    /* Failing to remove a journal that does not exist is fine: */
+    f = fopen(file_name, "r");
+    
+    if (!f)
+    {
+        return 0;
+    }
+    
+    fclose(f);
+    return 1;
+}
@@ -0,0 +1,100 @@
+#ifndef TELEPHONE_BOOK_JOURNAL_H
+#define TELEPHONE_BOOK_JOURNAL_H
+
+#include "telephone_book.h"
+#include <stddef.h>
+
+/*******************************************************************************
+* The operation tags starting each journal line. An add line carries the new   *
+* record, a remove line the record that was removed, both with their IDs.      *
+*******************************************************************************/
+#define TELEPHONE_BOOK_JOURNAL_ADD    'A'
+#define TELEPHONE_BOOK_JOURNAL_REMOVE 'R'
+
+/*******************************************************************************
+* The journal size in bytes past which the journal is folded back into the     *
+* record book file.                                                            *
+*******************************************************************************/
+#define TELEPHONE_BOOK_JOURNAL_COMPACTION_SIZE (64 * 1024)
+
+
+
+
+/*******************************************************************************
+* Appends one line tagged with 'operation' for each record in 'records' to the *
+* journal file 'file_name', and forces the journal to the disk. A torn last    *
+* line left by a crash while appending is cut off first, so the caller must    *
+* keep other writers of the journal out until the append is done.              *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_journal_append(const char* file_name,
+                                  char operation,
+                                  telephone_book_record_list* records);
+
+/*******************************************************************************
+* Applies the operations in the journal file 'file_name' to the record list in *
+* order. Added records go to the tail with their IDs, and each removal unlinks *
+* the record with its ID; a removal journaled without an ID unlinks the first  *
+* record with the same fields. An addition whose ID the list already holds is  *
+* an error, unless 'may_be_folded' is set: the journal was then set aside by a *
+* compaction that may have written it into the book before it was cut short,   *
+* and such an addition was already applied. A missing journal is an empty one, *
+* and a torn last line (from a crash while appending) is ignored. The number   *
+* of applied operations is stored in 'operation_count' unless it is NULL.      *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails. If the     *
+* failure is a malformed line or an addition of an ID the list already holds,  *
+* its (one-based) number is stored in 'bad_line_number', which is set to zero  *
+* otherwise. 'bad_line_number' may be NULL.                                    *
+*******************************************************************************/
+int telephone_book_journal_replay(const char* file_name,
+                                  telephone_book_record_list* list,
+                                  int may_be_folded,
+                                  size_t* operation_count,
+                                  size_t* bad_line_number);
+
+/*******************************************************************************
+* Raises 'next_id' past the ID of every record added in the journal file       *
+* 'file_name', so that a new record never takes the ID of one added before the *
+* last compaction.                                                             *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_journal_read_next_id(const char* file_name, int* next_id);
+
+/*******************************************************************************
+* Checks whether the journal file 'file_name' has outgrown the compaction      *
+* size.                                                                        *
+* ---                                                                          *
+* Returns a non-zero value if the journal should be compacted.                 *
+*******************************************************************************/
+int telephone_book_journal_needs_compaction(const char* file_name);
+
+/*******************************************************************************
+* Returns the size in bytes of the journal file 'file_name', zero if there is  *
+* no journal, or -1 if the size cannot be read.                                *
+*******************************************************************************/
+long telephone_book_journal_size(const char* file_name);
+
+/*******************************************************************************
+* Renames the journal file 'file_name' to 'folded_file_name', replacing what   *
+* was there, so that a compaction writing its operations into the book starts  *
+* a new journal. The set aside journal is removed once the book is written.    *
+* ---                                                                          *
+* Returns zero on success or if there is no journal, and a non-zero value if   *
+* the journal could not be renamed.                                            *
+*******************************************************************************/
+int telephone_book_journal_set_aside(const char* file_name,
+                                     const char* folded_file_name);
+
+/*******************************************************************************
+* Removes the journal file 'file_name'. Called once its operations have been   *
+* written to the record book file.                                             *
+* ---                                                                          *
+* Returns zero on success or if there is no journal, and a non-zero value if   *
+* the journal could not be removed.                                            *
+*******************************************************************************/
+int telephone_book_journal_clear(const char* file_name);
+
+#endif /* TELEPHONE_BOOK_JOURNAL_H */
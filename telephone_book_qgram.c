@@ -0,0 +1,321 @@
+#include "telephone_book_qgram.h"
+#include "telephone_book_distance.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define GRAM_STACK_CAPACITY 128
+#define PADDING_CHARACTER 0
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_qgram.h                *
+*******************************************************************************/
+
+
+static int gram_cmp(const void* pa, const void* pb)
+{
+    uint16_t a = *(const uint16_t*) pa;
+    uint16_t b = *(const uint16_t*) pb;
+    
+    return (a > b) - (a < b);
+}
+
+/*******************************************************************************
+* Stores the distinct bigrams of the padded, case-folded 'word' in 'grams',    *
+* which must have room for 'strlen(word) + 1' entries.                         *
+* ---                                                                          *
+* Returns the number of distinct bigrams.                                      *
+*******************************************************************************/
+static size_t extract_distinct_grams(const char* word,
+                                     size_t length,
+                                     uint16_t* grams)
+{
+    unsigned char previous = PADDING_CHARACTER;
+    unsigned char current;
+    size_t gram_count;
+    size_t i;
+    size_t j;
+    
+    for (i = 0; i <= length; ++i)
+    {
+        current = i < length ? telephone_book_distance_fold(word[i]) :
+                               PADDING_CHARACTER;
+        
+        grams[i] = (uint16_t) ((previous << 8) | current);
+        previous = current;
+    }
+    
+    qsort(grams, length + 1, sizeof *grams, gram_cmp);
+    gram_count = 1;
+    
+    for (j = 1; j <= length; ++j)
+    {
+        if (grams[j] != grams[gram_count - 1])
+        {
+            grams[gram_count++] = grams[j];
+        }
+    }
+    
+    return gram_count;
+}
+
+/*******************************************************************************
+* Returns the grams buffer for a word of length 'length': either the stack     *
+* buffer or a new heap block. Returns NULL if the allocation fails.            *
+*******************************************************************************/
+static uint16_t* get_gram_buffer(uint16_t* stack_buffer, size_t length)
+{
+    if (length + 1 <= GRAM_STACK_CAPACITY)
+    {
+        return stack_buffer;
+    }
+    
+    return malloc((length + 1) * sizeof *stack_buffer);
+}
+
+static size_t encoded_length(uint32_t value)
+{
+    size_t length = 1;
+    
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        ++length;
+    }
+    
+    return length;
+}
+
+static unsigned char* encode(unsigned char* out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    
+    *out++ = (unsigned char) value;
+    return out;
+}
+
+telephone_book_qgram_index*
+telephone_book_qgram_index_alloc(const char* const* names, int size)
+{
+    telephone_book_qgram_index* index;
+    uint16_t stack_grams[GRAM_STACK_CAPACITY];
+    uint16_t* grams;
+    int32_t* last_posted;
+    uint32_t* cursors;
+    size_t gram_count;
+    size_t length;
+    size_t j;
+    uint32_t total;
+    uint32_t gram_size;
+    int pass;
+    int i;
+    
+    index = malloc(sizeof *index);
+    
+    if (!index)
+    {
+        return NULL;
+    }
+    
+    index->size = size;
+    index->offsets = calloc(TELEPHONE_BOOK_QGRAM_COUNT + 1,
+                            sizeof *index->offsets);
+    index->gram_counts = malloc((size + 1) * sizeof *index->gram_counts);
+    index->postings = NULL;
+    
+    last_posted = malloc(TELEPHONE_BOOK_QGRAM_COUNT * sizeof *last_posted);
+    cursors = malloc(TELEPHONE_BOOK_QGRAM_COUNT * sizeof *cursors);
+    
+    if (!index->offsets || !index->gram_counts || !last_posted || !cursors)
+    {
+        free(last_posted);
+        free(cursors);
+        telephone_book_qgram_index_free(index);
+        return NULL;
+    }
+    
+    /* The first pass measures the encoded posting lists, the second one */
+    /* writes them: */
+    for (pass = 0; pass < 2; ++pass)
+    {
+        for (j = 0; j < TELEPHONE_BOOK_QGRAM_COUNT; ++j)
+        {
+            last_posted[j] = -1;
+        }
+        
+        for (i = 0; i < size; ++i)
+        {
+            length = strlen(names[i]);
+            grams = get_gram_buffer(stack_grams, length);
+            
+            if (!grams)
+            {
+                free(last_posted);
+                free(cursors);
+                telephone_book_qgram_index_free(index);
+                return NULL;
+            }
+            
+            gram_count = extract_distinct_grams(names[i], length, grams);
+            index->gram_counts[i] = (unsigned short)
+                (gram_count < 0xffff ? gram_count : 0xffff);
+            
+            for (j = 0; j < gram_count; ++j)
+            {
+                if (pass == 0)
+                {
+                    index->offsets[grams[j] + 1] +=
+                        (uint32_t) encoded_length(
+                                        (uint32_t) (i - last_posted[grams[j]]));
+                }
+                else
+                {
+                    cursors[grams[j]] = (uint32_t)
+                        (encode(&index->postings[cursors[grams[j]]],
+                                (uint32_t) (i - last_posted[grams[j]])) -
+                         index->postings);
+                }
+                
+                last_posted[grams[j]] = i;
+            }
+            
+            if (grams != stack_grams)
+            {
+                free(grams);
+            }
+        }
+        
+        if (pass == 1)
+        {
+            break;
+        }
+        
+        /* Turn the list sizes into offsets: */
+        total = 0;
+        
+        for (j = 0; j < TELEPHONE_BOOK_QGRAM_COUNT; ++j)
+        {
+            gram_size = index->offsets[j + 1];
+            index->offsets[j] = total;
+            cursors[j] = total;
+            total += gram_size;
+        }
+        
+        index->offsets[TELEPHONE_BOOK_QGRAM_COUNT] = total;
+        index->postings = malloc(total + 1);
+        
+        if (!index->postings)
+        {
+            free(last_posted);
+            free(cursors);
+            telephone_book_qgram_index_free(index);
+            return NULL;
+        }
+    }
+    
+    free(last_posted);
+    free(cursors);
+    return index;
+}
+
+int telephone_book_qgram_index_count_common(
+                            const telephone_book_qgram_index* index,
+                            const char* word,
+                            unsigned short* common_counts,
+                            unsigned char* touched_flags,
+                            int* touched,
+                            int* touched_size,
+                            size_t* gram_count)
+{
+    uint16_t stack_grams[GRAM_STACK_CAPACITY];
+    uint16_t* grams;
+    const unsigned char* cursor;
+    const unsigned char* end;
+    uint32_t delta;
+    int shift;
+    int record_index;
+    size_t length;
+    size_t j;
+    
+    if (!index || !word)
+    {
+        return 1;
+    }
+    
+    length = strlen(word);
+    grams = get_gram_buffer(stack_grams, length);
+    
+    if (!grams)
+    {
+        return 1;
+    }
+    
+    *gram_count = extract_distinct_grams(word, length, grams);
+    
+    for (j = 0; j < *gram_count; ++j)
+    {
+        cursor = &index->postings[index->offsets[grams[j]]];
+        end = &index->postings[index->offsets[grams[j] + 1]];
+        record_index = -1;
+        
+        while (cursor < end)
+        {
+            delta = 0;
+            shift = 0;
+            
+            do
+            {
+                delta |= (uint32_t) (*cursor & 0x7f) << shift;
+                shift += 7;
+            }
+            while (*cursor++ & 0x80);
+            
+            record_index += (int) delta;
+            common_counts[record_index]++;
+            
+            if (!touched_flags[record_index])
+            {
+                touched_flags[record_index] = 1;
+                touched[(*touched_size)++] = record_index;
+            }
+        }
+    }
+    
+    if (grams != stack_grams)
+    {
+        free(grams);
+    }
+    
+    return 0;
+}
+
+size_t telephone_book_qgram_lower_bound(size_t gram_count1,
+                                        size_t gram_count2,
+                                        size_t common_count)
+{
+    size_t larger = gram_count1 > gram_count2 ? gram_count1 : gram_count2;
+    
+    if (common_count >= larger)
+    {
+        return 0;
+    }
+    
+    return (larger - common_count + TELEPHONE_BOOK_QGRAM_LENGTH - 1) /
+           TELEPHONE_BOOK_QGRAM_LENGTH;
+}
+
+void telephone_book_qgram_index_free(telephone_book_qgram_index* index)
+{
+    if (!index)
+    {
+        return;
+    }
+    
+    free(index->offsets);
+    free(index->postings);
+    free(index->gram_counts);
+    free(index);
+}
@@ -0,0 +1,73 @@
+#ifndef TELEPHONE_BOOK_QGRAM_H
+#define TELEPHONE_BOOK_QGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************************************************************************
+* The length of the q-grams. Names are short, so bigrams keep the posting      *
+* lists selective while the gram table stays directly addressable.             *
+*******************************************************************************/
+#define TELEPHONE_BOOK_QGRAM_LENGTH 2
+
+/*******************************************************************************
+* The number of distinct q-grams, that is, the size of the posting table.      *
+*******************************************************************************/
+#define TELEPHONE_BOOK_QGRAM_COUNT 65536
+
+/*******************************************************************************
+* This structure holds an inverted index from the case-folded, padded bigrams  *
+* to the positions of the names containing them. Each posting list is sorted   *
+* and stored as variable-length encoded gaps in one shared byte array.         *
+*******************************************************************************/
+typedef struct {
+    uint32_t* offsets;
+    unsigned char* postings;
+    unsigned short* gram_counts;
+    int size;
+} telephone_book_qgram_index;
+
+
+
+
+/*******************************************************************************
+* Builds the q-gram index over the 'size' names in 'names'. The name at        *
+* position 'i' is posted under the index 'i'.                                  *
+* ---                                                                          *
+* Returns the new index or NULL if something goes wrong.                       *
+*******************************************************************************/
+telephone_book_qgram_index*
+telephone_book_qgram_index_alloc(const char* const* names, int size);
+
+/*******************************************************************************
+* Counts, for each indexed name, the number of distinct q-grams it shares with *
+* 'word'. The counts are added to 'common_counts', and each name whose count   *
+* becomes non-zero is appended to 'touched' if 'touched_flags' has not marked  *
+* it yet. The number of distinct q-grams of 'word' is stored in 'gram_count'.  *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_qgram_index_count_common(
+                            const telephone_book_qgram_index* index,
+                            const char* word,
+                            unsigned short* common_counts,
+                            unsigned char* touched_flags,
+                            int* touched,
+                            int* touched_size,
+                            size_t* gram_count);
+
+/*******************************************************************************
+* Returns a lower bound of the edit distance between two words that have       *
+* 'gram_count1' and 'gram_count2' distinct q-grams of which 'common_count' are *
+* shared. Each edit operation destroys at most q of the q-grams of a word.     *
+*******************************************************************************/
+size_t telephone_book_qgram_lower_bound(size_t gram_count1,
+                                        size_t gram_count2,
+                                        size_t common_count);
+
+/*******************************************************************************
+* Frees all the memory occupied by the q-gram index.                           *
+*******************************************************************************/
+void telephone_book_qgram_index_free(telephone_book_qgram_index* index);
+
+#endif /* TELEPHONE_BOOK_QGRAM_H */
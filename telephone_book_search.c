@@ -0,0 +1,2216 @@
+#include "telephone_book_search.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define INFINITE_DISTANCE ((size_t) 1000 * 1000 * 1000)
+#define INITIAL_RESULT_CAPACITY 16
+
+/* The fewest rows worth a thread of their own: */
+#define MIN_ROWS_PER_THREAD 4096
+
+/* The rows a scan worker visits between looks at the shared bound: */
+#define BOUND_REFRESH_INTERVAL 256
+
+/* The queries a batch search answers together, and the blocks of the last */
+/* name batch all of them run over before moving on: */
+#define QUERY_BLOCK_SIZE 64
+#define NAME_BLOCKS_PER_CHUNK 64
+
+/*******************************************************************************
+* This structure holds a preprocessed query, and the tables where it keeps its *
+* name distances.                                                              *
+*******************************************************************************/
+typedef struct {
+    const char* last_name;
+    const char* first_name;
+    telephone_book_search_name_distance* last_name_distances;
+    telephone_book_search_name_distance* first_name_distances;
+    telephone_book_distance_pattern last_name_pattern;
+    telephone_book_distance_pattern first_name_pattern;
+    telephone_book_distance_signature last_name_signature;
+    telephone_book_distance_signature first_name_signature;
+} search_query;
+
+/*******************************************************************************
+* This structure holds the state shared by the tree visitors.                  *
+*******************************************************************************/
+typedef struct {
+    telephone_book_search_index* index;
+    search_query* query;
+    telephone_book_search_result* result;
+    int failed;
+} tree_search_state;
+
+#ifndef _WIN32
+/*******************************************************************************
+* This structure holds the smallest distance any scan worker has found so far, *
+* which every worker uses to prune its own rows.                               *
+*******************************************************************************/
+typedef struct {
+    pthread_mutex_t mutex;
+    size_t distance;
+} scan_bound;
+
+/*******************************************************************************
+* This structure holds a name worker of a scan: the entries [begin, end) of    *
+* 'scan_name_ids' whose distances to the query it computes.                    *
+*******************************************************************************/
+typedef struct {
+    const telephone_book_search_index* index;
+    const search_query* query;
+    int begin;
+    int end;
+} name_worker;
+
+/*******************************************************************************
+* This structure holds a scan worker: the rows [begin, end) it scans, its own  *
+* copy of the query and its own result.                                        *
+*******************************************************************************/
+typedef struct {
+    telephone_book_search_index* index;
+    search_query query;
+    telephone_book_search_result result;
+    scan_bound* bound;
+    int begin;
+    int end;
+    int failed;
+} scan_worker;
+#endif
+
+/*******************************************************************************
+* This structure holds a record that passed the q-gram count filter along with *
+* the lower bound of its distance.                                             *
+*******************************************************************************/
+typedef struct {
+    size_t lower_bound;
+    int record_index;
+} qgram_candidate;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_search.h               *
+*******************************************************************************/
+
+
+/*******************************************************************************
+* Returns the case-folded last name in row 'record_index' of the store.        *
+*******************************************************************************/
+static const char* last_name_at(const telephone_book_search_index* index,
+                                int record_index)
+{
+    return &index->store->folded_names[index->store->name_offsets[
+                            index->store->last_name_ids[record_index]]];
+}
+
+/*******************************************************************************
+* Returns the case-folded first name in row 'record_index' of the store.       *
+*******************************************************************************/
+static const char* first_name_at(const telephone_book_search_index* index,
+                                 int record_index)
+{
+    return &index->store->folded_names[index->store->name_offsets[
+                            index->store->first_name_ids[record_index]]];
+}
+
+void telephone_book_search_result_init(telephone_book_search_result* result)
+{
+    result->record_indices = NULL;
+    result->distances = NULL;
+    result->size = 0;
+    result->capacity = 0;
+    result->limit = 0;
+    result->distance = INFINITE_DISTANCE;
+}
+
+void telephone_book_search_result_set_limit(
+                                        telephone_book_search_result* result,
+                                        int limit)
+{
+    result->limit = limit > 0 ? limit : 0;
+}
+
+void telephone_book_search_result_destroy(telephone_book_search_result* result)
+{
+    if (!result)
+    {
+        return;
+    }
+    
+    free(result->record_indices);
+    free(result->distances);
+    telephone_book_search_result_init(result);
+}
+
+static int record_index_cmp(const void* pa, const void* pb)
+{
+    int a = *(const int*) pa;
+    int b = *(const int*) pb;
+    
+    return (a > b) - (a < b);
+}
+
+/*******************************************************************************
+* Makes room for one more record in the result.                                *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int result_reserve(telephone_book_search_result* result)
+{
+    int* new_record_indices;
+    size_t* new_distances;
+    int new_capacity;
+    
+    if (result->size < result->capacity)
+    {
+        return 0;
+    }
+    
+    new_capacity = result->capacity ? 2 * result->capacity :
+                                      INITIAL_RESULT_CAPACITY;
+    
+    if (result->limit && new_capacity > result->limit)
+    {
+        new_capacity = result->limit;
+    }
+    
+    new_record_indices = realloc(result->record_indices,
+                                 new_capacity *
+                                 sizeof *result->record_indices);
+    
+    if (!new_record_indices)
+    {
+        return 1;
+    }
+    
+    result->record_indices = new_record_indices;
+    
+    if (result->limit)
+    {
+        new_distances = realloc(result->distances,
+                                new_capacity * sizeof *result->distances);
+        
+        if (!new_distances)
+        {
+            return 1;
+        }
+        
+        result->distances = new_distances;
+    }
+    
+    result->capacity = new_capacity;
+    return 0;
+}
+
+/*******************************************************************************
+* Returns non-zero if the entry 'a' of a limited result is farther than the    *
+* entry 'b': by distance, and then by position.                                *
+*******************************************************************************/
+static int heap_is_after(const telephone_book_search_result* result,
+                         int a,
+                         int b)
+{
+    if (result->distances[a] != result->distances[b])
+    {
+        return result->distances[a] > result->distances[b];
+    }
+    
+    return result->record_indices[a] > result->record_indices[b];
+}
+
+static void heap_swap(telephone_book_search_result* result, int a, int b)
+{
+    int record_index = result->record_indices[a];
+    size_t distance = result->distances[a];
+    
+    result->record_indices[a] = result->record_indices[b];
+    result->distances[a] = result->distances[b];
+    result->record_indices[b] = record_index;
+    result->distances[b] = distance;
+}
+
+/*******************************************************************************
+* Moves the entry 'position' down the heap of the first 'size' entries until   *
+* none of its children is farther.                                             *
+*******************************************************************************/
+static void heap_sift_down(telephone_book_search_result* result,
+                           int position,
+                           int size)
+{
+    int child;
+    
+    while ((child = 2 * position + 1) < size)
+    {
+        if (child + 1 < size && heap_is_after(result, child + 1, child))
+        {
+            ++child;
+        }
+        
+        if (!heap_is_after(result, child, position))
+        {
+            break;
+        }
+        
+        heap_swap(result, child, position);
+        position = child;
+    }
+}
+
+static void heap_sift_up(telephone_book_search_result* result, int position)
+{
+    int parent;
+    
+    while (position > 0)
+    {
+        parent = (position - 1) / 2;
+        
+        if (!heap_is_after(result, position, parent))
+        {
+            break;
+        }
+        
+        heap_swap(result, position, parent);
+        position = parent;
+    }
+}
+
+/*******************************************************************************
+* Offers a record to a limited result. Once the heap is full, a record only    *
+* gets in by replacing the farthest one, and the distance of the new farthest  *
+* record becomes the cutoff of the search.                                     *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int heap_offer(telephone_book_search_result* result,
+                      int record_index,
+                      size_t distance)
+{
+    if (result->size < result->limit)
+    {
+        if (result_reserve(result))
+        {
+            return 1;
+        }
+        
+        result->record_indices[result->size] = record_index;
+        result->distances[result->size] = distance;
+        heap_sift_up(result, result->size++);
+    }
+    else if (distance < result->distances[0] ||
+             record_index < result->record_indices[0])
+    {
+        /* The distance is within the cutoff, which is the top distance: */
+        result->record_indices[0] = record_index;
+        result->distances[0] = distance;
+        heap_sift_down(result, 0, result->size);
+    }
+    
+    if (result->size == result->limit)
+    {
+        result->distance = result->distances[0];
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Lowers the cutoff of the result to 'distance', dropping the records that are *
+* farther.                                                                     *
+*******************************************************************************/
+static void result_lower_cutoff(telephone_book_search_result* result,
+                                size_t distance)
+{
+    int size = 0;
+    int i;
+    
+    if (!result->limit)
+    {
+        result->size = 0;
+        result->distance = distance;
+        return;
+    }
+    
+    for (i = 0; i < result->size; ++i)
+    {
+        if (result->distances[i] <= distance)
+        {
+            result->record_indices[size] = result->record_indices[i];
+            result->distances[size++] = result->distances[i];
+        }
+    }
+    
+    result->size = size;
+    result->distance = distance;
+    
+    for (i = size / 2 - 1; i >= 0; --i)
+    {
+        heap_sift_down(result, i, size);
+    }
+}
+
+/*******************************************************************************
+* Puts the records of the result in their final order: a limited result by     *
+* distance and then by position, and any other by position.                    *
+*******************************************************************************/
+static void result_sort(telephone_book_search_result* result)
+{
+    int end;
+    
+    if (!result->limit)
+    {
+        qsort(result->record_indices,
+              result->size,
+              sizeof *result->record_indices,
+              record_index_cmp);
+        return;
+    }
+    
+    for (end = result->size - 1; end > 0; --end)
+    {
+        heap_swap(result, 0, end);
+        heap_sift_down(result, 0, end);
+    }
+}
+
+/*******************************************************************************
+* Offers the record at position 'record_index' with distance 'distance' to the *
+* result. Unless the result is limited, a smaller distance discards all the    *
+* records collected so far.                                                    *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int result_offer(telephone_book_search_result* result,
+                        int record_index,
+                        size_t distance)
+{
+    if (distance > result->distance)
+    {
+        return 0;
+    }
+    
+    if (result->limit)
+    {
+        return heap_offer(result, record_index, distance);
+    }
+    
+    if (distance < result->distance)
+    {
+        result->size = 0;
+        result->distance = distance;
+    }
+    
+    if (result_reserve(result))
+    {
+        return 1;
+    }
+    
+    result->record_indices[result->size++] = record_index;
+    return 0;
+}
+
+static int qgram_candidate_cmp(const void* pa, const void* pb)
+{
+    const qgram_candidate* a = pa;
+    const qgram_candidate* b = pb;
+    
+    if (a->lower_bound != b->lower_bound)
+    {
+        return a->lower_bound < b->lower_bound ? -1 : 1;
+    }
+    
+    return (a->record_index > b->record_index) -
+           (a->record_index < b->record_index);
+}
+
+int telephone_book_search_strategy_parse(
+                            const char* name,
+                            telephone_book_search_strategy* strategy)
+{
+    if (strcmp(name, "scan") == 0)
+    {
+        *strategy = TELEPHONE_BOOK_SEARCH_SCAN;
+    }
+    else if (strcmp(name, "bk-tree") == 0)
+    {
+        *strategy = TELEPHONE_BOOK_SEARCH_BK_TREE;
+    }
+    else if (strcmp(name, "qgram") == 0)
+    {
+        *strategy = TELEPHONE_BOOK_SEARCH_QGRAM;
+    }
+    else if (strcmp(name, "symspell") == 0)
+    {
+        *strategy = TELEPHONE_BOOK_SEARCH_SYMSPELL;
+    }
+    else if (strcmp(name, "trie") == 0)
+    {
+        *strategy = TELEPHONE_BOOK_SEARCH_TRIE;
+    }
+    else if (strcmp(name, "simd") == 0)
+    {
+        *strategy = TELEPHONE_BOOK_SEARCH_BATCH;
+    }
+    else
+    {
+        return 1;
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Finds the runs of rows sharing a last name, and builds a batch of the last   *
+* names of the runs and a batch of the distinct first names, along with the    *
+* tables their distances to a query are computed into.                         *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int build_batches(telephone_book_search_index* index)
+{
+    const char** names;
+    int name_count = index->store->name_count;
+    int run_count = 0;
+    int i;
+    
+    index->last_name_run_starts =
+        malloc((index->size + 1) * sizeof *index->last_name_run_starts);
+    
+    if (!index->last_name_run_starts)
+    {
+        return 1;
+    }
+    
+    /* A book sorted by last name has one run per distinct last name: */
+    for (i = 0; i < index->size; ++i)
+    {
+        if (i == 0 ||
+            index->store->last_name_ids[i] !=
+            index->store->last_name_ids[i - 1])
+        {
+            index->last_name_run_starts[run_count++] = i;
+        }
+    }
+    
+    index->last_name_run_starts[run_count] = index->size;
+    index->last_name_run_count = run_count;
+    
+    /* ALLOCATED: names */
+    names = calloc((run_count > name_count ? run_count : name_count) + 1,
+                   sizeof *names);
+    
+    if (!names)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i < run_count; ++i)
+    {
+        names[i] = last_name_at(index, index->last_name_run_starts[i]);
+    }
+    
+    index->last_name_batch = telephone_book_distance_batch_alloc(names,
+                                                                 run_count);
+    memset(names, 0, (name_count + 1) * sizeof *names);
+    
+    for (i = 0; i < index->size; ++i)
+    {
+        names[index->store->first_name_ids[i]] = first_name_at(index, i);
+    }
+    
+    index->first_name_batch = telephone_book_distance_batch_alloc(names,
+                                                                  name_count);
+    free(names);
+    
+    index->last_name_batch_distances = malloc(run_count + 1);
+    index->first_name_batch_distances = malloc(name_count + 1);
+    
+    return !index->last_name_batch ||
+           !index->first_name_batch ||
+           !index->last_name_batch_distances ||
+           !index->first_name_batch_distances;
+}
+
+/*******************************************************************************
+* Lists the distinct last names of the rows and then their distinct first      *
+* names into 'scan_name_ids', for the name pass of a scan on several threads.  *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int build_scan_name_ids(telephone_book_search_index* index)
+{
+    const uint32_t* name_ids[2];
+    unsigned char* is_listed;
+    int count = 0;
+    int k;
+    int i;
+    
+    /* ALLOCATED: index->scan_name_ids, is_listed */
+    index->scan_name_ids =
+        malloc(2 * ((size_t) index->store->name_count + 1) *
+               sizeof *index->scan_name_ids);
+    is_listed = malloc((size_t) index->store->name_count + 1);
+    
+    if (!index->scan_name_ids || !is_listed)
+    {
+        free(index->scan_name_ids);
+        free(is_listed);
+        index->scan_name_ids = NULL;
+        return 1;
+    }
+    
+    name_ids[0] = index->store->last_name_ids;
+    name_ids[1] = index->store->first_name_ids;
+    
+    for (k = 0; k < 2; ++k)
+    {
+        memset(is_listed, 0, (size_t) index->store->name_count + 1);
+        
+        for (i = 0; i < index->size; ++i)
+        {
+            if (!is_listed[name_ids[k][i]])
+            {
+                is_listed[name_ids[k][i]] = 1;
+                index->scan_name_ids[count++] = name_ids[k][i];
+            }
+        }
+        
+        if (k == 0)
+        {
+            index->scan_last_name_count = count;
+        }
+    }
+    
+    index->scan_name_count = count;
+    free(is_listed);
+    return 0;
+}
+
+/*******************************************************************************
+* Builds the last and first name tries. The list is sorted by last name, so    *
+* consecutive insertions into the last name trie share long prefixes.          *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int build_tries(telephone_book_search_index* index)
+{
+    int i;
+    
+    index->last_name_trie = telephone_book_trie_alloc(index->size);
+    index->first_name_trie = telephone_book_trie_alloc(index->size);
+    
+    if (!index->last_name_trie || !index->first_name_trie)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i < index->size; ++i)
+    {
+        if (telephone_book_trie_insert(index->last_name_trie,
+                                       last_name_at(index, i),
+                                       i) ||
+            telephone_book_trie_insert(index->first_name_trie,
+                                       first_name_at(index, i),
+                                       i))
+        {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Builds the deletion dictionaries and the buffers for their lookups.          *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int build_symspell_dictionaries(telephone_book_search_index* index)
+{
+    const char** names;
+    int max_name_count;
+    int i;
+    
+    /* ALLOCATED: names */
+    names = malloc((index->size + 1) * sizeof *names);
+    
+    if (!names)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i < index->size; ++i)
+    {
+        names[i] = last_name_at(index, i);
+    }
+    
+    index->last_name_symspell = telephone_book_symspell_alloc(
+                                names,
+                                index->size,
+                                TELEPHONE_BOOK_SYMSPELL_DEFAULT_MAX_DISTANCE);
+    
+    for (i = 0; i < index->size; ++i)
+    {
+        names[i] = first_name_at(index, i);
+    }
+    
+    index->first_name_symspell = telephone_book_symspell_alloc(
+                                names,
+                                index->size,
+                                TELEPHONE_BOOK_SYMSPELL_DEFAULT_MAX_DISTANCE);
+    free(names);
+    
+    if (!index->last_name_symspell || !index->first_name_symspell)
+    {
+        return 1;
+    }
+    
+    max_name_count = index->last_name_symspell->name_count;
+    
+    if (index->first_name_symspell->name_count > max_name_count)
+    {
+        max_name_count = index->first_name_symspell->name_count;
+    }
+    
+    index->symspell_name_ids = malloc((max_name_count + 1) *
+                                      sizeof *index->symspell_name_ids);
+    
+    index->symspell_distances = malloc((max_name_count + 1) *
+                                       sizeof *index->symspell_distances);
+    
+    return !index->symspell_name_ids || !index->symspell_distances;
+}
+
+/*******************************************************************************
+* Builds the q-gram indices and their scratch counters.                        *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int build_qgram_indices(telephone_book_search_index* index)
+{
+    const char** names;
+    int i;
+    
+    /* ALLOCATED: names */
+    names = malloc((index->size + 1) * sizeof *names);
+    
+    if (!names)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i < index->size; ++i)
+    {
+        names[i] = last_name_at(index, i);
+    }
+    
+    index->last_name_qgrams = telephone_book_qgram_index_alloc(names,
+                                                               index->size);
+    
+    for (i = 0; i < index->size; ++i)
+    {
+        names[i] = first_name_at(index, i);
+    }
+    
+    index->first_name_qgrams = telephone_book_qgram_index_alloc(names,
+                                                                index->size);
+    free(names);
+    
+    index->last_name_common_counts =
+        calloc(index->size + 1, sizeof *index->last_name_common_counts);
+    
+    index->first_name_common_counts =
+        calloc(index->size + 1, sizeof *index->first_name_common_counts);
+    
+    index->touched_flags = calloc(index->size + 1,
+                                  sizeof *index->touched_flags);
+    
+    index->touched = malloc((index->size + 1) * sizeof *index->touched);
+    
+    return !index->last_name_qgrams ||
+           !index->first_name_qgrams ||
+           !index->last_name_common_counts ||
+           !index->first_name_common_counts ||
+           !index->touched_flags ||
+           !index->touched;
+}
+
+telephone_book_search_index*
+telephone_book_search_index_alloc(telephone_book_record_list* list,
+                                  telephone_book_search_strategy strategy)
+{
+    telephone_book_search_index* index;
+    int i;
+    
+    if (!list)
+    {
+        return NULL;
+    }
+    
+    index = malloc(sizeof *index);
+    
+    if (!index)
+    {
+        return NULL;
+    }
+    
+    /* Without vector instructions the batch kernel loses to the bit-parallel */
+    /* patterns the scan computes one name at a time: */
+    if (strategy == TELEPHONE_BOOK_SEARCH_BATCH &&
+        telephone_book_distance_batch_get_kernel() ==
+        TELEPHONE_BOOK_DISTANCE_BATCH_SCALAR)
+    {
+        strategy = TELEPHONE_BOOK_SEARCH_SCAN;
+    }
+    
+    index->strategy = strategy;
+    index->last_name_tree = NULL;
+    index->first_name_tree = NULL;
+    index->last_name_qgrams = NULL;
+    index->first_name_qgrams = NULL;
+    index->last_name_common_counts = NULL;
+    index->first_name_common_counts = NULL;
+    index->touched_flags = NULL;
+    index->touched = NULL;
+    index->last_name_symspell = NULL;
+    index->first_name_symspell = NULL;
+    index->symspell_name_ids = NULL;
+    index->symspell_distances = NULL;
+    index->last_name_trie = NULL;
+    index->first_name_trie = NULL;
+    index->last_name_batch = NULL;
+    index->first_name_batch = NULL;
+    index->last_name_batch_distances = NULL;
+    index->first_name_batch_distances = NULL;
+    index->last_name_run_starts = NULL;
+    index->last_name_run_count = 0;
+    
+    index->signatures = NULL;
+    index->last_name_distances = NULL;
+    index->first_name_distances = NULL;
+    index->query_stamp = 0;
+    index->thread_count = 1;
+    index->scan_name_ids = NULL;
+    index->scan_last_name_count = 0;
+    index->scan_name_count = 0;
+    index->store = telephone_book_store_alloc(list);
+    
+    if (!index->store)
+    {
+        telephone_book_search_index_free(index);
+        return NULL;
+    }
+    
+    /* The store counts the nodes, which the list may not after removals: */
+    index->size = index->store->size;
+    
+    /* Allocate at least one element so that an empty list is not an error: */
+    index->signatures = malloc((index->store->name_count + 1) *
+                               sizeof *index->signatures);
+    
+    index->last_name_distances =
+        calloc(index->store->name_count + 1,
+               sizeof *index->last_name_distances);
+    
+    index->first_name_distances =
+        calloc(index->store->name_count + 1,
+               sizeof *index->first_name_distances);
+    
+    if (!index->signatures ||
+        !index->last_name_distances ||
+        !index->first_name_distances)
+    {
+        telephone_book_search_index_free(index);
+        return NULL;
+    }
+    
+    for (i = 0; i < index->store->name_count; ++i)
+    {
+        telephone_book_distance_signature_init(
+                &index->signatures[i],
+                &index->store->folded_names[index->store->name_offsets[i]]);
+    }
+    
+    if (strategy == TELEPHONE_BOOK_SEARCH_QGRAM)
+    {
+        if (build_qgram_indices(index))
+        {
+            telephone_book_search_index_free(index);
+            return NULL;
+        }
+        
+        return index;
+    }
+    
+    if (strategy == TELEPHONE_BOOK_SEARCH_SYMSPELL)
+    {
+        if (build_symspell_dictionaries(index))
+        {
+            telephone_book_search_index_free(index);
+            return NULL;
+        }
+        
+        return index;
+    }
+    
+    if (strategy == TELEPHONE_BOOK_SEARCH_TRIE)
+    {
+        if (build_tries(index))
+        {
+            telephone_book_search_index_free(index);
+            return NULL;
+        }
+        
+        return index;
+    }
+    
+    if (strategy == TELEPHONE_BOOK_SEARCH_BATCH)
+    {
+        if (build_batches(index))
+        {
+            telephone_book_search_index_free(index);
+            return NULL;
+        }
+        
+        return index;
+    }
+    
+    if (strategy != TELEPHONE_BOOK_SEARCH_BK_TREE)
+    {
+        return index;
+    }
+    
+    index->last_name_tree = telephone_book_bk_tree_alloc(index->size);
+    index->first_name_tree = telephone_book_bk_tree_alloc(index->size);
+    
+    if (!index->last_name_tree || !index->first_name_tree)
+    {
+        telephone_book_search_index_free(index);
+        return NULL;
+    }
+    
+    for (i = 0; i < index->size; ++i)
+    {
+        if (telephone_book_bk_tree_insert(index->last_name_tree,
+                                          last_name_at(index, i),
+                                          i) ||
+            telephone_book_bk_tree_insert(index->first_name_tree,
+                                          first_name_at(index, i),
+                                          i))
+        {
+            telephone_book_search_index_free(index);
+            return NULL;
+        }
+    }
+    
+    return index;
+}
+
+void telephone_book_search_index_free(telephone_book_search_index* index)
+{
+    if (!index)
+    {
+        return;
+    }
+    
+    telephone_book_store_free(index->store);
+    free(index->signatures);
+    free(index->last_name_distances);
+    free(index->first_name_distances);
+    free(index->scan_name_ids);
+    telephone_book_bk_tree_free(index->last_name_tree);
+    telephone_book_bk_tree_free(index->first_name_tree);
+    telephone_book_qgram_index_free(index->last_name_qgrams);
+    telephone_book_qgram_index_free(index->first_name_qgrams);
+    free(index->last_name_common_counts);
+    free(index->first_name_common_counts);
+    free(index->touched_flags);
+    free(index->touched);
+    telephone_book_symspell_free(index->last_name_symspell);
+    telephone_book_symspell_free(index->first_name_symspell);
+    free(index->symspell_name_ids);
+    free(index->symspell_distances);
+    telephone_book_trie_free(index->last_name_trie);
+    telephone_book_trie_free(index->first_name_trie);
+    telephone_book_distance_batch_free(index->last_name_batch);
+    telephone_book_distance_batch_free(index->first_name_batch);
+    free(index->last_name_batch_distances);
+    free(index->first_name_batch_distances);
+    free(index->last_name_run_starts);
+    free(index);
+}
+
+/*******************************************************************************
+* Returns a lower bound of the distance from the query name summarized by      *
+* 'signature' to the name 'name_id'. The first call of a query takes the       *
+* signature lower bound; later calls return whatever 'distances' learned since.*
+*******************************************************************************/
+static size_t name_lower_bound(
+                        const telephone_book_search_index* index,
+                        telephone_book_search_name_distance* distances,
+                        const telephone_book_distance_signature* signature,
+                        uint32_t name_id)
+{
+    telephone_book_search_name_distance* known = &distances[name_id];
+    
+    if (known->stamp != index->query_stamp)
+    {
+        known->distance =
+            telephone_book_distance_lower_bound(signature,
+                                                &index->signatures[name_id]);
+        known->stamp = index->query_stamp;
+        known->is_exact = 0;
+    }
+    
+    return known->distance;
+}
+
+/*******************************************************************************
+* Computes the distance from the query name to the name 'name_id', giving up   *
+* as soon as it is known to exceed 'max_distance'. Each name is computed at    *
+* most once per query unless a later call allows a larger 'max_distance' than  *
+* the one that gave up on it.                                                  *
+* ---                                                                          *
+* Returns the exact distance if it is at most 'max_distance', and              *
+* 'max_distance + 1' otherwise.                                                *
+*******************************************************************************/
+static size_t name_distance(const telephone_book_search_index* index,
+                            telephone_book_search_name_distance* distances,
+                            const telephone_book_distance_pattern* pattern,
+                            const telephone_book_distance_signature* signature,
+                            uint32_t name_id,
+                            size_t max_distance)
+{
+    telephone_book_search_name_distance* known = &distances[name_id];
+    size_t distance = name_lower_bound(index, distances, signature, name_id);
+    
+    if (distance > max_distance)
+    {
+        return max_distance + 1;
+    }
+    
+    if (known->is_exact)
+    {
+        return distance;
+    }
+    
+    distance = telephone_book_distance_pattern_compute_bounded(
+                    pattern,
+                    &index->store->folded_names[
+                                    index->store->name_offsets[name_id]],
+                    index->signatures[name_id].length,
+                    max_distance);
+    
+    known->distance = distance;
+    known->is_exact = distance <= max_distance;
+    return distance;
+}
+
+/*******************************************************************************
+* Computes the first name distance of the record at position 'record_index',   *
+* giving up as soon as it is known to exceed 'max_distance'.                   *
+*******************************************************************************/
+static size_t first_name_distance(telephone_book_search_index* index,
+                                  search_query* query,
+                                  int record_index,
+                                  size_t max_distance)
+{
+    return name_distance(index,
+                         query->first_name_distances,
+                         &query->first_name_pattern,
+                         &query->first_name_signature,
+                         index->store->first_name_ids[record_index],
+                         max_distance);
+}
+
+/*******************************************************************************
+* Computes the distance of the record at position 'record_index' and offers it *
+* to the result. The record is rejected by the name lower bounds before any    *
+* dynamic programming, and the first name is not looked at once the last name  *
+* alone rules the record out. Records sharing a name reuse its distance.       *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int offer_record(telephone_book_search_index* index,
+                        search_query* query,
+                        int record_index,
+                        telephone_book_search_result* result)
+{
+    uint32_t last_name_id = index->store->last_name_ids[record_index];
+    uint32_t first_name_id = index->store->first_name_ids[record_index];
+    size_t last_name_distance;
+    size_t first_name_lower_bound;
+    size_t distance;
+    
+    last_name_distance = query->last_name ?
+        name_lower_bound(index,
+                         query->last_name_distances,
+                         &query->last_name_signature,
+                         last_name_id) : 0;
+    
+    first_name_lower_bound = query->first_name ?
+        name_lower_bound(index,
+                         query->first_name_distances,
+                         &query->first_name_signature,
+                         first_name_id) : 0;
+    
+    if (last_name_distance + first_name_lower_bound > result->distance)
+    {
+        return 0;
+    }
+    
+    if (query->last_name)
+    {
+        last_name_distance =
+            name_distance(index,
+                          query->last_name_distances,
+                          &query->last_name_pattern,
+                          &query->last_name_signature,
+                          last_name_id,
+                          result->distance - first_name_lower_bound);
+        
+        if (last_name_distance + first_name_lower_bound > result->distance)
+        {
+            /* No need to look at the first name: */
+            return 0;
+        }
+    }
+    
+    distance = last_name_distance +
+        (query->first_name ?
+            first_name_distance(index,
+                                query,
+                                record_index,
+                                result->distance - last_name_distance) :
+            0);
+    
+    return result_offer(result, record_index, distance);
+}
+
+#ifndef _WIN32
+/*******************************************************************************
+* Runs 'routine' on each of the 'worker_count' workers of 'worker_size' bytes  *
+* at 'workers', every one but the first on a thread of its own. Whatever could *
+* not get a thread runs on the calling thread.                                 *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int run_workers(void* (*routine)(void*),
+                       void* workers,
+                       size_t worker_size,
+                       int worker_count)
+{
+    pthread_t* threads;
+    int* is_started;
+    int i;
+    
+    /* ALLOCATED: threads, is_started */
+    threads = malloc(worker_count * sizeof *threads);
+    is_started = calloc(worker_count, sizeof *is_started);
+    
+    if (!threads || !is_started)
+    {
+        free(threads);
+        free(is_started);
+        return 1;
+    }
+    
+    for (i = 1; i < worker_count; ++i)
+    {
+        is_started[i] = pthread_create(&threads[i],
+                                       NULL,
+                                       routine,
+                                       (char*) workers + i * worker_size) == 0;
+    }
+    
+    for (i = 0; i < worker_count; ++i)
+    {
+        if (!is_started[i])
+        {
+            routine((char*) workers + i * worker_size);
+        }
+    }
+    
+    for (i = 0; i < worker_count; ++i)
+    {
+        if (is_started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    
+    free(threads);
+    free(is_started);
+    return 0;
+}
+
+/*******************************************************************************
+* Computes the exact distances from the query to the names of a name worker    *
+* into the name distance tables of the index, stamped for the current query.   *
+* The entries below 'scan_last_name_count' are last names, the others first    *
+* names.                                                                       *
+*******************************************************************************/
+static void* run_name_worker(void* argument)
+{
+    name_worker* worker = argument;
+    const telephone_book_search_index* index = worker->index;
+    const telephone_book_distance_pattern* pattern;
+    telephone_book_search_name_distance* known;
+    uint32_t name_id;
+    int i;
+    
+    for (i = worker->begin; i < worker->end; ++i)
+    {
+        name_id = index->scan_name_ids[i];
+        
+        if (i < index->scan_last_name_count)
+        {
+            pattern = &worker->query->last_name_pattern;
+            known = &worker->query->last_name_distances[name_id];
+        }
+        else
+        {
+            pattern = &worker->query->first_name_pattern;
+            known = &worker->query->first_name_distances[name_id];
+        }
+        
+        known->distance = telephone_book_distance_pattern_compute(
+                            pattern,
+                            &index->store->folded_names[
+                                        index->store->name_offsets[name_id]],
+                            index->signatures[name_id].length);
+        known->stamp = index->query_stamp;
+        known->is_exact = 1;
+    }
+    
+    return NULL;
+}
+
+/*******************************************************************************
+* Scans the rows of a worker. Every 'BOUND_REFRESH_INTERVAL' rows, the worker  *
+* publishes its cutoff if it beats the shared bound, or adopts the bound       *
+* otherwise, dropping the records it has that are farther than the bound. The  *
+* name distances are all known by then, so the worker only reads them.         *
+*******************************************************************************/
+static void* run_scan_worker(void* argument)
+{
+    scan_worker* worker = argument;
+    size_t bound_distance;
+    int i;
+    
+    for (i = worker->begin; i < worker->end && !worker->failed; ++i)
+    {
+        if ((i - worker->begin) % BOUND_REFRESH_INTERVAL == 0)
+        {
+            pthread_mutex_lock(&worker->bound->mutex);
+            
+            if (worker->result.distance < worker->bound->distance)
+            {
+                worker->bound->distance = worker->result.distance;
+            }
+            
+            bound_distance = worker->bound->distance;
+            pthread_mutex_unlock(&worker->bound->mutex);
+            
+            if (bound_distance < worker->result.distance)
+            {
+                result_lower_cutoff(&worker->result, bound_distance);
+            }
+        }
+        
+        worker->failed = offer_record(worker->index,
+                                      &worker->query,
+                                      i,
+                                      &worker->result);
+    }
+    
+    return NULL;
+}
+
+/*******************************************************************************
+* Scans the records on 'thread_count' threads in two passes. The first splits  *
+* the distinct names of the rows among the threads, which compute their exact  *
+* distances into the shared tables of the index; the second splits the rows    *
+* into contiguous ranges, whose results are merged in row order.               *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int search_scan_threads(telephone_book_search_index* index,
+                               search_query* query,
+                               int thread_count,
+                               telephone_book_search_result* result)
+{
+    scan_bound bound;
+    name_worker* name_workers;
+    scan_worker* workers;
+    size_t distance = INFINITE_DISTANCE;
+    int name_begin = query->last_name ? 0 : index->scan_last_name_count;
+    int name_end = query->first_name ? index->scan_name_count :
+                                       index->scan_last_name_count;
+    int status;
+    int i;
+    int j;
+    
+    /* ALLOCATED: name_workers, workers */
+    name_workers = malloc(thread_count * sizeof *name_workers);
+    workers = malloc(thread_count * sizeof *workers);
+    
+    if (!name_workers || !workers ||
+        pthread_mutex_init(&bound.mutex, NULL))
+    {
+        free(name_workers);
+        free(workers);
+        return 1;
+    }
+    
+    for (i = 0; i < thread_count; ++i)
+    {
+        name_workers[i].index = index;
+        name_workers[i].query = query;
+        name_workers[i].begin = name_begin +
+            (int) ((long long) (name_end - name_begin) * i / thread_count);
+        name_workers[i].end = name_begin +
+            (int) ((long long) (name_end - name_begin) * (i + 1) /
+                   thread_count);
+    }
+    
+    status = run_workers(run_name_worker,
+                         name_workers,
+                         sizeof *name_workers,
+                         thread_count);
+    
+    bound.distance = INFINITE_DISTANCE;
+    
+    for (i = 0; i < thread_count; ++i)
+    {
+        workers[i].index = index;
+        workers[i].query = *query;
+        workers[i].bound = &bound;
+        workers[i].begin = (int) ((long long) index->size * i / thread_count);
+        workers[i].end =
+            (int) ((long long) index->size * (i + 1) / thread_count);
+        workers[i].failed = 0;
+        telephone_book_search_result_init(&workers[i].result);
+        telephone_book_search_result_set_limit(&workers[i].result,
+                                               result->limit);
+    }
+    
+    status = status ||
+             run_workers(run_scan_worker, workers, sizeof *workers,
+                         thread_count);
+    
+    for (i = 0; i < thread_count; ++i)
+    {
+        status |= workers[i].failed;
+        
+        if (workers[i].result.distance < distance)
+        {
+            distance = workers[i].result.distance;
+        }
+    }
+    
+    /* The ranges are in row order, and so are the records of each range: */
+    for (i = 0; i < thread_count && !status; ++i)
+    {
+        if (!result->limit && workers[i].result.distance != distance)
+        {
+            continue;
+        }
+        
+        for (j = 0; j < workers[i].result.size && !status; ++j)
+        {
+            status = result_offer(result,
+                                  workers[i].result.record_indices[j],
+                                  result->limit ?
+                                      workers[i].result.distances[j] :
+                                      distance);
+        }
+    }
+    
+    for (i = 0; i < thread_count; ++i)
+    {
+        telephone_book_search_result_destroy(&workers[i].result);
+    }
+    
+    pthread_mutex_destroy(&bound.mutex);
+    free(name_workers);
+    free(workers);
+    return status;
+}
+#endif
+
+/*******************************************************************************
+* Scans all the records in list order, on several threads if the index allows  *
+* it and the book is large enough to pay for them.                             *
+*******************************************************************************/
+static int search_scan(telephone_book_search_index* index,
+                       search_query* query,
+                       telephone_book_search_result* result)
+{
+    int thread_count = index->thread_count;
+    int i;
+    
+    if (thread_count > index->size / MIN_ROWS_PER_THREAD)
+    {
+        thread_count = index->size / MIN_ROWS_PER_THREAD;
+    }
+
+#ifndef _WIN32
+    if (thread_count > 1)
+    {
+        return search_scan_threads(index, query, thread_count, result);
+    }
+#endif
+    
+    for (i = 0; i < index->size; ++i)
+    {
+        if (offer_record(index, query, i, result))
+        {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Offers the records in run 'run' of the last name, whose distance to the      *
+* query is 'last_name_distance', to the result. 'first_name_distances' holds   *
+* the distances to the distinct first names, or is NULL if the query has no    *
+* first name.                                                                  *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int offer_run(const telephone_book_search_index* index,
+                     int run,
+                     size_t last_name_distance,
+                     const unsigned char* first_name_distances,
+                     telephone_book_search_result* result)
+{
+    size_t distance;
+    int i;
+    
+    for (i = index->last_name_run_starts[run];
+         i < index->last_name_run_starts[run + 1];
+         ++i)
+    {
+        distance = last_name_distance +
+            (first_name_distances ?
+                first_name_distances[index->store->first_name_ids[i]] : 0);
+        
+        if (distance <= result->distance &&
+            result_offer(result, i, distance))
+        {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Computes the distance between the query and every run of a last name and     *
+* every distinct first name at once with the batch kernel, and then sums the   *
+* two distances of each record, skipping the runs whose last name alone is too *
+* far. A query too long for the kernel is answered by a scan.                  *
+*******************************************************************************/
+static int search_batch(telephone_book_search_index* index,
+                        search_query* query,
+                        telephone_book_search_result* result)
+{
+    size_t last_name_distance;
+    int run;
+    
+    if ((query->last_name &&
+         telephone_book_distance_batch_compute(
+                                    index->last_name_batch,
+                                    query->last_name,
+                                    index->last_name_batch_distances)) ||
+        (query->first_name &&
+         telephone_book_distance_batch_compute(
+                                    index->first_name_batch,
+                                    query->first_name,
+                                    index->first_name_batch_distances)))
+    {
+        return search_scan(index, query, result);
+    }
+    
+    for (run = 0; run < index->last_name_run_count; ++run)
+    {
+        last_name_distance = query->last_name ?
+            index->last_name_batch_distances[run] : 0;
+        
+        if (last_name_distance <= result->distance &&
+            offer_run(index,
+                      run,
+                      last_name_distance,
+                      query->first_name ?
+                          index->first_name_batch_distances : NULL,
+                      result))
+        {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Visits a tree node matched by a single name: every record in the node is at  *
+* the node distance.                                                           *
+*******************************************************************************/
+static size_t visit_single_name_node(void* state,
+                                     int first_record,
+                                     const int* next_record,
+                                     size_t distance)
+{
+    tree_search_state* search_state = state;
+    int record_index;
+    
+    for (record_index = first_record;
+         record_index >= 0;
+         record_index = next_record[record_index])
+    {
+        if (result_offer(search_state->result, record_index, distance))
+        {
+            search_state->failed = 1;
+            break;
+        }
+    }
+    
+    return search_state->result->distance;
+}
+
+/*******************************************************************************
+* Visits a last name tree node when both names are queried: the first name     *
+* distance of each record in the node is added to the node distance.           *
+*******************************************************************************/
+static size_t visit_last_name_node(void* state,
+                                   int first_record,
+                                   const int* next_record,
+                                   size_t distance)
+{
+    tree_search_state* search_state = state;
+    telephone_book_search_result* result = search_state->result;
+    size_t total_distance;
+    int record_index;
+    
+    for (record_index = first_record;
+         record_index >= 0 && distance <= result->distance;
+         record_index = next_record[record_index])
+    {
+        total_distance = distance +
+                         first_name_distance(search_state->index,
+                                             search_state->query,
+                                             record_index,
+                                             result->distance - distance);
+        
+        if (result_offer(result, record_index, total_distance))
+        {
+            search_state->failed = 1;
+            break;
+        }
+    }
+    
+    return result->distance;
+}
+
+/*******************************************************************************
+* Runs the nearest-match search over the BK-trees or the tries. The last name  *
+* tree drives the search whenever the last name is queried, since a record can *
+* never be closer than its last name alone.                                    *
+*******************************************************************************/
+static int search_tree(telephone_book_search_index* index,
+                       search_query* query,
+                       telephone_book_search_result* result)
+{
+    tree_search_state state;
+    int status;
+    
+    state.index = index;
+    state.query = query;
+    state.result = result;
+    state.failed = 0;
+    
+    if (index->strategy == TELEPHONE_BOOK_SEARCH_TRIE)
+    {
+        status = telephone_book_trie_search(
+                        query->last_name ? index->last_name_trie :
+                                           index->first_name_trie,
+                        query->last_name ? query->last_name :
+                                           query->first_name,
+                        result->distance,
+                        query->last_name && query->first_name ?
+                            visit_last_name_node :
+                            visit_single_name_node,
+                        &state);
+    }
+    else if (query->last_name)
+    {
+        status = telephone_book_bk_tree_search(
+                        index->last_name_tree,
+                        &query->last_name_pattern,
+                        result->distance,
+                        query->first_name ? visit_last_name_node :
+                                            visit_single_name_node,
+                        &state);
+    }
+    else
+    {
+        status = telephone_book_bk_tree_search(index->first_name_tree,
+                                               &query->first_name_pattern,
+                                               result->distance,
+                                               visit_single_name_node,
+                                               &state);
+    }
+    
+    if (status || state.failed)
+    {
+        return 1;
+    }
+    
+    /* The tree hands out the records out of the list order (a limited */
+    /* result is ranked once the search is over): */
+    if (!result->limit)
+    {
+        result_sort(result);
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Runs the nearest-match search with q-gram count filtering. Only the records  *
+* sharing q-grams with the query become candidates; they are verified in the   *
+* order of their count filter lower bounds until the bound exceeds the best    *
+* distance. The records sharing no q-gram at all are scanned only if the best  *
+* distance does not already rule them out.                                     *
+*******************************************************************************/
+static int search_qgram(telephone_book_search_index* index,
+                        search_query* query,
+                        telephone_book_search_result* result)
+{
+    qgram_candidate* candidates;
+    size_t last_name_gram_count = 0;
+    size_t first_name_gram_count = 0;
+    size_t untouched_lower_bound;
+    int touched_size = 0;
+    int status = 0;
+    int record_index;
+    int i;
+    
+    if (query->last_name &&
+        telephone_book_qgram_index_count_common(
+                                        index->last_name_qgrams,
+                                        query->last_name,
+                                        index->last_name_common_counts,
+                                        index->touched_flags,
+                                        index->touched,
+                                        &touched_size,
+                                        &last_name_gram_count))
+    {
+        status = 1;
+    }
+    
+    if (!status && query->first_name &&
+        telephone_book_qgram_index_count_common(
+                                        index->first_name_qgrams,
+                                        query->first_name,
+                                        index->first_name_common_counts,
+                                        index->touched_flags,
+                                        index->touched,
+                                        &touched_size,
+                                        &first_name_gram_count))
+    {
+        status = 1;
+    }
+    
+    /* ALLOCATED: candidates */
+    candidates = status ? NULL :
+                 malloc((touched_size + 1) * sizeof *candidates);
+    
+    if (!candidates)
+    {
+        status = 1;
+    }
+    
+    if (!status)
+    {
+        for (i = 0; i < touched_size; ++i)
+        {
+            record_index = index->touched[i];
+            candidates[i].record_index = record_index;
+            candidates[i].lower_bound =
+                (query->last_name ?
+                    telephone_book_qgram_lower_bound(
+                        last_name_gram_count,
+                        index->last_name_qgrams->gram_counts[record_index],
+                        index->last_name_common_counts[record_index]) : 0) +
+                (query->first_name ?
+                    telephone_book_qgram_lower_bound(
+                        first_name_gram_count,
+                        index->first_name_qgrams->gram_counts[record_index],
+                        index->first_name_common_counts[record_index]) : 0);
+        }
+        
+        qsort(candidates,
+              touched_size,
+              sizeof *candidates,
+              qgram_candidate_cmp);
+        
+        for (i = 0; i < touched_size && !status; ++i)
+        {
+            if (candidates[i].lower_bound > result->distance)
+            {
+                break;
+            }
+            
+            status = offer_record(index,
+                                  query,
+                                  candidates[i].record_index,
+                                  result);
+        }
+        
+        free(candidates);
+    }
+    
+    /* A record sharing no q-gram with the query is at least this far: */
+    untouched_lower_bound =
+        (query->last_name ?
+            telephone_book_qgram_lower_bound(last_name_gram_count, 0, 0) : 0) +
+        (query->first_name ?
+            telephone_book_qgram_lower_bound(first_name_gram_count, 0, 0) : 0);
+    
+    if (!status && untouched_lower_bound <= result->distance)
+    {
+        for (i = 0; i < index->size && !status; ++i)
+        {
+            if (!index->touched_flags[i])
+            {
+                status = offer_record(index, query, i, result);
+            }
+        }
+    }
+    
+    /* Reset the scratch counters for the next query: */
+    for (i = 0; i < touched_size; ++i)
+    {
+        record_index = index->touched[i];
+        index->last_name_common_counts[record_index] = 0;
+        index->first_name_common_counts[record_index] = 0;
+        index->touched_flags[record_index] = 0;
+    }
+    
+    if (status)
+    {
+        return 1;
+    }
+    
+    if (!result->limit)
+    {
+        result_sort(result);
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Runs the nearest-match search with the deletion dictionaries. The names      *
+* within the dictionary distance of the driving name (the last name whenever   *
+* it is queried) are found by hash probes, and their records are verified. If  *
+* the best distance found is within the dictionary distance, no other record   *
+* can be as close; otherwise the search falls back to the exhaustive scan.     *
+*******************************************************************************/
+static int search_symspell(telephone_book_search_index* index,
+                           search_query* query,
+                           telephone_book_search_result* result)
+{
+    telephone_book_symspell* dictionary;
+    telephone_book_distance_pattern* pattern;
+    size_t distance;
+    int found_count;
+    int record_index;
+    int i;
+    
+    if (query->last_name)
+    {
+        dictionary = index->last_name_symspell;
+        pattern = &query->last_name_pattern;
+    }
+    else
+    {
+        dictionary = index->first_name_symspell;
+        pattern = &query->first_name_pattern;
+    }
+    
+    found_count = telephone_book_symspell_find(dictionary,
+                                               pattern,
+                                               dictionary->max_distance,
+                                               index->symspell_name_ids,
+                                               index->symspell_distances);
+    
+    if (found_count < 0)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i < found_count; ++i)
+    {
+        distance = index->symspell_distances[i];
+        
+        for (record_index =
+                dictionary->names[index->symspell_name_ids[i]].first_record;
+             record_index >= 0 && distance <= result->distance;
+             record_index = dictionary->next_record[record_index])
+        {
+            if (result_offer(result,
+                             record_index,
+                             query->last_name && query->first_name ?
+                                distance +
+                                first_name_distance(
+                                    index,
+                                    query,
+                                    record_index,
+                                    result->distance - distance) :
+                                distance))
+            {
+                return 1;
+            }
+        }
+    }
+    
+    if (result->size == 0 || result->distance > dictionary->max_distance)
+    {
+        /* Keep the best distance as the cutoff, but let the scan collect */
+        /* the records in list order: */
+        result->size = 0;
+        return search_scan(index, query, result);
+    }
+    
+    if (!result->limit)
+    {
+        result_sort(result);
+    }
+    
+    return 0;
+}
+
+int telephone_book_search_index_set_thread_count(
+                                        telephone_book_search_index* index,
+                                        int thread_count)
+{
+    if (!index || thread_count < 1)
+    {
+        return 1;
+    }
+
+#ifdef _WIN32
+    thread_count = 1;
+#endif
+    
+    if (thread_count > 1 && !index->scan_name_ids &&
+        build_scan_name_ids(index))
+    {
+        return 1;
+    }
+    
+    index->thread_count = thread_count;
+    return 0;
+}
+
+int telephone_book_search_find_closest(telephone_book_search_index* index,
+                                       const char* last_name,
+                                       const char* first_name,
+                                       telephone_book_search_result* result)
+{
+    search_query query;
+    int status;
+    int i;
+    
+    if (!index || !result)
+    {
+        return 1;
+    }
+    
+    result->size = 0;
+    result->distance = INFINITE_DISTANCE;
+    
+    /* Retire the name distances of the previous query: */
+    if (++index->query_stamp == 0)
+    {
+        memset(index->last_name_distances,
+               0,
+               (index->store->name_count + 1) *
+               sizeof *index->last_name_distances);
+        
+        memset(index->first_name_distances,
+               0,
+               (index->store->name_count + 1) *
+               sizeof *index->first_name_distances);
+        
+        index->query_stamp = 1;
+    }
+    
+    if (!last_name && !first_name)
+    {
+        /* Every record matches, so a limited result takes the first ones: */
+        for (i = 0;
+             i < index->size && (!result->limit || i < result->limit);
+             ++i)
+        {
+            if (result_offer(result, i, 0))
+            {
+                return 1;
+            }
+        }
+        
+        if (result->limit)
+        {
+            result_sort(result);
+        }
+        
+        return 0;
+    }
+    
+    query.last_name = last_name;
+    query.first_name = first_name;
+    query.last_name_distances = index->last_name_distances;
+    query.first_name_distances = index->first_name_distances;
+    
+    if (last_name)
+    {
+        telephone_book_distance_pattern_init(&query.last_name_pattern,
+                                             last_name);
+        telephone_book_distance_signature_init(&query.last_name_signature,
+                                               last_name);
+    }
+    
+    if (first_name)
+    {
+        telephone_book_distance_pattern_init(&query.first_name_pattern,
+                                             first_name);
+        telephone_book_distance_signature_init(&query.first_name_signature,
+                                               first_name);
+    }
+    
+    switch (index->strategy)
+    {
+        case TELEPHONE_BOOK_SEARCH_BK_TREE:
+        case TELEPHONE_BOOK_SEARCH_TRIE:
+            status = search_tree(index, &query, result);
+            break;
+        
+        case TELEPHONE_BOOK_SEARCH_QGRAM:
+            status = search_qgram(index, &query, result);
+            break;
+        
+        case TELEPHONE_BOOK_SEARCH_SYMSPELL:
+            status = search_symspell(index, &query, result);
+            break;
+        
+        case TELEPHONE_BOOK_SEARCH_BATCH:
+            status = search_batch(index, &query, result);
+            break;
+        
+        default:
+            status = search_scan(index, &query, result);
+            break;
+    }
+    
+    if (!status && result->limit)
+    {
+        result_sort(result);
+    }
+    
+    return status;
+}
+
+/*******************************************************************************
+* Tells whether the batch search answers the query together with others: it    *
+* filters by last name, and its names fit the batch kernel.                    *
+*******************************************************************************/
+static int is_batch_query(const char* last_name, const char* first_name)
+{
+    return last_name &&
+           strlen(last_name) <= TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH &&
+           (!first_name ||
+            strlen(first_name) <= TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH);
+}
+
+/*******************************************************************************
+* Returns a lower bound of the distance between a query of length              *
+* 'query_length' and the words in the 'chunk_size' blocks of the batch that    *
+* start at block 'chunk_begin': how far the length is from theirs.             *
+*******************************************************************************/
+static size_t chunk_length_gap(const telephone_book_distance_batch* batch,
+                               int chunk_begin,
+                               int chunk_size,
+                               size_t query_length)
+{
+    size_t shortest =
+        batch->word_lengths[chunk_begin * TELEPHONE_BOOK_DISTANCE_BATCH_LANES];
+    size_t longest = batch->block_lengths[chunk_begin + chunk_size - 1];
+    
+    return query_length < shortest ? shortest - query_length :
+           query_length > longest ? query_length - longest :
+           0;
+}
+
+/*******************************************************************************
+* Answers up to 'QUERY_BLOCK_SIZE' batch queries together. The distances to    *
+* the first names of all of them are computed in one pass over the first name  *
+* batch. The last name batch is then walked a chunk of 'NAME_BLOCKS_PER_CHUNK' *
+* blocks at a time: while a chunk is in the cache, each query computes its     *
+* distances to the runs in the chunk and offers the records of the runs that   *
+* are close enough. The walk starts at the names as long as the median query   *
+* and moves outwards, so that the queries find their close records early and   *
+* then skip the chunks whose lengths alone are too far.                        *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int search_batch_block(telephone_book_search_index* index,
+                              const char* const* last_names,
+                              const char* const* first_names,
+                              int query_count,
+                              telephone_book_search_result* const* results,
+                              unsigned char* first_name_tables)
+{
+    const telephone_book_distance_batch* batch = index->last_name_batch;
+    unsigned char lane_distances[NAME_BLOCKS_PER_CHUNK *
+                                 TELEPHONE_BOOK_DISTANCE_BATCH_LANES];
+    const char* present_first_names[QUERY_BLOCK_SIZE];
+    const unsigned char* first_name_distances[QUERY_BLOCK_SIZE];
+    size_t last_name_lengths[QUERY_BLOCK_SIZE];
+    size_t length_counts[TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH + 1] = { 0 };
+    size_t table_size = (size_t) index->store->name_count + 1;
+    size_t median_length = 0;
+    int chunk_count = (batch->block_count + NAME_BLOCKS_PER_CHUNK - 1) /
+                      NAME_BLOCKS_PER_CHUNK;
+    int present_count = 0;
+    int first_chunk;
+    int chunk_begin;
+    int chunk_size;
+    int slot_count;
+    int slot;
+    int step;
+    int run;
+    int seen;
+    int q;
+    
+    for (q = 0; q < query_count; ++q)
+    {
+        last_name_lengths[q] = strlen(last_names[q]);
+        ++length_counts[last_name_lengths[q]];
+        first_name_distances[q] = NULL;
+        
+        if (first_names[q])
+        {
+            first_name_distances[q] =
+                &first_name_tables[present_count * table_size];
+            present_first_names[present_count++] = first_names[q];
+        }
+    }
+    
+    if (telephone_book_distance_batch_compute_many(index->first_name_batch,
+                                                   present_first_names,
+                                                   present_count,
+                                                   first_name_tables,
+                                                   table_size))
+    {
+        return 1;
+    }
+    
+    for (seen = length_counts[0]; 2 * seen < query_count;)
+    {
+        seen += length_counts[++median_length];
+    }
+    
+    /* The blocks are sorted by length: */
+    for (first_chunk = 0;
+         first_chunk + 1 < chunk_count &&
+         batch->block_lengths[(first_chunk + 1) * NAME_BLOCKS_PER_CHUNK - 1] <
+         median_length;
+         ++first_chunk)
+    {
+    }
+    
+    /* Visit the chunks first_chunk, first_chunk + 1, first_chunk - 1, ... */
+    for (step = 0; step < 2 * chunk_count; ++step)
+    {
+        chunk_begin = step % 2 == 0 ? first_chunk + step / 2 :
+                                      first_chunk - (step + 1) / 2;
+        
+        if (chunk_begin < 0 || chunk_begin >= chunk_count)
+        {
+            continue;
+        }
+        
+        chunk_begin *= NAME_BLOCKS_PER_CHUNK;
+        chunk_size = batch->block_count - chunk_begin;
+        
+        if (chunk_size > NAME_BLOCKS_PER_CHUNK)
+        {
+            chunk_size = NAME_BLOCKS_PER_CHUNK;
+        }
+        
+        slot_count = chunk_size * TELEPHONE_BOOK_DISTANCE_BATCH_LANES;
+        
+        for (q = 0; q < query_count; ++q)
+        {
+            if (chunk_length_gap(batch,
+                                 chunk_begin,
+                                 chunk_size,
+                                 last_name_lengths[q]) > results[q]->distance)
+            {
+                continue;
+            }
+            
+            if (telephone_book_distance_batch_compute_blocks(batch,
+                                                             last_names[q],
+                                                             chunk_begin,
+                                                             chunk_size,
+                                                             lane_distances))
+            {
+                return 1;
+            }
+            
+            for (slot = 0; slot < slot_count; ++slot)
+            {
+                run = batch->word_indices[
+                        chunk_begin * TELEPHONE_BOOK_DISTANCE_BATCH_LANES +
+                        slot];
+                
+                if (run >= 0 &&
+                    lane_distances[slot] <= results[q]->distance &&
+                    offer_run(index,
+                              run,
+                              lane_distances[slot],
+                              first_name_distances[q],
+                              results[q]))
+                {
+                    return 1;
+                }
+            }
+        }
+    }
+    
+    /* The runs were visited out of row order: */
+    for (q = 0; q < query_count; ++q)
+    {
+        result_sort(results[q]);
+    }
+    
+    return 0;
+}
+
+int telephone_book_search_find_closest_many(
+                                    telephone_book_search_index* index,
+                                    const char* const* last_names,
+                                    const char* const* first_names,
+                                    int query_count,
+                                    telephone_book_search_result* results)
+{
+    const char* block_last_names[QUERY_BLOCK_SIZE];
+    const char* block_first_names[QUERY_BLOCK_SIZE];
+    telephone_book_search_result* block_results[QUERY_BLOCK_SIZE];
+    int length_counts[TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH + 2] = { 0 };
+    unsigned char* tables;
+    int* order;
+    size_t table_size;
+    size_t length;
+    int batch_count = 0;
+    int block_size;
+    int status = 0;
+    int q;
+    int i;
+    
+    if (!index || !last_names || !first_names || query_count < 0 ||
+        (!results && query_count > 0))
+    {
+        return 1;
+    }
+    
+    if (index->strategy != TELEPHONE_BOOK_SEARCH_BATCH)
+    {
+        for (q = 0; q < query_count && !status; ++q)
+        {
+            status = telephone_book_search_find_closest(index,
+                                                        last_names[q],
+                                                        first_names[q],
+                                                        &results[q]);
+        }
+        
+        return status;
+    }
+    
+    table_size = (size_t) index->store->name_count + 1;
+    
+    /* ALLOCATED: tables, order */
+    tables = malloc(QUERY_BLOCK_SIZE * table_size);
+    order = malloc((query_count + 1) * sizeof *order);
+    
+    if (!tables || !order)
+    {
+        free(tables);
+        free(order);
+        return 1;
+    }
+    
+    for (q = 0; q < query_count && !status; ++q)
+    {
+        if (is_batch_query(last_names[q], first_names[q]))
+        {
+            ++length_counts[strlen(last_names[q]) + 1];
+            ++batch_count;
+            continue;
+        }
+        
+        status = telephone_book_search_find_closest(index,
+                                                    last_names[q],
+                                                    first_names[q],
+                                                    &results[q]);
+    }
+    
+    /* Queries of a length share the names worth visiting first, so each */
+    /* block takes queries of as few lengths as possible: */
+    for (length = 1; length <= TELEPHONE_BOOK_DISTANCE_BATCH_MAX_LENGTH + 1;
+         ++length)
+    {
+        length_counts[length] += length_counts[length - 1];
+    }
+    
+    for (q = 0; q < query_count && !status; ++q)
+    {
+        if (is_batch_query(last_names[q], first_names[q]))
+        {
+            order[length_counts[strlen(last_names[q])]++] = q;
+        }
+    }
+    
+    for (i = 0; i < batch_count && !status; i += block_size)
+    {
+        block_size = batch_count - i < QUERY_BLOCK_SIZE ? batch_count - i :
+                                                          QUERY_BLOCK_SIZE;
+        
+        for (q = 0; q < block_size; ++q)
+        {
+            results[order[i + q]].size = 0;
+            results[order[i + q]].distance = INFINITE_DISTANCE;
+            block_last_names[q] = last_names[order[i + q]];
+            block_first_names[q] = first_names[order[i + q]];
+            block_results[q] = &results[order[i + q]];
+        }
+        
+        status = search_batch_block(index,
+                                    block_last_names,
+                                    block_first_names,
+                                    block_size,
+                                    block_results,
+                                    tables);
+    }
+    
+    free(tables);
+    free(order);
+    return status;
+}
@@ -0,0 +1,194 @@
+#ifndef TELEPHONE_BOOK_SEARCH_H
+#define TELEPHONE_BOOK_SEARCH_H
+
+#include "telephone_book.h"
+#include "telephone_book_bk_tree.h"
+#include "telephone_book_distance.h"
+#include "telephone_book_distance_batch.h"
+#include "telephone_book_qgram.h"
+#include "telephone_book_store.h"
+#include "telephone_book_symspell.h"
+#include "telephone_book_trie.h"
+#include <stddef.h>
+
+/*******************************************************************************
+* This enumeration lists the available engines for the nearest-match search.   *
+*******************************************************************************/
+typedef enum {
+    TELEPHONE_BOOK_SEARCH_SCAN,
+    TELEPHONE_BOOK_SEARCH_BK_TREE,
+    TELEPHONE_BOOK_SEARCH_QGRAM,
+    TELEPHONE_BOOK_SEARCH_SYMSPELL,
+    TELEPHONE_BOOK_SEARCH_TRIE,
+    TELEPHONE_BOOK_SEARCH_BATCH
+} telephone_book_search_strategy;
+
+/*******************************************************************************
+* This structure holds what the current query knows about its distance to one  *
+* distinct name: either the exact distance or a lower bound of it. An entry    *
+* whose stamp is not the stamp of the current query is stale.                  *
+*******************************************************************************/
+typedef struct {
+    size_t distance;
+    unsigned int stamp;
+    int is_exact;
+} telephone_book_search_name_distance;
+
+/*******************************************************************************
+* This structure holds the search index over a loaded telephone book record    *
+* list. Records are addressed by their position in the list, which is their    *
+* row in the columnar store the names are read from. The signatures and the    *
+* name distances are kept per distinct name of the store, so that a query      *
+* computes each name distance once however many records share the name. Only   *
+* the structures of the selected strategy are built; the q-gram and deletion   *
+* dictionary strategies also keep scratch space reused by every query. A scan  *
+* may run on 'thread_count' threads, which share the name distances; it then   *
+* lists the distinct last names of the rows and then their distinct first      *
+* names in 'scan_name_ids'. The batch strategy also keeps where each run of    *
+* rows sharing a last name starts, followed by the number of rows, in          *
+* 'last_name_run_starts'.                                                      *
+*******************************************************************************/
+typedef struct {
+    telephone_book_store* store;
+    telephone_book_distance_signature* signatures;
+    telephone_book_search_name_distance* last_name_distances;
+    telephone_book_search_name_distance* first_name_distances;
+    unsigned int query_stamp;
+    int size;
+    int thread_count;
+    uint32_t* scan_name_ids;
+    int scan_last_name_count;
+    int scan_name_count;
+    telephone_book_search_strategy strategy;
+    telephone_book_bk_tree* last_name_tree;
+    telephone_book_bk_tree* first_name_tree;
+    telephone_book_qgram_index* last_name_qgrams;
+    telephone_book_qgram_index* first_name_qgrams;
+    unsigned short* last_name_common_counts;
+    unsigned short* first_name_common_counts;
+    unsigned char* touched_flags;
+    int* touched;
+    telephone_book_symspell* last_name_symspell;
+    telephone_book_symspell* first_name_symspell;
+    int* symspell_name_ids;
+    size_t* symspell_distances;
+    telephone_book_trie* last_name_trie;
+    telephone_book_trie* first_name_trie;
+    telephone_book_distance_batch* last_name_batch;
+    telephone_book_distance_batch* first_name_batch;
+    unsigned char* last_name_batch_distances;
+    unsigned char* first_name_batch_distances;
+    int* last_name_run_starts;
+    int last_name_run_count;
+} telephone_book_search_index;
+
+/*******************************************************************************
+* This structure holds the result of a search. With a zero 'limit', these are  *
+* the positions of all the records at the smallest distance, in ascending      *
+* order, and that distance. With a positive 'limit', these are the positions   *
+* of the 'limit' closest records and their 'distances', ranked by distance and *
+* then by position; while the search runs they form a max-heap, and            *
+* 'distance' is the farthest distance the result still accepts.                *
+*******************************************************************************/
+typedef struct {
+    int* record_indices;
+    size_t* distances;
+    int size;
+    int capacity;
+    int limit;
+    size_t distance;
+} telephone_book_search_result;
+
+
+
+
+/*******************************************************************************
+* Builds the search index over the argument list. The list must not change     *
+* while the index is in use. The batch strategy needs a vector kernel; where   *
+* the processor has none, the index is built for the scan instead.             *
+* ---                                                                          *
+* Returns the new index or NULL if something goes wrong.                       *
+*******************************************************************************/
+telephone_book_search_index*
+telephone_book_search_index_alloc(telephone_book_record_list* list,
+                                  telephone_book_search_strategy strategy);
+
+/*******************************************************************************
+* Parses the name of a search strategy ("scan", "bk-tree", "qgram",            *
+* "symspell", "trie" or "simd").                                               *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the name is unknown.        *
+*******************************************************************************/
+int telephone_book_search_strategy_parse(
+                            const char* name,
+                            telephone_book_search_strategy* strategy);
+
+/*******************************************************************************
+* Lets the scan strategy split its work among 'thread_count' threads. The      *
+* threads first share out the distinct names of the rows, computing each name  *
+* distance once into one table, and then share out the rows, which only read   *
+* it. The result is the same as with one thread, including its order. Where    *
+* threads are not available, the scan stays on the calling thread.             *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_search_index_set_thread_count(
+                                        telephone_book_search_index* index,
+                                        int thread_count);
+
+/*******************************************************************************
+* Finds all the records closest to the query. A NULL 'last_name' or            *
+* 'first_name' matches every record with distance zero.                        *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_search_find_closest(telephone_book_search_index* index,
+                                       const char* last_name,
+                                       const char* first_name,
+                                       telephone_book_search_result* result);
+
+/*******************************************************************************
+* Finds the records closest to each of the 'query_count' queries, query 'q'    *
+* being 'last_names[q]' and 'first_names[q]', into 'results[q]', like          *
+* 'telephone_book_search_find_closest'. The batch strategy answers the queries *
+* in blocks: the name distances of a block of queries are computed in one pass *
+* over the names, and each block of records is summed for every query of the   *
+* block while it is in the cache. The other strategies answer the queries one  *
+* by one.                                                                      *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_search_find_closest_many(
+                                    telephone_book_search_index* index,
+                                    const char* const* last_names,
+                                    const char* const* first_names,
+                                    int query_count,
+                                    telephone_book_search_result* results);
+
+/*******************************************************************************
+* Frees all the memory occupied by the search index.                           *
+*******************************************************************************/
+void telephone_book_search_index_free(telephone_book_search_index* index);
+
+
+
+
+/*******************************************************************************
+* Initializes an empty search result.                                          *
+*******************************************************************************/
+void telephone_book_search_result_init(telephone_book_search_result* result);
+
+/*******************************************************************************
+* Makes the result keep the 'limit' closest records whatever their distances,  *
+* or, if 'limit' is zero, all the records at the smallest distance.            *
+*******************************************************************************/
+void telephone_book_search_result_set_limit(
+                                        telephone_book_search_result* result,
+                                        int limit);
+
+/*******************************************************************************
+* Frees the memory held by the search result.                                  *
+*******************************************************************************/
+void telephone_book_search_result_destroy(telephone_book_search_result* result);
+
+#endif /* TELEPHONE_BOOK_SEARCH_H */
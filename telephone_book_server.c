@@ -0,0 +1,743 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "telephone_book_server.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define CONNECTION_QUEUE_CAPACITY 64
+#define LISTEN_BACKLOG 64
+#define READ_CHUNK_SIZE 4096
+
+/* How often, in milliseconds, the accepting thread checks for a stop: */
+#define STOP_POLL_INTERVAL 200
+
+/* How long, in milliseconds, a client may take to send its request or to */
+/* take in a part of the response: */
+#define REQUEST_TIMEOUT 5000
+
+/* How long, in milliseconds, a client waits for the whole response: */
+#define RESPONSE_TIMEOUT 60000
+
+/* The longest decimal argument count a request may start with: */
+#define MAX_ARGUMENT_COUNT_DIGITS 10
+
+#ifndef _WIN32
+/*******************************************************************************
+* This structure holds the connections accepted but not yet served, and what   *
+* the workers serve them with.                                                 *
+*******************************************************************************/
+typedef struct {
+    telephone_book_server_handler handler;
+    void* context;
+    int connections[CONNECTION_QUEUE_CAPACITY];
+    int head;
+    int size;
+    int is_closing;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+} connection_queue;
+
+/* Set by the signal handler to stop the server: */
+static volatile sig_atomic_t is_stop_requested = 0;
+#endif
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_server.h               *
+*******************************************************************************/
+
+
+#ifndef _WIN32
+static void request_stop(int signal_number)
+{
+    (void) signal_number;
+    is_stop_requested = 1;
+}
+
+/*******************************************************************************
+* Fills 'address' with the address of the socket 'socket_path'.                *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the path is too long.       *
+*******************************************************************************/
+static int make_address(const char* socket_path, struct sockaddr_un* address)
+{
+    if (strlen(socket_path) >= sizeof address->sun_path)
+    {
+        return 1;
+    }
+    
+    memset(address, 0, sizeof *address);
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+/*******************************************************************************
+* Connects to the socket 'socket_path'.                                        *
+* ---                                                                          *
+* Returns the connected descriptor, or -1 if nothing listens on the socket.    *
+*******************************************************************************/
+static int connect_socket(const char* socket_path)
+{
+    struct sockaddr_un address;
+    int fd;
+    
+    if (make_address(socket_path, &address))
+    {
+        return -1;
+    }
+    
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    
+    if (fd < 0)
+    {
+        return -1;
+    }
+    
+    if (connect(fd, (struct sockaddr*) &address, sizeof address))
+    {
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+/*******************************************************************************
+* Sets both the send and the receive timeout of the socket 'fd' to 'timeout'   *
+* milliseconds, so that no single transfer blocks for longer.                  *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int set_socket_timeouts(int fd, int timeout)
+{
+    struct timeval time_value;
+    
+    time_value.tv_sec = timeout / 1000;
+    time_value.tv_usec = (timeout % 1000) * 1000;
+    
+    return setsockopt(fd,
+                      SOL_SOCKET,
+                      SO_SNDTIMEO,
+                      &time_value,
+                      sizeof time_value) ||
+           setsockopt(fd,
+                      SOL_SOCKET,
+                      SO_RCVTIMEO,
+                      &time_value,
+                      sizeof time_value);
+}
+
+/*******************************************************************************
+* Returns the time in milliseconds on a clock that only moves forward.         *
+*******************************************************************************/
+static long long get_milliseconds(void)
+{
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int write_all(int fd, const char* data, size_t size)
+{
+    ssize_t written;
+    
+    while (size > 0)
+    {
+#ifdef MSG_NOSIGNAL
+        /* A peer that hung up must not kill a client with SIGPIPE: */
+        written = send(fd, data, size, MSG_NOSIGNAL);
+#else
+        written = write(fd, data, size);
+#endif
+        
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        
+        if (written <= 0)
+        {
+            return 1;
+        }
+        
+        data += written;
+        size -= (size_t) written;
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Reads 'fd' up to the end of the stream into a new NUL-terminated buffer,     *
+* stored in 'data' along with its size. A 'max_size' of zero means no limit.   *
+* The stream must end within 'timeout' milliseconds. A server being stopped    *
+* also gives up on a stream that stays idle.                                   *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails, the        *
+* stream is longer than 'max_size' or it does not end in time.                 *
+*******************************************************************************/
+static int read_all(int fd,
+                    size_t max_size,
+                    int timeout,
+                    char** data,
+                    size_t* size)
+{
+    struct pollfd reader;
+    char* buffer = NULL;
+    char* new_buffer;
+    size_t capacity = 0;
+    long long deadline = get_milliseconds() + timeout;
+    long long time_left;
+    ssize_t count;
+    int ready_count;
+    
+    reader.fd = fd;
+    reader.events = POLLIN;
+    *size = 0;
+    
+    for (;;)
+    {
+        time_left = deadline - get_milliseconds();
+        
+        /* Once stopping, only data already there is worth reading: */
+        if (is_stop_requested)
+        {
+            time_left = time_left > 0 ? 0 : time_left;
+        }
+        else if (time_left > STOP_POLL_INTERVAL)
+        {
+            time_left = STOP_POLL_INTERVAL;
+        }
+        
+        ready_count = time_left < 0 ? 0 : poll(&reader, 1, (int) time_left);
+        
+        if (ready_count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        
+        if (ready_count == 0 && time_left > 0)
+        {
+            continue;
+        }
+        
+        if (ready_count <= 0)
+        {
+            free(buffer);
+            return 1;
+        }
+        
+        if (capacity - *size < READ_CHUNK_SIZE + 1)
+        {
+            capacity = 2 * capacity + READ_CHUNK_SIZE + 1;
+            new_buffer = realloc(buffer, capacity);
+            
+            if (!new_buffer)
+            {
+                free(buffer);
+                return 1;
+            }
+            
+            buffer = new_buffer;
+        }
+        
+        count = read(fd, &buffer[*size], READ_CHUNK_SIZE);
+        
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        
+        if (count < 0 || (max_size > 0 && *size + count > max_size))
+        {
+            free(buffer);
+            return 1;
+        }
+        
+        if (count == 0)
+        {
+            break;
+        }
+        
+        *size += (size_t) count;
+    }
+    
+    buffer[*size] = '\0';
+    *data = buffer;
+    return 0;
+}
+
+/*******************************************************************************
+* Splits a request into its arguments, which stay in 'request'.                *
+* ---                                                                          *
+* Returns the new argument vector, terminated by NULL, or NULL if the request  *
+* is malformed or the vector cannot be allocated.                              *
+*******************************************************************************/
+static char** parse_request(char* request, size_t size, int* argc)
+{
+    char** argv;
+    char* end;
+    size_t offset;
+    long count;
+    int i;
+    
+    count = strtol(request, &end, 10);
+    
+    /* Each argument takes at least its terminator: */
+    if (*end != '\n' || count < 1 || (size_t) count > size)
+    {
+        return NULL;
+    }
+    
+    argv = malloc((count + 1) * sizeof *argv);
+    
+    if (!argv)
+    {
+        return NULL;
+    }
+    
+    offset = (size_t) (end - request) + 1;
+    
+    for (i = 0; i < count; ++i)
+    {
+        end = offset < size ? memchr(&request[offset], '\0', size - offset) :
+                              NULL;
+        
+        if (!end)
+        {
+            free(argv);
+            return NULL;
+        }
+        
+        argv[i] = &request[offset];
+        offset = (size_t) (end - request) + 1;
+    }
+    
+    argv[count] = NULL;
+    *argc = (int) count;
+    return argv;
+}
+
+/*******************************************************************************
+* Reads the request on the connection 'fd', runs the handler over it and sends *
+* back the response. Closes the connection.                                    *
+*******************************************************************************/
+static void serve_connection(connection_queue* queue, int fd)
+{
+    FILE* out;
+    char* request;
+    char** argv = NULL;
+    size_t size;
+    int argc;
+    int status = EXIT_FAILURE;
+    
+    /* ALLOCATED: request */
+    if (set_socket_timeouts(fd, REQUEST_TIMEOUT) ||
+        read_all(fd,
+                 TELEPHONE_BOOK_SERVER_MAX_REQUEST_SIZE,
+                 REQUEST_TIMEOUT,
+                 &request,
+                 &size))
+    {
+        close(fd);
+        return;
+    }
+    
+    out = fdopen(fd, "w");
+    
+    if (!out)
+    {
+        free(request);
+        close(fd);
+        return;
+    }
+    
+    /* ALLOCATED: request, argv */
+    argv = parse_request(request, size, &argc);
+    
+    if (argv)
+    {
+        status = queue->handler(queue->context, argc, argv, out);
+    }
+    else
+    {
+        fputs(TELEPHONE_BOOK_SERVER_ERROR_PREFIX "Malformed request.\n", out);
+    }
+    
+    fputc('\0', out);
+    fprintf(out, "%d", status);
+    fclose(out);
+    free(argv);
+    free(request);
+}
+
+static void* run_worker(void* argument)
+{
+    connection_queue* queue = argument;
+    int fd;
+    
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->mutex);
+        
+        while (queue->size == 0 && !queue->is_closing)
+        {
+            pthread_cond_wait(&queue->not_empty, &queue->mutex);
+        }
+        
+        /* The queued connections are still served when closing: */
+        if (queue->size == 0)
+        {
+            pthread_mutex_unlock(&queue->mutex);
+            return NULL;
+        }
+        
+        fd = queue->connections[queue->head];
+        queue->head = (queue->head + 1) % CONNECTION_QUEUE_CAPACITY;
+        --queue->size;
+        pthread_mutex_unlock(&queue->mutex);
+        
+        serve_connection(queue, fd);
+    }
+}
+
+/*******************************************************************************
+* Queues the connection 'fd' for the workers.                                  *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if the queue is full.          *
+*******************************************************************************/
+static int push_connection(connection_queue* queue, int fd)
+{
+    pthread_mutex_lock(&queue->mutex);
+    
+    if (queue->size == CONNECTION_QUEUE_CAPACITY)
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        return 1;
+    }
+    
+    queue->connections[(queue->head + queue->size) %
+                       CONNECTION_QUEUE_CAPACITY] = fd;
+    ++queue->size;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+/*******************************************************************************
+* Answers the connection 'fd' that finds the queue full with an error, without *
+* waiting for its request, and closes it. The response is small enough for the *
+* empty send buffer of a new connection, so this never blocks. What already    *
+* came of the request is read and dropped first, since closing a socket with   *
+* unread data resets the connection, and the client would lose the response.   *
+*******************************************************************************/
+static void reject_connection(int fd)
+{
+    static const char response[] =
+        TELEPHONE_BOOK_SERVER_ERROR_PREFIX "The server is busy.\n\0" "1";
+    char request[READ_CHUNK_SIZE];
+    
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    write_all(fd, response, sizeof response - 1);
+    shutdown(fd, SHUT_WR);
+    
+    while (read(fd, request, sizeof request) > 0)
+    {
+        /* Dropped unread. */
+    }
+    
+    close(fd);
+}
+
+static void install_signal_handlers(void)
+{
+    struct sigaction action;
+    
+    memset(&action, 0, sizeof action);
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    
+    /* A client hanging up must not kill the server: */
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+}
+#endif
+
+int telephone_book_server_listen(const char* socket_path)
+{
+#ifdef _WIN32
+    (void) socket_path;
+    return -1;
+#else
+    struct sockaddr_un address;
+    int fd;
+    
+    if (make_address(socket_path, &address))
+    {
+        return -1;
+    }
+    
+    fd = connect_socket(socket_path);
+    
+    if (fd >= 0)
+    {
+        /* Another server answers: */
+        close(fd);
+        return -1;
+    }
+    
+    unlink(socket_path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    
+    if (fd < 0)
+    {
+        return -1;
+    }
+    
+    if (bind(fd, (struct sockaddr*) &address, sizeof address) ||
+        listen(fd, LISTEN_BACKLOG))
+    {
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+#endif
+}
+
+int telephone_book_server_run(int listener_fd,
+                              const char* socket_path,
+                              int worker_count,
+                              telephone_book_server_handler handler,
+                              void* context)
+{
+#ifdef _WIN32
+    (void) listener_fd;
+    (void) socket_path;
+    (void) worker_count;
+    (void) handler;
+    (void) context;
+    return 1;
+#else
+    connection_queue queue;
+    struct pollfd listener;
+    pthread_t* workers;
+    int started_count = 0;
+    int fd;
+    
+    if (listener_fd < 0 || !socket_path || !handler || worker_count < 1)
+    {
+        return 1;
+    }
+    
+    queue.handler = handler;
+    queue.context = context;
+    queue.head = 0;
+    queue.size = 0;
+    queue.is_closing = 0;
+    
+    /* ALLOCATED: workers */
+    workers = malloc(worker_count * sizeof *workers);
+    
+    if (!workers)
+    {
+        close(listener_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    
+    listener.fd = listener_fd;
+    listener.events = POLLIN;
+    pthread_mutex_init(&queue.mutex, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+    is_stop_requested = 0;
+    install_signal_handlers();
+    
+    while (started_count < worker_count &&
+           pthread_create(&workers[started_count],
+                          NULL,
+                          run_worker,
+                          &queue) == 0)
+    {
+        ++started_count;
+    }
+    
+    while (started_count > 0 && !is_stop_requested)
+    {
+        if (poll(&listener, 1, STOP_POLL_INTERVAL) <= 0)
+        {
+            continue;
+        }
+        
+        fd = accept(listener.fd, NULL, NULL);
+        
+        /* The accepting thread never waits for the workers, so that a    */
+        /* few stalled clients cannot keep it from noticing a stop: */
+        if (fd >= 0 && push_connection(&queue, fd))
+        {
+            reject_connection(fd);
+        }
+    }
+    
+    close(listener.fd);
+    unlink(socket_path);
+    
+    pthread_mutex_lock(&queue.mutex);
+    queue.is_closing = 1;
+    pthread_cond_broadcast(&queue.not_empty);
+    pthread_mutex_unlock(&queue.mutex);
+    
+    while (started_count > 0)
+    {
+        pthread_join(workers[--started_count], NULL);
+    }
+    
+    pthread_cond_destroy(&queue.not_empty);
+    pthread_mutex_destroy(&queue.mutex);
+    free(workers);
+    return 0;
+#endif
+}
+
+int telephone_book_server_forward(const char* socket_path,
+                                  int argc,
+                                  char* argv[],
+                                  int* status)
+{
+#ifdef _WIN32
+    (void) socket_path;
+    (void) argc;
+    (void) argv;
+    (void) status;
+    return -1;
+#else
+    char header[MAX_ARGUMENT_COUNT_DIGITS + 2];
+    char* response;
+    char* line;
+    char* line_end;
+    char* text_end;
+    size_t size;
+    size_t prefix_length = strlen(TELEPHONE_BOOK_SERVER_ERROR_PREFIX);
+    int fd;
+    int i;
+    int is_sent;
+    
+    if (!socket_path || argc < 1 || !argv || !status)
+    {
+        return -1;
+    }
+    
+    fd = connect_socket(socket_path);
+    
+    if (fd < 0)
+    {
+        return -1;
+    }
+    
+    if (set_socket_timeouts(fd, RESPONSE_TIMEOUT))
+    {
+        close(fd);
+        return 1;
+    }
+    
+    sprintf(header, "%d\n", argc);
+    is_sent = !write_all(fd, header, strlen(header));
+    
+    for (i = 0; i < argc && is_sent; ++i)
+    {
+        is_sent = !write_all(fd, argv[i], strlen(argv[i]) + 1);
+    }
+    
+    /* A busy server answers without reading the request, so the response */
+    /* is read even if the request did not go through: */
+    if (is_sent && shutdown(fd, SHUT_WR))
+    {
+        close(fd);
+        return 1;
+    }
+    
+    /* ALLOCATED: response */
+    if (read_all(fd, 0, RESPONSE_TIMEOUT, &response, &size))
+    {
+        close(fd);
+        return 1;
+    }
+    
+    close(fd);
+    
+    /* The output ends at the last NUL, which the status follows: */
+    for (text_end = &response[size]; text_end > response && text_end[-1];)
+    {
+        --text_end;
+    }
+    
+    if (text_end == response)
+    {
+        free(response);
+        return 1;
+    }
+    
+    *status = atoi(text_end);
+    --text_end;
+    
+    for (line = response; line < text_end; line = line_end)
+    {
+        line_end = memchr(line, '\n', (size_t) (text_end - line));
+        line_end = line_end ? line_end + 1 : text_end;
+        
+        fwrite(line,
+               1,
+               (size_t) (line_end - line),
+               (size_t) (line_end - line) >= prefix_length &&
+               memcmp(line,
+                      TELEPHONE_BOOK_SERVER_ERROR_PREFIX,
+                      prefix_length) == 0 ? stderr : stdout);
+    }
+    
+    free(response);
+    return 0;
+#endif
+}
+
+int telephone_book_server_is_running(const char* socket_path)
+{
+#ifdef _WIN32
+    (void) socket_path;
+    return 0;
+#else
+    int fd;
+    
+    if (!socket_path)
+    {
+        return 0;
+    }
+    
+    fd = connect_socket(socket_path);
+    
+    if (fd < 0)
+    {
+        return 0;
+    }
+    
+    close(fd);
+    return 1;
+#endif
+}
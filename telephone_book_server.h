@@ -0,0 +1,82 @@
+#ifndef TELEPHONE_BOOK_SERVER_H
+#define TELEPHONE_BOOK_SERVER_H
+
+#include <stdio.h>
+
+/*******************************************************************************
+* The prefix of the response lines a client prints to the standard error.      *
+* Every other line goes to the standard output.                                *
+*******************************************************************************/
+#define TELEPHONE_BOOK_SERVER_ERROR_PREFIX "[ERROR] "
+
+/*******************************************************************************
+* The largest request a server accepts, in bytes.                              *
+*******************************************************************************/
+#define TELEPHONE_BOOK_SERVER_MAX_REQUEST_SIZE (64 * 1024)
+
+/*******************************************************************************
+* This type points to the function that serves a request. A request is the     *
+* argument vector of a command line, 'argv[0]' being the name of the client    *
+* executable. The handler writes what the command would print to 'out', and    *
+* returns the exit status of the command. Handlers run on several threads at   *
+* once.                                                                        *
+*******************************************************************************/
+typedef int (*telephone_book_server_handler)(void* context,
+                                             int argc,
+                                             char* argv[],
+                                             FILE* out);
+
+
+
+
+/*******************************************************************************
+* Binds and listens on the Unix domain socket 'socket_path', replacing a stale *
+* socket file left by a server that is gone. Clients connecting from now on    *
+* wait in the backlog until 'telephone_book_server_run' serves them.           *
+* ---                                                                          *
+* Returns the listening descriptor, or -1 if the socket cannot be set up,      *
+* which includes another server listening on it.                               *
+*******************************************************************************/
+int telephone_book_server_listen(const char* socket_path);
+
+/*******************************************************************************
+* Serves requests on 'listener_fd', which listens on the Unix domain socket    *
+* 'socket_path', until the process gets SIGINT or SIGTERM, and then closes it  *
+* and removes the socket file. Each connection carries one request: the number *
+* of arguments in decimal and a newline, and then each argument terminated by  *
+* a NUL character. The response is the output of the handler, a NUL character  *
+* and the exit status in decimal. 'worker_count' threads serve the accepted    *
+* connections. A client gets a few seconds to send its request and to take in  *
+* each part of the response before its connection is dropped, and a client     *
+* that finds the workers behind by a full queue is told the server is busy,    *
+* so that stalled clients can neither hold the server nor keep it from         *
+* stopping.                                                                    *
+* ---                                                                          *
+* Returns zero once stopped, and a non-zero value if the server cannot start.  *
+*******************************************************************************/
+int telephone_book_server_run(int listener_fd,
+                              const char* socket_path,
+                              int worker_count,
+                              telephone_book_server_handler handler,
+                              void* context);
+
+/*******************************************************************************
+* Sends the command line 'argv' to the server listening on 'socket_path', and  *
+* prints the response like the command would have, storing its exit status in  *
+* 'status'. Gives up on a server that does not answer within a minute.         *
+* ---                                                                          *
+* Returns zero if the server answered, a negative value if no server listens   *
+* on the socket, and a positive value if the exchange failed half-way.         *
+*******************************************************************************/
+int telephone_book_server_forward(const char* socket_path,
+                                  int argc,
+                                  char* argv[],
+                                  int* status);
+
+/*******************************************************************************
+* Returns a non-zero value if a server listens on 'socket_path', and zero      *
+* otherwise.                                                                   *
+*******************************************************************************/
+int telephone_book_server_is_running(const char* socket_path);
+
+#endif /* TELEPHONE_BOOK_SERVER_H */
@@ -0,0 +1,619 @@
+#include "telephone_book_store.h"
+#include "telephone_book_distance.h"
+#include "telephone_book_intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_NAMES_CAPACITY 4096
+
+/* The partitions the multikey quicksort leaves to an insertion sort: */
+#define NAME_INSERTION_SORT_SIZE 16
+
+/* The bits of the sort key each radix sort pass consumes: */
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+/*******************************************************************************
+* This structure holds the sort key of a row: the ranks of its last and first  *
+* names packed into one integer, and its current position.                     *
+*******************************************************************************/
+typedef struct {
+    uint64_t key;
+    int row;
+} row_key;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_store.h                *
+*******************************************************************************/
+
+
+/*******************************************************************************
+* Returns the table mapping each byte to its case-folded counterpart.          *
+*******************************************************************************/
+static const unsigned char* get_fold_table(void)
+{
+    static unsigned char fold_table[256];
+    static int is_initialized = 0;
+    int c;
+    
+    if (!is_initialized)
+    {
+        for (c = 0; c < 256; ++c)
+        {
+            fold_table[c] = telephone_book_distance_fold((char) c);
+        }
+        
+        is_initialized = 1;
+    }
+    
+    return fold_table;
+}
+
+/*******************************************************************************
+* Appends 'name' to the packed names, growing both name buffers as needed.     *
+* ---                                                                          *
+* Returns the offset of the name, or (size_t) -1 if the buffers could not      *
+* grow.                                                                        *
+*******************************************************************************/
+static size_t pack_name(telephone_book_store* store,
+                        size_t* capacity,
+                        const char* name,
+                        size_t length)
+{
+    const unsigned char* fold_table = get_fold_table();
+    char* new_names;
+    size_t offset = store->names_size;
+    size_t i;
+    
+    while (offset + length + 1 > *capacity)
+    {
+        new_names = realloc(store->names, 2 * *capacity);
+        
+        if (!new_names)
+        {
+            return (size_t) -1;
+        }
+        
+        store->names = new_names;
+        new_names = realloc(store->folded_names, 2 * *capacity);
+        
+        if (!new_names)
+        {
+            return (size_t) -1;
+        }
+        
+        store->folded_names = new_names;
+        *capacity *= 2;
+    }
+    
+    memcpy(&store->names[offset], name, length + 1);
+    
+    for (i = 0; i <= length; ++i)
+    {
+        store->folded_names[offset + i] =
+            (char) fold_table[(unsigned char) name[i]];
+    }
+    
+    store->names_size += length + 1;
+    return offset;
+}
+
+static void* alloc_column(int size, size_t element_size)
+{
+    /* Allocate at least one element so that an empty list is not an error: */
+    return malloc((size + 1) * element_size);
+}
+
+/*******************************************************************************
+* Returns the store name ID of the name 'name', packing the name if it is new. *
+* If 'name_map' is given, it maps the list name IDs to the store name IDs and  *
+* 'list_name_id' is the list name ID of the name; otherwise the name is        *
+* interned in 'table', whose name IDs are the store name IDs.                  *
+* ---                                                                          *
+* Returns the name ID, or -1 if something fails.                               *
+*******************************************************************************/
+static int store_name(telephone_book_store* store,
+                      size_t* names_capacity,
+                      int* name_map,
+                      telephone_book_intern_table* table,
+                      const char* name,
+                      int list_name_id)
+{
+    size_t length;
+    size_t offset;
+    int name_id;
+    
+    if (name_map && name_map[list_name_id] >= 0)
+    {
+        return name_map[list_name_id];
+    }
+    
+    length = strlen(name);
+    
+    if (!name_map)
+    {
+        name_id = telephone_book_intern_table_find(table, name, length);
+        
+        if (name_id >= 0)
+        {
+            return name_id;
+        }
+        
+        if (telephone_book_intern_table_add(table, name, length) < 0)
+        {
+            return -1;
+        }
+    }
+    
+    offset = pack_name(store, names_capacity, name, length);
+    
+    /* The offsets are 32 bits wide: */
+    if (offset == (size_t) -1 || offset > UINT32_MAX)
+    {
+        return -1;
+    }
+    
+    name_id = store->name_count++;
+    store->name_offsets[name_id] = (uint32_t) offset;
+    store->name_lengths[name_id] = (uint32_t) length;
+    
+    if (name_map)
+    {
+        name_map[list_name_id] = name_id;
+    }
+    
+    return name_id;
+}
+
+telephone_book_store* telephone_book_store_alloc(
+                                        telephone_book_record_list* list)
+{
+    telephone_book_store* store;
+    telephone_book_record_list_node* current_node;
+    telephone_book_record* record;
+    telephone_book_intern_table* table = NULL;
+    int* name_map = NULL;
+    int has_name_ids;
+    size_t names_capacity;
+    int last_name_id;
+    int first_name_id;
+    int size;
+    int i;
+    
+    if (!list)
+    {
+        return NULL;
+    }
+    
+    /* The list may hold fewer nodes than it claims after removals: */
+    size = 0;
+    has_name_ids = list->names != NULL;
+    
+    for (current_node = list->head;
+         current_node;
+         current_node = current_node->next)
+    {
+        ++size;
+        
+        if (current_node->record->last_name_id < 0 ||
+            current_node->record->first_name_id < 0)
+        {
+            has_name_ids = 0;
+        }
+    }
+    
+    store = calloc(1, sizeof *store);
+    
+    if (!store)
+    {
+        return NULL;
+    }
+    
+    /* The buffers double when the distinct names do not fit. */
+    names_capacity = INITIAL_NAMES_CAPACITY;
+    
+    store->size = size;
+    store->nodes = alloc_column(size, sizeof *store->nodes);
+    store->last_name_ids = alloc_column(size, sizeof *store->last_name_ids);
+    store->first_name_ids = alloc_column(size, sizeof *store->first_name_ids);
+    store->ids = alloc_column(size, sizeof *store->ids);
+    
+    /* Each row brings at most two new names: */
+    store->name_offsets = alloc_column(2 * size, sizeof *store->name_offsets);
+    store->name_lengths = alloc_column(2 * size, sizeof *store->name_lengths);
+    store->names = malloc(names_capacity);
+    store->folded_names = malloc(names_capacity);
+    
+    /* ALLOCATED: store, name_map or table */
+    if (has_name_ids)
+    {
+        name_map = malloc((list->names->size + 1) * sizeof *name_map);
+        
+        for (i = 0; name_map && i < list->names->size; ++i)
+        {
+            name_map[i] = -1;
+        }
+    }
+    else
+    {
+        table = telephone_book_intern_table_alloc();
+    }
+    
+    if (!store->nodes || !store->last_name_ids || !store->first_name_ids ||
+        !store->ids || !store->name_offsets || !store->name_lengths ||
+        !store->names || !store->folded_names || (!name_map && !table))
+    {
+        free(name_map);
+        telephone_book_intern_table_free(table);
+        telephone_book_store_free(store);
+        return NULL;
+    }
+    
+    for (current_node = list->head, i = 0;
+         current_node;
+         current_node = current_node->next, ++i)
+    {
+        record = current_node->record;
+        store->nodes[i] = current_node;
+        store->ids[i] = record->id;
+        
+        last_name_id = store_name(store,
+                                  &names_capacity,
+                                  name_map,
+                                  table,
+                                  record->last_name,
+                                  record->last_name_id);
+        
+        first_name_id = store_name(store,
+                                   &names_capacity,
+                                   name_map,
+                                   table,
+                                   record->first_name,
+                                   record->first_name_id);
+        
+        if (last_name_id < 0 || first_name_id < 0)
+        {
+            free(name_map);
+            telephone_book_intern_table_free(table);
+            telephone_book_store_free(store);
+            return NULL;
+        }
+        
+        store->last_name_ids[i] = (uint32_t) last_name_id;
+        store->first_name_ids[i] = (uint32_t) first_name_id;
+    }
+    
+    free(name_map);
+    telephone_book_intern_table_free(table);
+    return store;
+}
+
+/*******************************************************************************
+* Returns the character at 'depth' of the packed name 'name_id', which is the  *
+* terminating NUL past the end of the name.                                    *
+*******************************************************************************/
+static unsigned char name_char(const telephone_book_store* store,
+                               uint32_t name_id,
+                               size_t depth)
+{
+    return (unsigned char) store->names[store->name_offsets[name_id] + depth];
+}
+
+/*******************************************************************************
+* Compares the packed names 'a' and 'b' from 'depth' on, like 'strcmp'.        *
+*******************************************************************************/
+static int name_cmp(const telephone_book_store* store,
+                    uint32_t a,
+                    uint32_t b,
+                    size_t depth)
+{
+    return strcmp(&store->names[store->name_offsets[a] + depth],
+                  &store->names[store->name_offsets[b] + depth]);
+}
+
+static void swap_name_ids(uint32_t* name_ids, int i, int j)
+{
+    uint32_t name_id = name_ids[i];
+    
+    name_ids[i] = name_ids[j];
+    name_ids[j] = name_id;
+}
+
+/*******************************************************************************
+* Sorts the 'size' name IDs in 'name_ids' by their names, whose first 'depth'  *
+* characters are known to be equal, with the multikey quicksort of Bentley and *
+* Sedgewick: each partition step compares one character, so the common         *
+* prefixes of the names are never compared twice.                              *
+*******************************************************************************/
+static void sort_names(const telephone_book_store* store,
+                       uint32_t* name_ids,
+                       int size,
+                       size_t depth)
+{
+    unsigned char pivot;
+    unsigned char c;
+    int less;
+    int greater;
+    int i;
+    int j;
+    
+    while (size > NAME_INSERTION_SORT_SIZE)
+    {
+        swap_name_ids(name_ids, 0, size / 2);
+        pivot = name_char(store, name_ids[0], depth);
+        
+        /* Split into [0, less) < pivot, [less, greater] == pivot, and */
+        /* (greater, size) > pivot: */
+        less = 0;
+        greater = size - 1;
+        
+        for (i = 0; i <= greater;)
+        {
+            c = name_char(store, name_ids[i], depth);
+            
+            if (c < pivot)
+            {
+                swap_name_ids(name_ids, less++, i++);
+            }
+            else if (c > pivot)
+            {
+                swap_name_ids(name_ids, i, greater--);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+        
+        sort_names(store, name_ids, less, depth);
+        sort_names(store, name_ids + greater + 1, size - greater - 1, depth);
+        
+        /* The names sharing the pivot go on with the next character, unless */
+        /* they all end here (and are then one name): */
+        if (pivot == '\0')
+        {
+            return;
+        }
+        
+        name_ids += less;
+        size = greater - less + 1;
+        ++depth;
+    }
+    
+    for (i = 1; i < size; ++i)
+    {
+        for (j = i;
+             j > 0 && name_cmp(store, name_ids[j - 1], name_ids[j], depth) > 0;
+             --j)
+        {
+            swap_name_ids(name_ids, j - 1, j);
+        }
+    }
+}
+
+/*******************************************************************************
+* Sorts the 'size' row keys in 'keys' by their 'key' fields with a least       *
+* significant digit radix sort over the low 'key_bits' bits, which keeps rows  *
+* with equal keys in their order. 'buffer' has room for 'size' keys.           *
+* ---                                                                          *
+* Returns the array holding the sorted keys: 'keys' or 'buffer'.               *
+*******************************************************************************/
+static row_key* radix_sort_keys(row_key* keys,
+                                row_key* buffer,
+                                int size,
+                                int key_bits)
+{
+    size_t counts[RADIX_SIZE];
+    size_t position;
+    size_t count;
+    row_key* swap;
+    int shift;
+    int digit;
+    int i;
+    
+    for (shift = 0; shift < key_bits; shift += RADIX_BITS)
+    {
+        memset(counts, 0, sizeof counts);
+        
+        for (i = 0; i < size; ++i)
+        {
+            ++counts[(keys[i].key >> shift) & (RADIX_SIZE - 1)];
+        }
+        
+        position = 0;
+        
+        for (digit = 0; digit < RADIX_SIZE; ++digit)
+        {
+            count = counts[digit];
+            counts[digit] = position;
+            position += count;
+        }
+        
+        for (i = 0; i < size; ++i)
+        {
+            buffer[counts[(keys[i].key >> shift) & (RADIX_SIZE - 1)]++] =
+                keys[i];
+        }
+        
+        swap = keys;
+        keys = buffer;
+        buffer = swap;
+    }
+    
+    return keys;
+}
+
+/*******************************************************************************
+* Reorders the column 'column' of 'size' elements of 'element_size' bytes so   *
+* that row 'i' takes the old row 'keys[i].row'.                                *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int permute_column(void* column,
+                          size_t element_size,
+                          const row_key* keys,
+                          int size)
+{
+    char* old_column;
+    int i;
+    
+    /* ALLOCATED: old_column */
+    old_column = malloc((size + 1) * element_size);
+    
+    if (!old_column)
+    {
+        return 1;
+    }
+    
+    memcpy(old_column, column, size * element_size);
+    
+    for (i = 0; i < size; ++i)
+    {
+        memcpy((char*) column + i * element_size,
+               old_column + keys[i].row * element_size,
+               element_size);
+    }
+    
+    free(old_column);
+    return 0;
+}
+
+int telephone_book_store_sort(telephone_book_store* store)
+{
+    row_key* keys;
+    row_key* buffer;
+    row_key* sorted_keys;
+    uint32_t* name_ids;
+    uint32_t* name_ranks;
+    int rank_bits;
+    int status;
+    int i;
+    
+    if (!store)
+    {
+        return 1;
+    }
+    
+    /* ALLOCATED: keys, buffer, name_ids, name_ranks */
+    keys = malloc((store->size + 1) * sizeof *keys);
+    buffer = malloc((store->size + 1) * sizeof *buffer);
+    name_ids = malloc((store->name_count + 1) * sizeof *name_ids);
+    name_ranks = malloc((store->name_count + 1) * sizeof *name_ranks);
+    
+    if (!keys || !buffer || !name_ids || !name_ranks)
+    {
+        free(keys);
+        free(buffer);
+        free(name_ids);
+        free(name_ranks);
+        return 1;
+    }
+    
+    /* The names are distinct, so sorting them once ranks every row's names */
+    /* in 'strcmp' order, and the rows can then be sorted by integers: */
+    for (i = 0; i < store->name_count; ++i)
+    {
+        name_ids[i] = (uint32_t) i;
+    }
+    
+    sort_names(store, name_ids, store->name_count, 0);
+    
+    for (i = 0; i < store->name_count; ++i)
+    {
+        name_ranks[name_ids[i]] = (uint32_t) i;
+    }
+    
+    /* Enough bits for every rank: */
+    for (rank_bits = 1;
+         rank_bits < 32 &&
+         ((uint32_t) 1 << rank_bits) < (uint32_t) store->name_count;
+         ++rank_bits)
+    {
+    }
+    
+    for (i = 0; i < store->size; ++i)
+    {
+        keys[i].key = (uint64_t) name_ranks[store->last_name_ids[i]] <<
+                      rank_bits |
+                      name_ranks[store->first_name_ids[i]];
+        keys[i].row = i;
+    }
+    
+    free(name_ids);
+    free(name_ranks);
+    sorted_keys = radix_sort_keys(keys, buffer, store->size, 2 * rank_bits);
+    
+    /* The name bytes stay where they are; only the columns move. */
+    status = permute_column(store->nodes,
+                            sizeof *store->nodes,
+                            sorted_keys,
+                            store->size) ||
+             permute_column(store->last_name_ids,
+                            sizeof *store->last_name_ids,
+                            sorted_keys,
+                            store->size) ||
+             permute_column(store->first_name_ids,
+                            sizeof *store->first_name_ids,
+                            sorted_keys,
+                            store->size) ||
+             permute_column(store->ids,
+                            sizeof *store->ids,
+                            sorted_keys,
+                            store->size);
+    
+    free(keys);
+    free(buffer);
+    return status;
+}
+
+int telephone_book_store_relink(const telephone_book_store* store,
+                                telephone_book_record_list* list)
+{
+    int i;
+    
+    if (!store || !list)
+    {
+        return 1;
+    }
+    
+    if (store->size == 0)
+    {
+        return 0;
+    }
+    
+    list->head = store->nodes[0];
+    list->tail = store->nodes[store->size - 1];
+    list->tail->next = NULL;
+    
+    for (i = 0; i < store->size - 1; ++i)
+    {
+        store->nodes[i]->next = store->nodes[i + 1];
+    }
+    
+    return 0;
+}
+
+telephone_book_record* telephone_book_store_record(
+                                        const telephone_book_store* store,
+                                        int row)
+{
+    return store->nodes[row]->record;
+}
+
+void telephone_book_store_free(telephone_book_store* store)
+{
+    if (!store)
+    {
+        return;
+    }
+    
+    free(store->nodes);
+    free(store->last_name_ids);
+    free(store->first_name_ids);
+    free(store->ids);
+    free(store->name_offsets);
+    free(store->name_lengths);
+    free(store->names);
+    free(store->folded_names);
+    free(store);
+}
@@ -0,0 +1,74 @@
+#ifndef TELEPHONE_BOOK_STORE_H
+#define TELEPHONE_BOOK_STORE_H
+
+#include "telephone_book.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************************************************************************
+* This structure holds a columnar (struct-of-arrays) copy of a record list.    *
+* The names are interned: each distinct name is stored once, and row 'i'       *
+* refers to its last and first names by their name IDs. Name 'j' is at offset  *
+* 'name_offsets[j]' of 'names', NUL-terminated, and its case-folded copy at    *
+* the same offset of 'folded_names'. The 'nodes' column links each row back to *
+* the list it was built from.                                                  *
+*******************************************************************************/
+typedef struct {
+    int size;
+    telephone_book_record_list_node** nodes;
+    uint32_t* last_name_ids;
+    uint32_t* first_name_ids;
+    int* ids;
+    int name_count;
+    uint32_t* name_offsets;
+    uint32_t* name_lengths;
+    char* names;
+    char* folded_names;
+    size_t names_size;
+} telephone_book_store;
+
+
+
+
+/*******************************************************************************
+* Builds the columnar store over the records of the list, in list order. The   *
+* name IDs the list assigned at load time are reused when every record has     *
+* them; otherwise the names are interned here.                                 *
+* ---                                                                          *
+* Returns the new store or NULL if something goes wrong.                       *
+*******************************************************************************/
+telephone_book_store* telephone_book_store_alloc(
+                                        telephone_book_record_list* list);
+
+/*******************************************************************************
+* Sorts the rows of the store by last name and then by first name, like        *
+* 'telephone_book_record_list_sort'. Rows with equal names keep their order.   *
+* The distinct names are sorted once by a multikey quicksort, and the rows are *
+* then radix sorted by the ranks of their names.                               *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_store_sort(telephone_book_store* store);
+
+/*******************************************************************************
+* Relinks the nodes of 'list', which the store was built from, in the row      *
+* order of the store.                                                          *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_store_relink(const telephone_book_store* store,
+                                telephone_book_record_list* list);
+
+/*******************************************************************************
+* Returns the record in row 'row' of the store.                                *
+*******************************************************************************/
+telephone_book_record* telephone_book_store_record(
+                                        const telephone_book_store* store,
+                                        int row);
+
+/*******************************************************************************
+* Frees all the memory occupied by the store. The list is left intact.         *
+*******************************************************************************/
+void telephone_book_store_free(telephone_book_store* store);
+
+#endif /* TELEPHONE_BOOK_STORE_H */
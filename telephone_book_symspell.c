@@ -0,0 +1,546 @@
+#include "telephone_book_symspell.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define INITIAL_DELETION_SLOT_COUNT 1024
+#define INITIAL_POSTING_CAPACITY 1024
+
+/*******************************************************************************
+* The type of the function called for each deletion of a word.                 *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value to abort the generation.       *
+*******************************************************************************/
+typedef int (*deletion_callback)(void* context, uint64_t hash);
+
+/*******************************************************************************
+* This structure holds the state of inserting the deletions of one name.       *
+*******************************************************************************/
+typedef struct {
+    telephone_book_symspell* dictionary;
+    int name_id;
+} insert_context;
+
+/*******************************************************************************
+* This structure holds the state of a lookup.                                  *
+*******************************************************************************/
+typedef struct {
+    telephone_book_symspell* dictionary;
+    const telephone_book_distance_pattern* pattern;
+    size_t max_distance;
+    int* name_ids;
+    size_t* distances;
+    int found_count;
+    int touched_count;
+} find_context;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_symspell.h             *
+*******************************************************************************/
+
+
+static uint64_t hash_bytes(const unsigned char* bytes, size_t length)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    size_t i;
+    
+    for (i = 0; i < length; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    
+    return hash;
+}
+
+static size_t round_up_to_power_of_two(size_t value)
+{
+    size_t result = 1;
+    
+    while (result < value)
+    {
+        result <<= 1;
+    }
+    
+    return result;
+}
+
+static telephone_book_symspell_slot* alloc_slots(size_t slot_count)
+{
+    telephone_book_symspell_slot* slots = malloc(slot_count * sizeof *slots);
+    size_t i;
+    
+    if (!slots)
+    {
+        return NULL;
+    }
+    
+    for (i = 0; i < slot_count; ++i)
+    {
+        slots[i].first_posting = -1;
+    }
+    
+    return slots;
+}
+
+/*******************************************************************************
+* Calls 'callback' for each string obtained by deleting at most 'depth'        *
+* characters at positions not smaller than 'start' from 'word'. The buffers    *
+* hold room for one shortened copy of the word per remaining depth.            *
+*******************************************************************************/
+static int generate_deletions(const unsigned char* word,
+                              size_t length,
+                              size_t start,
+                              size_t depth,
+                              unsigned char* buffers,
+                              deletion_callback callback,
+                              void* context)
+{
+    size_t i;
+    
+    if (callback(context, hash_bytes(word, length)))
+    {
+        return 1;
+    }
+    
+    if (depth == 0)
+    {
+        return 0;
+    }
+    
+    for (i = start; i < length; ++i)
+    {
+        memcpy(buffers, word, i);
+        memcpy(buffers + i, word + i + 1, length - i - 1);
+        
+        if (generate_deletions(buffers,
+                               length - 1,
+                               i,
+                               depth - 1,
+                               buffers + length,
+                               callback,
+                               context))
+        {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Folds 'word' into a new buffer followed by room for the deletion buffers.    *
+* ---                                                                          *
+* Returns the new buffer or NULL if the allocation fails.                      *
+*******************************************************************************/
+static unsigned char* fold_word(const char* word,
+                                size_t length,
+                                size_t max_distance)
+{
+    unsigned char* folded = malloc((length + 1) * (max_distance + 1));
+    size_t i;
+    
+    if (!folded)
+    {
+        return NULL;
+    }
+    
+    for (i = 0; i < length; ++i)
+    {
+        folded[i] = telephone_book_distance_fold(word[i]);
+    }
+    
+    return folded;
+}
+
+/*******************************************************************************
+* Returns the slot for 'hash' in the deletion table: either the slot holding   *
+* it or the empty slot where it belongs.                                       *
+*******************************************************************************/
+static telephone_book_symspell_slot*
+find_deletion_slot(telephone_book_symspell_slot* slots,
+                   size_t mask,
+                   uint64_t hash)
+{
+    size_t i = (size_t) hash & mask;
+    
+    while (slots[i].first_posting >= 0 && slots[i].hash != hash)
+    {
+        i = (i + 1) & mask;
+    }
+    
+    return &slots[i];
+}
+
+/*******************************************************************************
+* Doubles the deletion table.                                                  *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+static int grow_deletion_slots(telephone_book_symspell* dictionary)
+{
+    size_t new_mask = 2 * dictionary->deletion_slot_mask + 1;
+    telephone_book_symspell_slot* new_slots = alloc_slots(new_mask + 1);
+    size_t i;
+    
+    if (!new_slots)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i <= dictionary->deletion_slot_mask; ++i)
+    {
+        if (dictionary->deletion_slots[i].first_posting >= 0)
+        {
+            *find_deletion_slot(new_slots,
+                                new_mask,
+                                dictionary->deletion_slots[i].hash) =
+                dictionary->deletion_slots[i];
+        }
+    }
+    
+    free(dictionary->deletion_slots);
+    dictionary->deletion_slots = new_slots;
+    dictionary->deletion_slot_mask = new_mask;
+    return 0;
+}
+
+static int insert_deletion(void* context, uint64_t hash)
+{
+    insert_context* state = context;
+    telephone_book_symspell* dictionary = state->dictionary;
+    telephone_book_symspell_slot* slot;
+    telephone_book_symspell_posting* new_postings;
+    
+    slot = find_deletion_slot(dictionary->deletion_slots,
+                              dictionary->deletion_slot_mask,
+                              hash);
+    
+    /* The same deletion may come out of different positions: */
+    if (slot->first_posting >= 0 &&
+        dictionary->postings[slot->first_posting].name_id == state->name_id)
+    {
+        return 0;
+    }
+    
+    if (dictionary->posting_count == dictionary->posting_capacity)
+    {
+        new_postings = realloc(dictionary->postings,
+                               2 * dictionary->posting_capacity *
+                               sizeof *dictionary->postings);
+        
+        if (!new_postings)
+        {
+            return 1;
+        }
+        
+        dictionary->postings = new_postings;
+        dictionary->posting_capacity *= 2;
+    }
+    
+    dictionary->postings[dictionary->posting_count].name_id = state->name_id;
+    dictionary->postings[dictionary->posting_count].next = slot->first_posting;
+    
+    if (slot->first_posting < 0)
+    {
+        slot->hash = hash;
+        dictionary->deletion_count++;
+    }
+    
+    slot->first_posting = dictionary->posting_count++;
+    
+    /* Keep the load factor at most one half: */
+    if (2 * dictionary->deletion_count > dictionary->deletion_slot_mask)
+    {
+        return grow_deletion_slots(dictionary);
+    }
+    
+    return 0;
+}
+
+/*******************************************************************************
+* Returns the ID of the name equal (case-insensitively) to the folded 'word',  *
+* or -1 along with the empty slot where such a name belongs.                   *
+*******************************************************************************/
+static int find_name(telephone_book_symspell* dictionary,
+                     const unsigned char* word,
+                     size_t length,
+                     uint64_t hash,
+                     telephone_book_symspell_slot** empty_slot)
+{
+    size_t i = (size_t) hash & dictionary->name_slot_mask;
+    telephone_book_symspell_slot* slot;
+    telephone_book_symspell_name* name;
+    size_t j;
+    
+    for (;; i = (i + 1) & dictionary->name_slot_mask)
+    {
+        slot = &dictionary->name_slots[i];
+        
+        if (slot->first_posting < 0)
+        {
+            *empty_slot = slot;
+            return -1;
+        }
+        
+        if (slot->hash != hash)
+        {
+            continue;
+        }
+        
+        name = &dictionary->names[slot->first_posting];
+        
+        if (name->name_length != length)
+        {
+            continue;
+        }
+        
+        for (j = 0; j < length; ++j)
+        {
+            if (telephone_book_distance_fold(name->name[j]) != word[j])
+            {
+                break;
+            }
+        }
+        
+        if (j == length)
+        {
+            return slot->first_posting;
+        }
+    }
+}
+
+telephone_book_symspell* telephone_book_symspell_alloc(const char* const* names,
+                                                       int size,
+                                                       size_t max_distance)
+{
+    telephone_book_symspell* dictionary;
+    telephone_book_symspell_slot* empty_slot = NULL;
+    telephone_book_symspell_name* name;
+    insert_context context;
+    unsigned char* folded;
+    size_t length;
+    uint64_t hash;
+    int name_id;
+    int i;
+    
+    dictionary = calloc(1, sizeof *dictionary);
+    
+    if (!dictionary)
+    {
+        return NULL;
+    }
+    
+    dictionary->max_distance = max_distance;
+    dictionary->record_count = size;
+    dictionary->name_slot_mask = round_up_to_power_of_two(2 * size + 2) - 1;
+    dictionary->deletion_slot_mask = INITIAL_DELETION_SLOT_COUNT - 1;
+    dictionary->posting_capacity = INITIAL_POSTING_CAPACITY;
+    
+    dictionary->names = malloc((size + 1) * sizeof *dictionary->names);
+    dictionary->next_record = malloc((size + 1) *
+                                     sizeof *dictionary->next_record);
+    dictionary->name_slots = alloc_slots(dictionary->name_slot_mask + 1);
+    dictionary->deletion_slots = alloc_slots(INITIAL_DELETION_SLOT_COUNT);
+    dictionary->postings = malloc(INITIAL_POSTING_CAPACITY *
+                                  sizeof *dictionary->postings);
+    
+    if (!dictionary->names || !dictionary->next_record ||
+        !dictionary->name_slots || !dictionary->deletion_slots ||
+        !dictionary->postings)
+    {
+        telephone_book_symspell_free(dictionary);
+        return NULL;
+    }
+    
+    context.dictionary = dictionary;
+    
+    for (i = 0; i < size; ++i)
+    {
+        length = strlen(names[i]);
+        folded = fold_word(names[i], length, max_distance);
+        
+        if (!folded)
+        {
+            telephone_book_symspell_free(dictionary);
+            return NULL;
+        }
+        
+        hash = hash_bytes(folded, length);
+        name_id = find_name(dictionary, folded, length, hash, &empty_slot);
+        
+        if (name_id < 0)
+        {
+            name_id = dictionary->name_count++;
+            empty_slot->hash = hash;
+            empty_slot->first_posting = name_id;
+            
+            name = &dictionary->names[name_id];
+            name->name = names[i];
+            name->name_length = length;
+            name->first_record = -1;
+            
+            context.name_id = name_id;
+            
+            if (generate_deletions(folded,
+                                   length,
+                                   0,
+                                   max_distance,
+                                   folded + length,
+                                   insert_deletion,
+                                   &context))
+            {
+                free(folded);
+                telephone_book_symspell_free(dictionary);
+                return NULL;
+            }
+        }
+        
+        free(folded);
+        
+        /* Chain the record to its name: */
+        name = &dictionary->names[name_id];
+        dictionary->next_record[i] = -1;
+        
+        if (name->first_record >= 0)
+        {
+            dictionary->next_record[name->last_record] = i;
+        }
+        else
+        {
+            name->first_record = i;
+        }
+        
+        name->last_record = i;
+    }
+    
+    dictionary->seen_names = calloc(dictionary->name_count + 1,
+                                    sizeof *dictionary->seen_names);
+    dictionary->touched_names = malloc((dictionary->name_count + 1) *
+                                       sizeof *dictionary->touched_names);
+    
+    if (!dictionary->seen_names || !dictionary->touched_names)
+    {
+        telephone_book_symspell_free(dictionary);
+        return NULL;
+    }
+    
+    return dictionary;
+}
+
+static int probe_deletion(void* context, uint64_t hash)
+{
+    find_context* state = context;
+    telephone_book_symspell* dictionary = state->dictionary;
+    telephone_book_symspell_slot* slot;
+    telephone_book_symspell_name* name;
+    size_t distance;
+    int posting;
+    int name_id;
+    
+    slot = find_deletion_slot(dictionary->deletion_slots,
+                              dictionary->deletion_slot_mask,
+                              hash);
+    
+    for (posting = slot->first_posting;
+         posting >= 0;
+         posting = dictionary->postings[posting].next)
+    {
+        name_id = dictionary->postings[posting].name_id;
+        
+        if (dictionary->seen_names[name_id])
+        {
+            continue;
+        }
+        
+        dictionary->seen_names[name_id] = 1;
+        dictionary->touched_names[state->touched_count++] = name_id;
+        
+        name = &dictionary->names[name_id];
+        distance = telephone_book_distance_pattern_compute_bounded(
+                                                        state->pattern,
+                                                        name->name,
+                                                        name->name_length,
+                                                        state->max_distance);
+        
+        if (distance <= state->max_distance)
+        {
+            state->name_ids[state->found_count] = name_id;
+            state->distances[state->found_count] = distance;
+            state->found_count++;
+        }
+    }
+    
+    return 0;
+}
+
+int telephone_book_symspell_find(telephone_book_symspell* dictionary,
+                                 const telephone_book_distance_pattern* pattern,
+                                 size_t max_distance,
+                                 int* name_ids,
+                                 size_t* distances)
+{
+    find_context context;
+    unsigned char* folded;
+    int status;
+    int i;
+    
+    if (!dictionary || !pattern)
+    {
+        return -1;
+    }
+    
+    if (max_distance > dictionary->max_distance)
+    {
+        max_distance = dictionary->max_distance;
+    }
+    
+    folded = fold_word(pattern->word, pattern->length, max_distance);
+    
+    if (!folded)
+    {
+        return -1;
+    }
+    
+    context.dictionary = dictionary;
+    context.pattern = pattern;
+    context.max_distance = max_distance;
+    context.name_ids = name_ids;
+    context.distances = distances;
+    context.found_count = 0;
+    context.touched_count = 0;
+    
+    status = generate_deletions(folded,
+                                pattern->length,
+                                0,
+                                max_distance,
+                                folded + pattern->length,
+                                probe_deletion,
+                                &context);
+    free(folded);
+    
+    for (i = 0; i < context.touched_count; ++i)
+    {
+        dictionary->seen_names[dictionary->touched_names[i]] = 0;
+    }
+    
+    return status ? -1 : context.found_count;
+}
+
+void telephone_book_symspell_free(telephone_book_symspell* dictionary)
+{
+    if (!dictionary)
+    {
+        return;
+    }
+    
+    free(dictionary->names);
+    free(dictionary->next_record);
+    free(dictionary->name_slots);
+    free(dictionary->deletion_slots);
+    free(dictionary->postings);
+    free(dictionary->seen_names);
+    free(dictionary->touched_names);
+    free(dictionary);
+}
@@ -0,0 +1,98 @@
+#ifndef TELEPHONE_BOOK_SYMSPELL_H
+#define TELEPHONE_BOOK_SYMSPELL_H
+
+#include "telephone_book_distance.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************************************************************************
+* The default number of deletions precomputed for each name. Most lookups are  *
+* typos at distance one or two.                                                *
+*******************************************************************************/
+#define TELEPHONE_BOOK_SYMSPELL_DEFAULT_MAX_DISTANCE 2
+
+/*******************************************************************************
+* This structure holds one distinct (case-insensitive) name along with the     *
+* chain of the records carrying it.                                            *
+*******************************************************************************/
+typedef struct {
+    const char* name;
+    size_t name_length;
+    int first_record;
+    int last_record;
+} telephone_book_symspell_name;
+
+/*******************************************************************************
+* This structure holds a slot of an open addressing hash table. A slot maps    *
+* the hash of a string to a chain of postings in 'postings'.                   *
+*******************************************************************************/
+typedef struct {
+    uint64_t hash;
+    int first_posting;
+} telephone_book_symspell_slot;
+
+/*******************************************************************************
+* This structure holds a posting: a name ID and the index of the next posting  *
+* with the same deletion hash, or -1.                                          *
+*******************************************************************************/
+typedef struct {
+    int name_id;
+    int next;
+} telephone_book_symspell_posting;
+
+/*******************************************************************************
+* This structure holds a deletion dictionary: every string obtained by         *
+* deleting at most 'max_distance' characters from a distinct name is hashed    *
+* to the IDs of the names producing it. Since only hashes are stored, a        *
+* collision merely adds a candidate that the caller verifies anyway.           *
+*******************************************************************************/
+typedef struct {
+    telephone_book_symspell_name* names;
+    int name_count;
+    int* next_record;
+    int record_count;
+    size_t max_distance;
+    telephone_book_symspell_slot* name_slots;
+    size_t name_slot_mask;
+    telephone_book_symspell_slot* deletion_slots;
+    size_t deletion_slot_mask;
+    size_t deletion_count;
+    telephone_book_symspell_posting* postings;
+    int posting_count;
+    int posting_capacity;
+    unsigned char* seen_names;
+    int* touched_names;
+} telephone_book_symspell;
+
+
+
+
+/*******************************************************************************
+* Builds the deletion dictionary over the 'size' names in 'names'. The name at *
+* position 'i' is recorded as record 'i'. The names are not copied.            *
+* ---                                                                          *
+* Returns the new dictionary or NULL if something goes wrong.                  *
+*******************************************************************************/
+telephone_book_symspell* telephone_book_symspell_alloc(const char* const* names,
+                                                       int size,
+                                                       size_t max_distance);
+
+/*******************************************************************************
+* Finds all the distinct names within 'max_distance' (at most the dictionary   *
+* maximum) from the pattern. Their IDs and distances are stored in 'name_ids'  *
+* and 'distances', which must have room for 'name_count' entries each.         *
+* ---                                                                          *
+* Returns the number of names found, or -1 if something fails.                 *
+*******************************************************************************/
+int telephone_book_symspell_find(telephone_book_symspell* dictionary,
+                                 const telephone_book_distance_pattern* pattern,
+                                 size_t max_distance,
+                                 int* name_ids,
+                                 size_t* distances);
+
+/*******************************************************************************
+* Frees all the memory occupied by the deletion dictionary.                    *
+*******************************************************************************/
+void telephone_book_symspell_free(telephone_book_symspell* dictionary);
+
+#endif /* TELEPHONE_BOOK_SYMSPELL_H */
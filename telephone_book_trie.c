@@ -0,0 +1,331 @@
+#include "telephone_book_trie.h"
+#include "telephone_book_distance.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_NODE_CAPACITY 64
+#define INITIAL_STACK_CAPACITY 64
+
+/*******************************************************************************
+* This structure holds a pending subtree of a search: its root, its depth and  *
+* the row minimum of its parent, which bounds every distance in the subtree.   *
+*******************************************************************************/
+typedef struct {
+    int node_index;
+    size_t depth;
+    size_t lower_bound;
+} search_stack_entry;
+
+/*******************************************************************************
+* Documentation comments may be found in telephone_book_trie.h                 *
+*******************************************************************************/
+
+
+/*******************************************************************************
+* Appends a new childless node with label 'label' to the node array.           *
+* ---                                                                          *
+* Returns the index of the new node, or -1 if the array could not grow.        *
+*******************************************************************************/
+static int append_node(telephone_book_trie* trie, unsigned char label)
+{
+    telephone_book_trie_node* new_nodes;
+    telephone_book_trie_node* node;
+    
+    if (trie->size == trie->capacity)
+    {
+        new_nodes = realloc(trie->nodes,
+                            2 * trie->capacity * sizeof *trie->nodes);
+        
+        if (!new_nodes)
+        {
+            return -1;
+        }
+        
+        trie->nodes = new_nodes;
+        trie->capacity *= 2;
+    }
+    
+    node = &trie->nodes[trie->size];
+    node->label = label;
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->first_record = -1;
+    node->last_record = -1;
+    return trie->size++;
+}
+
+telephone_book_trie* telephone_book_trie_alloc(int record_capacity)
+{
+    telephone_book_trie* trie = malloc(sizeof *trie);
+    
+    if (!trie)
+    {
+        return NULL;
+    }
+    
+    /* ALLOCATED: trie, nodes */
+    trie->nodes = malloc(INITIAL_NODE_CAPACITY * sizeof *trie->nodes);
+    
+    if (!trie->nodes)
+    {
+        free(trie);
+        return NULL;
+    }
+    
+    /* ALLOCATED: trie, nodes, next_record */
+    trie->next_record = malloc((record_capacity + 1) *
+                               sizeof *trie->next_record);
+    
+    if (!trie->next_record)
+    {
+        free(trie->nodes);
+        free(trie);
+        return NULL;
+    }
+    
+    trie->size = 0;
+    trie->capacity = INITIAL_NODE_CAPACITY;
+    trie->record_capacity = record_capacity;
+    trie->max_depth = 0;
+    
+    /* The root stands for the empty name: */
+    append_node(trie, 0);
+    return trie;
+}
+
+int telephone_book_trie_insert(telephone_book_trie* trie,
+                               const char* name,
+                               int record_index)
+{
+    telephone_book_trie_node* node;
+    unsigned char label;
+    size_t depth;
+    int node_index = 0;
+    int child_index;
+    
+    if (!trie || !name || record_index < 0 ||
+        record_index >= trie->record_capacity)
+    {
+        return 1;
+    }
+    
+    for (depth = 0; name[depth]; ++depth)
+    {
+        label = telephone_book_distance_fold(name[depth]);
+        
+        for (child_index = trie->nodes[node_index].first_child;
+             child_index >= 0;
+             child_index = trie->nodes[child_index].next_sibling)
+        {
+            if (trie->nodes[child_index].label == label)
+            {
+                break;
+            }
+        }
+        
+        if (child_index < 0)
+        {
+            child_index = append_node(trie, label);
+            
+            if (child_index < 0)
+            {
+                return 1;
+            }
+            
+            trie->nodes[child_index].next_sibling =
+                trie->nodes[node_index].first_child;
+            
+            trie->nodes[node_index].first_child = child_index;
+        }
+        
+        node_index = child_index;
+    }
+    
+    if (depth > trie->max_depth)
+    {
+        trie->max_depth = depth;
+    }
+    
+    node = &trie->nodes[node_index];
+    trie->next_record[record_index] = -1;
+    
+    if (node->last_record >= 0)
+    {
+        trie->next_record[node->last_record] = record_index;
+    }
+    else
+    {
+        node->first_record = record_index;
+    }
+    
+    node->last_record = record_index;
+    return 0;
+}
+
+int telephone_book_trie_search(const telephone_book_trie* trie,
+                               const char* word,
+                               size_t radius,
+                               telephone_book_trie_visitor visitor,
+                               void* state)
+{
+    search_stack_entry* stack;
+    search_stack_entry* new_stack;
+    size_t stack_size;
+    size_t stack_capacity;
+    size_t* rows;
+    size_t* row;
+    size_t* parent_row;
+    size_t word_length;
+    size_t row_minimum;
+    size_t best;
+    size_t depth;
+    size_t j;
+    const telephone_book_trie_node* node;
+    unsigned char label;
+    int node_index;
+    int child_index;
+    
+    if (!trie || !word || !visitor)
+    {
+        return 1;
+    }
+    
+    word_length = strlen(word);
+    
+    /* ALLOCATED: rows */
+    rows = malloc((trie->max_depth + 1) * (word_length + 1) * sizeof *rows);
+    
+    if (!rows)
+    {
+        return 1;
+    }
+    
+    /* ALLOCATED: rows, stack */
+    stack_capacity = INITIAL_STACK_CAPACITY;
+    stack = malloc(stack_capacity * sizeof *stack);
+    
+    if (!stack)
+    {
+        free(rows);
+        return 1;
+    }
+    
+    /* The row of the root is the distance from each query prefix to the */
+    /* empty name: */
+    for (j = 0; j <= word_length; ++j)
+    {
+        rows[j] = j;
+    }
+    
+    stack[0].node_index = 0;
+    stack[0].depth = 0;
+    stack[0].lower_bound = 0;
+    stack_size = 1;
+    
+    while (stack_size > 0)
+    {
+        --stack_size;
+        
+        /* The radius may have shrunk since the subtree was pushed: */
+        if (stack[stack_size].lower_bound > radius)
+        {
+            continue;
+        }
+        
+        node_index = stack[stack_size].node_index;
+        depth = stack[stack_size].depth;
+        node = &trie->nodes[node_index];
+        row = &rows[depth * (word_length + 1)];
+        row_minimum = row[0];
+        
+        if (depth > 0)
+        {
+            /* Extend the parent row by the label of this node: */
+            parent_row = row - (word_length + 1);
+            label = node->label;
+            row[0] = depth;
+            row_minimum = depth;
+            
+            for (j = 1; j <= word_length; ++j)
+            {
+                best = parent_row[j - 1] +
+                       (label == telephone_book_distance_fold(word[j - 1]) ?
+                        0 : 1);
+                
+                if (parent_row[j] + 1 < best)
+                {
+                    best = parent_row[j] + 1;
+                }
+                
+                if (row[j - 1] + 1 < best)
+                {
+                    best = row[j - 1] + 1;
+                }
+                
+                row[j] = best;
+                
+                if (best < row_minimum)
+                {
+                    row_minimum = best;
+                }
+            }
+        }
+        
+        if (node->first_record >= 0 && row[word_length] <= radius)
+        {
+            radius = visitor(state,
+                             node->first_record,
+                             trie->next_record,
+                             row[word_length]);
+        }
+        
+        /* Every name below extends this prefix, so none of them can be */
+        /* closer than the row minimum: */
+        if (row_minimum > radius)
+        {
+            continue;
+        }
+        
+        for (child_index = node->first_child;
+             child_index >= 0;
+             child_index = trie->nodes[child_index].next_sibling)
+        {
+            if (stack_size == stack_capacity)
+            {
+                new_stack = realloc(stack,
+                                    2 * stack_capacity * sizeof *stack);
+                
+                if (!new_stack)
+                {
+                    free(stack);
+                    free(rows);
+                    return 1;
+                }
+                
+                stack = new_stack;
+                stack_capacity *= 2;
+            }
+            
+            stack[stack_size].node_index = child_index;
+            stack[stack_size].depth = depth + 1;
+            stack[stack_size].lower_bound = row_minimum;
+            ++stack_size;
+        }
+    }
+    
+    free(stack);
+    free(rows);
+    return 0;
+}
+
+void telephone_book_trie_free(telephone_book_trie* trie)
+{
+    if (!trie)
+    {
+        return;
+    }
+    
+    free(trie->nodes);
+    free(trie->next_record);
+    free(trie);
+}
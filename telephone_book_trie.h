@@ -0,0 +1,84 @@
+#ifndef TELEPHONE_BOOK_TRIE_H
+#define TELEPHONE_BOOK_TRIE_H
+
+#include <stddef.h>
+
+/*******************************************************************************
+* This structure holds a single trie node. The node stands for the prefix      *
+* spelled by the case-folded labels on the path from the root, and chains the  *
+* records whose name is exactly that prefix.                                   *
+*******************************************************************************/
+typedef struct {
+    unsigned char label;
+    int first_child;
+    int next_sibling;
+    int first_record;
+    int last_record;
+} telephone_book_trie_node;
+
+/*******************************************************************************
+* This structure holds a trie over case-folded names. The nodes are kept in a  *
+* single array with the root at index zero, and the record chains are          *
+* threaded through 'next_record' like in the BK-tree.                          *
+*******************************************************************************/
+typedef struct {
+    telephone_book_trie_node* nodes;
+    int size;
+    int capacity;
+    int* next_record;
+    int record_capacity;
+    size_t max_depth;
+} telephone_book_trie;
+
+/*******************************************************************************
+* The type of the function called for each name within the search radius. It   *
+* receives the search state, the first record of the name, the record chain    *
+* links and the distance from the query to the name.                           *
+* ---                                                                          *
+* Returns the new (possibly smaller) search radius.                            *
+*******************************************************************************/
+typedef size_t (*telephone_book_trie_visitor)(void* state,
+                                              int first_record,
+                                              const int* next_record,
+                                              size_t distance);
+
+
+
+
+/*******************************************************************************
+* Allocates an empty trie that can hold records with indices from zero to      *
+* 'record_capacity - 1'.                                                       *
+* ---                                                                          *
+* Returns the new trie or NULL if something goes wrong.                        *
+*******************************************************************************/
+telephone_book_trie* telephone_book_trie_alloc(int record_capacity);
+
+/*******************************************************************************
+* Inserts the record with index 'record_index' under the name 'name'. Records  *
+* must be inserted in ascending index order so that each chain stays sorted.   *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_trie_insert(telephone_book_trie* trie,
+                               const char* name,
+                               int record_index);
+
+/*******************************************************************************
+* Calls 'visitor' for each name within 'radius' from 'word'. One row of the    *
+* edit distance matrix is computed per trie edge and shared by every name      *
+* below it; a subtree is skipped once its row minimum exceeds the radius.      *
+* ---                                                                          *
+* Returns zero on success, and a non-zero value if something fails.            *
+*******************************************************************************/
+int telephone_book_trie_search(const telephone_book_trie* trie,
+                               const char* word,
+                               size_t radius,
+                               telephone_book_trie_visitor visitor,
+                               void* state);
+
+/*******************************************************************************
+* Frees all the memory occupied by the trie.                                   *
+*******************************************************************************/
+void telephone_book_trie_free(telephone_book_trie* trie);
+
+#endif /* TELEPHONE_BOOK_TRIE_H */
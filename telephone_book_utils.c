@@ -6,6 +6,10 @@
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 const char* TELEPHONE_RECORD_BOOK_FILE_NAME = ".telephone_book";
+const char* TELEPHONE_RECORD_BOOK_JOURNAL_SUFFIX = ".journal";
+const char* TELEPHONE_RECORD_BOOK_FOLDED_JOURNAL_SUFFIX = ".journal.folded";
+const char* TELEPHONE_RECORD_BOOK_SOCKET_SUFFIX = ".socket";
+const char* TELEPHONE_RECORD_BOOK_LOCK_SUFFIX = ".lock";
 
 static const char* TITLE_LAST_NAME          = "Last name";
 static const char* TITLE_FIRST_NAME         = "First name";
@@ -59,6 +63,62 @@ char* get_telephone_record_book_file_path()
     return telephone_record_book_file_path;
 }
 
+/*******************************************************************************
+* Returns the path to the telephone book record file followed by 'suffix'.     *
+*******************************************************************************/
+static char* get_telephone_record_book_file_path_with_suffix(
+                                                        const char* suffix)
+{
+    char* telephone_record_book_file_path;
+    char* suffixed_file_path;
+    
+    /* ALLOCATED: telephone_record_book_file_path */
+    telephone_record_book_file_path = get_telephone_record_book_file_path();
+    
+    if (!telephone_record_book_file_path)
+    {
+        return NULL;
+    }
+    
+    suffixed_file_path = realloc(telephone_record_book_file_path,
+                                 strlen(telephone_record_book_file_path) +
+                                 strlen(suffix) +
+                                 1);
+    
+    if (!suffixed_file_path)
+    {
+        free(telephone_record_book_file_path);
+        return NULL;
+    }
+    
+    strcat(suffixed_file_path, suffix);
+    return suffixed_file_path;
+}
+
+char* get_telephone_record_book_journal_file_path()
+{
+    return get_telephone_record_book_file_path_with_suffix(
+                                    TELEPHONE_RECORD_BOOK_JOURNAL_SUFFIX);
+}
+
+char* get_telephone_record_book_folded_journal_file_path()
+{
+    return get_telephone_record_book_file_path_with_suffix(
+                                TELEPHONE_RECORD_BOOK_FOLDED_JOURNAL_SUFFIX);
+}
+
+char* get_telephone_record_book_socket_file_path()
+{
+    return get_telephone_record_book_file_path_with_suffix(
+                                    TELEPHONE_RECORD_BOOK_SOCKET_SUFFIX);
+}
+
+char* get_telephone_record_book_lock_file_path()
+{
+    return get_telephone_record_book_file_path_with_suffix(
+                                    TELEPHONE_RECORD_BOOK_LOCK_SUFFIX);
+}
+
 static char* write_separator(char* str, char c, size_t n)
 {
     memset(str, c, n);
@@ -120,7 +180,8 @@ char* load_separator_string(size_t max_last_name_token_length,
 }
 
 output_table_strings*
-output_table_strings_create(telephone_book_record_list* list)
+output_table_strings_create(telephone_book_record* const* records,
+                            size_t record_count)
 {
     size_t max_last_name_token_length        = strlen(TITLE_LAST_NAME);
     size_t max_first_name_token_length       = strlen(TITLE_FIRST_NAME);
@@ -144,10 +205,10 @@ output_table_strings_create(telephone_book_record_list* list)
     char* separator_string;
     char* id_holder_string;
     
-    telephone_book_record_list_node* current_node;
     telephone_book_record* current_record;
+    size_t record_index;
     
-    if (!list)
+    if (!records && record_count > 0)
     {
         return NULL;
     }
@@ -169,11 +230,9 @@ output_table_strings_create(telephone_book_record_list* list)
         return NULL;
     }
     
-    current_node = list->head;
-    
-    while (current_node)
+    for (record_index = 0; record_index < record_count; ++record_index)
     {
-        current_record = current_node->record;
+        current_record = records[record_index];
         
         last_name_token_length  = strlen(current_record->last_name);
         first_name_token_length = strlen(current_record->first_name);
@@ -195,8 +254,6 @@ output_table_strings_create(telephone_book_record_list* list)
         
         max_telephone_contact_id_length = MAX(max_telephone_contact_id_length,
                                               telephone_contact_id_length);
-        
-        current_node = current_node->next;
     }
     
     /* ALLOCATED: output_table */
@@ -29,10 +29,36 @@ typedef struct {
 char* get_telephone_record_book_file_path();
 
 /*******************************************************************************
-* Creates and returns all format strings for printing the record list.         *
+* Returns a C string representing the full path to the journal of pending      *
+* changes to the telephone book record file.                                   *
+*******************************************************************************/
+char* get_telephone_record_book_journal_file_path();
+
+/*******************************************************************************
+* Returns a C string representing the full path the journal is set aside to    *
+* while a compaction writes its changes into the telephone book record file.   *
+*******************************************************************************/
+char* get_telephone_record_book_folded_journal_file_path();
+
+/*******************************************************************************
+* Returns a C string representing the full path to the socket a server of the  *
+* telephone book record file listens on.                                       *
+*******************************************************************************/
+char* get_telephone_record_book_socket_file_path();
+
+/*******************************************************************************
+* Returns a C string representing the full path to the file whose lock a       *
+* process holds while it writes the telephone book record file or its journal. *
+*******************************************************************************/
+char* get_telephone_record_book_lock_file_path();
+
+/*******************************************************************************
+* Creates and returns all format strings for printing the 'record_count'       *
+* records pointed to by 'records'.                                             *
 *******************************************************************************/
 output_table_strings*
-output_table_strings_create(telephone_book_record_list* list);
+output_table_strings_create(telephone_book_record* const* records,
+                            size_t record_count);
 
 /*******************************************************************************
 * Creates and returns a structure containing all format strings necessary for  *
@@ -0,0 +1,352 @@
+#!/bin/sh
+#
+# Runs the command line tests of the telephone book. The program is built
+# from the sources in the parent directory, and each test runs it with a
+# fresh, empty home directory of its own:
+#
+#     sh tests/run_tests.sh
+#
+# Set CC to choose the compiler. The script exits with a non-zero status if
+# any test fails.
+
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+WORK_DIR=$(mktemp -d)
+TB="$WORK_DIR/tb"
+STALLED_CLIENT="$WORK_DIR/stalled_client"
+CC=${CC:-cc}
+PASSED_COUNT=0
+FAILED_COUNT=0
+SERVER_PID=
+
+trap 'stop_server; rm -rf "$WORK_DIR"' EXIT
+
+if ! $CC -std=c99 -O2 -o "$TB" "$SOURCE_DIR"/*.c -lpthread ||
+   ! $CC -std=c99 -O2 -o "$STALLED_CLIENT" \
+       "$SOURCE_DIR"/tests/stalled_client.c; then
+    echo "Cannot build the program." >&2
+    exit 1
+fi
+
+# Reports a failed check of the current test.
+fail()
+{
+    echo "    $1" >&2
+    TEST_FAILED=1
+}
+
+# Checks that the last command exited with the status $1.
+expect_status()
+{
+    [ "$STATUS" -eq "$1" ] || fail "exit status $STATUS, expected $1"
+}
+
+# Checks that the file $1 contains the line $2.
+expect_line()
+{
+    grep -qxF -- "$2" "$1" || fail "no line '$2' in $(basename "$1")"
+}
+
+# Checks that the file $1 does not contain the text $2.
+expect_no_text()
+{
+    ! grep -qF -- "$2" "$1" || fail "unexpected '$2' in $(basename "$1")"
+}
+
+# Checks that the text $2 appears on exactly $3 lines of the file $1.
+expect_count()
+{
+    count=$(grep -cF -- "$2" "$1")
+    [ "$count" -eq "$3" ] || fail "'$2' on $count lines, expected $3"
+}
+
+# Runs the program with the given arguments, keeping its exit status in
+# STATUS and its outputs in $WORK_DIR/out and $WORK_DIR/err.
+run_tb()
+{
+    "$TB" "$@" > "$WORK_DIR/out" 2> "$WORK_DIR/err"
+    STATUS=$?
+}
+
+# Runs the program like run_tb, but kills it if it runs for more than $1
+# seconds.
+run_tb_within()
+{
+    time_limit=$1
+    shift
+    "$TB" "$@" > "$WORK_DIR/out" 2> "$WORK_DIR/err" &
+    tb_pid=$!
+    (sleep "$time_limit"; kill "$tb_pid" 2> /dev/null) &
+    watchdog_pid=$!
+    wait "$tb_pid"
+    STATUS=$?
+    kill "$watchdog_pid" 2> /dev/null
+}
+
+# Starts a server of the book and waits until it listens.
+start_server()
+{
+    "$TB" --serve > "$WORK_DIR/server.log" 2>&1 &
+    SERVER_PID=$!
+
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        [ -S "$HOME/.telephone_book.socket" ] && return 0
+        sleep 0.2
+    done
+
+    fail "the server did not start"
+    return 1
+}
+
+# Stops the server, if one was started.
+stop_server()
+{
+    if [ -n "$SERVER_PID" ]; then
+        kill -TERM "$SERVER_PID" 2> /dev/null
+        wait "$SERVER_PID" 2> /dev/null
+        SERVER_PID=
+    fi
+}
+
+# Runs the test function $1 in a new home directory holding an empty book.
+run_test()
+{
+    HOME="$WORK_DIR/home_$1"
+    export HOME
+    mkdir "$HOME" && : > "$HOME/.telephone_book"
+    TEST_FAILED=0
+    $1
+    stop_server
+
+    if [ "$TEST_FAILED" -eq 0 ]; then
+        PASSED_COUNT=$((PASSED_COUNT + 1))
+    else
+        echo "FAILED: $1" >&2
+        FAILED_COUNT=$((FAILED_COUNT + 1))
+    fi
+}
+
+
+
+
+test_add_rejects_empty_field()
+{
+    run_tb -a "" John 555
+    expect_status 1
+    run_tb -a Smith "" 555
+    expect_status 1
+    run_tb -a Smith John ""
+    expect_status 1
+    expect_no_text "$HOME/.telephone_book.journal" "Smith" 2> /dev/null
+}
+
+test_add_rejects_whitespace()
+{
+    run_tb -a "Mary Ann" Smith 555
+    expect_status 1
+    run_tb -a Smith John "555 1234"
+    expect_status 1
+    run_tb -a Smith "$(printf 'Jo\thn')" 555
+    expect_status 1
+    run_tb
+    expect_no_text "$WORK_DIR/out" "Smith"
+}
+
+test_add_rejects_long_field()
+{
+    long_name=$(printf '%065d' 0)
+    run_tb -a "$long_name" John 555
+    expect_status 1
+    run_tb -a Smith "$long_name" 555
+    expect_status 1
+    run_tb -a Smith John "$long_name"
+    expect_status 1
+    run_tb -a Smith John "$(printf '%064d' 0)"
+    expect_status 0
+    run_tb
+    expect_line "$WORK_DIR/out" \
+        "Smith     | John       | $(printf '%064d' 0) | 1 "
+}
+
+test_served_add_rejects_invalid_fields()
+{
+    start_server || return
+    run_tb -a "Mary Ann" Smith 555
+    expect_status 1
+    run_tb -a "" Smith 555
+    expect_status 1
+    run_tb -a Smith John "$(printf '%065d' 0)"
+    expect_status 1
+    run_tb -a Smith John 555
+    expect_status 0
+    stop_server
+    run_tb
+    expect_line "$WORK_DIR/out" "Smith     | John       | 555              | 1 "
+    expect_no_text "$WORK_DIR/out" "Mary"
+}
+
+test_stalled_clients_do_not_hold_server()
+{
+    start_server || return
+    # As many idle connections as the server has workers:
+    "$STALLED_CLIENT" "$HOME/.telephone_book.socket" 4 30 &
+    stalled_pid=$!
+    sleep 0.5
+    run_tb_within 15 -a Smith John 555
+    expect_status 0
+    expect_line "$WORK_DIR/out" "[INFO] Added the record with ID 1."
+    kill "$stalled_pid"
+}
+
+test_full_server_answers_busy()
+{
+    start_server || return
+    # More idle connections than the workers and the queue take together:
+    "$STALLED_CLIENT" "$HOME/.telephone_book.socket" 80 30 &
+    stalled_pid=$!
+    sleep 0.5
+    run_tb_within 2 Smith
+    expect_status 1
+    expect_line "$WORK_DIR/err" "[ERROR] The server is busy."
+    start_time=$(date +%s)
+    stop_server
+    [ $(($(date +%s) - start_time)) -le 2 ] ||
+        fail "the server took too long to stop"
+    kill "$stalled_pid"
+}
+
+test_concurrent_adds_get_distinct_ids()
+{
+    i=1
+    while [ "$i" -le 40 ]; do
+        "$TB" -a "Name$i" John 555 > /dev/null 2>&1 &
+        i=$((i + 1))
+    done
+    wait
+    run_tb
+    expect_status 0
+    expect_count "$WORK_DIR/out" "| John " 40
+    id_count=$(grep -F "| John " "$WORK_DIR/out" |
+               awk -F '|' '{ print $4 + 0 }' | sort -un | wc -l)
+    [ "$id_count" -eq 40 ] || fail "$id_count distinct IDs, expected 40"
+}
+
+test_journal_append_drops_torn_tail()
+{
+    run_tb -a Smith John 111
+    printf 'A TornA' >> "$HOME/.telephone_book.journal"
+    run_tb -a Guy New 555
+    expect_status 0
+    run_tb
+    expect_status 0
+    expect_line "$WORK_DIR/out" "Guy       | New        | 555              | 2 "
+    expect_no_text "$WORK_DIR/out" "TornA"
+}
+
+test_journal_rejects_extra_tokens()
+{
+    run_tb -a Smith John 111
+    echo "A Doe Jane 222 2 3" >> "$HOME/.telephone_book.journal"
+    run_tb
+    expect_status 1
+}
+
+test_journal_rejects_duplicate_id()
+{
+    run_tb -a Smith John 111
+    echo "A Doe Jane 222 1" >> "$HOME/.telephone_book.journal"
+    run_tb
+    expect_status 1
+    expect_line "$WORK_DIR/err" "[ERROR] Malformed entry or duplicate record ID \
+on line 2 of '$HOME/.telephone_book.journal'."
+}
+
+test_stale_journal_changes_nothing()
+{
+    run_tb -a Smith John 111
+    run_tb -a Doe Jane 222
+    # A crash right after a compaction set the journal aside and wrote the
+    # book:
+    mv "$HOME/.telephone_book.journal" "$HOME/.telephone_book.journal.folded"
+    printf '#next_id 3\nDoe Jane 222 2\nSmith John 111 1\n' \
+        > "$HOME/.telephone_book"
+    run_tb
+    expect_status 0
+    expect_count "$WORK_DIR/out" "Smith" 1
+    expect_count "$WORK_DIR/out" "Doe" 1
+    [ ! -e "$HOME/.telephone_book.journal.folded" ] ||
+        fail "the set aside journal was kept"
+    run_tb -r 1
+    mv "$HOME/.telephone_book.journal" "$HOME/.telephone_book.journal.folded"
+    printf '#next_id 3\nDoe Jane 222 2\n' > "$HOME/.telephone_book"
+    run_tb
+    expect_status 0
+    expect_count "$WORK_DIR/out" "Smith" 0
+    expect_count "$WORK_DIR/out" "Doe" 1
+}
+
+test_set_aside_journal_is_recovered()
+{
+    run_tb -a Smith John 111
+    # A crash right after a compaction set the journal aside, before it
+    # wrote the book:
+    mv "$HOME/.telephone_book.journal" "$HOME/.telephone_book.journal.folded"
+    run_tb -a Doe Jane 222
+    expect_line "$WORK_DIR/out" "[INFO] Added the record with ID 2."
+    run_tb
+    expect_status 0
+    expect_count "$WORK_DIR/out" "Smith" 1
+    expect_count "$WORK_DIR/out" "Doe" 1
+    expect_line "$HOME/.telephone_book" "Smith John 111 1"
+}
+
+test_stale_removal_spares_other_records()
+{
+    # The removed record is gone from the book, and one with the same
+    # fields was added since:
+    printf '#next_id 3\nSmith John 111 2\n' > "$HOME/.telephone_book"
+    echo "R Smith John 111 1" > "$HOME/.telephone_book.journal"
+    run_tb
+    expect_status 0
+    expect_count "$WORK_DIR/out" "Smith" 1
+}
+
+test_legacy_ids_are_written_back()
+{
+    printf 'Smith John 111 1\nDoe Jane 222 1\nBrown Bob 333 0\n' \
+        > "$HOME/.telephone_book"
+    run_tb -a Adams Al 444
+    expect_status 0
+    run_tb
+    cp "$WORK_DIR/out" "$WORK_DIR/first_listing"
+    run_tb
+    cmp -s "$WORK_DIR/first_listing" "$WORK_DIR/out" ||
+        fail "the IDs changed between two listings"
+    expect_line "$HOME/.telephone_book" "Doe Jane 222 2"
+    expect_line "$HOME/.telephone_book" "Brown Bob 333 3"
+    run_tb -r 3
+    expect_status 0
+    run_tb
+    expect_no_text "$WORK_DIR/out" "Brown"
+    expect_count "$WORK_DIR/out" "Doe" 1
+}
+
+
+
+
+run_test test_add_rejects_empty_field
+run_test test_add_rejects_whitespace
+run_test test_add_rejects_long_field
+run_test test_served_add_rejects_invalid_fields
+run_test test_stalled_clients_do_not_hold_server
+run_test test_full_server_answers_busy
+run_test test_concurrent_adds_get_distinct_ids
+run_test test_journal_append_drops_torn_tail
+run_test test_journal_rejects_extra_tokens
+run_test test_journal_rejects_duplicate_id
+run_test test_stale_journal_changes_nothing
+run_test test_set_aside_journal_is_recovered
+run_test test_stale_removal_spares_other_records
+run_test test_legacy_ids_are_written_back
+
+echo "$PASSED_COUNT passed, $FAILED_COUNT failed."
+[ "$FAILED_COUNT" -eq 0 ]
@@ -0,0 +1,51 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*******************************************************************************
+* Opens 'CONNECTION_COUNT' connections to the server socket 'SOCKET_PATH' and  *
+* holds them for 'SECONDS' seconds without sending a request, the way a hung   *
+* or hostile client would. Used by run_tests.sh:                               *
+*                                                                              *
+*     stalled_client SOCKET_PATH CONNECTION_COUNT SECONDS                      *
+*******************************************************************************/
+int main(int argc, char* argv[])
+{
+    struct sockaddr_un address;
+    int connection_count;
+    int i;
+    int fd;
+    
+    if (argc != 4 || strlen(argv[1]) >= sizeof address.sun_path)
+    {
+        fprintf(stderr, "Usage: %s SOCKET_PATH CONNECTION_COUNT SECONDS\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, argv[1]);
+    connection_count = atoi(argv[2]);
+    
+    for (i = 0; i < connection_count; ++i)
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        
+        if (fd < 0 ||
+            connect(fd, (struct sockaddr*) &address, sizeof address))
+        {
+            perror("connect");
+            return EXIT_FAILURE;
+        }
+    }
+    
+    /* The connections stay open until the process exits: */
+    sleep((unsigned) atoi(argv[3]));
+    return EXIT_SUCCESS;
+}